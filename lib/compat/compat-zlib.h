@@ -36,6 +36,18 @@
 #define gzerror		zng_gzerror
 #define gzclose		zng_gzclose
 #define zError		zng_zError
+#define z_stream	zng_stream
+#define compressBound	zng_compressBound
+#define crc32		zng_crc32
+#define crc32_combine	zng_crc32_combine
+#define deflateInit2	zng_deflateInit2
+#define deflateSetDictionary zng_deflateSetDictionary
+#define deflate		zng_deflate
+#define deflateEnd	zng_deflateEnd
+#define inflateInit2	zng_inflateInit2
+#define inflate		zng_inflate
+#define inflateReset	zng_inflateReset
+#define inflateEnd	zng_inflateEnd
 #endif
 
 #endif /* COMPAT_ZLIB_H */
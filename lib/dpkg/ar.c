@@ -139,8 +139,13 @@ dpkg_ar_normalize_name(struct dpkg_ar_hdr *arh)
 		name[i] = '\0';
 }
 
+/**
+ * Get the size of an ar member, without erroring out on invalid values.
+ *
+ * @return The member size, or -1 if it is not a decimal number.
+ */
 off_t
-dpkg_ar_member_parse_size(struct dpkg_ar *ar, struct dpkg_ar_hdr *arh)
+dpkg_ar_member_get_size(const struct dpkg_ar_hdr *arh)
 {
 	const char *str = arh->ar_size;
 	int len = sizeof(arh->ar_size);
@@ -153,9 +158,7 @@ dpkg_ar_member_parse_size(struct dpkg_ar *ar, struct dpkg_ar_hdr *arh)
 		if (*str == ' ')
 			break;
 		if (*str < '0' || *str > '9')
-			ohshit(_("invalid character '%c' in archive '%s' "
-			         "member '%.16s' size"),
-			       *str, ar->name, arh->ar_name);
+			return -1;
 
 		size *= 10;
 		size += *str++ - '0';
@@ -164,6 +167,25 @@ dpkg_ar_member_parse_size(struct dpkg_ar *ar, struct dpkg_ar_hdr *arh)
 	return size;
 }
 
+off_t
+dpkg_ar_member_parse_size(struct dpkg_ar *ar, struct dpkg_ar_hdr *arh)
+{
+	const char *str = arh->ar_size;
+	off_t size;
+
+	size = dpkg_ar_member_get_size(arh);
+	if (size < 0) {
+		while (*str == ' ' || (*str >= '0' && *str <= '9'))
+			str++;
+
+		ohshit(_("invalid character '%c' in archive '%s' "
+		         "member '%.16s' size"),
+		       *str, ar->name, arh->ar_name);
+	}
+
+	return size;
+}
+
 bool
 dpkg_ar_member_is_invalid(struct dpkg_ar_hdr *arh)
 {
@@ -102,6 +102,8 @@ dpkg_ar_normalize_name(struct dpkg_ar_hdr *arh);
 bool
 dpkg_ar_member_is_invalid(struct dpkg_ar_hdr *arh);
 off_t
+dpkg_ar_member_get_size(const struct dpkg_ar_hdr *arh);
+off_t
 dpkg_ar_member_parse_size(struct dpkg_ar *ar, struct dpkg_ar_hdr *arh);
 
 void
@@ -0,0 +1,174 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * arena.c - memory arena support
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <obstack.h>
+
+#include <dpkg/dpkg.h>
+#include <dpkg/arena.h>
+
+/* We use lots of mem, so use a large chunk. */
+#define ARENA_CHUNK_SIZE 8192
+
+struct dpkg_arena {
+	struct obstack obs;
+	/* The first object, to release everything else on reset. */
+	void *base;
+	struct dpkg_arena_stats stats;
+};
+
+static void *
+arena_chunk_alloc(void *arg, size_t size)
+{
+	struct dpkg_arena *arena = arg;
+
+	arena->stats.chunks++;
+	arena->stats.size += size;
+	if (arena->stats.peak < arena->stats.size)
+		arena->stats.peak = arena->stats.size;
+
+	return m_malloc(size);
+}
+
+static void
+arena_chunk_free(void *arg, void *ptr)
+{
+	struct dpkg_arena *arena = arg;
+	struct _obstack_chunk *chunk = ptr;
+
+	arena->stats.chunks--;
+	arena->stats.size -= chunk->limit - (char *)chunk;
+
+	free(chunk);
+}
+
+/**
+ * Create a new memory arena.
+ *
+ * @return The new arena, to be released with dpkg_arena_free().
+ */
+struct dpkg_arena *
+dpkg_arena_new(void)
+{
+	struct dpkg_arena *arena;
+
+	arena = m_malloc(sizeof(*arena));
+	memset(&arena->stats, 0, sizeof(arena->stats));
+
+	obstack_specify_allocation_with_arg(&arena->obs, ARENA_CHUNK_SIZE, 0,
+	                                    arena_chunk_alloc, arena_chunk_free,
+	                                    arena);
+	/* cppcheck-suppress[nullPointerArithmetic]:
+	 * False positive, imported module. */
+	arena->base = obstack_alloc(&arena->obs, 0);
+
+	return arena;
+}
+
+/**
+ * Allocate memory from an arena.
+ *
+ * The memory is suitably aligned for any type, and is only released when
+ * the arena gets reset or freed.
+ */
+void *
+dpkg_arena_alloc(struct dpkg_arena *arena, size_t size)
+{
+	arena->stats.allocs++;
+	arena->stats.used += size;
+
+	/* cppcheck-suppress[nullPointerArithmetic]:
+	 * False positive, imported module. */
+	return obstack_alloc(&arena->obs, size);
+}
+
+/**
+ * Duplicate a string into an arena.
+ */
+char *
+dpkg_arena_strdup(struct dpkg_arena *arena, const char *str)
+{
+	return dpkg_arena_strndup(arena, str, strlen(str));
+}
+
+/**
+ * Duplicate the first len bytes of a string into an arena.
+ *
+ * The string must be at least len bytes long, the copy gets always
+ * NUL-terminated.
+ */
+char *
+dpkg_arena_strndup(struct dpkg_arena *arena, const char *str, size_t len)
+{
+	arena->stats.allocs++;
+	arena->stats.used += len + 1;
+
+	/* cppcheck-suppress[nullPointerArithmetic]:
+	 * False positive, imported module. */
+	return obstack_copy0(&arena->obs, str, len);
+}
+
+/**
+ * Get the usage statistics for an arena.
+ */
+void
+dpkg_arena_get_stats(struct dpkg_arena *arena, struct dpkg_arena_stats *stats)
+{
+	*stats = arena->stats;
+}
+
+/**
+ * Release all the memory allocated from an arena, for reuse.
+ *
+ * The first chunk is kept, so that an arena which gets refilled with a
+ * similar amount of data does not need to allocate it again.
+ */
+void
+dpkg_arena_reset(struct dpkg_arena *arena)
+{
+	/* cppcheck-suppress[nullPointerArithmetic,pointerLessThanZero]:
+	 * False positive, imported module. */
+	obstack_free(&arena->obs, arena->base);
+	/* cppcheck-suppress[nullPointerArithmetic]:
+	 * False positive, imported module. */
+	arena->base = obstack_alloc(&arena->obs, 0);
+
+	arena->stats.allocs = 0;
+	arena->stats.used = 0;
+}
+
+/**
+ * Release an arena and all the memory allocated from it.
+ */
+void
+dpkg_arena_free(struct dpkg_arena *arena)
+{
+	if (arena == NULL)
+		return;
+
+	/* cppcheck-suppress[nullPointerArithmetic,pointerLessThanZero]:
+	 * False positive, imported module. */
+	obstack_free(&arena->obs, NULL);
+	free(arena);
+}
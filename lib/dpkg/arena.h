@@ -0,0 +1,76 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * arena.h - memory arena support
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBDPKG_ARENA_H
+#define LIBDPKG_ARENA_H
+
+#include <stddef.h>
+
+#include <dpkg/macros.h>
+
+DPKG_BEGIN_DECLS
+
+/**
+ * @defgroup arena Memory arenas
+ * @ingroup dpkg-internal
+ * @{
+ *
+ * An arena hands out memory that cannot be freed individually, but only
+ * all at once, either by resetting the arena for reuse or by freeing it.
+ */
+
+struct dpkg_arena;
+
+/**
+ * Arena usage statistics.
+ */
+struct dpkg_arena_stats {
+	/** Number of chunks currently held. */
+	size_t chunks;
+	/** Bytes currently held in chunks. */
+	size_t size;
+	/** Maximum bytes held in chunks over the arena lifetime. */
+	size_t peak;
+	/** Number of allocations since the last reset. */
+	size_t allocs;
+	/** Bytes requested since the last reset. */
+	size_t used;
+};
+
+struct dpkg_arena *
+dpkg_arena_new(void);
+void *
+dpkg_arena_alloc(struct dpkg_arena *arena, size_t size);
+char *
+dpkg_arena_strdup(struct dpkg_arena *arena, const char *str);
+char *
+dpkg_arena_strndup(struct dpkg_arena *arena, const char *str, size_t len);
+void
+dpkg_arena_get_stats(struct dpkg_arena *arena, struct dpkg_arena_stats *stats);
+void
+dpkg_arena_reset(struct dpkg_arena *arena);
+void
+dpkg_arena_free(struct dpkg_arena *arena);
+
+/** @} */
+
+DPKG_END_DECLS
+
+#endif /* LIBDPKG_ARENA_H */
@@ -27,6 +27,14 @@
 
 #include <errno.h>
 #include <md5.h>
+#ifdef HAVE_SHA1_H
+#include <sha1.h>
+#endif
+#if defined(HAVE_SHA2_H)
+#include <sha2.h>
+#elif defined(HAVE_SHA256_H)
+#include <sha256.h>
+#endif
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -36,85 +44,225 @@
 #include <dpkg/varbuf.h>
 #include <dpkg/fdio.h>
 #include <dpkg/buffer.h>
+#include <dpkg/compress.h>
+#include <dpkg/tarfn.h>
+
+struct buffer_digest_ops {
+	int type;
+	int size;
+	void (*init)(void *ctx);
+	void (*update)(void *ctx, const void *buf, size_t len);
+	void (*final)(unsigned char *digest, void *ctx);
+};
+
+static void
+buffer_md5_init(void *ctx)
+{
+	MD5Init(ctx);
+}
+
+static void
+buffer_md5_update(void *ctx, const void *buf, size_t len)
+{
+	MD5Update(ctx, buf, len);
+}
+
+static void
+buffer_md5_final(unsigned char *digest, void *ctx)
+{
+	MD5Final(digest, ctx);
+}
+
+#ifdef HAVE_SHA1_H
+static void
+buffer_sha1_init(void *ctx)
+{
+	SHA1Init(ctx);
+}
+
+static void
+buffer_sha1_update(void *ctx, const void *buf, size_t len)
+{
+	SHA1Update(ctx, buf, len);
+}
+
+static void
+buffer_sha1_final(unsigned char *digest, void *ctx)
+{
+	SHA1Final(digest, ctx);
+}
+#endif
+
+#if defined(HAVE_SHA2_H)
+typedef SHA2_CTX SHA256_CTX;
+#elif defined(HAVE_SHA256_H)
+/* The FreeBSD interface uses different function names. */
+#define SHA256Init SHA256_Init
+#define SHA256Update SHA256_Update
+#define SHA256Final SHA256_Final
+#endif
+
+#ifdef HAVE_SHA256
+static void
+buffer_sha256_init(void *ctx)
+{
+	SHA256Init(ctx);
+}
 
-struct buffer_md5_ctx {
-	MD5_CTX ctx;
+static void
+buffer_sha256_update(void *ctx, const void *buf, size_t len)
+{
+	SHA256Update(ctx, buf, len);
+}
+
+static void
+buffer_sha256_final(unsigned char *digest, void *ctx)
+{
+	SHA256Final(digest, ctx);
+}
+#endif
+
+/* Large enough for any of the supported digests. */
+#define BUFFER_DIGEST_LENGTH_MAX 32
+
+static const struct buffer_digest_ops buffer_digest_ops[] = {
+	{
+		.type = BUFFER_DIGEST_MD5,
+		.size = MD5_DIGEST_LENGTH,
+		.init = buffer_md5_init,
+		.update = buffer_md5_update,
+		.final = buffer_md5_final,
+#ifdef HAVE_SHA1_H
+	}, {
+		.type = BUFFER_DIGEST_SHA1,
+		.size = SHA1_DIGEST_LENGTH,
+		.init = buffer_sha1_init,
+		.update = buffer_sha1_update,
+		.final = buffer_sha1_final,
+#endif
+#ifdef HAVE_SHA256
+	}, {
+		.type = BUFFER_DIGEST_SHA256,
+		.size = SHA256_DIGEST_LENGTH,
+		.init = buffer_sha256_init,
+		.update = buffer_sha256_update,
+		.final = buffer_sha256_final,
+#endif
+	},
+};
+
+struct buffer_digest_ctx {
+	const struct buffer_digest_ops *ops;
 	char *hash;
+	union {
+		MD5_CTX md5;
+#ifdef HAVE_SHA1_H
+		SHA1_CTX sha1;
+#endif
+#ifdef HAVE_SHA256
+		SHA256_CTX sha256;
+#endif
+	} ctx;
 };
 
-static void
-buffer_md5_init(struct buffer_data *data)
+struct buffer_digest_state {
+	int nctx;
+	struct buffer_digest_ctx ctx[];
+};
+
+static const struct buffer_digest_ops *
+buffer_digest_get_ops(int type)
 {
-	struct buffer_md5_ctx *ctx;
+	size_t i;
+
+	for (i = 0; i < countof(buffer_digest_ops); i++)
+		if (buffer_digest_ops[i].type == type)
+			return &buffer_digest_ops[i];
 
-	ctx = m_malloc(sizeof(*ctx));
-	ctx->hash = data->arg.ptr;
-	data->arg.ptr = ctx;
-	MD5Init(&ctx->ctx);
+	internerr("unknown digest type %i", type);
 }
 
 static off_t
 buffer_digest_init(struct buffer_data *data)
 {
+	struct buffer_digest_entry single[2];
+	const struct buffer_digest_entry *list;
+	struct buffer_digest_state *state;
+	int i, n;
+
 	switch (data->type) {
 	case BUFFER_DIGEST_NULL:
+		return 0;
+	case BUFFER_DIGEST_MULTI:
+		list = data->arg.ptr;
 		break;
-	case BUFFER_DIGEST_MD5:
-		buffer_md5_init(data);
+	default:
+		single[0].type = data->type;
+		single[0].hash = data->arg.ptr;
+		single[1].type = BUFFER_DIGEST_NULL;
+		list = single;
 		break;
 	}
 
+	for (n = 0; list[n].type != BUFFER_DIGEST_NULL; n++)
+		;
+
+	state = m_malloc(sizeof(*state) + n * sizeof(state->ctx[0]));
+	state->nctx = n;
+	for (i = 0; i < n; i++) {
+		struct buffer_digest_ctx *ctx = &state->ctx[i];
+
+		ctx->ops = buffer_digest_get_ops(list[i].type);
+		ctx->hash = list[i].hash;
+		ctx->ops->init(&ctx->ctx);
+	}
+	data->arg.ptr = state;
+
 	return 0;
 }
 
 static off_t
 buffer_digest_update(struct buffer_data *digest, const void *buf, off_t length)
 {
+	struct buffer_digest_state *state;
 	off_t ret = length;
+	int i;
 
-	switch (digest->type) {
-	case BUFFER_DIGEST_NULL:
-		break;
-	case BUFFER_DIGEST_MD5:
-		MD5Update(&(((struct buffer_md5_ctx *)digest->arg.ptr)->ctx),
-		          buf, length);
-		break;
-	default:
-		internerr("unknown data type %i", digest->type);
-	}
+	if (digest->type == BUFFER_DIGEST_NULL)
+		return ret;
 
-	return ret;
-}
+	/* Feed each chunk to all digests while it is still in the cache. */
+	state = digest->arg.ptr;
+	for (i = 0; i < state->nctx; i++)
+		state->ctx[i].ops->update(&state->ctx[i].ctx, buf, length);
 
-static void
-buffer_md5_done(struct buffer_data *data)
-{
-	struct buffer_md5_ctx *ctx;
-	unsigned char digest[16], *p = digest;
-	char *hash;
-	int i;
-
-	ctx = (struct buffer_md5_ctx *)data->arg.ptr;
-	hash = ctx->hash;
-	MD5Final(digest, &ctx->ctx);
-	for (i = 0; i < 16; ++i) {
-		snprintf(hash, 3, "%02x", *p++);
-		hash += 2;
-	}
-	*hash = '\0';
-	free(ctx);
+	return ret;
 }
 
 static off_t
 buffer_digest_done(struct buffer_data *data)
 {
-	switch (data->type) {
-	case BUFFER_DIGEST_NULL:
-		break;
-	case BUFFER_DIGEST_MD5:
-		buffer_md5_done(data);
-		break;
+	static const char hexdigits[] = "0123456789abcdef";
+	struct buffer_digest_state *state;
+	int i, j;
+
+	if (data->type == BUFFER_DIGEST_NULL)
+		return 0;
+
+	state = data->arg.ptr;
+	for (i = 0; i < state->nctx; i++) {
+		struct buffer_digest_ctx *ctx = &state->ctx[i];
+		unsigned char digest[BUFFER_DIGEST_LENGTH_MAX];
+		char *hash = ctx->hash;
+
+		ctx->ops->final(digest, &ctx->ctx);
+		for (j = 0; j < ctx->ops->size; j++) {
+			*hash++ = hexdigits[digest[j] >> 4];
+			*hash++ = hexdigits[digest[j] & 0xf];
+		}
+		*hash = '\0';
 	}
+	free(state);
 
 	return 0;
 }
@@ -155,6 +303,14 @@ buffer_read(struct buffer_data *data, void *buf, off_t length,
 		if (ret < 0)
 			dpkg_put_errno(err, _("cannot read"));
 		break;
+	case BUFFER_READ_STREAM:
+		ret = decompress_stream_read(data->arg.ptr, buf, length);
+		break;
+	case BUFFER_READ_TAR:
+		ret = tar_archive_read(data->arg.ptr, buf, length);
+		if (ret < 0)
+			dpkg_put_errno(err, _("cannot read"));
+		break;
 	default:
 		internerr("unknown data type %i", data->type);
 	}
@@ -175,6 +331,66 @@ buffer_digest(const void *input, void *output, int type, off_t limit)
 	return ret;
 }
 
+/*
+ * Copy the data straight from the tar archive read-ahead buffer, which
+ * avoids the intermediate buffer and its allocation for each entry.
+ */
+static off_t
+buffer_copy_tar(struct tar_archive *tar,
+                struct buffer_data *digest,
+                struct buffer_data *write_data,
+                off_t limit, struct dpkg_error *err)
+{
+	const char *buf;
+	size_t bufsize = DPKG_BUFFER_SIZE;
+	off_t bytesread = 0, byteswritten = 0;
+	off_t totalread = 0, totalwritten = 0;
+
+	if ((limit >= 0) && (limit < (off_t)bufsize))
+		bufsize = limit;
+
+	buffer_digest_init(digest);
+
+	while (bufsize > 0) {
+		bytesread = tar_archive_read_ptr(tar, &buf, bufsize);
+		if (bytesread < 0) {
+			dpkg_put_errno(err, _("cannot read"));
+			break;
+		}
+		if (bytesread == 0)
+			break;
+
+		totalread += bytesread;
+
+		if (limit >= 0) {
+			limit -= bytesread;
+			if (limit < (off_t)bufsize)
+				bufsize = limit;
+		}
+
+		buffer_digest_update(digest, buf, bytesread);
+
+		byteswritten = buffer_write(write_data, buf, bytesread, err);
+		if (byteswritten < 0)
+			break;
+		if (byteswritten == 0)
+			break;
+
+		totalwritten += byteswritten;
+	}
+
+	buffer_digest_done(digest);
+
+	if (bytesread < 0 || byteswritten < 0)
+		return -1;
+	if (totalread != totalwritten)
+		return -1;
+	if (limit > 0)
+		return dpkg_put_error(err, _("unexpected end of file or stream"));
+
+	return totalread;
+}
+
 static off_t
 buffer_copy(struct buffer_data *read_data,
             struct buffer_data *digest,
@@ -186,6 +402,11 @@ buffer_copy(struct buffer_data *read_data,
 	off_t bytesread = 0, byteswritten = 0;
 	off_t totalread = 0, totalwritten = 0;
 
+	if (read_data->type == BUFFER_READ_TAR &&
+	    ((struct tar_archive *)read_data->arg.ptr)->buf != NULL)
+		return buffer_copy_tar(read_data->arg.ptr, digest, write_data,
+		                       limit, err);
+
 	if ((limit >= 0) && (limit < bufsize))
 		bufsize = limit;
 	if (bufsize == 0)
@@ -261,6 +482,32 @@ buffer_copy_IntPtr(int Iin, int Tin,
 	return buffer_copy(&read_data, &digest, &write_data, limit, err);
 }
 
+off_t
+buffer_copy_PtrInt(void *Pin, int Tin,
+                   void *Pdigest, int Tdigest,
+                   int Iout, int Tout,
+                   off_t limit, struct dpkg_error *err)
+{
+	struct buffer_data read_data = { .type = Tin, .arg.ptr = Pin };
+	struct buffer_data digest = { .type = Tdigest, .arg.ptr = Pdigest };
+	struct buffer_data write_data = { .type = Tout, .arg.i = Iout };
+
+	return buffer_copy(&read_data, &digest, &write_data, limit, err);
+}
+
+off_t
+buffer_copy_PtrPtr(void *Pin, int Tin,
+                   void *Pdigest, int Tdigest,
+                   void *Pout, int Tout,
+                   off_t limit, struct dpkg_error *err)
+{
+	struct buffer_data read_data = { .type = Tin, .arg.ptr = Pin };
+	struct buffer_data digest = { .type = Tdigest, .arg.ptr = Pdigest };
+	struct buffer_data write_data = { .type = Tout, .arg.ptr = Pout };
+
+	return buffer_copy(&read_data, &digest, &write_data, limit, err);
+}
+
 static off_t
 buffer_skip(struct buffer_data *input, off_t limit, struct dpkg_error *err)
 {
@@ -274,6 +521,9 @@ buffer_skip(struct buffer_data *input, off_t limit, struct dpkg_error *err)
 		if (errno != ESPIPE)
 			return dpkg_put_errno(err, _("cannot seek"));
 		break;
+	case BUFFER_READ_STREAM:
+	case BUFFER_READ_TAR:
+		break;
 	default:
 		internerr("unknown data type %i", input->type);
 	}
@@ -293,3 +543,11 @@ buffer_skip_Int(int I, int T, off_t limit, struct dpkg_error *err)
 
 	return buffer_skip(&input, limit, err);
 }
+
+off_t
+buffer_skip_Ptr(void *P, int T, off_t limit, struct dpkg_error *err)
+{
+	struct buffer_data input = { .type = T, .arg.ptr = P };
+
+	return buffer_skip(&input, limit, err);
+}
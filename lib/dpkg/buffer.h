@@ -45,8 +45,13 @@ DPKG_BEGIN_DECLS
 
 #define BUFFER_DIGEST_NULL		4
 #define BUFFER_DIGEST_MD5		5
+#define BUFFER_DIGEST_SHA256		8
+#define BUFFER_DIGEST_MULTI		9
+#define BUFFER_DIGEST_SHA1		10
 
 #define BUFFER_READ_FD			0
+#define BUFFER_READ_STREAM		6
+#define BUFFER_READ_TAR			7
 
 struct buffer_data {
 	union {
@@ -56,14 +61,37 @@ struct buffer_data {
 	int type;
 };
 
+/**
+ * A digest to compute with BUFFER_DIGEST_MULTI.
+ *
+ * These get passed as an array terminated by a BUFFER_DIGEST_NULL type,
+ * so that several digests can be computed in a single pass over the data.
+ */
+struct buffer_digest_entry {
+	int type;
+	char *hash;
+};
+
 # define buffer_md5(buf, hash, limit) \
 	buffer_digest(buf, hash, BUFFER_DIGEST_MD5, limit)
+# define buffer_sha256(buf, hash, limit) \
+	buffer_digest(buf, hash, BUFFER_DIGEST_SHA256, limit)
 
 # define fd_md5(fd, hash, limit, err) \
 	buffer_copy_IntPtr(fd, BUFFER_READ_FD, \
 	                   hash, BUFFER_DIGEST_MD5, \
 	                   NULL, BUFFER_WRITE_NULL, \
 	                   limit, err)
+# define fd_sha256(fd, hash, limit, err) \
+	buffer_copy_IntPtr(fd, BUFFER_READ_FD, \
+	                   hash, BUFFER_DIGEST_SHA256, \
+	                   NULL, BUFFER_WRITE_NULL, \
+	                   limit, err)
+# define fd_digests(fd, digests, limit, err) \
+	buffer_copy_IntPtr(fd, BUFFER_READ_FD, \
+	                   digests, BUFFER_DIGEST_MULTI, \
+	                   NULL, BUFFER_WRITE_NULL, \
+	                   limit, err)
 # define fd_fd_copy(fd1, fd2, limit, err) \
 	buffer_copy_IntInt(fd1, BUFFER_READ_FD, \
 	                   NULL, BUFFER_DIGEST_NULL, \
@@ -82,6 +110,37 @@ struct buffer_data {
 # define fd_skip(fd, limit, err) \
 	buffer_skip_Int(fd, BUFFER_READ_FD, limit, err)
 
+# define stream_md5(ds, hash, limit, err) \
+	buffer_copy_PtrPtr(ds, BUFFER_READ_STREAM, \
+	                   hash, BUFFER_DIGEST_MD5, \
+	                   NULL, BUFFER_WRITE_NULL, \
+	                   limit, err)
+# define stream_fd_copy_and_md5(ds, fd, hash, limit, err) \
+	buffer_copy_PtrInt(ds, BUFFER_READ_STREAM, \
+	                   hash, BUFFER_DIGEST_MD5, \
+	                   fd, BUFFER_WRITE_FD, \
+	                   limit, err)
+# define stream_skip(ds, limit, err) \
+	buffer_skip_Ptr(ds, BUFFER_READ_STREAM, limit, err)
+
+# define tar_md5(tar, hash, limit, err) \
+	buffer_copy_PtrPtr(tar, BUFFER_READ_TAR, \
+	                   hash, BUFFER_DIGEST_MD5, \
+	                   NULL, BUFFER_WRITE_NULL, \
+	                   limit, err)
+# define tar_fd_copy_and_md5(tar, fd, hash, limit, err) \
+	buffer_copy_PtrInt(tar, BUFFER_READ_TAR, \
+	                   hash, BUFFER_DIGEST_MD5, \
+	                   fd, BUFFER_WRITE_FD, \
+	                   limit, err)
+# define tar_vbuf_copy_and_md5(tar, buf, hash, limit, err) \
+	buffer_copy_PtrPtr(tar, BUFFER_READ_TAR, \
+	                   hash, BUFFER_DIGEST_MD5, \
+	                   buf, BUFFER_WRITE_VBUF, \
+	                   limit, err)
+# define tar_skip(tar, limit, err) \
+	buffer_skip_Ptr(tar, BUFFER_READ_TAR, limit, err)
+
 
 off_t
 buffer_copy_IntPtr(int i, int typeIn,
@@ -96,9 +155,24 @@ buffer_copy_IntInt(int i1, int typeIn,
                    off_t limit, struct dpkg_error *err)
 	DPKG_ATTR_REQRET;
 off_t
+buffer_copy_PtrInt(void *p, int typeIn,
+                   void *f, int typeDigest,
+                   int i, int typeOut,
+                   off_t limit, struct dpkg_error *err)
+	DPKG_ATTR_REQRET;
+off_t
+buffer_copy_PtrPtr(void *p1, int typeIn,
+                   void *f, int typeDigest,
+                   void *p2, int typeOut,
+                   off_t limit, struct dpkg_error *err)
+	DPKG_ATTR_REQRET;
+off_t
 buffer_skip_Int(int I, int T, off_t limit, struct dpkg_error *err)
 	DPKG_ATTR_REQRET;
 off_t
+buffer_skip_Ptr(void *P, int T, off_t limit, struct dpkg_error *err)
+	DPKG_ATTR_REQRET;
+off_t
 buffer_digest(const void *buf, void *hash, int typeDigest, off_t length);
 
 /** @} */
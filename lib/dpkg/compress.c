@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
 
@@ -50,10 +51,12 @@
 #include <dpkg/i18n.h>
 #include <dpkg/dpkg.h>
 #include <dpkg/error.h>
+#include <dpkg/debug.h>
 #include <dpkg/varbuf.h>
 #include <dpkg/fdio.h>
 #include <dpkg/buffer.h>
 #include <dpkg/meminfo.h>
+#include <dpkg/thread-pool.h>
 #include <dpkg/command.h>
 #include <dpkg/compress.h>
 #if USE_LIBZ_IMPL == USE_LIBZ_IMPL_NONE || \
@@ -129,6 +132,8 @@ enum dpkg_stream_status {
 };
 #endif
 
+struct decompress_stream;
+
 struct compressor {
 	const char *name;
 	const char *extension;
@@ -139,8 +144,70 @@ struct compressor {
 	                 int fd_in, int fd_out, const char *desc);
 	void (*decompress)(struct compress_params *params,
 	                   int fd_in, int fd_out, const char *desc);
+
+	/* In-process pull decompression, optional. */
+	void (*decompress_init)(struct decompress_stream *ds);
+	size_t (*decompress_code)(struct decompress_stream *ds,
+	                          uint8_t *buf, size_t len);
+	void (*decompress_done)(struct decompress_stream *ds);
+	/* Random access support, optional. Returns the uncompressed offset
+	 * the stream got positioned at, or -1 to skip to offset by reading. */
+	off_t (*decompress_seek)(struct decompress_stream *ds, off_t offset);
+};
+
+struct decompress_stream {
+	const struct compressor *compressor;
+	struct compress_params *params;
+	char *desc;
+	void *ctx;
+
+	int fd;
+	/* The compressed member offset in fd, or -1 if not seekable. */
+	off_t start;
+	/* The compressed member size, or -1 if unbounded. */
+	off_t member_size;
+	/* Compressed bytes left to read, or -1 if unbounded. */
+	off_t size;
+	bool eof_in;
+	bool eof_out;
+	/* The uncompressed offset of the next read. */
+	off_t pos;
+
+	uint8_t *buf_in;
+	uint8_t *next_in;
+	size_t avail_in;
+
+	uint8_t *buf_out;
+	uint8_t *next_out;
+	size_t avail_out;
 };
 
+static void
+decompress_stream_fill(struct decompress_stream *ds)
+{
+	size_t len = DPKG_BUFFER_SIZE;
+	ssize_t n;
+
+	if (ds->size >= 0 && ds->size < (off_t)len)
+		len = ds->size;
+	if (len == 0) {
+		ds->eof_in = true;
+		return;
+	}
+
+	n = fd_read(ds->fd, ds->buf_in, len);
+	if (n < 0)
+		ohshite(_("%s: cannot read data for %s compression stream"),
+		        ds->desc, ds->compressor->name);
+	if (n == 0)
+		ds->eof_in = true;
+	if (ds->size >= 0)
+		ds->size -= n;
+
+	ds->next_in = ds->buf_in;
+	ds->avail_in = n;
+}
+
 /*
  * No compressor (pass-through).
  */
@@ -172,6 +239,38 @@ compress_none(struct compress_params *params, int fd_in, int fd_out,
 		       desc, err.str);
 }
 
+static size_t
+decompress_none_code(struct decompress_stream *ds, uint8_t *buf, size_t len)
+{
+	len = min(len, ds->avail_in);
+	memcpy(buf, ds->next_in, len);
+	ds->next_in += len;
+	ds->avail_in -= len;
+
+	if (ds->avail_in == 0 && ds->eof_in)
+		ds->eof_out = true;
+
+	return len;
+}
+
+static off_t
+decompress_none_seek(struct decompress_stream *ds, off_t offset)
+{
+	if (ds->start < 0 || ds->member_size < 0 || offset > ds->member_size)
+		return -1;
+
+	if (lseek(ds->fd, ds->start + offset, SEEK_SET) < 0)
+		ohshite(_("%s: cannot seek in %s compressed stream"),
+		        ds->desc, "none");
+
+	ds->size = ds->member_size - offset;
+	ds->next_in = ds->buf_in;
+	ds->avail_in = 0;
+	ds->eof_in = false;
+
+	return offset;
+}
+
 static const struct compressor compressor_none = {
 	.name = "none",
 	.extension = "",
@@ -179,8 +278,231 @@ static const struct compressor compressor_none = {
 	.fixup_params = fixup_none_params,
 	.compress = compress_none,
 	.decompress = decompress_none,
+	.decompress_code = decompress_none_code,
+	.decompress_seek = decompress_none_seek,
 };
 
+#if USE_LIBZ_IMPL != USE_LIBZ_IMPL_NONE || defined(WITH_LIBBZ2)
+/*
+ * Parallel block compression.
+ *
+ * The input gets split into blocks, which get compressed independently on
+ * a thread pool, and then get joined in order into a single stream by the
+ * compressor specific code. The block boundaries only depend on the input
+ * data, and the blocks are used even when running on a single thread, so
+ * the output does not depend on the number of threads nor CPUs.
+ */
+
+/* How many blocks to have in flight per thread. */
+#define COMPRESS_BLOCK_AHEAD	2
+
+struct compress_block {
+	struct thread_task task;
+	const struct compress_params *params;
+	/* The dictionary followed by the block data. */
+	uint8_t *buf;
+	size_t dict_len;
+	size_t len;
+	bool last;
+	struct varbuf out;
+	uint32_t crc;
+	int err;
+};
+
+struct compress_blocks;
+
+struct compress_block_ops {
+	const char *name;
+	/* The size of the data to use as dictionary from the previous block. */
+	size_t dict_size;
+	/* The maximum size of a block. */
+	size_t (*block_size)(const struct compress_params *params);
+	/* The size to cut a block at, if it can be shorter than the maximum. */
+	size_t (*block_split)(const struct compress_params *params,
+	                      const uint8_t *buf, size_t len);
+	size_t (*bound)(size_t len);
+	thread_task_func *code;
+	void (*start)(struct compress_blocks *cb);
+	void (*put)(struct compress_blocks *cb, struct compress_block *block);
+	void (*finish)(struct compress_blocks *cb);
+};
+
+struct compress_blocks {
+	const struct compress_block_ops *ops;
+	struct compress_params *params;
+	const char *desc;
+	struct thread_pool *pool;
+	struct compress_block *blocks;
+	int n_blocks;
+
+	/* The output pending to be written. */
+	struct varbuf out;
+
+	/* The compressor specific stream state. */
+	uint32_t crc;
+	uint64_t size;
+	uint64_t bits;
+	int n_bits;
+};
+
+static int
+compress_blocks_get_cputhreads(struct compress_params *params)
+{
+	int threads_max = thread_pool_get_cputhreads();
+
+	if (params->threads_max >= 0)
+		return clamp(params->threads_max, 1, threads_max);
+
+	return threads_max;
+}
+
+static void
+compress_blocks_free(struct compress_blocks *cb)
+{
+	int i;
+
+	/* This waits for any pending task. */
+	thread_pool_free(cb->pool);
+
+	for (i = 0; i < cb->n_blocks; i++) {
+		free(cb->blocks[i].buf);
+		varbuf_destroy(&cb->blocks[i].out);
+	}
+	free(cb->blocks);
+	varbuf_destroy(&cb->out);
+}
+
+static void
+cu_compress_blocks_free(int argc, void **argv)
+{
+	struct compress_blocks *cb = argv[0];
+
+	compress_blocks_free(cb);
+}
+
+static void
+compress_blocks_flush(struct compress_blocks *cb, int fd_out)
+{
+	if (fd_write(fd_out, cb->out.buf, cb->out.used) < 0)
+		ohshite(_("%s: cannot compress and write data to %s compression stream"),
+		        cb->desc, cb->ops->name);
+	varbuf_reset(&cb->out);
+}
+
+static void
+compress_blocks(const struct compress_block_ops *ops,
+                struct compress_params *params, int fd_in, int fd_out,
+                const char *desc)
+{
+	/* This needs to be static so that we can pass its address to
+	 * push_cleanup, as the stack gets unwound before the cleanups run. */
+	static struct compress_blocks cb;
+	struct compress_block *block, *prev = NULL;
+	size_t block_size, extra = 0;
+	int jobs, next_in = 0, next_out = 0;
+	int i;
+	bool eof = false, eof_in = false;
+
+	block_size = ops->block_size(params);
+	jobs = compress_blocks_get_cputhreads(params);
+
+	cb.ops = ops;
+	cb.params = params;
+	cb.desc = desc;
+	cb.pool = thread_pool_new(jobs);
+	cb.n_blocks = max(thread_pool_get_jobs(cb.pool), 1) * COMPRESS_BLOCK_AHEAD;
+	cb.blocks = m_calloc(cb.n_blocks, sizeof(*cb.blocks));
+	for (i = 0; i < cb.n_blocks; i++) {
+		cb.blocks[i].params = params;
+		cb.blocks[i].buf = m_malloc(ops->dict_size + block_size);
+		varbuf_init(&cb.blocks[i].out, 0);
+	}
+	varbuf_init(&cb.out, 0);
+	cb.crc = 0;
+	cb.size = 0;
+	cb.bits = 0;
+	cb.n_bits = 0;
+
+	debug(dbg_general, "compress: %s blocks of %zu bytes with %d threads",
+	      ops->name, block_size, thread_pool_get_jobs(cb.pool));
+
+	push_cleanup(cu_compress_blocks_free, ~ehflag_normaltidy, 1, &cb);
+
+	ops->start(&cb);
+
+	while (!eof || next_out < next_in) {
+		ssize_t n;
+
+		/* Queue blocks until all the slots are in use. */
+		while (!eof && next_in - next_out < cb.n_blocks) {
+			block = &cb.blocks[next_in % cb.n_blocks];
+
+			/* The dictionary always fits in the previous block, as
+			 * only the last one can be shorter than it, and blocks
+			 * only get split by compressors without dictionary. */
+			if (prev) {
+				uint8_t *data = prev->buf + prev->dict_len + prev->len;
+
+				block->dict_len = ops->dict_size;
+				memcpy(block->buf, data - block->dict_len,
+				       block->dict_len + extra);
+			} else {
+				block->dict_len = 0;
+			}
+
+			/* Carry over any data left from the previous block. */
+			block->len = extra;
+			if (!eof_in) {
+				n = fd_read(fd_in, block->buf + block->dict_len + extra,
+				            block_size - extra);
+				if (n < 0)
+					ohshite(_("%s: cannot read data for %s compression stream"),
+					        desc, ops->name);
+
+				block->len += n;
+				eof_in = block->len < block_size;
+			}
+
+			extra = block->len;
+			if (ops->block_split)
+				block->len = ops->block_split(params,
+				                              block->buf + block->dict_len,
+				                              block->len);
+			extra -= block->len;
+
+			block->last = eof = eof_in && extra == 0;
+			block->err = 0;
+			varbuf_reset(&block->out);
+			varbuf_grow(&block->out, ops->bound(block->len));
+
+			block->task.func = ops->code;
+			block->task.data = block;
+			thread_pool_submit(cb.pool, &block->task);
+
+			prev = block;
+			next_in++;
+		}
+
+		block = &cb.blocks[next_out % cb.n_blocks];
+		thread_pool_wait(cb.pool, &block->task);
+		ops->put(&cb, block);
+		compress_blocks_flush(&cb, fd_out);
+		next_out++;
+	}
+
+	ops->finish(&cb);
+	compress_blocks_flush(&cb, fd_out);
+
+	if (close(fd_out))
+		ohshite(_("%s: cannot compress and write data to %s compression stream"),
+		        desc, ops->name);
+
+	pop_cleanup(ehflag_normaltidy);
+
+	compress_blocks_free(&cb);
+}
+#endif
+
 /*
  * Gzip compressor.
  */
@@ -251,70 +573,217 @@ decompress_gzip(struct compress_params *params, int fd_in, int fd_out,
 		        desc, "gzip");
 }
 
-static void
-compress_gzip(struct compress_params *params, int fd_in, int fd_out,
-              const char *desc)
-{
-	char *buffer;
-	char combuf[6];
-	size_t bufsize = DPKG_BUFFER_SIZE;
-	int strategy;
-	int z_errnum;
-	gzFile gzfile;
+/* The block and dictionary sizes used by pigz. */
+#define GZIP_BLOCK_SIZE		(128 * 1024)
+#define GZIP_DICT_SIZE		(32 * 1024)
+/* The gzip header OS field value for Unix, as used by zlib. */
+#define GZIP_OS_UNIX		3
 
+static int
+compress_gzip_get_strategy(const struct compress_params *params)
+{
 	if (params->strategy == COMPRESSOR_STRATEGY_FILTERED)
-		strategy = 'f';
+		return Z_FILTERED;
 	else if (params->strategy == COMPRESSOR_STRATEGY_HUFFMAN)
-		strategy = 'h';
+		return Z_HUFFMAN_ONLY;
 	else if (params->strategy == COMPRESSOR_STRATEGY_RLE)
-		strategy = 'R';
+		return Z_RLE;
 	else if (params->strategy == COMPRESSOR_STRATEGY_FIXED)
-		strategy = 'F';
+		return Z_FIXED;
 	else
-		strategy = ' ';
+		return Z_DEFAULT_STRATEGY;
+}
 
-	snprintf(combuf, sizeof(combuf), "w%d%c", params->level, strategy);
-	gzfile = gzdopen(fd_out, combuf);
-	if (gzfile == NULL)
-		ohshit(_("%s: cannot bind output to %s compression stream"),
-		       desc, "gzip");
+static size_t
+compress_gzip_block_size(const struct compress_params *params)
+{
+	return GZIP_BLOCK_SIZE;
+}
 
-	buffer = m_malloc(bufsize);
+static size_t
+compress_gzip_bound(size_t len)
+{
+	/* Room for the sync flush marker. */
+	return compressBound(len) + 16;
+}
 
-	for (;;) {
-		int actualread, actualwrite;
+/*
+ * Compress each block into a raw deflate stream, primed with the previous
+ * block data as dictionary. All but the last block end with a sync flush,
+ * which aligns them to a byte boundary, so that they can be concatenated.
+ */
+static void
+compress_gzip_block(void *data)
+{
+	struct compress_block *block = data;
+	z_stream zs;
+	int z_errnum;
 
-		actualread = fd_read(fd_in, buffer, bufsize);
-		if (actualread < 0)
-			ohshite(_("%s: cannot read data for %s compression stream"),
-			        desc, "gzip");
-		if (actualread == 0) /* EOF. */
-			break;
+	memset(&zs, 0, sizeof(zs));
+	z_errnum = deflateInit2(&zs, block->params->level, Z_DEFLATED,
+	                        -MAX_WBITS, 8,
+	                        compress_gzip_get_strategy(block->params));
+	if (z_errnum != Z_OK) {
+		block->err = z_errnum;
+		return;
+	}
 
-		actualwrite = gzwrite(gzfile, buffer, actualread);
-		if (actualwrite != actualread) {
-			const char *errmsg = gzerror(gzfile, &z_errnum);
+	if (block->dict_len) {
+		z_errnum = deflateSetDictionary(&zs, block->buf, block->dict_len);
+		if (z_errnum != Z_OK)
+			goto out;
+	}
 
-			if (z_errnum == Z_ERRNO)
-				errmsg = strerror(errno);
-			ohshit(_("%s: cannot compress and write data to %s compression stream: %s"),
-			       desc, "gzip", errmsg);
-		}
+	zs.next_in = block->buf + block->dict_len;
+	zs.avail_in = block->len;
+	zs.next_out = (uint8_t *)block->out.buf;
+	zs.avail_out = block->out.size;
+
+	z_errnum = deflate(&zs, block->last ? Z_FINISH : Z_SYNC_FLUSH);
+	if (block->last && z_errnum == Z_STREAM_END)
+		z_errnum = Z_OK;
+	else if (z_errnum == Z_OK && (zs.avail_in || zs.avail_out == 0))
+		z_errnum = Z_BUF_ERROR;
+
+	block->out.used = block->out.size - zs.avail_out;
+	block->crc = crc32(0, block->buf + block->dict_len, block->len);
+
+out:
+	deflateEnd(&zs);
+	block->err = z_errnum;
+}
+
+static void
+compress_gzip_start(struct compress_blocks *cb)
+{
+	int level = cb->params->level;
+	int strategy = compress_gzip_get_strategy(cb->params);
+	uint8_t header[10] = { 0x1f, 0x8b, Z_DEFLATED };
+
+	/* Fill the extra flags and OS fields as zlib does. */
+	if (level == 9)
+		header[8] = 2;
+	else if (strategy >= Z_HUFFMAN_ONLY || level < 2)
+		header[8] = 4;
+	header[9] = GZIP_OS_UNIX;
+
+	varbuf_add_buf(&cb->out, header, sizeof(header));
+}
+
+static void
+compress_gzip_put(struct compress_blocks *cb, struct compress_block *block)
+{
+	if (block->err != Z_OK)
+		ohshit(_("%s: cannot compress and write data to %s compression stream: %s"),
+		       cb->desc, "gzip", zError(block->err));
+
+	varbuf_add_buf(&cb->out, block->out.buf, block->out.used);
+
+	cb->crc = crc32_combine(cb->crc, block->crc, block->len);
+	cb->size += block->len;
+}
+
+static void
+compress_gzip_finish(struct compress_blocks *cb)
+{
+	uint8_t trailer[8];
+	int i;
+
+	/* The CRC-32 and the input size modulo 2^32, in little-endian. */
+	for (i = 0; i < 4; i++) {
+		trailer[i] = cb->crc >> (i * 8);
+		trailer[i + 4] = cb->size >> (i * 8);
 	}
 
-	free(buffer);
+	varbuf_add_buf(&cb->out, trailer, sizeof(trailer));
+}
 
-	z_errnum = gzclose(gzfile);
-	if (z_errnum) {
-		const char *errmsg;
+static const struct compress_block_ops compress_gzip_blocks = {
+	.name = "gzip",
+	.dict_size = GZIP_DICT_SIZE,
+	.block_size = compress_gzip_block_size,
+	.bound = compress_gzip_bound,
+	.code = compress_gzip_block,
+	.start = compress_gzip_start,
+	.put = compress_gzip_put,
+	.finish = compress_gzip_finish,
+};
 
-		if (z_errnum == Z_ERRNO)
-			errmsg = strerror(errno);
+static void
+compress_gzip(struct compress_params *params, int fd_in, int fd_out,
+              const char *desc)
+{
+	compress_blocks(&compress_gzip_blocks, params, fd_in, fd_out, desc);
+}
+
+static void DPKG_ATTR_NORET
+decompress_gzip_error(struct decompress_stream *ds, z_stream *zs, int z_errnum)
+{
+	const char *errmsg;
+
+	if (zs->msg)
+		errmsg = zs->msg;
+	else
+		errmsg = zError(z_errnum);
+	ohshit(_("%s: cannot read and decompress data from %s compressed stream: %s"),
+	       ds->desc, "gzip", errmsg);
+}
+
+static void
+decompress_gzip_init(struct decompress_stream *ds)
+{
+	z_stream *zs;
+	int z_errnum;
+
+	zs = m_calloc(1, sizeof(*zs));
+	ds->ctx = zs;
+
+	/* Only accept the gzip format, as gzread() does. */
+	z_errnum = inflateInit2(zs, MAX_WBITS + 16);
+	if (z_errnum != Z_OK)
+		decompress_gzip_error(ds, zs, z_errnum);
+}
+
+static size_t
+decompress_gzip_code(struct decompress_stream *ds, uint8_t *buf, size_t len)
+{
+	z_stream *zs = ds->ctx;
+	int z_errnum;
+
+	zs->next_in = ds->next_in;
+	zs->avail_in = ds->avail_in;
+	zs->next_out = buf;
+	zs->avail_out = len;
+
+	z_errnum = inflate(zs, Z_NO_FLUSH);
+
+	ds->next_in = zs->next_in;
+	ds->avail_in = zs->avail_in;
+
+	if (z_errnum == Z_STREAM_END) {
+		/* Concatenated gzip members get decompressed as a single
+		 * stream, and anything else is trailing garbage, as with
+		 * gzread(). */
+		if (ds->avail_in == 0 && !ds->eof_in)
+			decompress_stream_fill(ds);
+		if (ds->avail_in > 0 && ds->next_in[0] == 0x1f)
+			inflateReset(zs);
 		else
-			errmsg = zError(z_errnum);
-		ohshit(_("%s: cannot compress and write data to %s compression stream: %s"),
-		       desc, "gzip", errmsg);
+			ds->eof_out = true;
+	} else if (z_errnum != Z_OK && z_errnum != Z_BUF_ERROR) {
+		decompress_gzip_error(ds, zs, z_errnum);
 	}
+
+	return len - zs->avail_out;
+}
+
+static void
+decompress_gzip_done(struct decompress_stream *ds)
+{
+	z_stream *zs = ds->ctx;
+
+	inflateEnd(zs);
+	free(zs);
 }
 #else
 static const char *env_gzip[] = {
@@ -357,6 +826,11 @@ static const struct compressor compressor_gzip = {
 	.fixup_params = fixup_gzip_params,
 	.compress = compress_gzip,
 	.decompress = decompress_gzip,
+#if USE_LIBZ_IMPL != USE_LIBZ_IMPL_NONE
+	.decompress_init = decompress_gzip_init,
+	.decompress_code = decompress_gzip_code,
+	.decompress_done = decompress_gzip_done,
+#endif
 };
 
 /*
@@ -419,63 +893,256 @@ decompress_bzip2(struct compress_params *params, int fd_in, int fd_out,
 		        desc, "bzip2");
 }
 
+/* The bzip2 stream block header and end of stream magic numbers. */
+#define BZIP2_BLOCK_MAGIC_BITS	48
+#define BZIP2_EOS_MAGIC_HI	0x177245
+#define BZIP2_EOS_MAGIC_LO	0x385090
+
+/* The libbz2 block size limit after the initial run-length encoding. */
+#define BZIP2_BLOCK_MAX(level)	((level) * 100000 - 19)
+
+static size_t
+compress_bzip2_block_size(const struct compress_params *params)
+{
+	/* The initial run-length encoding can shrink the input a lot, so cap
+	 * the buffers to something reasonable, which only makes very
+	 * repetitive data get split into more blocks than libbz2 would. */
+	return 2 * params->level * 100000;
+}
+
+/*
+ * Split the blocks at the same places libbz2 would, by replaying its initial
+ * run-length encoding, so that each block fits in a single bzip2 block, and
+ * the compression ratio is the same as with a single libbz2 stream.
+ */
+static size_t
+compress_bzip2_block_split(const struct compress_params *params,
+                           const uint8_t *buf, size_t len)
+{
+	size_t block_max = BZIP2_BLOCK_MAX(params->level);
+	size_t used = 0;
+	size_t run = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		/* The pending run is not accounted until it gets flushed, and
+		 * when the block is full it gets carried over to the next. */
+		if (used >= block_max)
+			return i - run;
+
+		if (run > 0 && buf[i] == buf[i - 1] && run < 255) {
+			run++;
+			continue;
+		}
+
+		/* Runs of 4 or more bytes get encoded into 5 bytes. */
+		used += run < 4 ? run : 5;
+		run = 1;
+	}
+
+	return i;
+}
+
+static size_t
+compress_bzip2_bound(size_t len)
+{
+	return len + len / 100 + 600;
+}
+
+/*
+ * Compress each block into a complete bzip2 stream, containing a single
+ * bzip2 block, which then gets extracted at the bit level to be joined
+ * with the others.
+ */
 static void
-compress_bzip2(struct compress_params *params, int fd_in, int fd_out,
-               const char *desc)
+compress_bzip2_block(void *data)
 {
-	char *buffer;
-	char combuf[6];
-	size_t bufsize = DPKG_BUFFER_SIZE;
-	int bz_errnum;
-	BZFILE *bzfile;
+	struct compress_block *block = data;
+	unsigned int len = block->out.size;
 
-	snprintf(combuf, sizeof(combuf), "w%d", params->level);
-	bzfile = BZ2_bzdopen(fd_out, combuf);
-	if (bzfile == NULL)
-		ohshit(_("%s: cannot bind output to %s compression stream"),
-		       desc, "bzip2");
+	if (block->len == 0) {
+		block->err = BZ_OK;
+		return;
+	}
 
-	buffer = m_malloc(bufsize);
+	block->err = BZ2_bzBuffToBuffCompress(block->out.buf, &len,
+	                                      (char *)block->buf + block->dict_len,
+	                                      block->len, block->params->level,
+	                                      0, 0);
+	block->out.used = len;
+}
 
-	for (;;) {
-		int actualread, actualwrite;
+static uint32_t
+compress_bzip2_get_bits(const uint8_t *buf, size_t pos, int n)
+{
+	uint32_t value = 0;
+	int i;
 
-		actualread = fd_read(fd_in, buffer, bufsize);
-		if (actualread < 0)
-			ohshite(_("%s: cannot read data for %s compression stream"),
-			        desc, "bzip2");
-		if (actualread == 0) /* EOF. */
-			break;
+	for (i = 0; i < n; i++, pos++)
+		value = (value << 1) | ((buf[pos / 8] >> (7 - pos % 8)) & 1);
 
-		actualwrite = BZ2_bzwrite(bzfile, buffer, actualread);
-		if (actualwrite != actualread) {
-			const char *errmsg = BZ2_bzerror(bzfile, &bz_errnum);
+	return value;
+}
 
-			if (bz_errnum == BZ_IO_ERROR)
-				errmsg = strerror(errno);
-			ohshit(_("%s: cannot compress and write data to %s compression stream: %s"),
-			       desc, "bzip2", errmsg);
-		}
+static void
+compress_bzip2_put_bits(struct compress_blocks *cb, uint32_t value, int n)
+{
+	cb->bits = (cb->bits << n) | value;
+	cb->n_bits += n;
+
+	while (cb->n_bits >= 8) {
+		cb->n_bits -= 8;
+		varbuf_add_char(&cb->out, cb->bits >> cb->n_bits);
 	}
+	cb->bits &= (1 << cb->n_bits) - 1;
+}
 
-	free(buffer);
+static void
+compress_bzip2_start(struct compress_blocks *cb)
+{
+	varbuf_add_fmt(&cb->out, "BZh%d", cb->params->level);
+}
+
+static void
+compress_bzip2_put(struct compress_blocks *cb, struct compress_block *block)
+{
+	const uint8_t *buf = (const uint8_t *)block->out.buf;
+	size_t pos, end;
+	uint32_t crc;
+	int pad;
 
-	BZ2_bzWriteClose(&bz_errnum, bzfile, 0, NULL, NULL);
-	if (bz_errnum != BZ_OK) {
+	if (block->err != BZ_OK) {
 		const char *errmsg = _("unexpected bzip2 error");
 
-		if (bz_errnum == BZ_IO_ERROR)
-			errmsg = strerror(errno);
+		if (block->err == BZ_MEM_ERROR)
+			errmsg = strerror(ENOMEM);
 		ohshit(_("%s: cannot compress and write data to %s compression stream: %s"),
-		       desc, "bzip2", errmsg);
+		       cb->desc, "bzip2", errmsg);
 	}
 
-	/* Because BZ2_bzWriteClose has done a fflush on the file handle,
-	 * doing a close on the file descriptor associated with it should
-	 * be safe™. */
-	if (close(fd_out))
-		ohshite(_("%s: cannot compress and write data to %s compression stream"),
-		        desc, "bzip2");
+	if (block->len == 0)
+		return;
+
+	/* The block CRC follows the stream header and the block magic. */
+	pos = 32;
+	crc = compress_bzip2_get_bits(buf, pos + BZIP2_BLOCK_MAGIC_BITS, 32);
+
+	/* Find the end of stream magic, followed by the stream CRC, which
+	 * for a single block is the block CRC, and up to 7 padding bits. */
+	for (pad = 0; pad < 8; pad++) {
+		end = block->out.used * 8 - pad - 80;
+
+		if (compress_bzip2_get_bits(buf, end, 24) == BZIP2_EOS_MAGIC_HI &&
+		    compress_bzip2_get_bits(buf, end + 24, 24) == BZIP2_EOS_MAGIC_LO &&
+		    compress_bzip2_get_bits(buf, end + 48, 32) == crc)
+			break;
+	}
+	if (pad == 8)
+		internerr("bzip2 block stream without a single block");
+
+	for (; pos + 8 <= end; pos += 8)
+		compress_bzip2_put_bits(cb, buf[pos / 8], 8);
+	compress_bzip2_put_bits(cb, compress_bzip2_get_bits(buf, pos, end - pos),
+	                        end - pos);
+
+	cb->crc = ((cb->crc << 1) | (cb->crc >> 31)) ^ crc;
+}
+
+static void
+compress_bzip2_finish(struct compress_blocks *cb)
+{
+	compress_bzip2_put_bits(cb, BZIP2_EOS_MAGIC_HI, 24);
+	compress_bzip2_put_bits(cb, BZIP2_EOS_MAGIC_LO, 24);
+	compress_bzip2_put_bits(cb, cb->crc, 32);
+	if (cb->n_bits)
+		compress_bzip2_put_bits(cb, 0, 8 - cb->n_bits);
+}
+
+static const struct compress_block_ops compress_bzip2_blocks = {
+	.name = "bzip2",
+	.dict_size = 0,
+	.block_size = compress_bzip2_block_size,
+	.block_split = compress_bzip2_block_split,
+	.bound = compress_bzip2_bound,
+	.code = compress_bzip2_block,
+	.start = compress_bzip2_start,
+	.put = compress_bzip2_put,
+	.finish = compress_bzip2_finish,
+};
+
+static void
+compress_bzip2(struct compress_params *params, int fd_in, int fd_out,
+               const char *desc)
+{
+	compress_blocks(&compress_bzip2_blocks, params, fd_in, fd_out, desc);
+}
+
+static void DPKG_ATTR_NORET
+decompress_bzip2_error(struct decompress_stream *ds, int bz_errnum)
+{
+	const char *errmsg;
+
+	switch (bz_errnum) {
+	case BZ_MEM_ERROR:
+		errmsg = strerror(ENOMEM);
+		break;
+	case BZ_DATA_ERROR:
+	case BZ_DATA_ERROR_MAGIC:
+		errmsg = _("compressed data is corrupt");
+		break;
+	default:
+		errmsg = _("unexpected bzip2 error");
+		break;
+	}
+	ohshit(_("%s: cannot read and decompress data from %s compressed stream: %s"),
+	       ds->desc, "bzip2", errmsg);
+}
+
+static void
+decompress_bzip2_init(struct decompress_stream *ds)
+{
+	bz_stream *bs;
+	int bz_errnum;
+
+	bs = m_calloc(1, sizeof(*bs));
+	ds->ctx = bs;
+
+	bz_errnum = BZ2_bzDecompressInit(bs, 0, 0);
+	if (bz_errnum != BZ_OK)
+		decompress_bzip2_error(ds, bz_errnum);
+}
+
+static size_t
+decompress_bzip2_code(struct decompress_stream *ds, uint8_t *buf, size_t len)
+{
+	bz_stream *bs = ds->ctx;
+	int bz_errnum;
+
+	bs->next_in = (char *)ds->next_in;
+	bs->avail_in = ds->avail_in;
+	bs->next_out = (char *)buf;
+	bs->avail_out = len;
+
+	bz_errnum = BZ2_bzDecompress(bs);
+
+	ds->next_in = (uint8_t *)bs->next_in;
+	ds->avail_in = bs->avail_in;
+
+	if (bz_errnum == BZ_STREAM_END)
+		ds->eof_out = true;
+	else if (bz_errnum != BZ_OK)
+		decompress_bzip2_error(ds, bz_errnum);
+
+	return len - bs->avail_out;
+}
+
+static void
+decompress_bzip2_done(struct decompress_stream *ds)
+{
+	bz_stream *bs = ds->ctx;
+
+	BZ2_bzDecompressEnd(bs);
+	free(bs);
 }
 #else
 static const char *env_bzip2[] = {
@@ -518,6 +1185,11 @@ static const struct compressor compressor_bzip2 = {
 	.fixup_params = fixup_bzip2_params,
 	.compress = compress_bzip2,
 	.decompress = decompress_bzip2,
+#ifdef WITH_LIBBZ2
+	.decompress_init = decompress_bzip2_init,
+	.decompress_code = decompress_bzip2_code,
+	.decompress_done = decompress_bzip2_done,
+#endif
 };
 
 /*
@@ -741,6 +1413,7 @@ filter_xz_init(struct io_lzma *io, lzma_stream *s)
 
 #ifdef HAVE_LZMA_MT_ENCODER
 	mt_options.preset = preset;
+	mt_options.block_size = io->params->block_size;
 	mt_memlimit = filter_xz_get_memlimit();
 	mt_options.threads = filter_xz_get_cputhreads(io->params);
 
@@ -806,6 +1479,288 @@ decompress_xz(struct compress_params *params, int fd_in, int fd_out,
 	filter_lzma(&io, fd_in, fd_out);
 }
 
+struct io_lzma_stream {
+	struct io_lzma io;
+	lzma_stream s;
+
+	/* Random access support, for xz only. */
+	bool index_loaded;
+	lzma_index *index;
+	lzma_index_iter iter;
+	lzma_check check;
+	/* Whether we are decoding the blocks from the index one by one. */
+	bool blocks;
+};
+
+static void
+decompress_lzma_stream_init(struct decompress_stream *ds,
+                            void (*init)(struct io_lzma *io, lzma_stream *s))
+{
+	struct io_lzma_stream *ctx;
+	lzma_stream s = LZMA_STREAM_INIT;
+
+	ctx = m_malloc(sizeof(*ctx));
+	ctx->s = s;
+	ctx->io.desc = ds->desc;
+	ctx->io.params = ds->params;
+	ctx->io.init = init;
+	ctx->io.code = filter_lzma_code;
+	ctx->io.done = filter_lzma_done;
+	ctx->index_loaded = false;
+	ctx->index = NULL;
+	ctx->blocks = false;
+	ds->ctx = ctx;
+
+	ctx->io.status = DPKG_STREAM_OK;
+	ctx->io.action = DPKG_STREAM_INIT;
+	ctx->io.init(&ctx->io, &ctx->s);
+	ctx->io.action = DPKG_STREAM_RUN;
+}
+
+static size_t
+decompress_lzma_stream_code(struct decompress_stream *ds,
+                            uint8_t *buf, size_t len)
+{
+	struct io_lzma_stream *ctx = ds->ctx;
+
+	if (ds->avail_in == 0 && ds->eof_in)
+		ctx->io.action = DPKG_STREAM_FINISH;
+
+	ctx->s.next_in = ds->next_in;
+	ctx->s.avail_in = ds->avail_in;
+	ctx->s.next_out = buf;
+	ctx->s.avail_out = len;
+
+	ctx->io.code(&ctx->io, &ctx->s);
+
+	ds->next_in = (uint8_t *)ctx->s.next_in;
+	ds->avail_in = ctx->s.avail_in;
+
+	if (ctx->io.status == DPKG_STREAM_END)
+		ds->eof_out = true;
+
+	return len - ctx->s.avail_out;
+}
+
+static void
+decompress_lzma_stream_done(struct decompress_stream *ds)
+{
+	struct io_lzma_stream *ctx = ds->ctx;
+
+	ctx->io.done(&ctx->io, &ctx->s);
+	free(ctx);
+}
+
+static void
+decompress_xz_init(struct decompress_stream *ds)
+{
+	decompress_lzma_stream_init(ds, filter_unxz_init);
+}
+
+static bool
+decompress_xz_pread(struct decompress_stream *ds, void *buf, size_t len,
+                    off_t offset)
+{
+	if (lseek(ds->fd, ds->start + offset, SEEK_SET) < 0)
+		return false;
+
+	return fd_read(ds->fd, buf, len) == (ssize_t)len;
+}
+
+/*
+ * Load the index from the end of the xz stream, which maps the uncompressed
+ * offsets to the blocks that can be decoded independently. We only support
+ * members with a single stream, as generated by our compressor.
+ */
+static bool
+decompress_xz_decode_index(struct decompress_stream *ds)
+{
+	struct io_lzma_stream *ctx = ds->ctx;
+	uint8_t buf[LZMA_STREAM_HEADER_SIZE];
+	lzma_stream_flags header_flags, footer_flags;
+	uint64_t memlimit = UINT64_MAX;
+	uint8_t *index_buf;
+	size_t index_pos = 0;
+	lzma_ret ret;
+
+	if (ds->start < 0 || ds->member_size < 2 * LZMA_STREAM_HEADER_SIZE)
+		return false;
+
+	if (!decompress_xz_pread(ds, buf, sizeof(buf), 0) ||
+	    lzma_stream_header_decode(&header_flags, buf) != LZMA_OK)
+		return false;
+	if (!decompress_xz_pread(ds, buf, sizeof(buf),
+	                         ds->member_size - LZMA_STREAM_HEADER_SIZE) ||
+	    lzma_stream_footer_decode(&footer_flags, buf) != LZMA_OK)
+		return false;
+	if (lzma_stream_flags_compare(&header_flags, &footer_flags) != LZMA_OK)
+		return false;
+	if (footer_flags.backward_size >
+	    (lzma_vli)ds->member_size - 2 * LZMA_STREAM_HEADER_SIZE)
+		return false;
+
+	index_buf = m_malloc(footer_flags.backward_size);
+	if (!decompress_xz_pread(ds, index_buf, footer_flags.backward_size,
+	                         ds->member_size - LZMA_STREAM_HEADER_SIZE -
+	                         footer_flags.backward_size)) {
+		free(index_buf);
+		return false;
+	}
+	ret = lzma_index_buffer_decode(&ctx->index, &memlimit, NULL, index_buf,
+	                               &index_pos, footer_flags.backward_size);
+	free(index_buf);
+	if (ret != LZMA_OK)
+		return false;
+
+	if (lzma_index_stream_flags(ctx->index, &footer_flags) != LZMA_OK ||
+	    lzma_index_file_size(ctx->index) != (lzma_vli)ds->member_size ||
+	    lzma_index_block_count(ctx->index) < 2) {
+		lzma_index_end(ctx->index, NULL);
+		ctx->index = NULL;
+		return false;
+	}
+	ctx->check = footer_flags.check;
+
+	debug(dbg_general, "compress: %s index with %ju blocks", "xz",
+	      (uintmax_t)lzma_index_block_count(ctx->index));
+
+	return true;
+}
+
+static bool
+decompress_xz_load_index(struct decompress_stream *ds)
+{
+	off_t pos;
+	bool ok;
+
+	/* Restore the input position, in case we keep decoding linearly. */
+	pos = lseek(ds->fd, 0, SEEK_CUR);
+	if (pos < 0)
+		return false;
+	ok = decompress_xz_decode_index(ds);
+	if (lseek(ds->fd, pos, SEEK_SET) < 0)
+		ohshite(_("%s: cannot seek in %s compressed stream"),
+		        ds->desc, "xz");
+
+	return ok;
+}
+
+/*
+ * Set up the decoder for the block at the current index iterator, and
+ * point the input at its compressed data.
+ */
+static void
+decompress_xz_block_init(struct decompress_stream *ds)
+{
+	struct io_lzma_stream *ctx = ds->ctx;
+	lzma_filter filters[LZMA_FILTERS_MAX + 1];
+	lzma_block block;
+	uint8_t header[LZMA_BLOCK_HEADER_SIZE_MAX];
+	lzma_stream s = LZMA_STREAM_INIT;
+	off_t offset = ctx->iter.block.compressed_file_offset;
+	lzma_ret ret;
+	int i;
+
+	if (!decompress_xz_pread(ds, header, 1, offset))
+		ohshite(_("%s: cannot read data for %s compression stream"),
+		        ds->desc, "xz");
+
+	filters[0].id = LZMA_VLI_UNKNOWN;
+	memset(&block, 0, sizeof(block));
+	block.version = 1;
+	block.check = ctx->check;
+	block.filters = filters;
+	block.header_size = lzma_block_header_size_decode(header[0]);
+
+	if (!decompress_xz_pread(ds, header + 1, block.header_size - 1,
+	                         offset + 1))
+		ohshite(_("%s: cannot read data for %s compression stream"),
+		        ds->desc, "xz");
+
+	ret = lzma_block_header_decode(&block, NULL, header);
+	if (ret == LZMA_OK)
+		ret = lzma_block_compressed_size(&block,
+		                                 ctx->iter.block.unpadded_size);
+	if (ret == LZMA_OK) {
+		lzma_end(&ctx->s);
+		ctx->s = s;
+		ret = lzma_block_decoder(&ctx->s, &block);
+	}
+	/* The filter options are only needed to set up the decoder. */
+	for (i = 0; filters[i].id != LZMA_VLI_UNKNOWN; i++)
+		free(filters[i].options);
+	if (ret != LZMA_OK)
+		filter_lzma_error(&ctx->io, ret);
+
+	ctx->io.status = DPKG_STREAM_OK;
+	ctx->io.action = DPKG_STREAM_RUN;
+
+	ds->size = ctx->iter.block.total_size - block.header_size;
+	ds->next_in = ds->buf_in;
+	ds->avail_in = 0;
+	ds->eof_in = false;
+}
+
+static size_t
+decompress_xz_code(struct decompress_stream *ds, uint8_t *buf, size_t len)
+{
+	struct io_lzma_stream *ctx = ds->ctx;
+	size_t n;
+
+	n = decompress_lzma_stream_code(ds, buf, len);
+
+	/* Continue with the next block, if any. */
+	if (ctx->blocks && ds->eof_out &&
+	    !lzma_index_iter_next(&ctx->iter, LZMA_INDEX_ITER_BLOCK)) {
+		decompress_xz_block_init(ds);
+		ds->eof_out = false;
+	}
+
+	return n;
+}
+
+static off_t
+decompress_xz_seek(struct decompress_stream *ds, off_t offset)
+{
+	struct io_lzma_stream *ctx = ds->ctx;
+	lzma_index_iter iter;
+	off_t block_start;
+
+	if (!ctx->index_loaded) {
+		ctx->index_loaded = true;
+		if (!decompress_xz_load_index(ds))
+			return -1;
+	}
+	if (ctx->index == NULL)
+		return -1;
+
+	lzma_index_iter_init(&iter, ctx->index);
+	if (lzma_index_iter_locate(&iter, offset))
+		return -1;
+
+	/* Keep decoding when the offset is ahead in the same block. */
+	block_start = iter.block.uncompressed_file_offset;
+	if (ds->pos >= block_start && ds->pos <= offset)
+		return -1;
+
+	ctx->iter = iter;
+	decompress_xz_block_init(ds);
+	ctx->blocks = true;
+
+	return block_start;
+}
+
+static void
+decompress_xz_done(struct decompress_stream *ds)
+{
+	struct io_lzma_stream *ctx = ds->ctx;
+
+	if (ctx->index)
+		lzma_index_end(ctx->index, NULL);
+
+	decompress_lzma_stream_done(ds);
+}
+
 static void
 compress_xz(struct compress_params *params, int fd_in, int fd_out,
             const char *desc)
@@ -837,9 +1792,15 @@ decompress_xz(struct compress_params *params, int fd_in, int fd_out,
 	command_decompress_init(&cmd, XZ, desc);
 	command_add_arg(&cmd, "--format=xz");
 
+	/* Older xz versions default to a single thread when decompressing,
+	 * so request as many threads as CPUs when there is no limit, as we
+	 * do with liblzma. Versions without threaded decompression ignore
+	 * the option. */
 	if (params->threads_max > 0) {
 		threads_opt = str_fmt("-T%d", params->threads_max);
 		command_add_arg(&cmd, threads_opt);
+	} else if (params->threads_max < 0) {
+		command_add_arg(&cmd, "-T0");
 	}
 
 	fd_fd_filter(&cmd, fd_in, fd_out, env_xz);
@@ -854,12 +1815,18 @@ compress_xz(struct compress_params *params, int fd_in, int fd_out,
 {
 	struct command cmd;
 	char *threads_opt = NULL;
+	char *block_size_opt = NULL;
 
 	command_compress_init(&cmd, XZ, desc, params->level);
 
 	if (params->strategy == COMPRESSOR_STRATEGY_EXTREME)
 		command_add_arg(&cmd, "-e");
 
+	if (params->block_size > 0) {
+		block_size_opt = str_fmt("--block-size=%zu", params->block_size);
+		command_add_arg(&cmd, block_size_opt);
+	}
+
 	if (params->threads_max > 0) {
 		/* Do not generate warnings when adjusting memory usage, nor
 		 * exit with non-zero due to those not emitted warnings. */
@@ -885,6 +1852,7 @@ compress_xz(struct compress_params *params, int fd_in, int fd_out,
 	fd_fd_filter(&cmd, fd_in, fd_out, env_xz);
 
 	command_destroy(&cmd);
+	free(block_size_opt);
 	free(threads_opt);
 }
 #endif
@@ -896,6 +1864,12 @@ static const struct compressor compressor_xz = {
 	.fixup_params = fixup_none_params,
 	.compress = compress_xz,
 	.decompress = decompress_xz,
+#ifdef WITH_LIBLZMA
+	.decompress_init = decompress_xz_init,
+	.decompress_code = decompress_xz_code,
+	.decompress_done = decompress_xz_done,
+	.decompress_seek = decompress_xz_seek,
+#endif
 };
 
 /*
@@ -951,6 +1925,12 @@ decompress_lzma(struct compress_params *params, int fd_in, int fd_out,
 	filter_lzma(&io, fd_in, fd_out);
 }
 
+static void
+decompress_lzma_init(struct decompress_stream *ds)
+{
+	decompress_lzma_stream_init(ds, filter_unlzma_init);
+}
+
 static void
 compress_lzma(struct compress_params *params, int fd_in, int fd_out,
               const char *desc)
@@ -1002,6 +1982,11 @@ static const struct compressor compressor_lzma = {
 	.fixup_params = fixup_none_params,
 	.compress = compress_lzma,
 	.decompress = decompress_lzma,
+#ifdef WITH_LIBLZMA
+	.decompress_init = decompress_lzma_init,
+	.decompress_code = decompress_lzma_stream_code,
+	.decompress_done = decompress_lzma_stream_done,
+#endif
 };
 
 /*
@@ -1120,7 +2105,8 @@ filter_unzstd_code(struct io_zstd *io, struct io_zstd_stream *s)
 	s->next_out += buf_out.pos;
 	s->avail_out -= buf_out.pos;
 
-	if (ret == 0)
+	/* Keep going on concatenated frames until the input is exhausted. */
+	if (ret == 0 && s->avail_in == 0 && s->action == DPKG_STREAM_FINISH)
 		s->status = DPKG_STREAM_END;
 }
 
@@ -1262,6 +2248,51 @@ decompress_zstd(struct compress_params *params, int fd_in, int fd_out,
 	filter_zstd(&io, fd_in, fd_out);
 }
 
+static void
+decompress_zstd_init(struct decompress_stream *ds)
+{
+	ZSTD_DCtx *dctx;
+
+	dctx = ZSTD_createDCtx();
+	if (dctx == NULL)
+		ohshit(_("%s: cannot create %s decompression context"),
+		       ds->desc, "zstd");
+	ds->ctx = dctx;
+}
+
+static size_t
+decompress_zstd_code(struct decompress_stream *ds, uint8_t *buf, size_t len)
+{
+	ZSTD_inBuffer buf_in = { ds->next_in, ds->avail_in, 0 };
+	ZSTD_outBuffer buf_out = { buf, len, 0 };
+	size_t ret;
+
+	ret = ZSTD_decompressStream(ds->ctx, &buf_out, &buf_in);
+	if (ZSTD_isError(ret))
+		ohshit(_("%s: %s compression failure: %s"),
+		       ds->desc, "zstd", ZSTD_getErrorName(ret));
+
+	ds->next_in += buf_in.pos;
+	ds->avail_in -= buf_in.pos;
+
+	/* Concatenated frames get decompressed as a single stream, as with
+	 * the zstd command, so we only stop at the end of the last one. */
+	if (ret == 0) {
+		if (ds->avail_in == 0 && !ds->eof_in)
+			decompress_stream_fill(ds);
+		if (ds->avail_in == 0)
+			ds->eof_out = true;
+	}
+
+	return buf_out.pos;
+}
+
+static void
+decompress_zstd_done(struct decompress_stream *ds)
+{
+	ZSTD_freeDCtx(ds->ctx);
+}
+
 static void
 compress_zstd(struct compress_params *params, int fd_in, int fd_out,
               const char *desc)
@@ -1336,6 +2367,11 @@ static const struct compressor compressor_zstd = {
 	.fixup_params = fixup_none_params,
 	.compress = compress_zstd,
 	.decompress = decompress_zstd,
+#ifdef WITH_LIBZSTD
+	.decompress_init = decompress_zstd_init,
+	.decompress_code = decompress_zstd_code,
+	.decompress_done = decompress_zstd_done,
+#endif
 };
 
 /*
@@ -1490,3 +2526,184 @@ compress_filter(struct compress_params *params, int fd_in, int fd_out,
 
 	varbuf_destroy(&desc);
 }
+
+/*
+ * Decompression stream.
+ */
+
+/**
+ * Open an in-process decompression stream.
+ *
+ * The compressed data is read from fd_in, up to size bytes, or until end of
+ * file if size is -1, and the decompressed data can then be pulled with
+ * decompress_stream_read(), which avoids having to go through a pipe.
+ *
+ * @return The stream, or NULL if the compressor has no in-process
+ *         implementation, in which case the caller should use
+ *         decompress_filter() instead.
+ */
+struct decompress_stream *
+decompress_stream_open(struct compress_params *params, int fd_in, off_t size,
+                       const char *desc_fmt, ...)
+{
+	const struct compressor *compressor_ops = compressor(params->type);
+	struct decompress_stream *ds;
+	struct varbuf desc = VARBUF_INIT;
+	va_list args;
+
+	if (compressor_ops->decompress_code == NULL)
+		return NULL;
+
+	va_start(args, desc_fmt);
+	varbuf_add_vfmt(&desc, desc_fmt, args);
+	va_end(args);
+
+	ds = m_calloc(1, sizeof(*ds));
+	ds->compressor = compressor_ops;
+	ds->params = params;
+	ds->desc = varbuf_detach(&desc);
+	ds->fd = fd_in;
+	ds->start = lseek(fd_in, 0, SEEK_CUR);
+	ds->member_size = size;
+	ds->size = size;
+	ds->buf_in = m_malloc(DPKG_BUFFER_SIZE);
+	ds->buf_out = m_malloc(DPKG_BUFFER_SIZE);
+
+	if (compressor_ops->decompress_init)
+		compressor_ops->decompress_init(ds);
+
+	return ds;
+}
+
+static size_t
+decompress_stream_decode(struct decompress_stream *ds, uint8_t *buf, size_t len)
+{
+	size_t n;
+
+	do {
+		if (ds->avail_in == 0 && !ds->eof_in)
+			decompress_stream_fill(ds);
+
+		n = ds->compressor->decompress_code(ds, buf, len);
+
+		if (n == 0 && !ds->eof_out && ds->avail_in == 0 && ds->eof_in)
+			ohshit(_("%s: cannot read and decompress data from %s compressed stream: %s"),
+			       ds->desc, ds->compressor->name,
+			       _("unexpected end of input"));
+	} while (n == 0 && !ds->eof_out);
+
+	return n;
+}
+
+/**
+ * Read decompressed data from the stream.
+ *
+ * Small reads, such as the ones for tar headers, are served from an output
+ * buffer, while large ones get decompressed directly into the caller buffer.
+ * Any error is fatal.
+ *
+ * @return The amount of data read, which is less than len only at the end
+ *         of the stream.
+ */
+ssize_t
+decompress_stream_read(struct decompress_stream *ds, void *buf, size_t len)
+{
+	uint8_t *ptr = buf;
+	size_t total = 0;
+
+	while (total < len) {
+		size_t n;
+
+		if (ds->avail_out == 0) {
+			if (ds->eof_out)
+				break;
+
+			if (len - total >= DPKG_BUFFER_SIZE) {
+				total += decompress_stream_decode(ds, ptr + total,
+				                                  DPKG_BUFFER_SIZE);
+				continue;
+			}
+
+			ds->next_out = ds->buf_out;
+			ds->avail_out = decompress_stream_decode(ds, ds->buf_out,
+			                                         DPKG_BUFFER_SIZE);
+			continue;
+		}
+
+		n = min(ds->avail_out, len - total);
+		memcpy(ptr + total, ds->next_out, n);
+		ds->next_out += n;
+		ds->avail_out -= n;
+		total += n;
+	}
+
+	ds->pos += total;
+
+	return total;
+}
+
+/**
+ * Position the decompression stream at an uncompressed offset.
+ *
+ * If the compressed stream supports random access, and the input file
+ * descriptor is seekable, this jumps to the closest preceding point from
+ * where decompression can start. Otherwise this can only move forward,
+ * by decompressing and discarding the data in between. Any error is fatal.
+ */
+void
+decompress_stream_seek(struct decompress_stream *ds, off_t offset)
+{
+	if (ds->compressor->decompress_seek && offset != ds->pos) {
+		off_t pos;
+
+		pos = ds->compressor->decompress_seek(ds, offset);
+		if (pos >= 0) {
+			ds->pos = pos;
+			ds->next_out = ds->buf_out;
+			ds->avail_out = 0;
+			ds->eof_out = false;
+		}
+	}
+
+	if (offset < ds->pos)
+		ohshit(_("%s: cannot seek backwards in %s compressed stream"),
+		       ds->desc, ds->compressor->name);
+
+	while (ds->pos < offset) {
+		size_t n;
+
+		if (ds->avail_out == 0) {
+			if (ds->eof_out)
+				ohshit(_("%s: cannot read and decompress data from %s compressed stream: %s"),
+				       ds->desc, ds->compressor->name,
+				       _("unexpected end of input"));
+
+			ds->next_out = ds->buf_out;
+			ds->avail_out = decompress_stream_decode(ds, ds->buf_out,
+			                                         DPKG_BUFFER_SIZE);
+			continue;
+		}
+
+		n = min((off_t)ds->avail_out, offset - ds->pos);
+		ds->next_out += n;
+		ds->avail_out -= n;
+		ds->pos += n;
+	}
+}
+
+/**
+ * Close the decompression stream.
+ *
+ * The input file descriptor is left open.
+ */
+void
+decompress_stream_close(struct decompress_stream *ds)
+{
+	if (ds->compressor->decompress_done)
+		ds->compressor->decompress_done(ds);
+
+	free(ds->buf_in);
+	free(ds->buf_out);
+	free(ds->desc);
+	free(ds);
+}
@@ -22,6 +22,8 @@
 #ifndef LIBDPKG_COMPRESS_H
 #define LIBDPKG_COMPRESS_H
 
+#include <sys/types.h>
+
 #include <dpkg/macros.h>
 #include <dpkg/error.h>
 
@@ -62,6 +64,9 @@ struct compress_params {
 	enum compressor_strategy strategy;
 	int level;
 	int threads_max;
+	/* The uncompressed size of each independent block, or 0 for the
+	 * compressor default. Only used by the xz multi-threaded encoder. */
+	size_t block_size;
 };
 
 enum compressor_type
@@ -90,6 +95,19 @@ compress_filter(struct compress_params *params, int fd_in, int fd_out,
                 const char *desc, ...)
 	DPKG_ATTR_PRINTF(4);
 
+struct decompress_stream;
+
+struct decompress_stream *
+decompress_stream_open(struct compress_params *params, int fd_in, off_t size,
+                       const char *desc, ...)
+	DPKG_ATTR_PRINTF(4);
+ssize_t
+decompress_stream_read(struct decompress_stream *ds, void *buf, size_t len);
+void
+decompress_stream_seek(struct decompress_stream *ds, off_t offset);
+void
+decompress_stream_close(struct decompress_stream *ds);
+
 /** @} */
 
 DPKG_END_DECLS
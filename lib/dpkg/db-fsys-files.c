@@ -33,6 +33,7 @@
 #include <sys/stat.h>
 
 #include <errno.h>
+#include <stdint.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -45,9 +46,12 @@
 #include <dpkg/path.h>
 #include <dpkg/dir.h>
 #include <dpkg/fdio.h>
+#include <dpkg/file.h>
+#include <dpkg/debug.h>
 #include <dpkg/pkg-array.h>
 #include <dpkg/pkg-files.h>
 #include <dpkg/progress.h>
+#include <dpkg/thread-pool.h>
 #include <dpkg/db-ctrl.h>
 #include <dpkg/db-fsys.h>
 
@@ -70,26 +74,47 @@ enum pkg_filesdb_load_status {
 
 static enum pkg_filesdb_load_status saidread = PKG_FILESDB_LOAD_NONE;
 
+enum fsys_list_error {
+	FSYS_LIST_OK,
+	FSYS_LIST_NO_NEWLINE,
+	FSYS_LIST_EMPTY_NAME,
+	FSYS_LIST_NO_MEMORY,
+};
+
+struct fsys_list {
+	char **names;
+	int n_names;
+	enum fsys_list_error error;
+};
+
+/**
+ * Split a files list buffer into its pathnames.
+ *
+ * The buffer gets modified in place. This can be called from a worker
+ * thread, so it must not fail fatally, and any error gets recorded to be
+ * reported later on.
+ */
 static void
-fsys_list_parse_buffer(struct varbuf *vb, struct pkginfo *pkg)
+fsys_list_split(struct fsys_list *list, char *buf, size_t len)
 {
-	struct fsys_namenode_list **files_tail;
 	char *loaded_list_end, *thisline;
+	int n_alloc = 0;
 
-	loaded_list_end = vb->buf + vb->used;
+	list->names = NULL;
+	list->n_names = 0;
+	list->error = FSYS_LIST_OK;
 
-	files_tail = &pkg->files;
-	thisline = vb->buf;
+	loaded_list_end = buf + len;
+	thisline = buf;
 
 	while (thisline < loaded_list_end) {
-		struct fsys_namenode *namenode;
 		char *nextline, *ptr;
 
 		ptr = memchr(thisline, '\n', loaded_list_end - thisline);
-		if (ptr == NULL)
-			ohshit(_("files list file for package '%s' "
-			         "is missing final newline"),
-			       pkg_name(pkg, pnaw_nonambig));
+		if (ptr == NULL) {
+			list->error = FSYS_LIST_NO_NEWLINE;
+			return;
+		}
 
 		/* Where to start next time around. */
 		nextline = ptr + 1;
@@ -98,52 +123,668 @@ fsys_list_parse_buffer(struct varbuf *vb, struct pkginfo *pkg)
 		if (ptr > thisline && ptr[-1] == '/')
 			ptr--;
 
-		/* Add the file to the list. */
-		if (ptr == thisline)
-			ohshit(_("files list file for package '%s' "
-			         "contains empty filename"),
-			       pkg_name(pkg, pnaw_nonambig));
+		if (ptr == thisline) {
+			list->error = FSYS_LIST_EMPTY_NAME;
+			return;
+		}
 		*ptr = '\0';
 
-		namenode = fsys_hash_find_node(thisline, FHFF_NONE);
-		files_tail = pkg_files_add_file(pkg, namenode, files_tail);
+		if (list->n_names == n_alloc) {
+			char **names;
+
+			n_alloc = n_alloc ? n_alloc * 2 : 64;
+			names = realloc(list->names, n_alloc * sizeof(*names));
+			if (names == NULL) {
+				list->error = FSYS_LIST_NO_MEMORY;
+				return;
+			}
+			list->names = names;
+		}
+		list->names[list->n_names++] = thisline;
 
 		thisline = nextline;
 	}
 }
 
 /**
- * Load the list of files in this package into memory, or update the
- * list if it is there but stale.
+ * Add the split pathnames to the package files list.
+ *
+ * The split list gets freed.
  */
-void
-ensure_packagefiles_available(struct pkginfo *pkg)
+static void
+fsys_list_insert(struct fsys_list *list, struct pkginfo *pkg)
 {
-	const char *filelistfile;
-	struct varbuf buf = VARBUF_INIT;
+	struct fsys_namenode_list **files_tail;
+	enum fsys_list_error error = list->error;
+	int i;
+
+	files_tail = &pkg->files;
+
+	for (i = 0; i < list->n_names; i++) {
+		struct fsys_namenode *namenode;
+
+		/* Add the file to the list. */
+		namenode = fsys_hash_find_node(list->names[i], FHFF_NONE);
+		files_tail = pkg_files_add_file(pkg, namenode, files_tail);
+	}
+
+	free(list->names);
+	list->names = NULL;
+	list->n_names = 0;
+
+	if (error == FSYS_LIST_NO_NEWLINE)
+		ohshit(_("files list file for package '%s' "
+		         "is missing final newline"),
+		       pkg_name(pkg, pnaw_nonambig));
+	else if (error == FSYS_LIST_EMPTY_NAME)
+		ohshit(_("files list file for package '%s' "
+		         "contains empty filename"),
+		       pkg_name(pkg, pnaw_nonambig));
+	else if (error == FSYS_LIST_NO_MEMORY)
+		ohshit(_("cannot split files list file for package '%s': %s"),
+		       pkg_name(pkg, pnaw_nonambig), strerror(ENOMEM));
+}
+
+static void
+fsys_list_parse_buffer(char *buf, size_t len, struct pkginfo *pkg)
+{
+	struct fsys_list list;
+
+	fsys_list_split(&list, buf, len);
+	fsys_list_insert(&list, pkg);
+}
+
+/*** Files list cache. ***/
+
+/*
+ * The files list cache contains a copy of the files list files of all the
+ * installed packages, so that they can be loaded with a single sequential
+ * read, instead of having to open and read each of them.
+ *
+ * Each record is keyed on the name and identity of the files list file it
+ * was copied from, which gets checked on load, so the files list files are
+ * still the authoritative source, and any stale record is ignored. New
+ * records get appended when writing a files list file, and the cache gets
+ * regenerated whenever there are missing or superseded records, if we
+ * can write to the database directory.
+ */
+
+#define FSYS_CACHE_MAGIC	"dpkgfsc"
+#define FSYS_CACHE_VERSION	2
+#define FSYS_CACHE_BYTEORDER	0x01020304
+
+struct fsys_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+};
+
+struct fsys_cache_record {
+	uint32_t keylen;
+	uint32_t datalen;
+	uint32_t datahash;
+	uint32_t pad;
+	/* Identity of the files list file. */
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	/* In nanoseconds, to catch rewrites within the same second. */
+	int64_t mtime;
+	int64_t ctime;
+};
+
+struct fsys_cache_entry {
+	struct fsys_cache_record rec;
+	const char *key;
+	char *data;
+	int seq;
+};
+
+static bool fsys_cache_used = false;
+static struct varbuf *fsys_cache_rec = NULL;
+
+static const char *
+fsys_cache_get_key(const char *listfile)
+{
+	const char *key;
+
+	key = strrchr(listfile, '/');
+	if (key == NULL)
+		return listfile;
+
+	return key + 1;
+}
+
+static void
+fsys_cache_add_header(struct varbuf *vb)
+{
+	struct fsys_cache_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, FSYS_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = FSYS_CACHE_VERSION;
+	hdr.byteorder = FSYS_CACHE_BYTEORDER;
+
+	varbuf_add_buf(vb, &hdr, sizeof(hdr));
+}
+
+static void
+fsys_cache_add_record(struct varbuf *vb, const struct stat *st,
+                      const char *key, const char *data, size_t datalen)
+{
+	struct fsys_cache_record rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.keylen = strlen(key);
+	rec.datalen = datalen;
+	rec.datahash = str_fnv_hash_len(data, datalen);
+	rec.dev = st->st_dev;
+	rec.ino = st->st_ino;
+	rec.size = st->st_size;
+	rec.mtime = file_stat_mtime_nsec(st);
+	rec.ctime = file_stat_ctime_nsec(st);
+
+	varbuf_add_buf(vb, &rec, sizeof(rec));
+	varbuf_add_buf(vb, key, rec.keylen);
+	varbuf_add_char(vb, '\0');
+	varbuf_add_buf(vb, data, datalen);
+}
+
+static void
+fsys_cache_add_entry(struct varbuf *vb, const struct fsys_cache_entry *entry)
+{
+	varbuf_add_buf(vb, &entry->rec, sizeof(entry->rec));
+	varbuf_add_buf(vb, entry->key, entry->rec.keylen);
+	varbuf_add_char(vb, '\0');
+	varbuf_add_buf(vb, entry->data, entry->rec.datalen);
+}
+
+static bool
+fsys_cache_entry_matches(const struct fsys_cache_entry *entry,
+                         const struct stat *st)
+{
+	return entry->rec.dev == (uint64_t)st->st_dev &&
+	       entry->rec.ino == (uint64_t)st->st_ino &&
+	       entry->rec.size == (uint64_t)st->st_size &&
+	       entry->rec.mtime == file_stat_mtime_nsec(st) &&
+	       entry->rec.ctime == file_stat_ctime_nsec(st) &&
+	       entry->rec.datalen == entry->rec.size;
+}
+
+static int
+fsys_cache_entry_cmp(const void *a, const void *b)
+{
+	const struct fsys_cache_entry *ea = a;
+	const struct fsys_cache_entry *eb = b;
+	int rc;
+
+	rc = strcmp(ea->key, eb->key);
+	if (rc)
+		return rc;
+
+	/* Later records supersede earlier ones, so sort them first. */
+	return eb->seq - ea->seq;
+}
+
+static int
+fsys_cache_key_cmp(const void *a, const void *b)
+{
+	const char *key = a;
+	const struct fsys_cache_entry *entry = b;
+
+	return strcmp(key, entry->key);
+}
+
+/**
+ * Load the files list cache.
+ *
+ * The entries get sorted by key, keeping only the latest record for each.
+ * Any truncated or corrupt record stops the load, as nothing past it can
+ * be trusted.
+ *
+ * @return The number of records read, including superseded ones.
+ */
+static int
+fsys_cache_load(struct varbuf *vb, struct fsys_cache_entry **entries_r,
+                int *n_entries_r)
+{
+	struct varbuf ref = VARBUF_INIT;
 	struct dpkg_error err = DPKG_ERROR_INIT;
+	struct fsys_cache_entry *entries = NULL;
+	char *cachefile;
+	char *ptr, *end;
+	int n_records = 0, n_entries = 0, n_alloc = 0;
+	int i;
 
-	if (pkg->files_list_valid)
+	*entries_r = NULL;
+	*n_entries_r = 0;
+
+	cachefile = dpkg_db_get_path(FILESCACHEFILE);
+	if (file_slurp(cachefile, vb, &err) < 0) {
+		debug(dbg_general, "files-cache: cannot load: %s", err.str);
+		dpkg_error_destroy(&err);
+		free(cachefile);
+		return 0;
+	}
+	free(cachefile);
+
+	fsys_cache_add_header(&ref);
+	if (vb->used < ref.used || memcmp(vb->buf, ref.buf, ref.used) != 0) {
+		debug(dbg_general, "files-cache: unknown format");
+		varbuf_destroy(&ref);
+		return 0;
+	}
+
+	ptr = vb->buf + ref.used;
+	end = vb->buf + vb->used;
+	varbuf_destroy(&ref);
+
+	while (ptr < end) {
+		struct fsys_cache_entry entry;
+		size_t avail;
+
+		avail = end - ptr;
+		if (avail < sizeof(entry.rec))
+			break;
+		memcpy(&entry.rec, ptr, sizeof(entry.rec));
+		avail -= sizeof(entry.rec);
+		if (entry.rec.keylen == 0 || entry.rec.keylen >= avail ||
+		    entry.rec.datalen > avail - entry.rec.keylen - 1)
+			break;
+
+		entry.key = ptr + sizeof(entry.rec);
+		entry.data = ptr + sizeof(entry.rec) + entry.rec.keylen + 1;
+		if (entry.key[entry.rec.keylen] != '\0' ||
+		    memchr(entry.key, '\0', entry.rec.keylen) != NULL ||
+		    str_fnv_hash_len(entry.data, entry.rec.datalen) !=
+		    entry.rec.datahash)
+			break;
+		entry.seq = n_records++;
+
+		if (n_entries == n_alloc) {
+			n_alloc = n_alloc ? n_alloc * 2 : 1024;
+			entries = m_realloc(entries, n_alloc * sizeof(*entries));
+		}
+		entries[n_entries++] = entry;
+
+		ptr = entry.data + entry.rec.datalen;
+	}
+	if (ptr < end)
+		debug(dbg_general, "files-cache: corrupt record %d", n_records);
+
+	if (n_entries == 0) {
+		free(entries);
+		return n_records;
+	}
+
+	qsort(entries, n_entries, sizeof(*entries), fsys_cache_entry_cmp);
+	for (i = 1, n_alloc = 1; i < n_entries; i++) {
+		if (strcmp(entries[i].key, entries[n_alloc - 1].key) == 0)
+			continue;
+		entries[n_alloc++] = entries[i];
+	}
+
+	*entries_r = entries;
+	*n_entries_r = n_alloc;
+
+	return n_records;
+}
+
+static void
+fsys_cache_write(struct varbuf *vb)
+{
+	char *cachefile, *cachefile_new;
+	int fd;
+
+	cachefile = dpkg_db_get_path(FILESCACHEFILE);
+	cachefile_new = str_fmt("%s-new.XXXXXX", cachefile);
+
+	fd = mkstemp(cachefile_new);
+	if (fd < 0) {
+		debug(dbg_general, "files-cache: cannot create %s: %s",
+		      cachefile_new, strerror(errno));
+		goto out;
+	}
+
+	if (fchmod(fd, 0644) < 0 ||
+	    fd_write(fd, vb->buf, vb->used) < 0 ||
+	    fsync(fd) < 0) {
+		close(fd);
+		goto fail;
+	}
+	if (close(fd) < 0 || rename(cachefile_new, cachefile) < 0)
+		goto fail;
+
+	dir_sync_path(dpkg_db_get_dir());
+
+	goto out;
+
+fail:
+	debug(dbg_general, "files-cache: cannot write %s: %s",
+	      cachefile, strerror(errno));
+	unlink(cachefile_new);
+out:
+	free(cachefile_new);
+	free(cachefile);
+}
+
+/**
+ * Append a files list file record to the files list cache.
+ *
+ * If there is no cache, it will be created on the next full load.
+ */
+static void
+fsys_cache_append(const char *listfile, const char *data, size_t datalen)
+{
+	struct varbuf vb = VARBUF_INIT;
+	struct stat st;
+	char *cachefile;
+	int fd;
+
+	if (stat(listfile, &st) < 0)
 		return;
 
-	/* Throw away any stale data, if there was any. */
-	pkg_files_blank(pkg);
+	cachefile = dpkg_db_get_path(FILESCACHEFILE);
+	fd = open(cachefile, O_WRONLY | O_APPEND);
+	if (fd < 0) {
+		free(cachefile);
+		return;
+	}
 
-	/* Packages which aren't installed don't have a files list. */
-	if (pkg->status == PKG_STAT_NOTINSTALLED) {
+	/* Use a single write, so that concurrent readers are less likely
+	 * to see a partial record, which would get ignored anyway. */
+	fsys_cache_add_record(&vb, &st, fsys_cache_get_key(listfile),
+	                      data, datalen);
+	if (fd_write(fd, vb.buf, vb.used) < 0)
+		debug(dbg_general, "files-cache: cannot append to %s: %s",
+		      cachefile, strerror(errno));
+
+	close(fd);
+	varbuf_destroy(&vb);
+	free(cachefile);
+}
+
+/**
+ * Load the files lists from the files list cache.
+ *
+ * The packages with a missing or stale record are left to be loaded from
+ * their files list files. If the cache needs to be regenerated, this sets
+ * up the recording of the ones that get loaded, which needs to be finished
+ * with fsys_cache_commit().
+ */
+static void
+fsys_cache_apply(struct pkg_array *array)
+{
+	struct varbuf vb = VARBUF_INIT;
+	struct fsys_cache_entry *entries, **hits;
+	int n_records, n_entries, n_live = 0;
+	bool rebuild = false;
+	int i;
+
+	fsys_cache_used = true;
+
+	n_records = fsys_cache_load(&vb, &entries, &n_entries);
+
+	hits = m_calloc(array->n_pkgs, sizeof(*hits));
+	for (i = 0; i < array->n_pkgs; i++) {
+		struct pkginfo *pkg = array->pkgs[i];
+		struct fsys_cache_entry *entry;
+		const char *listfile;
+		struct stat st;
+
+		if (pkg->status == PKG_STAT_NOTINSTALLED)
+			continue;
+
+		listfile = pkg_infodb_get_file(pkg, &pkg->installed, LISTFILE);
+		if (stat(listfile, &st) < 0)
+			continue;
+
+		entry = bsearch(fsys_cache_get_key(listfile), entries,
+		                n_entries, sizeof(*entries), fsys_cache_key_cmp);
+		if (entry && fsys_cache_entry_matches(entry, &st)) {
+			hits[i] = entry;
+			n_live++;
+		} else {
+			rebuild = true;
+		}
+	}
+	if (n_records > n_live)
+		rebuild = true;
+
+	debug(dbg_general, "files-cache: %d records, %d live, rebuild %s",
+	      n_records, n_live, rebuild ? "yes" : "no");
+
+	if (rebuild && access(dpkg_db_get_dir(), W_OK) == 0) {
+		fsys_cache_rec = m_malloc(sizeof(*fsys_cache_rec));
+		varbuf_init(fsys_cache_rec, vb.used);
+		fsys_cache_add_header(fsys_cache_rec);
+	}
+
+	for (i = 0; i < array->n_pkgs; i++) {
+		struct pkginfo *pkg = array->pkgs[i];
+		struct fsys_cache_entry *entry = hits[i];
+
+		if (entry == NULL)
+			continue;
+
+		/* This must be done before parsing, which modifies the data. */
+		if (fsys_cache_rec)
+			fsys_cache_add_entry(fsys_cache_rec, entry);
+
+		if (pkg->files_list_valid)
+			continue;
+
+		pkg_files_blank(pkg);
+		if (entry->rec.datalen)
+			fsys_list_parse_buffer(entry->data, entry->rec.datalen,
+			                       pkg);
 		pkg->files_list_valid = true;
-		return;
 	}
 
+	free(hits);
+	free(entries);
+	varbuf_destroy(&vb);
+}
+
+static void
+fsys_cache_commit(void)
+{
+	if (fsys_cache_rec == NULL)
+		return;
+
+	fsys_cache_write(fsys_cache_rec);
+
+	varbuf_destroy(fsys_cache_rec);
+	free(fsys_cache_rec);
+	fsys_cache_rec = NULL;
+}
+
+/*** Files list loading. ***/
+
+enum fsys_list_load_error {
+	FSYS_LIST_LOAD_OK,
+	FSYS_LIST_LOAD_OPEN,
+	FSYS_LIST_LOAD_STAT,
+	FSYS_LIST_LOAD_NOT_REGULAR,
+	FSYS_LIST_LOAD_READ,
+};
+
+struct fsys_list_load {
+	struct thread_task task;
+
+	/* Input members. */
+	struct pkginfo *pkg;
+	char *filename;
+	bool record;
+
+	/*
+	 * Output members. These are filled from the worker threads, which
+	 * cannot use the fatal error reporting nor allocation functions, so
+	 * errors get recorded with their errno, to be reported on completion.
+	 */
+	enum fsys_list_load_error error;
+	int syserrno;
+	struct stat st;
+	char *buf;
+	size_t len;
+	char *data;
+	struct fsys_list list;
+};
+
+static void
+fsys_list_load_init(struct fsys_list_load *load, struct pkginfo *pkg)
+{
+	const char *filelistfile;
+
 	filelistfile = pkg_infodb_get_file(pkg, &pkg->installed, LISTFILE);
 
+	load->pkg = pkg;
+	load->filename = m_strdup(filelistfile);
+	load->record = fsys_cache_rec != NULL;
+	load->error = FSYS_LIST_LOAD_OK;
+	load->syserrno = 0;
+	load->buf = NULL;
+	load->len = 0;
+	load->data = NULL;
+	load->list.names = NULL;
+	load->list.n_names = 0;
+	load->list.error = FSYS_LIST_OK;
+}
+
+static void
+fsys_list_load_destroy(struct fsys_list_load *load)
+{
+	free(load->filename);
+	load->filename = NULL;
+	free(load->buf);
+	load->buf = NULL;
+	free(load->data);
+	load->data = NULL;
+	free(load->list.names);
+	load->list.names = NULL;
+}
+
+static int
+fsys_list_load_fail(struct fsys_list_load *load,
+                    enum fsys_list_load_error error, int syserrno)
+{
+	load->error = error;
+	load->syserrno = syserrno;
+
+	return -1;
+}
+
+static int
+fsys_list_load_read(struct fsys_list_load *load)
+{
+	ssize_t n;
+	int fd;
+
+	fd = open(load->filename, O_RDONLY);
+	if (fd < 0)
+		return fsys_list_load_fail(load, FSYS_LIST_LOAD_OPEN, errno);
+
+	if (fstat(fd, &load->st) < 0) {
+		fsys_list_load_fail(load, FSYS_LIST_LOAD_STAT, errno);
+		goto out;
+	}
+	if (!S_ISREG(load->st.st_mode)) {
+		fsys_list_load_fail(load, FSYS_LIST_LOAD_NOT_REGULAR, 0);
+		goto out;
+	}
+	if (load->st.st_size == 0)
+		goto out;
+
+	load->buf = malloc(load->st.st_size + 1);
+	if (load->buf == NULL) {
+		fsys_list_load_fail(load, FSYS_LIST_LOAD_READ, ENOMEM);
+		goto out;
+	}
+	n = fd_read(fd, load->buf, load->st.st_size);
+	if (n < 0) {
+		fsys_list_load_fail(load, FSYS_LIST_LOAD_READ, errno);
+		goto out;
+	}
+	load->len = n;
+	load->buf[load->len] = '\0';
+
+out:
+	(void)close(fd);
+
+	return load->error == FSYS_LIST_LOAD_OK ? 0 : -1;
+}
+
+/**
+ * Read and split the files list file for a package.
+ *
+ * This can be run from a worker thread, so it must not use any function
+ * that can fail fatally, and errors get recorded for fsys_list_load_done().
+ */
+static void
+fsys_list_load_run(void *data)
+{
+	struct fsys_list_load *load = data;
+
+	if (fsys_list_load_read(load) < 0)
+		return;
+
+	/* Keep a pristine copy, as splitting modifies the buffer. */
+	if (load->record && load->len) {
+		load->data = malloc(load->len);
+		if (load->data == NULL) {
+			fsys_list_load_fail(load, FSYS_LIST_LOAD_READ, ENOMEM);
+			return;
+		}
+		memcpy(load->data, load->buf, load->len);
+	}
+
+	if (load->len)
+		fsys_list_split(&load->list, load->buf, load->len);
+}
+
+static void
+fsys_list_load_error(struct fsys_list_load *load, struct dpkg_error *err)
+{
+	errno = load->syserrno;
+
+	switch (load->error) {
+	case FSYS_LIST_LOAD_OPEN:
+		dpkg_put_errno(err, _("cannot open %s"), load->filename);
+		break;
+	case FSYS_LIST_LOAD_STAT:
+		dpkg_put_errno(err, _("cannot stat %s"), load->filename);
+		break;
+	case FSYS_LIST_LOAD_NOT_REGULAR:
+		dpkg_put_error(err, _("%s is not a regular file"), load->filename);
+		break;
+	case FSYS_LIST_LOAD_READ:
+		dpkg_put_errno(err, _("cannot read %s"), load->filename);
+		break;
+	default:
+		internerr("unknown files list load error %d", load->error);
+	}
+}
+
+static void
+fsys_list_load_done(struct fsys_list_load *load)
+{
+	struct pkginfo *pkg = load->pkg;
+
+	/* Throw away any stale data, if there was any. */
+	pkg_files_blank(pkg);
+
 	onerr_abort++;
 
-	if (file_slurp(filelistfile, &buf, &err) < 0) {
-		if (err.syserrno != ENOENT)
+	if (load->error != FSYS_LIST_LOAD_OK) {
+		if (load->syserrno != ENOENT) {
+			struct dpkg_error err = DPKG_ERROR_INIT;
+
+			fsys_list_load_error(load, &err);
 			dpkg_error_print(&err,
 			                 _("loading files list file for package '%s'"),
 			                 pkg_name(pkg, pnaw_nonambig));
+			dpkg_error_destroy(&err);
+		}
 
 		onerr_abort--;
 		if (pkg->status != PKG_STAT_CONFIGFILES &&
@@ -157,16 +798,172 @@ ensure_packagefiles_available(struct pkginfo *pkg)
 		return;
 	}
 
-	if (buf.used)
-		fsys_list_parse_buffer(&buf, pkg);
+	if (fsys_cache_rec && load->record)
+		fsys_cache_add_record(fsys_cache_rec, &load->st,
+		                      fsys_cache_get_key(load->filename),
+		                      load->data, load->len);
 
-	varbuf_destroy(&buf);
+	fsys_list_insert(&load->list, pkg);
 
 	onerr_abort--;
 
 	pkg->files_list_valid = true;
 }
 
+static bool
+fsys_list_load_needed(struct pkginfo *pkg)
+{
+	return !pkg->files_list_valid && pkg->status != PKG_STAT_NOTINSTALLED;
+}
+
+/**
+ * Load the list of files in this package into memory, or update the
+ * list if it is there but stale.
+ */
+void
+ensure_packagefiles_available(struct pkginfo *pkg)
+{
+	struct fsys_list_load load;
+
+	if (pkg->files_list_valid)
+		return;
+
+	/* Packages which aren't installed don't have a files list. */
+	if (pkg->status == PKG_STAT_NOTINSTALLED) {
+		/* Throw away any stale data, if there was any. */
+		pkg_files_blank(pkg);
+		pkg->files_list_valid = true;
+		return;
+	}
+
+	fsys_list_load_init(&load, pkg);
+	fsys_list_load_run(&load);
+	fsys_list_load_done(&load);
+	fsys_list_load_destroy(&load);
+}
+
+/*
+ * Parallel files list loading.
+ *
+ * The files list files get read and split by a pool of worker threads,
+ * while the main thread inserts them into the files database in order,
+ * so that the result is the same as when loading them serially.
+ */
+
+/* The loading is mostly I/O bound, so we can use more threads than CPUs
+ * to keep the storage busy, but there is no point in too many. */
+#define FSYS_LIST_LOAD_JOBS_MIN		4
+#define FSYS_LIST_LOAD_JOBS_MAX		8
+/* Do not bother with threads for few packages. */
+#define FSYS_LIST_LOAD_PARALLEL_MIN	64
+/* How many packages to read ahead per thread. */
+#define FSYS_LIST_LOAD_AHEAD		16
+
+struct fsys_list_loader {
+	struct thread_pool *pool;
+	struct fsys_list_load *loads;
+	int n_loads;
+	int next;
+	int ahead;
+};
+
+static void
+fsys_list_loader_free(struct fsys_list_loader *loader)
+{
+	int i;
+
+	/* This waits for any pending task. */
+	thread_pool_free(loader->pool);
+
+	for (i = 0; i < loader->n_loads; i++)
+		fsys_list_load_destroy(&loader->loads[i]);
+	free(loader->loads);
+	free(loader);
+}
+
+static void
+cu_fsys_list_loader_free(int argc, void **argv)
+{
+	struct fsys_list_loader *loader = argv[0];
+
+	fsys_list_loader_free(loader);
+}
+
+static struct fsys_list_loader *
+fsys_list_loader_new(struct pkg_array *array)
+{
+	struct fsys_list_loader *loader;
+	int jobs, pending = 0;
+	int i;
+
+	jobs = clamp(thread_pool_get_cputhreads(),
+	             FSYS_LIST_LOAD_JOBS_MIN, FSYS_LIST_LOAD_JOBS_MAX);
+
+	for (i = 0; i < array->n_pkgs; i++)
+		if (fsys_list_load_needed(array->pkgs[i]))
+			pending++;
+	if (pending < FSYS_LIST_LOAD_PARALLEL_MIN)
+		return NULL;
+
+	loader = m_malloc(sizeof(*loader));
+	loader->pool = thread_pool_new(jobs);
+	loader->n_loads = array->n_pkgs;
+	loader->loads = m_calloc(loader->n_loads, sizeof(*loader->loads));
+	loader->next = 0;
+	loader->ahead = thread_pool_get_jobs(loader->pool) *
+	                FSYS_LIST_LOAD_AHEAD;
+
+	debug(dbg_general, "files-list: loading %d packages with %d threads",
+	      pending, thread_pool_get_jobs(loader->pool));
+
+	push_cleanup(cu_fsys_list_loader_free, ~ehflag_normaltidy, 1, loader);
+
+	return loader;
+}
+
+static void
+fsys_list_loader_done(struct fsys_list_loader *loader)
+{
+	pop_cleanup(ehflag_normaltidy);
+
+	fsys_list_loader_free(loader);
+}
+
+/**
+ * Load the files list for the package at a given index, while queueing
+ * the read ahead of the following ones.
+ */
+static void
+fsys_list_loader_load(struct fsys_list_loader *loader,
+                      struct pkg_array *array, int index)
+{
+	struct fsys_list_load *load;
+
+	for (; loader->next < array->n_pkgs &&
+	       loader->next <= index + loader->ahead; loader->next++) {
+		struct pkginfo *pkg = array->pkgs[loader->next];
+
+		if (!fsys_list_load_needed(pkg))
+			continue;
+
+		load = &loader->loads[loader->next];
+		fsys_list_load_init(load, pkg);
+		load->task.func = fsys_list_load_run;
+		load->task.data = load;
+		thread_pool_submit(loader->pool, &load->task);
+	}
+
+	load = &loader->loads[index];
+	if (load->pkg == NULL) {
+		ensure_packagefiles_available(array->pkgs[index]);
+		return;
+	}
+
+	thread_pool_wait(loader->pool, &load->task);
+	fsys_list_load_done(load);
+	fsys_list_load_destroy(load);
+}
+
 #if defined(HAVE_LINUX_FIEMAP_H)
 static int
 pkg_sorter_by_files_list_phys_offs(const void *a, const void *b)
@@ -209,6 +1006,7 @@ pkg_files_optimize_load(struct pkg_array *array)
 		int fd;
 
 		if (pkg->status == PKG_STAT_NOTINSTALLED ||
+		    pkg->files_list_valid ||
 		    pkg->files_list_phys_offs != 0)
 			continue;
 
@@ -247,6 +1045,9 @@ pkg_files_optimize_load(struct pkg_array *array)
 		const char *listfile;
 		int fd;
 
+		if (pkg->files_list_valid)
+			continue;
+
 		listfile = pkg_infodb_get_file(pkg, &pkg->installed, LISTFILE);
 
 		fd = open(listfile, O_RDONLY | O_NONBLOCK);
@@ -267,6 +1068,7 @@ void
 ensure_allinstfiles_available(void)
 {
 	struct pkg_array array;
+	struct fsys_list_loader *loader;
 	struct progress progress;
 	int i;
 
@@ -281,17 +1083,30 @@ ensure_allinstfiles_available(void)
 
 	pkg_array_init_from_hash(&array);
 
+	if (!fsys_cache_used)
+		fsys_cache_apply(&array);
+
 	pkg_files_optimize_load(&array);
 
+	loader = fsys_list_loader_new(&array);
+
 	for (i = 0; i < array.n_pkgs; i++) {
 		struct pkginfo *pkg = array.pkgs[i];
 
-		ensure_packagefiles_available(pkg);
+		if (loader)
+			fsys_list_loader_load(loader, &array, i);
+		else
+			ensure_packagefiles_available(pkg);
 
 		if (saidread == PKG_FILESDB_LOAD_INPROGRESS)
 			progress_step(&progress);
 	}
 
+	if (loader)
+		fsys_list_loader_done(loader);
+
+	fsys_cache_commit();
+
 	pkg_array_destroy(&array);
 
 	allpackagesdone = true;
@@ -324,6 +1139,7 @@ write_filelist_except(struct pkginfo *pkg, struct pkgbin *pkgbin,
 {
 	struct atomic_file *file;
 	struct fsys_namenode_list *node;
+	struct varbuf vb = VARBUF_INIT;
 	const char *listfile;
 
 	listfile = pkg_infodb_get_file(pkg, pkgbin, LISTFILE);
@@ -333,11 +1149,13 @@ write_filelist_except(struct pkginfo *pkg, struct pkgbin *pkgbin,
 
 	for (node = list; node; node = node->next) {
 		if (!(mask && (node->namenode->flags & mask))) {
-			fputs(node->namenode->name, file->fp);
-			putc('\n', file->fp);
+			varbuf_add_str(&vb, node->namenode->name);
+			varbuf_add_char(&vb, '\n');
 		}
 	}
 
+	fputs(varbuf_str(&vb), file->fp);
+
 	atomic_file_sync(file);
 	atomic_file_close(file);
 	atomic_file_commit(file);
@@ -345,5 +1163,8 @@ write_filelist_except(struct pkginfo *pkg, struct pkgbin *pkgbin,
 
 	dir_sync_path(pkg_infodb_get_dir());
 
+	fsys_cache_append(listfile, vb.buf, vb.used);
+	varbuf_destroy(&vb);
+
 	note_must_reread_files_inpackage(pkg);
 }
@@ -49,12 +49,15 @@
 static bool db_initialized;
 
 static enum modstatdb_rw cstatus = -1, cflags = 0;
+static enum parsedbflags parse_flags;
 static char *lockfile;
 static char *frontendlockfile;
-static char *statusfile, *availablefile;
+static char *statusfile, *statuscachefile, *availablefile;
 static char *importanttmpfile = NULL;
 static FILE *importanttmp;
 static int nextupdate;
+static int note_nesting;
+static bool updates_unsynced;
 static char *updatesdir;
 static int updateslength;
 static struct varbuf updatefn;
@@ -91,7 +94,8 @@ cleanupdates(void)
 	struct dirent **cdlist;
 	int cdn;
 
-	parsedb(statusfile, pdb_parse_status, NULL);
+	parsedb_cached(statusfile, statuscachefile,
+	               pdb_parse_status | parse_flags, NULL);
 
 	updateslength = -1;
 	cdn = scandir(updatesdir, &cdlist, update_file_filter, alphasort);
@@ -113,7 +117,8 @@ cleanupdates(void)
 		for (i = 0; i < cdn; i++) {
 			varbuf_rollback(&updatefn_state);
 			varbuf_add_str(&updatefn, cdlist[i]->d_name);
-			parsedb(updatefn.buf, pdb_parse_update, NULL);
+			parsedb(updatefn.buf, pdb_parse_update | parse_flags,
+			        NULL);
 		}
 
 		if (cstatus >= msdbrw_write) {
@@ -177,6 +182,9 @@ static const struct fni {
 	}, {
 		.suffix = STATUSFILE,
 		.store = &statusfile,
+	}, {
+		.suffix = STATUSCACHEFILE,
+		.store = &statuscachefile,
 	}, {
 		.suffix = AVAILFILE,
 		.store = &availablefile,
@@ -328,6 +336,16 @@ modstatdb_open(enum modstatdb_rw readwritereq)
 	cflags = readwritereq & msdbrw_available_mask;
 	readwritereq &= ~msdbrw_available_mask;
 
+	if (readwritereq & msdbrw_lazy_fields) {
+		readwritereq &= ~msdbrw_lazy_fields;
+		if (readwritereq != msdbrw_readonly ||
+		    cflags >= msdbrw_available_write)
+			internerr("lazy fields requested for a writable database");
+		parse_flags = pdb_lazy_fields;
+	} else {
+		parse_flags = 0;
+	}
+
 	switch (readwritereq) {
 	case msdbrw_needsuperuser:
 	case msdbrw_needsuperuserlockonly:
@@ -379,7 +397,8 @@ modstatdb_open(enum modstatdb_rw readwritereq)
 	if (cstatus != msdbrw_needsuperuserlockonly) {
 		cleanupdates();
 		if (cflags >= msdbrw_available_readonly)
-			parsedb(availablefile, pdb_parse_available, NULL);
+			parsedb(availablefile, pdb_parse_available | parse_flags,
+			        NULL);
 	}
 
 	if (cstatus >= msdbrw_write) {
@@ -425,6 +444,7 @@ modstatdb_checkpoint(void)
 	}
 
 	dir_sync_path(updatesdir);
+	updates_unsynced = false;
 
 	nextupdate = 0;
 }
@@ -486,7 +506,12 @@ modstatdb_note_core(struct pkginfo *pkg)
 		ohshite(_("cannot install updated status of '%s'"),
 		        pkg_name(pkg, pnaw_nonambig));
 
-	dir_sync_path(updatesdir);
+	/* The notes done from within another note get the sync of the
+	 * updates directory batched, see modstatdb_note(). */
+	if (note_nesting == 0)
+		dir_sync_path(updatesdir);
+	else
+		updates_unsynced = true;
 
 	/* Have we made a real mess? */
 	if (varbuf_rollback_len(&updatefn_state) > IMPORTANTMAXLEN)
@@ -549,8 +574,18 @@ modstatdb_note(struct pkginfo *pkg)
 		 * successfully recording the status of the package we were
 		 * pointed at by our caller, although there is some risk of
 		 * leaving us in a slightly odd situation which is cleared up
-		 * by the trigger handling logic in deppossi_ok_found. */
+		 * by the trigger handling logic in deppossi_ok_found.
+		 *
+		 * The update files for the awaiters are still written one per
+		 * package, but their directory gets synced once at the end. */
+		note_nesting++;
 		trig_clear_awaiters(pkg);
+		note_nesting--;
+
+		if (note_nesting == 0 && updates_unsynced) {
+			dir_sync_path(updatesdir);
+			updates_unsynced = false;
+		}
 	}
 
 	onerr_abort--;
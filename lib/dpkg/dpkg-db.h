@@ -107,6 +107,8 @@ enum pkgmultiarch {
 	PKG_MULTIARCH_FOREIGN,
 };
 
+struct pkg_lazy_field;
+
 /**
  * Node describing a binary package file.
  *
@@ -132,6 +134,8 @@ struct pkgbin {
 	struct dpkg_version version;
 	struct conffile *conffiles;
 	struct arbitraryfield *arbs;
+	/** The fields whose parsing has been deferred, see pkgbin_parse_lazy(). */
+	struct pkg_lazy_field *lazy;
 };
 
 /**
@@ -289,6 +293,9 @@ enum DPKG_ATTR_ENUM_FLAGS modstatdb_rw {
 	msdbrw_available_readonly	= DPKG_BIT(8),
 	msdbrw_available_write		= DPKG_BIT(9),
 	msdbrw_available_mask		= 0x0300,
+
+	/** Defer parsing the expensive fields, only for read-only access. */
+	msdbrw_lazy_fields		= DPKG_BIT(10),
 };
 
 void
@@ -387,18 +394,27 @@ enum DPKG_ATTR_ENUM_FLAGS parsedbflags {
 	pdb_dash_is_stdin		= DPKG_BIT(9),
 	/** Allow empty/missing files. */
 	pdb_allow_empty			= DPKG_BIT(10),
+	/** Keep the file data until the database is reset, and reference the
+	 * verbatim field values from it instead of copying them. */
+	pdb_zero_copy			= DPKG_BIT(11),
+	/** Keep the expensive fields unparsed until pkgbin_parse_lazy() gets
+	 * called, the reverse dependencies are not set up until then. Only
+	 * applies to values the binary cache records as parsing cleanly. */
+	pdb_lazy_fields			= DPKG_BIT(12),
 
 	/* Standard operations. */
 
 	pdb_parse_status	= pdb_lax_parser |
 				  pdb_weakclassification |
-				  pdb_allow_empty,
+				  pdb_allow_empty |
+				  pdb_zero_copy,
 	pdb_parse_update	= pdb_parse_status |
 				  pdb_single_stanza,
 	pdb_parse_available	= pdb_recordavailable |
 				  pdb_rejectstatus |
 				  pdb_lax_parser |
-				  pdb_allow_empty,
+				  pdb_allow_empty |
+				  pdb_zero_copy,
 	pdb_parse_binary	= pdb_recordavailable |
 				  pdb_rejectstatus |
 				  pdb_single_stanza,
@@ -414,11 +430,16 @@ find_arbfield_info(const struct arbitraryfield *arbs, const char *fieldname);
 
 int
 parsedb(const char *filename, enum parsedbflags, struct pkginfo **donep);
+int
+parsedb_cached(const char *filename, const char *cachefile,
+               enum parsedbflags flags, struct pkginfo **donep);
 void
 copy_dependency_links(struct pkginfo *pkg,
                       struct dependency **updateme,
                       struct dependency *newdepends,
                       bool available);
+void
+pkgbin_parse_lazy(struct pkginfo *pkg, struct pkgbin *pkgbin);
 
 /*** from parsehelp.c ***/
 
@@ -551,6 +572,12 @@ pkg_virtual_deppossi_satisfied(struct deppossi *dependee,
 
 /*** from nfmalloc.c ***/
 
+struct dpkg_arena;
+
+void
+nfmalloc_set_arena(struct dpkg_arena *arena);
+struct dpkg_arena *
+nfmalloc_get_arena(void);
 void *
 nfmalloc(size_t);
 char *
@@ -76,6 +76,9 @@ DPKG_BEGIN_DECLS
 #define TRIGGERSCIFILE     "triggers"
 
 #define STATUSFILE        "status"
+#define STATUSCACHEFILE   "status-cache"
+#define FILESCACHEFILE    "files-cache"
+#define VERIFYCACHEFILE   "verify-cache"
 #define AVAILFILE         "available"
 #define LOCKFILE          "lock"
 #define FRONTENDLOCKFILE  "lock-frontend"
@@ -95,6 +98,8 @@ DPKG_BEGIN_DECLS
 #define MAXUPDATES         250
 
 #define MD5HASHLEN           32
+#define SHA1HASHLEN          40
+#define SHA256HASHLEN        64
 #define MAXTRIGDIRECTIVE     256
 
 #define BACKEND		"dpkg-deb"
@@ -488,6 +488,10 @@ varbuf_stanza(struct varbuf *vb,
 	const struct fieldinfo *fip;
 	const struct arbitraryfield *afp;
 
+	if (pkgbin->lazy)
+		internerr("package %s has unparsed fields",
+		          pkgbin_name_const(pkg, pkgbin, pnaw_always));
+
 	for (fip = fieldinfos; fip->name; fip++) {
 		fip->wcall(vb, pkg, pkgbin, fw_printheader, fip);
 	}
@@ -175,7 +175,8 @@ f_charfield(struct pkginfo *pkg, struct pkgbin *pkgbin,
             const char *value, const struct fieldinfo *fip)
 {
 	if (*value)
-		STRUCTFIELD(pkgbin, fip->integer, char *) = nfstrsave(value);
+		STRUCTFIELD(pkgbin, fip->integer, const char *) =
+			parse_strsave(ps, value);
 }
 
 void
@@ -233,7 +234,7 @@ f_section(struct pkginfo *pkg, struct pkgbin *pkgbin,
 	if (!*value)
 		return;
 
-	pkg->section = nfstrsave(value);
+	pkg->section = parse_strsave(ps, value);
 }
 
 void
@@ -183,30 +183,35 @@ file_copy_perms(const char *src, const char *dst)
 
 static int
 file_slurp_fd(int fd, const char *filename, struct varbuf *vb,
-              struct dpkg_error *err)
+              struct stat *st, struct dpkg_error *err)
 {
-	struct stat st;
-
-	if (fstat(fd, &st) < 0)
+	if (fstat(fd, st) < 0)
 		return dpkg_put_errno(err, _("cannot stat %s"), filename);
 
-	if (!S_ISREG(st.st_mode))
+	if (!S_ISREG(st->st_mode))
 		return dpkg_put_error(err, _("%s is not a regular file"),
 		                      filename);
 
-	if (st.st_size == 0)
+	if (st->st_size == 0)
 		return 0;
 
-	varbuf_init(vb, st.st_size + 1);
-	if (fd_read(fd, vb->buf, st.st_size) < 0)
+	varbuf_init(vb, st->st_size + 1);
+	if (fd_read(fd, vb->buf, st->st_size) < 0)
 		return dpkg_put_errno(err, _("cannot read %s"), filename);
-	varbuf_trunc(vb, st.st_size);
+	varbuf_trunc(vb, st->st_size);
 
 	return 0;
 }
 
+/**
+ * Read the whole contents of a file, and return its metadata.
+ *
+ * The metadata is fetched from the same open file the contents are read
+ * from, so that they are guaranteed to match.
+ */
 int
-file_slurp(const char *filename, struct varbuf *vb, struct dpkg_error *err)
+file_slurp_stat(const char *filename, struct varbuf *vb, struct stat *st,
+                struct dpkg_error *err)
 {
 	int fd;
 	int rc;
@@ -217,13 +222,61 @@ file_slurp(const char *filename, struct varbuf *vb, struct dpkg_error *err)
 	if (fd < 0)
 		return dpkg_put_errno(err, _("cannot open %s"), filename);
 
-	rc = file_slurp_fd(fd, filename, vb, err);
+	rc = file_slurp_fd(fd, filename, vb, st, err);
 
 	(void)close(fd);
 
 	return rc;
 }
 
+int
+file_slurp(const char *filename, struct varbuf *vb, struct dpkg_error *err)
+{
+	struct stat st;
+
+	return file_slurp_stat(filename, vb, &st, err);
+}
+
+#define NSEC_PER_SEC	1000000000LL
+
+/**
+ * Return the modification time of a file, in nanoseconds.
+ *
+ * If the system does not provide sub-second timestamps, this has a one
+ * second granularity.
+ */
+int64_t
+file_stat_mtime_nsec(const struct stat *st)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+	return st->st_mtim.tv_sec * NSEC_PER_SEC + st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+	return st->st_mtimespec.tv_sec * NSEC_PER_SEC +
+	       st->st_mtimespec.tv_nsec;
+#else
+	return st->st_mtime * NSEC_PER_SEC;
+#endif
+}
+
+/**
+ * Return the status change time of a file, in nanoseconds.
+ *
+ * If the system does not provide sub-second timestamps, this has a one
+ * second granularity.
+ */
+int64_t
+file_stat_ctime_nsec(const struct stat *st)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+	return st->st_ctim.tv_sec * NSEC_PER_SEC + st->st_ctim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+	return st->st_ctimespec.tv_sec * NSEC_PER_SEC +
+	       st->st_ctimespec.tv_nsec;
+#else
+	return st->st_ctime * NSEC_PER_SEC;
+#endif
+}
+
 static void
 file_lock_setup(struct flock *fl, short type)
 {
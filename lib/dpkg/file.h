@@ -22,8 +22,10 @@
 #define LIBDPKG_FILE_H
 
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <dpkg/macros.h>
 #include <dpkg/error.h>
@@ -68,6 +70,14 @@ file_copy_perms(const char *src, const char *dst);
 
 int
 file_slurp(const char *filename, struct varbuf *vb, struct dpkg_error *err);
+int
+file_slurp_stat(const char *filename, struct varbuf *vb, struct stat *st,
+                struct dpkg_error *err);
+
+int64_t
+file_stat_mtime_nsec(const struct stat *st);
+int64_t
+file_stat_ctime_nsec(const struct stat *st);
 
 enum file_lock_flags {
 	FILE_LOCK_NOWAIT,
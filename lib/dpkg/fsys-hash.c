@@ -23,6 +23,7 @@
 #include <config.h>
 #include <compat.h>
 
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -33,34 +34,94 @@
 
 #include "fsys.h"
 
-/* This must always be a prime for optimal performance.
- * This is the closest one to 2^18 (262144). */
-#define BINS 262139
+/*
+ * The hash table uses open addressing with linear probing, where each slot
+ * stores the full hash and the length of the name besides the node, so
+ * that most mismatches can be rejected without touching the node. The
+ * table grows by doubling its size when reaching the maximum load factor,
+ * without needing to rehash the names.
+ *
+ * The nodes are also linked in insertion order, which is the order used by
+ * the iterator, so that it does not depend on the table size.
+ */
+
+/* This must always be a power of two. */
+#define FSYS_HASH_SIZE_MIN	4096
+/* Maximum load factor, in percent. */
+#define FSYS_HASH_LOAD_MAX	70
+
+struct fsys_hash_slot {
+	uint32_t hash;
+	uint32_t namelen;
+	struct fsys_namenode *node;
+};
 
-static struct fsys_namenode *bins[BINS];
+static struct fsys_hash_slot *slots;
+static size_t nslots = 0;
 static int nfiles = 0;
 
+static struct fsys_namenode *nodes_head = NULL;
+static struct fsys_namenode **nodes_tail = &nodes_head;
+
+static inline size_t
+fsys_hash_slot_index(uint32_t hash)
+{
+	/* Mix the upper bits in, as we only use the lower ones. */
+	return (hash ^ (hash >> 16)) & (nslots - 1);
+}
+
+static void
+fsys_hash_resize(size_t size)
+{
+	struct fsys_hash_slot *old_slots = slots;
+	size_t old_nslots = nslots;
+	size_t i;
+
+	slots = m_calloc(size, sizeof(*slots));
+	nslots = size;
+
+	for (i = 0; i < old_nslots; i++) {
+		size_t n;
+
+		if (old_slots[i].node == NULL)
+			continue;
+
+		n = fsys_hash_slot_index(old_slots[i].hash);
+		while (slots[n].node)
+			n = (n + 1) & (nslots - 1);
+		slots[n] = old_slots[i];
+	}
+
+	free(old_slots);
+}
+
 void
 fsys_hash_init(void)
 {
-	struct fsys_namenode *fnn;
-	int i;
+	size_t i;
+
+	for (i = 0; i < nslots; i++) {
+		struct fsys_namenode *fnn = slots[i].node;
+
+		if (fnn == NULL)
+			continue;
 
-	for (i = 0; i < BINS; i++) {
-		for (fnn = bins[i]; fnn; fnn = fnn->next) {
-			fnn->flags = 0;
-			fnn->oldhash = NULL;
-			fnn->newhash = NULL;
-			fnn->file_ondisk_id = NULL;
-		}
+		fnn->flags = 0;
+		fnn->oldhash = NULL;
+		fnn->newhash = NULL;
+		fnn->file_ondisk_id = NULL;
 	}
 }
 
 void
 fsys_hash_reset(void)
 {
-	memset(bins, 0, sizeof(bins));
+	free(slots);
+	slots = NULL;
+	nslots = 0;
 	nfiles = 0;
+	nodes_head = NULL;
+	nodes_tail = &nodes_head;
 }
 
 int
@@ -72,97 +133,197 @@ fsys_hash_entries(void)
 struct fsys_namenode *
 fsys_hash_find_node(const char *name, enum fsys_hash_find_flags flags)
 {
-	struct fsys_namenode **pointerp, *newnode;
+	struct fsys_namenode *newnode;
 	const char *orig_name = name;
+	uint32_t hash;
+	size_t namelen;
+	size_t n;
 
 	/* We skip initial slashes and ‘./’ pairs, and add our own single
 	 * leading slash. */
 	name = path_skip_slash_dotslash(name);
 
-	pointerp = bins + (str_fnv_hash(name) % (BINS));
-	while (*pointerp) {
+	hash = str_fnv_hash(name);
+	namelen = strlen(name);
+
+	if (nslots == 0)
+		fsys_hash_resize(FSYS_HASH_SIZE_MIN);
+
+	for (n = fsys_hash_slot_index(hash); slots[n].node;
+	     n = (n + 1) & (nslots - 1)) {
+		struct fsys_namenode *fnn = slots[n].node;
+
+		if (slots[n].hash != hash || slots[n].namelen != namelen)
+			continue;
+
 		/* XXX: This should not be needed, but it has been a constant
 		 * source of assertions over the years. Hopefully with the
 		 * internerr() we will get better diagnostics. */
-		if ((*pointerp)->name[0] != '/')
+		if (fnn->name[0] != '/')
 			internerr("filename node '%s' does not start with '/'",
-			          (*pointerp)->name);
+			          fnn->name);
 
-		if (strcmp((*pointerp)->name + 1, name) == 0)
-			return *pointerp;
-
-		pointerp = &(*pointerp)->next;
+		if (memcmp(fnn->name + 1, name, namelen) == 0)
+			return fnn;
 	}
 
 	if (flags & FHFF_NO_NEW)
 		return NULL;
 
-	newnode = nfmalloc(sizeof(*newnode));
-	memset(newnode, 0, sizeof(*newnode));
 	if ((flags & FHFF_NO_COPY) && name > orig_name && name[-1] == '/') {
+		newnode = nfmalloc(sizeof(*newnode));
+		memset(newnode, 0, sizeof(*newnode));
 		newnode->name = name - 1;
 	} else {
-		char *newname = nfmalloc(strlen(name) + 2);
+		char *newname;
 
+		/* Allocate the name right after the node, for locality. */
+		newnode = nfmalloc(sizeof(*newnode) + namelen + 2);
+		memset(newnode, 0, sizeof(*newnode));
+		newname = (char *)(newnode + 1);
 		newname[0] = '/';
-		strcpy(newname + 1, name);
+		memcpy(newname + 1, name, namelen + 1);
 		newnode->name = newname;
 	}
-	*pointerp = newnode;
+
+	slots[n].hash = hash;
+	slots[n].namelen = namelen;
+	slots[n].node = newnode;
 	nfiles++;
 
+	*nodes_tail = newnode;
+	nodes_tail = &newnode->next;
+
+	if ((size_t)nfiles * 100 >= nslots * FSYS_HASH_LOAD_MAX)
+		fsys_hash_resize(nslots * 2);
+
 	return newnode;
 }
 
 void
 fsys_hash_report(FILE *file)
 {
-	struct fsys_namenode *node;
-	int i, c;
+	size_t i;
 	int *freq;
-	int empty = 0, used = 0, collided = 0;
-
-	freq = m_malloc(sizeof(freq[0]) * nfiles + 1);
-	for (i = 0; i <= nfiles; i++)
-		freq[i] = 0;
-	for (i = 0; i < BINS; i++) {
-		for (c = 0, node = bins[i]; node; c++, node = node->next)
-			;
-		fprintf(file, "fsys-hash: bin %5d has %7d\n", i, c);
-
-		if (c == 0) {
-			empty++;
-		} else if (c == 1) {
-			used++;
-		} else {
-			used++;
-			collided++;
-		}
-		freq[c]++;
+	int used = 0, displaced = 0;
+	int probe_max = 0;
+	long probes = 0;
+
+	freq = m_calloc(nfiles + 1, sizeof(freq[0]));
+	for (i = 0; i < nslots; i++) {
+		size_t home;
+		int dist;
+
+		if (slots[i].node == NULL)
+			continue;
+
+		home = fsys_hash_slot_index(slots[i].hash);
+		dist = (i - home) & (nslots - 1);
+
+		used++;
+		if (dist > 0)
+			displaced++;
+		if (dist > probe_max)
+			probe_max = dist;
+		probes += dist + 1;
+		freq[dist]++;
 	}
-	for (i = nfiles; i > 0 && freq[i] == 0; i--)
-		;
-	while (i >= 0) {
-		fprintf(file, "fsys-hash: size %7d occurs %5d times\n",
-		        i, freq[i]);
-		i--;
-	}
-	fprintf(file, "fsys-hash: bins empty %d\n", empty);
-	fprintf(file, "fsys-hash: bins used %d (collided %d)\n", used,
-	        collided);
+	for (i = 0; i <= (size_t)probe_max; i++)
+		fprintf(file, "fsys-hash: probe length %7zu occurs %7d times\n",
+		        i + 1, freq[i]);
+	fprintf(file, "fsys-hash: slots %zu (%zu bytes)\n",
+	        nslots, nslots * sizeof(*slots));
+	fprintf(file, "fsys-hash: slots used %d (displaced %d)\n",
+	        used, displaced);
+	fprintf(file, "fsys-hash: load factor %.2f\n",
+	        nslots ? (double)used / nslots : 0.0);
+	fprintf(file, "fsys-hash: probe length average %.2f, max %d\n",
+	        used ? (double)probes / used : 0.0, probe_max + 1);
 
 	m_output(file, "<hash report>");
 
 	free(freq);
 }
 
+/*
+ * Output order.
+ *
+ * The database files and the command output listing nodes follow the order
+ * of the chained hash table with a fixed number of bins used before, with
+ * the nodes in the same bin in insertion order, so that they do not change
+ * depending on the table implementation.
+ */
+
+/* This was the closest prime to 2^18 (262144). */
+#define FSYS_HASH_OUTPUT_BINS	262139
+
+struct fsys_hash_sort_node {
+	uint32_t bin;
+	int seq;
+	struct fsys_namenode *node;
+};
+
+static int
+fsys_hash_sort_node_cmp(const void *a, const void *b)
+{
+	const struct fsys_hash_sort_node *na = a;
+	const struct fsys_hash_sort_node *nb = b;
+
+	if (na->bin < nb->bin)
+		return -1;
+	if (na->bin > nb->bin)
+		return 1;
+
+	return na->seq - nb->seq;
+}
+
+/**
+ * Sort nodes in output order.
+ *
+ * The nodes are expected to be in insertion order, which is kept for the
+ * nodes in the same bin.
+ *
+ * @param nodes The array of nodes to sort.
+ * @param nnodes The number of nodes in the array.
+ */
+void
+fsys_hash_sort_nodes(struct fsys_namenode **nodes, int nnodes)
+{
+	struct fsys_hash_sort_node *snodes;
+	int i;
+
+	if (nnodes < 2)
+		return;
+
+	snodes = m_malloc(sizeof(*snodes) * nnodes);
+	for (i = 0; i < nnodes; i++) {
+		snodes[i].bin = str_fnv_hash(nodes[i]->name + 1) %
+		                FSYS_HASH_OUTPUT_BINS;
+		snodes[i].seq = i;
+		snodes[i].node = nodes[i];
+	}
+
+	qsort(snodes, nnodes, sizeof(*snodes), fsys_hash_sort_node_cmp);
+
+	for (i = 0; i < nnodes; i++)
+		nodes[i] = snodes[i].node;
+	free(snodes);
+}
+
 /*
  * Forward iterator.
+ *
+ * The nodes are returned in insertion order, including the nodes added
+ * while iterating, even after having reached the end. The sorted iterator
+ * returns the nodes in output order instead, from a snapshot taken when
+ * creating it, so the nodes added while iterating are not returned.
  */
 
 struct fsys_hash_iter {
-	struct fsys_namenode *namenode;
-	int nbinn;
+	struct fsys_namenode *last;
+	struct fsys_namenode **nodes;
+	int nnodes;
+	int nnode;
 };
 
 struct fsys_hash_iter *
@@ -171,8 +332,26 @@ fsys_hash_iter_new(void)
 	struct fsys_hash_iter *iter;
 
 	iter = m_malloc(sizeof(*iter));
-	iter->namenode = NULL;
-	iter->nbinn = 0;
+	iter->last = NULL;
+	iter->nodes = NULL;
+	iter->nnodes = 0;
+	iter->nnode = 0;
+
+	return iter;
+}
+
+struct fsys_hash_iter *
+fsys_hash_iter_new_sorted(void)
+{
+	struct fsys_hash_iter *iter;
+	struct fsys_namenode *fnn;
+
+	iter = fsys_hash_iter_new();
+	iter->nodes = m_malloc(sizeof(*iter->nodes) * (nfiles + 1));
+	for (fnn = nodes_head; fnn; fnn = fnn->next)
+		iter->nodes[iter->nnodes++] = fnn;
+
+	fsys_hash_sort_nodes(iter->nodes, iter->nnodes);
 
 	return iter;
 }
@@ -180,16 +359,23 @@ fsys_hash_iter_new(void)
 struct fsys_namenode *
 fsys_hash_iter_next(struct fsys_hash_iter *iter)
 {
-	struct fsys_namenode *fnn = NULL;
+	struct fsys_namenode *fnn;
 
-	while (!iter->namenode) {
-		if (iter->nbinn >= BINS)
+	if (iter->nodes) {
+		if (iter->nnode >= iter->nnodes)
 			return NULL;
 
-		iter->namenode = bins[iter->nbinn++];
+		return iter->nodes[iter->nnode++];
 	}
-	fnn = iter->namenode;
-	iter->namenode = fnn->next;
+
+	/* Resume from the last returned node, so that we do not miss any
+	 * node appended after having reached the end. */
+	if (iter->last)
+		fnn = iter->last->next;
+	else
+		fnn = nodes_head;
+	if (fnn)
+		iter->last = fnn;
 
 	return fnn;
 }
@@ -197,5 +383,6 @@ fsys_hash_iter_next(struct fsys_hash_iter *iter)
 void
 fsys_hash_iter_free(struct fsys_hash_iter *iter)
 {
+	free(iter->nodes);
 	free(iter);
 }
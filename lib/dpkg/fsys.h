@@ -85,6 +85,8 @@ enum DPKG_ATTR_ENUM_FLAGS fsys_namenode_flags {
 	FNNF_FILTERED			= DPKG_BIT(9),
 	/** Conffile removal requested by upgrade. */
 	FNNF_RM_CONFF_ON_UPGRADE	= DPKG_BIT(10),
+	/** New file contents are pending to be written. */
+	FNNF_DEFERRED_WRITE		= DPKG_BIT(11),
 };
 
 /**
@@ -182,9 +184,14 @@ fsys_hash_report(FILE *file);
 int
 fsys_hash_entries(void);
 
+void
+fsys_hash_sort_nodes(struct fsys_namenode **nodes, int nnodes);
+
 struct fsys_hash_iter;
 struct fsys_hash_iter *
 fsys_hash_iter_new(void);
+struct fsys_hash_iter *
+fsys_hash_iter_new_sorted(void);
 struct fsys_namenode *
 fsys_hash_iter_next(struct fsys_hash_iter *iter);
 void
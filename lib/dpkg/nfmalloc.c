@@ -21,71 +21,74 @@
 #include <config.h>
 #include <compat.h>
 
-#include <string.h>
-#include <stdlib.h>
-#include <obstack.h>
-
 #include <dpkg/i18n.h>
 #include <dpkg/dpkg.h>
 #include <dpkg/dpkg-db.h>
+#include <dpkg/arena.h>
 
-#define obstack_chunk_alloc m_malloc
-#define obstack_chunk_free free
-
-static struct obstack db_obs;
-static bool dbobs_init = false;
+static struct dpkg_arena *nf_arena_default;
+static struct dpkg_arena *nf_arena;
 
-/* We use lots of mem, so use a large chunk. */
-#define CHUNK_SIZE 8192
+static struct dpkg_arena *
+nfarena(void)
+{
+	if (nf_arena)
+		return nf_arena;
+	if (nf_arena_default == NULL)
+		nf_arena_default = dpkg_arena_new();
+	return nf_arena_default;
+}
 
-#define OBSTACK_INIT \
-	do { \
-		if (!dbobs_init) \
-			nfobstack_init(); \
-	} while (0)
+/**
+ * Set the arena to use for the non-freeing allocations.
+ *
+ * This covers the in-core database, that is the package and files
+ * databases and the parsed data hanging from them. The arena is owned by
+ * the caller, and nffreeall() will reset it instead of freeing it, so that
+ * the database can be reloaded with bounded memory usage.
+ *
+ * @param arena The arena to use, or NULL to use the internal default one.
+ */
+void
+nfmalloc_set_arena(struct dpkg_arena *arena)
+{
+	nf_arena = arena;
+}
 
-static void
-nfobstack_init(void)
+/**
+ * Get the arena used for the non-freeing allocations.
+ */
+struct dpkg_arena *
+nfmalloc_get_arena(void)
 {
-	obstack_init(&db_obs);
-	dbobs_init = true;
-	obstack_chunk_size(&db_obs) = CHUNK_SIZE;
+	return nfarena();
 }
 
 void *
 nfmalloc(size_t size)
 {
-	OBSTACK_INIT;
-	/* cppcheck-suppress[nullPointerArithmetic]:
-	 * False positive, imported module. */
-	return obstack_alloc(&db_obs, size);
+	return dpkg_arena_alloc(nfarena(), size);
 }
 
 char *
 nfstrsave(const char *string)
 {
-	OBSTACK_INIT;
-	/* cppcheck-suppress[nullPointerArithmetic]:
-	 * False positive, imported module. */
-	return obstack_copy0(&db_obs, string, strlen(string));
+	return dpkg_arena_strdup(nfarena(), string);
 }
 
 char *
 nfstrnsave(const char *string, size_t size)
 {
-	OBSTACK_INIT;
-	/* cppcheck-suppress[nullPointerArithmetic]:
-	 * False positive, imported module. */
-	return obstack_copy0(&db_obs, string, size);
+	return dpkg_arena_strndup(nfarena(), string, size);
 }
 
 void
 nffreeall(void)
 {
-	if (dbobs_init) {
-		/* cppcheck-suppress[nullPointerArithmetic,pointerLessThanZero]:
-		 * False positive, imported module. */
-		obstack_free(&db_obs, NULL);
-		dbobs_init = false;
+	if (nf_arena) {
+		dpkg_arena_reset(nf_arena);
+	} else {
+		dpkg_arena_free(nf_arena_default);
+		nf_arena_default = NULL;
 	}
 }
@@ -0,0 +1,425 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * parse-cache.c - binary database file cache
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef USE_MMAP
+#include <sys/mman.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dpkg/macros.h>
+#include <dpkg/i18n.h>
+#include <dpkg/dpkg.h>
+#include <dpkg/dpkg-db.h>
+#include <dpkg/string.h>
+#include <dpkg/debug.h>
+#include <dpkg/fdio.h>
+#include <dpkg/file.h>
+#include <dpkg/parsedump.h>
+
+/*
+ * The cache contains the deb822 stanzas already split into fields, so that
+ * replaying them avoids the character based scanner and the field name
+ * lookups. The field values are stored NUL-terminated, so that they can be
+ * passed directly to the field parsers.
+ *
+ * The file is host specific, and it is keyed on the identity of the deb822
+ * file it was generated from, so any change to it will make the cache stale.
+ *
+ * Layout: a header, followed by a sequence of records, each one a field
+ * record or an end of stanza record, each aligned to PARSE_CACHE_ALIGN.
+ */
+
+#define PARSE_CACHE_MAGIC	"dpkgdbc"
+#define PARSE_CACHE_VERSION	3
+#define PARSE_CACHE_BYTEORDER	0x01020304
+#define PARSE_CACHE_ALIGN	4
+
+/* Special field indices. */
+#define PARSE_CACHE_FIELD_ARBITRARY	-1
+#define PARSE_CACHE_STANZA_END		-2
+
+/* Record flags. */
+#define PARSE_CACHE_FIELD_PROBLEMS	DPKG_BIT(0)
+
+struct parse_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	/* Fingerprint of the fieldinfos table the indices refer to. */
+	uint32_t fieldinfos_hash;
+	uint32_t pad;
+	/* Identity of the deb822 file. */
+	uint64_t db_dev;
+	uint64_t db_ino;
+	uint64_t db_size;
+	/* In nanoseconds, to catch rewrites within the same second. */
+	int64_t db_mtime;
+	int64_t db_ctime;
+	/* Size of the record data following the header. */
+	uint64_t data_size;
+};
+
+struct parse_cache_record {
+	int32_t fieldidx;
+	uint32_t lno;
+	uint32_t namelen;
+	uint32_t valuelen;
+	uint32_t flags;
+};
+
+static int
+parse_cache_fieldinfos_count(void)
+{
+	const struct fieldinfo *fip;
+
+	for (fip = fieldinfos; fip->name; fip++)
+		;
+
+	return fip - fieldinfos;
+}
+
+static uint32_t
+parse_cache_fieldinfos_hash(void)
+{
+	const struct fieldinfo *fip;
+	uint32_t hash = 0;
+
+	for (fip = fieldinfos; fip->name; fip++)
+		hash = hash * 31 + str_fnv_hash(fip->name);
+
+	return hash;
+}
+
+static void
+parse_cache_init_header(struct parse_cache_header *hdr, const struct stat *st)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, PARSE_CACHE_MAGIC, sizeof(hdr->magic));
+	hdr->version = PARSE_CACHE_VERSION;
+	hdr->byteorder = PARSE_CACHE_BYTEORDER;
+	hdr->fieldinfos_hash = parse_cache_fieldinfos_hash();
+	hdr->db_dev = st->st_dev;
+	hdr->db_ino = st->st_ino;
+	hdr->db_size = st->st_size;
+	hdr->db_mtime = file_stat_mtime_nsec(st);
+	hdr->db_ctime = file_stat_ctime_nsec(st);
+}
+
+static void
+parse_cache_add_record(struct varbuf *rec, int fieldidx, int lno,
+                       const char *name, size_t namelen,
+                       const char *value, size_t valuelen, uint32_t flags)
+{
+	struct parse_cache_record r;
+	size_t pad;
+
+	r.fieldidx = fieldidx;
+	r.lno = lno;
+	r.namelen = namelen;
+	r.valuelen = valuelen;
+	r.flags = flags;
+
+	varbuf_add_buf(rec, &r, sizeof(r));
+	varbuf_add_buf(rec, name, namelen);
+	varbuf_add_char(rec, '\0');
+	varbuf_add_buf(rec, value, valuelen);
+	varbuf_add_char(rec, '\0');
+
+	pad = (PARSE_CACHE_ALIGN - (rec->used % PARSE_CACHE_ALIGN)) %
+	      PARSE_CACHE_ALIGN;
+	while (pad--)
+		varbuf_add_char(rec, '\0');
+}
+
+/**
+ * Record a parsed field into the cache being generated.
+ *
+ * Whether parsing the field emitted any warning or error is recorded too,
+ * so that only values known to be clean get their parsing deferred when
+ * replaying the cache.
+ */
+void
+parsedb_cache_add_field(struct varbuf *rec, int lno,
+                        const struct field_state *fs, bool problems)
+{
+	uint32_t flags = problems ? PARSE_CACHE_FIELD_PROBLEMS : 0;
+
+	if (fs->fieldidx < 0)
+		parse_cache_add_record(rec, PARSE_CACHE_FIELD_ARBITRARY, lno,
+		                       fs->fieldstart, fs->fieldlen,
+		                       fs->valuestart, fs->valuelen, flags);
+	else
+		parse_cache_add_record(rec, fs->fieldidx, lno, NULL, 0,
+		                       fs->valuestart, fs->valuelen, flags);
+}
+
+/**
+ * Record the end of a parsed stanza into the cache being generated.
+ */
+void
+parsedb_cache_add_stanza(struct varbuf *rec, int lno)
+{
+	parse_cache_add_record(rec, PARSE_CACHE_STANZA_END, lno,
+	                       NULL, 0, NULL, 0, 0);
+}
+
+/**
+ * Get the next record from the cache data.
+ *
+ * The data must have been validated, so that we can trust its contents.
+ */
+static const char *
+parse_cache_get_record(const char *ptr, struct parse_cache_record *r,
+                       const char **name, const char **value)
+{
+	size_t len;
+
+	memcpy(r, ptr, sizeof(*r));
+	ptr += sizeof(*r);
+
+	*name = ptr;
+	*value = ptr + r->namelen + 1;
+
+	len = sizeof(*r) + r->namelen + 1 + r->valuelen + 1;
+	len = (len + PARSE_CACHE_ALIGN - 1) & ~(size_t)(PARSE_CACHE_ALIGN - 1);
+
+	return ptr - sizeof(*r) + len;
+}
+
+static bool
+parse_cache_validate(const char *data, const char *end)
+{
+	int32_t nfields = parse_cache_fieldinfos_count();
+	bool in_stanza = false;
+
+	while (data < end) {
+		struct parse_cache_record r;
+		const char *name, *value;
+
+		if ((size_t)(end - data) < sizeof(r))
+			return false;
+		memcpy(&r, data, sizeof(r));
+		if (r.namelen >= (size_t)(end - data) ||
+		    r.valuelen >= (size_t)(end - data))
+			return false;
+
+		data = parse_cache_get_record(data, &r, &name, &value);
+		if (data > end)
+			return false;
+		if (name[r.namelen] != '\0' || value[r.valuelen] != '\0')
+			return false;
+
+		if (r.fieldidx == PARSE_CACHE_STANZA_END) {
+			if (!in_stanza)
+				return false;
+			in_stanza = false;
+		} else if (r.fieldidx == PARSE_CACHE_FIELD_ARBITRARY) {
+			if (r.namelen == 0)
+				return false;
+			in_stanza = true;
+		} else if (r.fieldidx >= 0 && r.fieldidx < nfields) {
+			in_stanza = true;
+		} else {
+			return false;
+		}
+	}
+
+	return !in_stanza;
+}
+
+/**
+ * Open the binary cache for a deb822 file.
+ *
+ * @return The parser context, or NULL if there is no usable cache.
+ */
+struct parsedb_state *
+parsedb_cache_open(const char *filename, const char *cachefile,
+                   enum parsedbflags flags)
+{
+	struct parsedb_state *ps;
+	struct parse_cache_header hdr, ref;
+	struct stat st;
+	char *data;
+	size_t size;
+	int fd;
+
+	if (stat(filename, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+		return NULL;
+
+	fd = open(cachefile, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	parse_cache_init_header(&ref, &st);
+
+	if (fd_read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    memcmp(&hdr, &ref, offsetof(struct parse_cache_header, data_size)) ||
+	    hdr.data_size == 0 ||
+	    fstat(fd, &st) < 0 ||
+	    (uint64_t)st.st_size != sizeof(hdr) + hdr.data_size) {
+		debug(dbg_general, "parse-cache: stale cache %s for %s",
+		      cachefile, filename);
+		close(fd);
+		return NULL;
+	}
+
+	size = st.st_size;
+#ifdef USE_MMAP
+	data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+#else
+	data = m_malloc(size);
+	if (fd_read(fd, data + sizeof(hdr), hdr.data_size) != (ssize_t)hdr.data_size) {
+		free(data);
+		close(fd);
+		return NULL;
+	}
+#endif
+
+	if (!parse_cache_validate(data + sizeof(hdr), data + size)) {
+		debug(dbg_general, "parse-cache: corrupt cache %s for %s",
+		      cachefile, filename);
+#ifdef USE_MMAP
+		munmap(data, size);
+#else
+		free(data);
+#endif
+		close(fd);
+		return NULL;
+	}
+
+	ps = parsedb_new(filename, fd, flags | pdb_close_fd);
+	ps->cache_replay = true;
+	ps->data = data;
+	ps->dataptr = data + sizeof(hdr);
+	ps->endptr = data + size;
+
+	push_cleanup(cu_closefd, ~ehflag_normaltidy, 1, &ps->fd);
+
+	return ps;
+}
+
+/**
+ * Replay a deb822 stanza from the binary cache.
+ */
+bool
+parsedb_cache_stanza(struct parsedb_state *ps, struct field_state *fs,
+                     parse_field_func *parse_field, void *parse_obj)
+{
+	if (parse_at_eof(ps))
+		return false;
+
+	for (;;) {
+		struct parse_cache_record r;
+		const char *name, *value;
+
+		ps->dataptr = (char *)parse_cache_get_record(ps->dataptr, &r,
+		                                             &name, &value);
+		ps->lno = r.lno;
+
+		if (r.fieldidx == PARSE_CACHE_STANZA_END)
+			break;
+
+		if (r.fieldidx == PARSE_CACHE_FIELD_ARBITRARY) {
+			fs->fieldidx = -1;
+			fs->fieldstart = name;
+			fs->fieldlen = r.namelen;
+		} else {
+			fs->fieldidx = r.fieldidx;
+			fs->fieldstart = fieldinfos[r.fieldidx].name;
+			fs->fieldlen = fieldinfos[r.fieldidx].namelen;
+		}
+		fs->valuestart = value;
+		fs->valuelen = r.valuelen;
+		fs->value_checked = !(r.flags & PARSE_CACHE_FIELD_PROBLEMS);
+
+		parse_field(ps, fs, parse_obj);
+	}
+
+	return true;
+}
+
+/**
+ * Write the binary cache for the deb822 file being parsed.
+ *
+ * The cache is only an optimization, so any failure is silently ignored,
+ * which covers the common case of not having write access to the database
+ * directory. The new cache is atomically put in place, so that concurrent
+ * readers never see partial contents.
+ */
+void
+parsedb_cache_write(struct parsedb_state *ps, const char *cachefile,
+                    struct varbuf *rec)
+{
+	struct parse_cache_header hdr;
+	struct stat st;
+	char *cachefile_new;
+	int fd;
+
+	if (rec->used == 0 || fstat(ps->fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return;
+
+	parse_cache_init_header(&hdr, &st);
+	hdr.data_size = rec->used;
+
+	cachefile_new = str_fmt("%s-new.XXXXXX", cachefile);
+	fd = mkstemp(cachefile_new);
+	if (fd < 0) {
+		debug(dbg_general, "parse-cache: cannot create %s: %s",
+		      cachefile_new, strerror(errno));
+		free(cachefile_new);
+		return;
+	}
+
+	if (fchmod(fd, 0644) < 0 ||
+	    fd_write(fd, &hdr, sizeof(hdr)) < 0 ||
+	    fd_write(fd, rec->buf, rec->used) < 0 ||
+	    fsync(fd) < 0) {
+		close(fd);
+		goto fail;
+	}
+	if (close(fd) < 0 || rename(cachefile_new, cachefile) < 0)
+		goto fail;
+
+	free(cachefile_new);
+	return;
+
+fail:
+	debug(dbg_general, "parse-cache: cannot write %s: %s",
+	      cachefile, strerror(errno));
+	unlink(cachefile_new);
+	free(cachefile_new);
+}
@@ -106,6 +106,44 @@ struct pkg_parse_object {
 	struct pkgbin *pkgbin;
 };
 
+/**
+ * Return whether the field parsing can be deferred with pdb_lazy_fields.
+ *
+ * These are the fields that build many objects per value, and which the
+ * read-only queries rarely need.
+ */
+bool
+parse_field_is_lazy(const struct fieldinfo *fip)
+{
+	return fip->rcall == f_dependency || fip->rcall == f_conffiles;
+}
+
+/**
+ * Keep the field value to be parsed by pkgbin_parse_lazy().
+ */
+static void
+pkg_parse_field_defer(struct parsedb_state *ps, struct pkgbin *pkgbin,
+                      const struct fieldinfo *fip, const char *value)
+{
+	struct pkg_lazy_field *lazy, **lazyp;
+
+	if (ps->lazy_filename == NULL)
+		ps->lazy_filename = nfstrsave(ps->filename);
+
+	lazy = nfmalloc(sizeof(*lazy));
+	lazy->next = NULL;
+	lazy->fip = fip;
+	lazy->value = ps->data_inplace ? value : nfstrsave(value);
+	lazy->filename = ps->lazy_filename;
+	lazy->flags = ps->flags & ~pdb_close_fd;
+	lazy->lno = ps->lno;
+
+	/* Keep the field order, so that the dependencies end up the same. */
+	for (lazyp = &pkgbin->lazy; *lazyp; lazyp = &(*lazyp)->next)
+		;
+	*lazyp = lazy;
+}
+
 /**
  * Parse the field and value into the package being constructed.
  */
@@ -115,22 +153,51 @@ pkg_parse_field(struct parsedb_state *ps, struct field_state *fs,
 {
 	struct pkg_parse_object *pkg_obj = parse_obj;
 	const struct fieldinfo *fip;
+	int problems = ps->problems;
 	int *ip;
 
-	for (fip = fieldinfos, ip = fs->fieldencountered; fip->name; fip++, ip++)
-		if (fip->namelen == (size_t)fs->fieldlen &&
-		    strncasecmp(fip->name, fs->fieldstart, fs->fieldlen) == 0)
-			break;
+	if (fs->fieldidx < 0) {
+		for (fip = fieldinfos; fip->name; fip++)
+			if (fip->namelen == (size_t)fs->fieldlen &&
+			    strncasecmp(fip->name, fs->fieldstart, fs->fieldlen) == 0)
+				break;
+		if (fip->name)
+			fs->fieldidx = fip - fieldinfos;
+	} else {
+		fip = &fieldinfos[fs->fieldidx];
+	}
 
 	if (fip->name) {
+		const char *value;
+
+		ip = &fs->fieldencountered[fs->fieldidx];
 		if ((*ip)++)
 			parse_error(ps,
 			            _("duplicate value for '%s' field"),
 			            fip->name);
 
-		varbuf_set_buf(&fs->value, fs->valuestart, fs->valuelen);
+		/* The binary cache contains already NUL-terminated values. */
+		if (ps->cache_replay) {
+			value = fs->valuestart;
+		} else if (ps->data_inplace) {
+			/* The value is followed by the newline or trailing
+			 * spaces, which we can overwrite. */
+			char *value_inplace = (char *)fs->valuestart;
+
+			value_inplace[fs->valuelen] = '\0';
+			value = value_inplace;
+		} else {
+			varbuf_set_buf(&fs->value, fs->valuestart, fs->valuelen);
+			value = fs->value.buf;
+		}
 
-		fip->rcall(pkg_obj->pkg, pkg_obj->pkgbin, ps, fs->value.buf, fip);
+		/* Only defer values known to parse without problems, so that
+		 * these do not go unreported. */
+		if ((ps->flags & pdb_lazy_fields) && fs->value_checked &&
+		    parse_field_is_lazy(fip))
+			pkg_parse_field_defer(ps, pkg_obj->pkgbin, fip, value);
+		else
+			fip->rcall(pkg_obj->pkg, pkg_obj->pkgbin, ps, value, fip);
 	} else {
 		struct arbitraryfield *arp, **larpp;
 
@@ -151,11 +218,27 @@ pkg_parse_field(struct parsedb_state *ps, struct field_state *fs,
 		}
 
 		arp = nfmalloc(sizeof(*arp));
-		arp->name = nfstrnsave(fs->fieldstart, fs->fieldlen);
-		arp->value = nfstrnsave(fs->valuestart, fs->valuelen);
+		if (ps->data_inplace) {
+			/* The name is followed by the colon or spaces, and
+			 * the value by the newline or trailing spaces. */
+			char *name_inplace = (char *)fs->fieldstart;
+			char *value_inplace = (char *)fs->valuestart;
+
+			name_inplace[fs->fieldlen] = '\0';
+			value_inplace[fs->valuelen] = '\0';
+			arp->name = name_inplace;
+			arp->value = value_inplace;
+		} else {
+			arp->name = nfstrnsave(fs->fieldstart, fs->fieldlen);
+			arp->value = nfstrnsave(fs->valuestart, fs->valuelen);
+		}
 		arp->next = NULL;
 		*larpp = arp;
 	}
+
+	if (ps->cache_rec)
+		parsedb_cache_add_field(ps->cache_rec, ps->lno, fs,
+		                        ps->problems != problems);
 }
 
 /**
@@ -548,6 +631,11 @@ parsedb_new(const char *filename, int fd, enum parsedbflags flags)
 	ps->endptr = NULL;
 	ps->pkg = NULL;
 	ps->pkgbin = NULL;
+	ps->cache_rec = NULL;
+	ps->cache_replay = false;
+	ps->data_inplace = false;
+	ps->lazy_filename = NULL;
+	ps->problems = 0;
 
 	return ps;
 }
@@ -604,6 +692,18 @@ parsedb_load(struct parsedb_state *ps)
 
 		ps->dataptr = varbuf_detach(&buf);
 		ps->endptr = ps->dataptr + size;
+	} else if (st.st_size > 0 && (ps->flags & pdb_zero_copy)) {
+		/* The data is allocated with the database, and gets released
+		 * when it is reset, so that the values can point into it. */
+		ps->dataptr = nfmalloc(st.st_size + 1);
+
+		if (fd_read(ps->fd, ps->dataptr, st.st_size) < 0)
+			ohshite(_("cannot read package control file '%s'"),
+			        ps->filename);
+		ps->dataptr[st.st_size] = '\0';
+
+		ps->endptr = ps->dataptr + st.st_size;
+		ps->data_inplace = true;
 	} else if (st.st_size > 0) {
 #ifdef USE_MMAP
 		ps->dataptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
@@ -625,6 +725,33 @@ parsedb_load(struct parsedb_state *ps)
 	ps->data = ps->dataptr;
 }
 
+/**
+ * Find the end of the current line.
+ *
+ * This uses memchr(), which is usually vectorized by the C library, instead
+ * of going byte by byte. The MSDOS end of file character also ends a line.
+ *
+ * @return A pointer to the line terminator, or the end of data if none.
+ */
+static char *
+parse_find_eol(struct parsedb_state *ps)
+{
+	size_t len = ps->endptr - ps->dataptr;
+	char *eol, *eof;
+
+	eol = memchr(ps->dataptr, '\n', len);
+	if (eol)
+		len = eol - ps->dataptr;
+	else
+		eol = ps->endptr;
+
+	eof = memchr(ps->dataptr, MSDOS_EOF_CHAR, len);
+	if (eof)
+		return eof;
+
+	return eol;
+}
+
 /**
  * Parse a deb822 stanza.
  */
@@ -651,6 +778,8 @@ parse_stanza(struct parsedb_state *ps, struct field_state *fs,
 		bool blank_line;
 
 		/* Scan field name. */
+		fs->fieldidx = -1;
+		fs->value_checked = false;
 		fs->fieldstart = ps->dataptr - 1;
 		while (!parse_at_eof(ps) &&
 		       !c_isspace(c) &&
@@ -703,11 +832,15 @@ parse_stanza(struct parsedb_state *ps, struct field_state *fs,
 		fs->valuestart = ps->dataptr - 1;
 		for (;;) {
 			if (c == '\n' || c == MSDOS_EOF_CHAR) {
-				if (blank_line)
+				if (blank_line) {
 					parse_lax_problem(ps, pdb_lax_stanza_parser,
 					                  _("blank line in value of field '%.*s'"),
 					                  fs->fieldlen,
 					                  fs->fieldstart);
+					/* Do not cache data that would
+					 * lose this warning on replay. */
+					ps->cache_rec = NULL;
+				}
 				ps->lno++;
 
 				if (parse_at_eof(ps))
@@ -722,8 +855,14 @@ parse_stanza(struct parsedb_state *ps, struct field_state *fs,
 
 				parse_ungetc(c, ps);
 				blank_line = true;
-			} else if (blank_line && !c_isspace(c)) {
-				blank_line = false;
+			} else {
+				if (blank_line && !c_isspace(c))
+					blank_line = false;
+
+				/* Once we know the line is not blank, skip
+				 * straight to its end. */
+				if (!blank_line)
+					ps->dataptr = parse_find_eol(ps);
 			}
 
 			if (parse_at_eof(ps))
@@ -765,7 +904,7 @@ parsedb_close(struct parsedb_state *ps)
 			        ps->filename);
 	}
 
-	if (ps->data != NULL) {
+	if (ps->data != NULL && !ps->data_inplace) {
 #ifdef USE_MMAP
 		munmap(ps->data, ps->endptr - ps->data);
 #else
@@ -819,8 +958,15 @@ parsedb_parse(struct parsedb_state *ps, struct pkginfo **donep)
 		memset(fieldencountered, 0, sizeof(fieldencountered));
 		pkgset_blank(&tmp_set);
 
-		if (!parse_stanza(ps, &fs, pkg_parse_field, &pkg_obj))
-			break;
+		if (ps->cache_replay) {
+			if (!parsedb_cache_stanza(ps, &fs, pkg_parse_field, &pkg_obj))
+				break;
+		} else {
+			if (!parse_stanza(ps, &fs, pkg_parse_field, &pkg_obj))
+				break;
+			if (ps->cache_rec)
+				parsedb_cache_add_stanza(ps->cache_rec, ps->lno);
+		}
 
 		if (pdone && donep)
 			parse_error(ps,
@@ -876,6 +1022,46 @@ parsedb(const char *filename, enum parsedbflags flags, struct pkginfo **pkgp)
 	return count;
 }
 
+/**
+ * Parse a deb822 file, using a binary cache if possible.
+ *
+ * If the cache file is up-to-date with the deb822 file, then the
+ * pre-tokenized stanzas are replayed from it, otherwise the deb822 file
+ * gets parsed and the cache file regenerated, if we can write to it.
+ *
+ * donep may be NULL.
+ * If donep is not NULL only one package's information is expected.
+ */
+int
+parsedb_cached(const char *filename, const char *cachefile,
+               enum parsedbflags flags, struct pkginfo **pkgp)
+{
+	struct parsedb_state *ps;
+	struct varbuf rec = VARBUF_INIT;
+	int count;
+
+	ps = parsedb_cache_open(filename, cachefile, flags);
+	if (ps) {
+		count = parsedb_parse(ps, pkgp);
+		parsedb_close(ps);
+
+		return count;
+	}
+
+	ps = parsedb_open(filename, flags);
+	parsedb_load(ps);
+	if (ps->fd >= 0 && ps->data != NULL)
+		ps->cache_rec = &rec;
+	count = parsedb_parse(ps, pkgp);
+	if (ps->cache_rec)
+		parsedb_cache_write(ps, cachefile, &rec);
+	parsedb_close(ps);
+
+	varbuf_destroy(&rec);
+
+	return count;
+}
+
 /**
  * Copy dependency links structures.
  *
@@ -946,3 +1132,61 @@ copy_dependency_links(struct pkginfo *pkg,
 	/* Finally, we fill in the new value. */
 	*updateme = newdepends;
 }
+
+/**
+ * Parse the deferred fields of a package.
+ *
+ * This needs to be called before accessing the dependencies or conffiles
+ * of a package loaded with pdb_lazy_fields, and it does nothing otherwise.
+ *
+ * @param pkg The package the pkgbin belongs to.
+ * @param pkgbin The package binary information to parse the fields into.
+ */
+void
+pkgbin_parse_lazy(struct pkginfo *pkg, struct pkgbin *pkgbin)
+{
+	struct parsedb_state *ps;
+	struct pkg_lazy_field *lazy;
+	struct dependency *olddepends, *newdepends, *dep;
+	struct deppossi *dop;
+
+	lazy = pkgbin->lazy;
+	if (lazy == NULL)
+		return;
+	pkgbin->lazy = NULL;
+
+	ps = parsedb_new(lazy->filename, -1, lazy->flags);
+	ps->pkg = pkg;
+	ps->pkgbin = pkgbin;
+
+	/* The dependencies are parsed on their own, to then link them as in
+	 * pkg_parse_copy(). */
+	olddepends = pkgbin->depends;
+	pkgbin->depends = NULL;
+	for (; lazy; lazy = lazy->next) {
+		ps->lno = lazy->lno;
+		lazy->fip->rcall(pkg, pkgbin, ps, lazy->value, lazy->fip);
+	}
+	newdepends = pkgbin->depends;
+	pkgbin->depends = olddepends;
+
+	/* Perform the checks from pkg_parse_verify() for these fields. */
+	for (dep = newdepends; dep; dep = dep->next)
+		for (dop = dep->list; dop; dop = dop->next)
+			if (!dop->arch)
+				dop->arch = pkgbin->arch;
+
+	if (!(ps->flags & pdb_recordavailable) &&
+	    pkg->status == PKG_STAT_NOTINSTALLED &&
+	    pkgbin->conffiles) {
+		parse_warn(ps,
+		           _("package has status %s and has conffiles, forgetting them"),
+		           pkg_status_name(pkg));
+		pkgbin->conffiles = NULL;
+	}
+
+	copy_dependency_links(pkg, &pkgbin->depends, newdepends,
+	                      pkgbin == &pkg->available);
+
+	parsedb_close(ps);
+}
@@ -62,6 +62,30 @@ struct parsedb_state {
 	const char *filename;
 	int fd;
 	int lno;
+
+	/** Token recorder for the binary database cache, or NULL. */
+	struct varbuf *cache_rec;
+	/** Whether the data is a binary database cache to replay. */
+	bool cache_replay;
+	/** Whether the data is kept until the database is reset, so that the
+	 * field values can be terminated and referenced in place. */
+	bool data_inplace;
+	/** The filename copy referenced by the deferred fields, or NULL. */
+	const char *lazy_filename;
+	/** Number of parser warnings and errors emitted. */
+	int problems;
+};
+
+/**
+ * Field value whose parsing has been deferred.
+ */
+struct pkg_lazy_field {
+	struct pkg_lazy_field *next;
+	const struct fieldinfo *fip;
+	const char *value;
+	const char *filename;
+	enum parsedbflags flags;
+	int lno;
 };
 
 #define parse_at_eof(ps)	((ps)->dataptr >= (ps)->endptr)
@@ -74,6 +98,10 @@ struct field_state {
 	struct varbuf value;
 	int fieldlen;
 	int valuelen;
+	/** Index into fieldinfos, or -1 if it needs to be looked up. */
+	int fieldidx;
+	/** Whether the value is known to parse without problems. */
+	bool value_checked;
 	int *fieldencountered;
 };
 
@@ -95,6 +123,21 @@ bool
 parse_stanza(struct parsedb_state *ps, struct field_state *fs,
              parse_field_func *parse_field, void *parse_obj);
 
+struct parsedb_state *
+parsedb_cache_open(const char *filename, const char *cachefile,
+                   enum parsedbflags flags);
+bool
+parsedb_cache_stanza(struct parsedb_state *ps, struct field_state *fs,
+                     parse_field_func *parse_field, void *parse_obj);
+void
+parsedb_cache_add_field(struct varbuf *rec, int lno,
+                        const struct field_state *fs, bool problems);
+void
+parsedb_cache_add_stanza(struct varbuf *rec, int lno);
+void
+parsedb_cache_write(struct parsedb_state *ps, const char *cachefile,
+                    struct varbuf *rec);
+
 #define STRUCTFIELD(klass, off, type) (*(type *)((uintptr_t)(klass) + (off)))
 
 #define PKGIFPOFF(f) (offsetof(struct pkgbin, f))
@@ -162,11 +205,17 @@ struct fieldinfo {
 	size_t integer;
 };
 
+bool
+parse_field_is_lazy(const struct fieldinfo *fip);
+
 int
 parse_db_version(struct parsedb_state *ps,
                  struct dpkg_version *version, const char *value)
 	DPKG_ATTR_REQRET;
 
+const char *
+parse_strsave(struct parsedb_state *ps, const char *value);
+
 void
 parse_error(struct parsedb_state *ps, const char *fmt, ...)
 	DPKG_ATTR_NORET DPKG_ATTR_PRINTF(2);
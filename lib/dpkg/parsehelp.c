@@ -41,6 +41,8 @@ parse_error_msg(struct parsedb_state *ps, const char *fmt, va_list args)
 {
 	struct varbuf *vb = &ps->errmsg;
 
+	ps->problems++;
+
 	if (ps->pkg && ps->pkg->set->name)
 		varbuf_set_fmt(vb, _("parsing file '%s' near line %d package '%s':\n "),
 		               ps->filename, ps->lno,
@@ -352,6 +354,21 @@ parse_db_version(struct parsedb_state *ps, struct dpkg_version *version,
 	return -1;
 }
 
+/**
+ * Save a field value for the lifetime of the database.
+ *
+ * If the value is referenced in place from data that is kept until the
+ * database is reset, then no copy is needed.
+ */
+const char *
+parse_strsave(struct parsedb_state *ps, const char *value)
+{
+	if (ps->data_inplace)
+		return value;
+
+	return nfstrsave(value);
+}
+
 void
 parse_must_have_field(struct parsedb_state *ps,
                       const char *value, const char *what)
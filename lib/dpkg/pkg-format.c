@@ -428,6 +428,8 @@ pkg_format_print(struct varbuf *vb, const struct pkg_format_node *head,
 				fip = find_field_info(virtinfos, node->data);
 
 			if (fip) {
+				if (parse_field_is_lazy(fip))
+					pkgbin_parse_lazy(pkg, pkgbin);
 				fip->wcall(&wb, pkg, pkgbin, 0, fip);
 
 				pkg_format_item(&fb, node, varbuf_str(&wb));
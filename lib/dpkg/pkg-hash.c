@@ -24,6 +24,7 @@
 #include <config.h>
 #include <compat.h>
 
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -35,19 +36,82 @@
 #include <dpkg/arch.h>
 
 /*
- * This must always be a prime for optimal performance.
+ * The hash table uses open addressing with linear probing, where each slot
+ * stores the full hash and the length of the name besides the package set,
+ * so that most mismatches can be rejected without any string comparison.
+ * The table grows by doubling its size when reaching the maximum load
+ * factor, without needing to rehash the names.
  *
- * We use a number that is close to the amount of packages currently present
- * in a Debian suite, so that installed and available packages do not add
- * tons of collisions.
- *
- * The memory usage is «BINS * sizeof(void *)».
+ * The package sets are also linked in insertion order, which is the order
+ * used by the iterators, so that it does not depend on the table size.
  */
-#define BINS 65521
 
-static struct pkgset *bins[BINS];
+/* This must always be a power of two. */
+#define PKG_HASH_SIZE_MIN	1024
+/* Maximum load factor, in percent. */
+#define PKG_HASH_LOAD_MAX	70
+
+struct pkg_hash_slot {
+	uint32_t hash;
+	uint32_t namelen;
+	struct pkgset *set;
+};
+
+static struct pkg_hash_slot *slots;
+static size_t nslots = 0;
+static struct pkgset *set_head;
+static struct pkgset **set_tail = &set_head;
 static int npkg, nset;
 
+static inline size_t
+pkg_hash_slot_index(uint32_t hash)
+{
+	/* Mix the upper bits in, as we only use the lower ones. */
+	return (hash ^ (hash >> 16)) & (nslots - 1);
+}
+
+static void
+pkg_hash_resize(size_t size)
+{
+	struct pkg_hash_slot *old_slots = slots;
+	size_t old_nslots = nslots;
+	size_t i;
+
+	slots = m_calloc(size, sizeof(*slots));
+	nslots = size;
+
+	for (i = 0; i < old_nslots; i++) {
+		size_t n;
+
+		if (old_slots[i].set == NULL)
+			continue;
+
+		n = pkg_hash_slot_index(old_slots[i].hash);
+		while (slots[n].set)
+			n = (n + 1) & (nslots - 1);
+		slots[n] = old_slots[i];
+	}
+
+	free(old_slots);
+}
+
+static bool
+pkg_hash_name_match(const char *setname, const char *name, size_t namelen)
+{
+	size_t i;
+
+	/* The set name is always stored in lowercase, and most names are
+	 * requested in lowercase too. */
+	if (memcmp(setname, name, namelen) == 0)
+		return true;
+
+	for (i = 0; i < namelen; i++)
+		if (setname[i] != (char)c_tolower(name[i]))
+			return false;
+
+	return true;
+}
+
 /**
  * Return the package set with the given name.
  *
@@ -67,32 +131,47 @@ static int npkg, nset;
 struct pkgset *
 pkg_hash_find_set(const char *inname)
 {
-	struct pkgset **setp, *new_set;
-	char *name = m_strdup(inname), *p;
-
-	p = name;
-	while (*p) {
-		*p = c_tolower(*p);
-		p++;
+	struct pkgset *new_set;
+	char *name;
+	uint32_t hash;
+	size_t namelen;
+	size_t i, n;
+
+	/* Hash the lowercased name, without making a lowercased copy. */
+	hash = str_fnv_hash_lower(inname, &namelen);
+
+	if (nslots == 0)
+		pkg_hash_resize(PKG_HASH_SIZE_MIN);
+
+	for (n = pkg_hash_slot_index(hash); slots[n].set;
+	     n = (n + 1) & (nslots - 1)) {
+		if (slots[n].hash != hash || slots[n].namelen != namelen)
+			continue;
+		if (pkg_hash_name_match(slots[n].set->name, inname, namelen))
+			return slots[n].set;
 	}
 
-	setp = bins + (str_fnv_hash(name) % (BINS));
-	while (*setp && strcasecmp((*setp)->name, name))
-		setp = &(*setp)->next;
-	if (*setp) {
-		free(name);
-		return *setp;
-	}
-
-	new_set = nfmalloc(sizeof(*new_set));
+	/* Allocate the name right after the set, for locality. */
+	new_set = nfmalloc(sizeof(*new_set) + namelen + 1);
 	pkgset_blank(new_set);
-	new_set->name = nfstrsave(name);
+	name = (char *)(new_set + 1);
+	for (i = 0; i < namelen; i++)
+		name[i] = c_tolower(inname[i]);
+	name[namelen] = '\0';
+	new_set->name = name;
 	new_set->next = NULL;
-	*setp = new_set;
+
+	*set_tail = new_set;
+	set_tail = &new_set->next;
+
+	slots[n].hash = hash;
+	slots[n].namelen = namelen;
+	slots[n].set = new_set;
 	nset++;
 	npkg++;
 
-	free(name);
+	if ((size_t)nset * 100 >= nslots * PKG_HASH_LOAD_MAX)
+		pkg_hash_resize(nslots * 2);
 
 	return new_set;
 }
@@ -265,8 +344,8 @@ pkg_hash_count_pkg(void)
 }
 
 struct pkg_hash_iter {
+	struct pkgset **setp;
 	struct pkginfo *pkg;
-	int nbinn;
 };
 
 /**
@@ -282,8 +361,8 @@ pkg_hash_iter_new(void)
 	struct pkg_hash_iter *iter;
 
 	iter = m_malloc(sizeof(*iter));
+	iter->setp = &set_head;
 	iter->pkg = NULL;
-	iter->nbinn = 0;
 
 	return iter;
 }
@@ -302,19 +381,11 @@ pkg_hash_iter_next_set(struct pkg_hash_iter *iter)
 {
 	struct pkgset *set;
 
-	while (!iter->pkg) {
-		if (iter->nbinn >= BINS)
-			return NULL;
-		if (bins[iter->nbinn])
-			iter->pkg = &bins[iter->nbinn]->pkg;
-		iter->nbinn++;
-	}
-
-	set = iter->pkg->set;
-	if (set->next)
-		iter->pkg = &set->next->pkg;
-	else
-		iter->pkg = NULL;
+	set = *iter->setp;
+	if (set == NULL)
+		return NULL;
+	iter->setp = &set->next;
+	iter->pkg = &set->pkg;
 
 	return set;
 }
@@ -335,25 +406,18 @@ pkg_hash_iter_next_set(struct pkg_hash_iter *iter)
 struct pkginfo *
 pkg_hash_iter_next_pkg(struct pkg_hash_iter *iter)
 {
-	struct pkginfo *pkg;
+	struct pkgset *set;
 
-	while (!iter->pkg) {
-		if (iter->nbinn >= BINS)
-			return NULL;
-		if (bins[iter->nbinn])
-			iter->pkg = &bins[iter->nbinn]->pkg;
-		iter->nbinn++;
+	if (iter->pkg && iter->pkg->arch_next) {
+		iter->pkg = iter->pkg->arch_next;
+		return iter->pkg;
 	}
 
-	pkg = iter->pkg;
-	if (pkg->arch_next)
-		iter->pkg = pkg->arch_next;
-	else if (pkg->set->next)
-		iter->pkg = &pkg->set->next->pkg;
-	else
-		iter->pkg = NULL;
+	set = pkg_hash_iter_next_set(iter);
+	if (set == NULL)
+		return NULL;
 
-	return pkg;
+	return iter->pkg;
 }
 
 /**
@@ -374,44 +438,52 @@ pkg_hash_reset(void)
 	nffreeall();
 	nset = 0;
 	npkg = 0;
-	memset(bins, 0, sizeof(bins));
+	free(slots);
+	slots = NULL;
+	nslots = 0;
+	set_head = NULL;
+	set_tail = &set_head;
 }
 
 void
 pkg_hash_report(FILE *file)
 {
-	int i, c;
-	struct pkgset *pkg;
+	size_t i;
 	int *freq;
-	int empty = 0, used = 0, collided = 0;
-
-	freq = m_malloc(sizeof(int) * nset + 1);
-	for (i = 0; i <= nset; i++)
-		freq[i] = 0;
-	for (i = 0; i < BINS; i++) {
-		for (c = 0, pkg = bins[i]; pkg; c++, pkg = pkg->next)
-			;
-		fprintf(file, "pkg-hash: bin %5d has %7d\n", i, c);
-
-		if (c == 0) {
-			empty++;
-		} else if (c == 1) {
-			used++;
-		} else {
-			used++;
-			collided++;
-		}
-		freq[c]++;
-	}
-	for (i = nset; i > 0 && freq[i] == 0; i--)
-		;
-	while (i >= 0) {
-		fprintf(file, "pkg-hash: size %7d occurs %5d times\n",
-		        i, freq[i]);
-		i--;
+	int used = 0, displaced = 0;
+	int probe_max = 0;
+	long probes = 0;
+
+	freq = m_calloc(nset + 1, sizeof(freq[0]));
+	for (i = 0; i < nslots; i++) {
+		size_t home;
+		int dist;
+
+		if (slots[i].set == NULL)
+			continue;
+
+		home = pkg_hash_slot_index(slots[i].hash);
+		dist = (i - home) & (nslots - 1);
+
+		used++;
+		if (dist > 0)
+			displaced++;
+		if (dist > probe_max)
+			probe_max = dist;
+		probes += dist + 1;
+		freq[dist]++;
 	}
-	fprintf(file, "pkg-hash: bins empty %d\n", empty);
-	fprintf(file, "pkg-hash: bins used %d (collided %d)\n", used, collided);
+	for (i = 0; i <= (size_t)probe_max; i++)
+		fprintf(file, "pkg-hash: probe length %7zu occurs %7d times\n",
+		        i + 1, freq[i]);
+	fprintf(file, "pkg-hash: slots %zu (%zu bytes)\n",
+	        nslots, nslots * sizeof(*slots));
+	fprintf(file, "pkg-hash: slots used %d (displaced %d)\n",
+	        used, displaced);
+	fprintf(file, "pkg-hash: load factor %.2f\n",
+	        nslots ? (double)used / nslots : 0.0);
+	fprintf(file, "pkg-hash: probe length average %.2f, max %d\n",
+	        used ? (double)probes / used : 0.0, probe_max + 1);
 
 	m_output(file, "<hash report>");
 
@@ -111,6 +111,7 @@ pkgbin_blank(struct pkgbin *pkgbin)
 	dpkg_version_blank(&pkgbin->version);
 	pkgbin->conffiles = NULL;
 	pkgbin->arbs = NULL;
+	pkgbin->lazy = NULL;
 }
 
 void
@@ -210,7 +211,8 @@ pkg_is_informative(struct pkginfo *pkg, struct pkgbin *pkgbin)
 	    str_is_set(pkgbin->source) ||
 	    dpkg_version_is_informative(&pkgbin->version) ||
 	    pkgbin->conffiles ||
-	    pkgbin->arbs)
+	    pkgbin->arbs ||
+	    pkgbin->lazy)
 		return true;
 
 	return false;
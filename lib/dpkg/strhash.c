@@ -21,6 +21,7 @@
 #include <config.h>
 #include <compat.h>
 
+#include <dpkg/c-ctype.h>
 #include <dpkg/string.h>
 
 #define FNV_OFFSET_BASIS 2166136261UL
@@ -48,3 +49,52 @@ str_fnv_hash(const char *str)
 
 	return h;
 }
+
+/**
+ * Fowler/Noll/Vo -- FNV-1a simple memory buffer hash.
+ *
+ * @param buf The buffer to hash.
+ * @param len The length of the buffer.
+ *
+ * @return The hashed value.
+ */
+unsigned int
+str_fnv_hash_len(const char *buf, size_t len)
+{
+	unsigned int h = FNV_OFFSET_BASIS;
+	unsigned int p = FNV_MIXING_PRIME;
+
+	while (len--) {
+		h ^= *buf++;
+		h *= p;
+	}
+
+	return h;
+}
+
+/**
+ * Fowler/Noll/Vo -- FNV-1a simple lowercased string hash.
+ *
+ * The string is hashed as if it had been lowercased first, so that
+ * case-insensitive lookups do not need a lowercased copy of it.
+ *
+ * @param str The string to hash.
+ * @param len The returned length of the string.
+ *
+ * @return The hashed value.
+ */
+unsigned int
+str_fnv_hash_lower(const char *str, size_t *len)
+{
+	const char *s = str;
+	unsigned int h = FNV_OFFSET_BASIS;
+	unsigned int p = FNV_MIXING_PRIME;
+
+	while (*s) {
+		h ^= (char)c_tolower(*s++);
+		h *= p;
+	}
+	*len = s - str;
+
+	return h;
+}
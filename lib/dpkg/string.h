@@ -60,6 +60,10 @@ str_match_end(const char *str, const char *end);
 
 unsigned int
 str_fnv_hash(const char *str);
+unsigned int
+str_fnv_hash_len(const char *buf, size_t len);
+unsigned int
+str_fnv_hash_lower(const char *str, size_t *len);
 
 char *
 str_concat(char *dst, ...)
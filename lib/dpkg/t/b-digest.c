@@ -0,0 +1,154 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * b-digest.c - test digest performance
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dpkg/dpkg.h>
+#include <dpkg/fdio.h>
+#include <dpkg/buffer.h>
+
+#include <dpkg/perf.h>
+
+#define DIGEST_FILE_SYNTH "b-digest.data"
+
+/* Size of the synthetic file, in MiB. */
+#define DIGEST_FILE_SIZE 1024
+
+static off_t
+bench_gen_file(const char *filename, int mib)
+{
+	char *buf;
+	off_t size = 0;
+	int fd, i;
+
+	buf = m_malloc(1024 * 1024);
+	for (i = 0; i < 1024 * 1024; i++)
+		buf[i] = (i * 7 + i / 4096) & 0xff;
+
+	fd = open(filename, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0)
+		ohshite("cannot create %s", filename);
+	for (i = 0; i < mib; i++) {
+		if (fd_write(fd, buf, 1024 * 1024) < 0)
+			ohshite("cannot write %s", filename);
+		size += 1024 * 1024;
+	}
+	if (close(fd))
+		ohshite("cannot close %s", filename);
+
+	free(buf);
+
+	return size;
+}
+
+static void
+bench_digest(const char *filename, off_t size, int type, void *hash,
+             const char *str)
+{
+	struct dpkg_error err;
+	struct perf_slot ps;
+	struct timespec t_res;
+	double secs;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		ohshite("cannot open %s", filename);
+
+	perf_ts_slot_start(&ps);
+	if (buffer_copy_IntPtr(fd, BUFFER_READ_FD, hash, type,
+	                       NULL, BUFFER_WRITE_NULL, -1, &err) != size)
+		ohshit("cannot digest %s: %s", filename, err.str);
+	perf_ts_slot_stop(&ps);
+
+	close(fd);
+
+	perf_ts_slot_print(&ps, str);
+
+	perf_ts_sub(&ps.t_end, &ps.t_ini, &t_res);
+	secs = t_res.tv_sec + t_res.tv_nsec / 1e9;
+	if (secs > 0)
+		printf("%s: %jd bytes, %.2f GiB/sec\n", str, (intmax_t)size,
+		       (double)size / secs / (1024 * 1024 * 1024));
+}
+
+int
+main(int argc, const char *const *argv)
+{
+	char md5[MD5HASHLEN + 1];
+#ifdef HAVE_SHA256
+	char sha256[SHA256HASHLEN + 1];
+	struct buffer_digest_entry digests[] = {
+		{ BUFFER_DIGEST_MD5, md5 },
+		{ BUFFER_DIGEST_SHA256, sha256 },
+		{ BUFFER_DIGEST_NULL, NULL },
+	};
+#endif
+	const char *filename = argv[1];
+	struct stat st;
+	off_t size;
+	bool synth = false;
+
+	push_error_context();
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	perf_ts_mark_print("init");
+
+	if (filename) {
+		if (stat(filename, &st) < 0)
+			ohshite("cannot stat %s", filename);
+		size = st.st_size;
+	} else {
+		size = bench_gen_file(DIGEST_FILE_SYNTH, DIGEST_FILE_SIZE);
+		filename = DIGEST_FILE_SYNTH;
+		synth = true;
+	}
+
+	/* Warm up the page cache, so that we measure the digests. */
+	bench_digest(filename, size, BUFFER_DIGEST_NULL, NULL, "read");
+
+	bench_digest(filename, size, BUFFER_DIGEST_MD5, md5, "md5");
+#ifdef HAVE_SHA256
+	bench_digest(filename, size, BUFFER_DIGEST_SHA256, sha256, "sha256");
+	bench_digest(filename, size, BUFFER_DIGEST_MULTI, digests,
+	             "md5+sha256");
+#endif
+
+	if (synth)
+		unlink(DIGEST_FILE_SYNTH);
+
+	pop_error_context(ehflag_normaltidy);
+
+	perf_ts_mark_print("shutdown");
+
+	return 0;
+}
@@ -23,6 +23,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <time.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -37,6 +38,56 @@
 
 static const char *admindir;
 
+#define LOOKUP_PASSES 10
+
+static void
+perf_maxrss_print(const char *str)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) < 0)
+		return;
+
+	printf("%s: max RSS %ld KiB\n", str, ru.ru_maxrss);
+}
+
+static void
+bench_fsys_hash_lookup(void)
+{
+	struct perf_slot ps;
+	struct fsys_hash_iter *iter;
+	struct fsys_namenode *fnn;
+	const char **names;
+	struct timespec t_res;
+	double secs;
+	int nnames = 0, pass, i;
+
+	names = m_malloc(fsys_hash_entries() * sizeof(*names));
+	iter = fsys_hash_iter_new();
+	while ((fnn = fsys_hash_iter_next(iter)))
+		names[nnames++] = fnn->name;
+	fsys_hash_iter_free(iter);
+
+	perf_ts_slot_start(&ps);
+	for (pass = 0; pass < LOOKUP_PASSES; pass++) {
+		for (i = 0; i < nnames; i++) {
+			if (fsys_hash_find_node(names[i], FHFF_NO_NEW) == NULL)
+				ohshit("cannot find fsys node %s", names[i]);
+		}
+	}
+	perf_ts_slot_stop(&ps);
+
+	perf_ts_slot_print(&ps, "lookup nodes");
+
+	perf_ts_sub(&ps.t_end, &ps.t_ini, &t_res);
+	secs = t_res.tv_sec + t_res.tv_nsec / 1e9;
+	if (secs > 0)
+		printf("lookup nodes: %d entries, %.0f lookups/sec\n",
+		       nnames, (double)nnames * LOOKUP_PASSES / secs);
+
+	free(names);
+}
+
 int
 main(int argc, const char *const *argv)
 {
@@ -66,6 +117,9 @@ main(int argc, const char *const *argv)
 	perf_ts_slot_stop(&ps);
 
 	perf_ts_slot_print(&ps, "load .list");
+	perf_maxrss_print("load .list");
+
+	bench_fsys_hash_lookup();
 
 	if (test_is_verbose()) {
 		pkg_hash_report(stdout);
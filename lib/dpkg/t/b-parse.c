@@ -0,0 +1,142 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * b-parse.c - test deb822 database parsing performance
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dpkg/i18n.h>
+#include <dpkg/dpkg.h>
+#include <dpkg/dpkg-db.h>
+#include <dpkg/varbuf.h>
+
+#include <dpkg/perf.h>
+
+#define STATUSFILE_SYNTH "b-parse.status"
+
+#define PARSE_STANZAS 20000
+#define PARSE_PASSES 5
+
+static off_t
+bench_gen_status(const char *filename)
+{
+	struct varbuf vb = VARBUF_INIT;
+	FILE *fp;
+	off_t size;
+	int i, l;
+
+	for (i = 0; i < PARSE_STANZAS; i++) {
+		varbuf_add_fmt(&vb,
+		               "Package: package-name-%d\n"
+		               "Status: install ok installed\n"
+		               "Priority: optional\n"
+		               "Section: libs\n"
+		               "Installed-Size: %d\n"
+		               "Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+		               "Architecture: all\n"
+		               "Multi-Arch: foreign\n"
+		               "Version: 1.%d-1\n"
+		               "Depends: libc6 (>= 2.36), libfoo%d (= 1.%d-1), libbar | libbaz\n"
+		               "Description: synthetic package number %d\n",
+		               i, i * 3, i, i, i, i);
+		for (l = 0; l < 8; l++)
+			varbuf_add_fmt(&vb,
+			               " This is line %d of the long description of the "
+			               "synthetic package, with some filler text.\n", l);
+		varbuf_add_str(&vb,
+		               "Homepage: https://www.example.org/\n"
+		               "X-Custom-Field: some value\n"
+		               "\n");
+	}
+
+	fp = fopen(filename, "w");
+	if (fp == NULL)
+		ohshite("cannot create %s", filename);
+	if (fwrite(vb.buf, vb.used, 1, fp) != 1)
+		ohshite("cannot write %s", filename);
+	if (fclose(fp))
+		ohshite("cannot close %s", filename);
+
+	size = vb.used;
+	varbuf_destroy(&vb);
+
+	return size;
+}
+
+static void
+bench_parsedb(const char *filename, off_t size, enum parsedbflags flags,
+              const char *str)
+{
+	struct perf_slot ps;
+	struct timespec t_res;
+	double secs;
+	int pass;
+
+	perf_ts_slot_start(&ps);
+	for (pass = 0; pass < PARSE_PASSES; pass++) {
+		pkg_hash_reset();
+		if (parsedb(filename, flags, NULL) != PARSE_STANZAS)
+			ohshit("unexpected number of stanzas in %s", filename);
+	}
+	perf_ts_slot_stop(&ps);
+
+	perf_ts_slot_print(&ps, str);
+
+	perf_ts_sub(&ps.t_end, &ps.t_ini, &t_res);
+	secs = t_res.tv_sec + t_res.tv_nsec / 1e9;
+	if (secs > 0)
+		printf("%s: %jd bytes, %.1f MiB/sec\n", str, (intmax_t)size,
+		       (double)size * PARSE_PASSES / secs / (1024 * 1024));
+
+	pkg_hash_reset();
+}
+
+int
+main(int argc, const char *const *argv)
+{
+	off_t size;
+
+	push_error_context();
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	perf_ts_mark_print("init");
+
+	size = bench_gen_status(STATUSFILE_SYNTH);
+
+	bench_parsedb(STATUSFILE_SYNTH, size, pdb_parse_status & ~pdb_zero_copy,
+	              "parsedb status");
+	bench_parsedb(STATUSFILE_SYNTH, size, pdb_parse_status,
+	              "parsedb status zero-copy");
+
+	unlink(STATUSFILE_SYNTH);
+
+	pop_error_context(ehflag_normaltidy);
+
+	perf_ts_mark_print("shutdown");
+
+	return 0;
+}
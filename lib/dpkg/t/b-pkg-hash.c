@@ -24,17 +24,183 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #include <dpkg/i18n.h>
 #include <dpkg/dpkg.h>
 #include <dpkg/dpkg-db.h>
+#include <dpkg/arch.h>
 
 #include <dpkg/perf.h>
 
 static const char *admindir;
 
+#define CACHEFILE "b-pkg-hash.cache"
+
+#define LOOKUP_PASSES 20
+#define INSERT_SETS 200000
+
+static void
+perf_rate_print(struct perf_slot *ps, const char *str, int entries, int ops)
+{
+	struct timespec t_res;
+	double secs;
+
+	perf_ts_sub(&ps->t_end, &ps->t_ini, &t_res);
+	secs = t_res.tv_sec + t_res.tv_nsec / 1e9;
+	if (secs > 0)
+		printf("%s: %d entries, %.0f ops/sec\n", str, entries, ops / secs);
+}
+
+static void
+bench_pkg_hash_lookup(void)
+{
+	struct perf_slot ps;
+	struct pkg_hash_iter *iter;
+	struct pkgset *set;
+	struct pkginfo *pkg;
+	const char **names;
+	int nnames = 0, npkgs = 0, pass, i;
+
+	names = m_malloc(pkg_hash_count_set() * sizeof(*names));
+	iter = pkg_hash_iter_new();
+	while ((set = pkg_hash_iter_next_set(iter)))
+		names[nnames++] = set->name;
+	pkg_hash_iter_free(iter);
+
+	perf_ts_slot_start(&ps);
+	for (pass = 0; pass < LOOKUP_PASSES; pass++) {
+		for (i = 0; i < nnames; i++) {
+			set = pkg_hash_find_set(names[i]);
+			if (set->name != names[i])
+				ohshit("cannot find package set %s", names[i]);
+		}
+	}
+	perf_ts_slot_stop(&ps);
+
+	perf_ts_slot_print(&ps, "lookup sets");
+	perf_rate_print(&ps, "lookup sets", nnames, nnames * LOOKUP_PASSES);
+
+	perf_ts_slot_start(&ps);
+	for (pass = 0; pass < LOOKUP_PASSES; pass++) {
+		iter = pkg_hash_iter_new();
+		while ((pkg = pkg_hash_iter_next_pkg(iter))) {
+			struct pkginfo *found;
+
+			if (pkg->installed.arch->type == DPKG_ARCH_NONE)
+				continue;
+
+			found = pkg_hash_find_pkg(pkg->set->name,
+			                          pkg->installed.arch);
+			if (found != pkg)
+				ohshit("cannot find package %s",
+				       pkg->set->name);
+			npkgs++;
+		}
+		pkg_hash_iter_free(iter);
+	}
+	perf_ts_slot_stop(&ps);
+
+	perf_ts_slot_print(&ps, "lookup pkgs");
+	perf_rate_print(&ps, "lookup pkgs", npkgs / LOOKUP_PASSES, npkgs);
+
+	free(names);
+}
+
+static void
+bench_pkg_hash_insert(void)
+{
+	struct perf_slot ps;
+	char name[64];
+	int i;
+
+	pkg_hash_reset();
+
+	perf_ts_slot_start(&ps);
+	for (i = 0; i < INSERT_SETS; i++) {
+		snprintf(name, sizeof(name), "libpackage-name%d-%d", i % 100, i);
+		pkg_hash_find_pkg(name, dpkg_arch_get(DPKG_ARCH_NATIVE));
+	}
+	perf_ts_slot_stop(&ps);
+
+	perf_ts_slot_print(&ps, "insert sets");
+	perf_rate_print(&ps, "insert sets", INSERT_SETS, INSERT_SETS);
+
+	perf_ts_slot_start(&ps);
+	for (i = 0; i < INSERT_SETS; i++) {
+		snprintf(name, sizeof(name), "LibPackage-Name%d-%d", i % 100, i);
+		pkg_hash_find_set(name);
+	}
+	perf_ts_slot_stop(&ps);
+
+	perf_ts_slot_print(&ps, "lookup sets mixed case");
+	perf_rate_print(&ps, "lookup sets mixed case", INSERT_SETS, INSERT_SETS);
+
+	if (pkg_hash_count_set() != INSERT_SETS)
+		ohshit("unexpected number of package sets %d",
+		       pkg_hash_count_set());
+
+	pkg_hash_reset();
+}
+
+static void
+bench_parsedb_cache(void)
+{
+	struct perf_slot ps;
+	char *statusfile;
+
+	statusfile = dpkg_db_get_path(STATUSFILE);
+	unlink(CACHEFILE);
+
+	pkg_hash_reset();
+	perf_ts_slot_start(&ps);
+	parsedb(statusfile, pdb_parse_status, NULL);
+	perf_ts_slot_stop(&ps);
+	perf_ts_slot_print(&ps, "parsedb text");
+
+	pkg_hash_reset();
+	perf_ts_slot_start(&ps);
+	parsedb_cached(statusfile, CACHEFILE, pdb_parse_status, NULL);
+	perf_ts_slot_stop(&ps);
+	perf_ts_slot_print(&ps, "parsedb cache generate");
+
+	pkg_hash_reset();
+	perf_ts_slot_start(&ps);
+	parsedb_cached(statusfile, CACHEFILE, pdb_parse_status, NULL);
+	perf_ts_slot_stop(&ps);
+	perf_ts_slot_print(&ps, "parsedb cache replay");
+
+	pkg_hash_reset();
+	unlink(CACHEFILE);
+	free(statusfile);
+}
+
+static void
+bench_parsedb_zero_copy(void)
+{
+	struct perf_slot ps;
+	char *availfile;
+
+	availfile = dpkg_db_get_path(AVAILFILE);
+
+	pkg_hash_reset();
+	perf_ts_slot_start(&ps);
+	parsedb(availfile, pdb_parse_available & ~pdb_zero_copy, NULL);
+	perf_ts_slot_stop(&ps);
+	perf_ts_slot_print(&ps, "parsedb available copy");
+
+	pkg_hash_reset();
+	perf_ts_slot_start(&ps);
+	parsedb(availfile, pdb_parse_available, NULL);
+	perf_ts_slot_stop(&ps);
+	perf_ts_slot_print(&ps, "parsedb available zero-copy");
+
+	pkg_hash_reset();
+	free(availfile);
+}
+
 int
 main(int argc, const char *const *argv)
 {
@@ -53,10 +219,18 @@ main(int argc, const char *const *argv)
 
 	perf_ts_slot_print(&ps, "modstatdb_init");
 
+	bench_pkg_hash_lookup();
+
 	if (test_is_verbose())
 		pkg_hash_report(stdout);
 
 	modstatdb_shutdown();
+
+	bench_pkg_hash_insert();
+
+	bench_parsedb_cache();
+	bench_parsedb_zero_copy();
+
 	pop_error_context(ehflag_normaltidy);
 
 	perf_ts_mark_print("shutdown");
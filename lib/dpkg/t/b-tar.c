@@ -0,0 +1,220 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * b-tar.c - test tar archive creation performance
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dpkg/dpkg.h>
+#include <dpkg/fdio.h>
+#include <dpkg/path.h>
+#include <dpkg/treewalk.h>
+#include <dpkg/subproc.h>
+#include <dpkg/command.h>
+#include <dpkg/tarfn.h>
+
+#include <dpkg/perf.h>
+
+#define TAR_TREE_SYNTH "b-tar.tree"
+#define TAR_FILE "b-tar.tar"
+
+#define TAR_TREE_DIRS 100
+#define TAR_TREE_FILES 100
+#define TAR_TREE_FILE_SIZE 4096
+
+static void
+bench_gen_tree(const char *dirname)
+{
+	char data[TAR_TREE_FILE_SIZE];
+	char *pathname;
+	int d, f;
+
+	memset(data, 'x', sizeof(data));
+
+	if (mkdir(dirname, 0755) < 0)
+		ohshite("cannot create %s", dirname);
+
+	for (d = 0; d < TAR_TREE_DIRS; d++) {
+		pathname = str_fmt("%s/dir-%d", dirname, d);
+		if (mkdir(pathname, 0755) < 0)
+			ohshite("cannot create %s", pathname);
+		free(pathname);
+
+		for (f = 0; f < TAR_TREE_FILES; f++) {
+			int fd;
+
+			pathname = str_fmt("%s/dir-%d/file-%d", dirname, d, f);
+			fd = open(pathname, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+			if (fd < 0)
+				ohshite("cannot create %s", pathname);
+			if (fd_write(fd, data, sizeof(data)) < 0)
+				ohshite("cannot write %s", pathname);
+			close(fd);
+			free(pathname);
+		}
+	}
+}
+
+static void
+bench_tar_native(const char *dir, const struct tar_pack_options *options)
+{
+	struct tar_writer *tw;
+	struct treeroot *tree;
+	struct treenode *node;
+	int fd;
+
+	fd = open(TAR_FILE, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0)
+		ohshite("cannot create %s", TAR_FILE);
+
+	tw = tar_writer_new(fd, TAR_FILE, options);
+	tree = treewalk_open(dir, TREEWALK_NONE, NULL);
+	for (node = treewalk_node(tree); node; node = treewalk_next(tree)) {
+		char *nodename;
+
+		nodename = str_fmt("./%s", treenode_get_virtname(node));
+		tar_writer_add(tw, nodename, treenode_get_pathname(node),
+		               treenode_get_stat(node));
+		free(nodename);
+	}
+	treewalk_close(tree);
+	tar_writer_close(tw);
+
+	close(fd);
+}
+
+static void
+bench_tar_exec(const char *dir, const struct tar_pack_options *options)
+{
+	struct treeroot *tree;
+	struct treenode *node;
+	int pipe_filenames[2];
+	pid_t pid;
+
+	m_pipe(pipe_filenames);
+	pid = subproc_fork();
+	if (pid == 0) {
+		struct command cmd;
+		char mtime[50];
+		int fd;
+
+		fd = open(TAR_FILE, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+		if (fd < 0)
+			ohshite("cannot create %s", TAR_FILE);
+		m_dup2(fd, 1);
+		close(fd);
+		m_dup2(pipe_filenames[0], 0);
+		close(pipe_filenames[0]);
+		close(pipe_filenames[1]);
+
+		if (chdir(dir))
+			ohshite("cannot change directory to '%s'", dir);
+
+		snprintf(mtime, sizeof(mtime), "@%jd", options->timestamp);
+
+		command_init(&cmd, TAR, "tar -cf");
+		command_add_args(&cmd, "tar",
+		                 "-cf", "-",
+		                 "--format=gnu",
+		                 "--mtime", mtime,
+		                 "--clamp-mtime",
+		                 "--owner", "root:0",
+		                 "--group", "root:0",
+		                 "--null",
+		                 "--no-unquote",
+		                 "--no-recursion",
+		                 "-T", "-",
+		                 NULL);
+		command_exec(&cmd);
+	}
+	close(pipe_filenames[0]);
+
+	tree = treewalk_open(dir, TREEWALK_NONE, NULL);
+	for (node = treewalk_node(tree); node; node = treewalk_next(tree)) {
+		char *nodename;
+
+		nodename = str_fmt("./%s", treenode_get_virtname(node));
+		if (fd_write(pipe_filenames[1], nodename, strlen(nodename) + 1) < 0)
+			ohshite("cannot write filename to tar pipe");
+		free(nodename);
+	}
+	treewalk_close(tree);
+
+	close(pipe_filenames[1]);
+	subproc_reap(pid, "tar -cf", 0);
+}
+
+int
+main(int argc, const char *const *argv)
+{
+	struct tar_pack_options options = {
+		.timestamp = time(NULL),
+		.mode = NULL,
+		.root_owner_group = true,
+	};
+	struct perf_slot ps;
+	const char *dir = argv[1];
+	bool synth = false;
+
+	push_error_context();
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	perf_ts_mark_print("init");
+
+	if (dir == NULL) {
+		bench_gen_tree(TAR_TREE_SYNTH);
+		dir = TAR_TREE_SYNTH;
+		synth = true;
+	}
+
+	/* Warm up the page cache, so that we measure the archivers. */
+	bench_tar_native(dir, &options);
+
+	perf_ts_slot_start(&ps);
+	bench_tar_native(dir, &options);
+	perf_ts_slot_stop(&ps);
+	perf_ts_slot_print(&ps, "tar-writer");
+
+	perf_ts_slot_start(&ps);
+	bench_tar_exec(dir, &options);
+	perf_ts_slot_stop(&ps);
+	perf_ts_slot_print(&ps, "tar-exec");
+
+	unlink(TAR_FILE);
+	if (synth)
+		path_remove_tree(TAR_TREE_SYNTH);
+
+	pop_error_context(ehflag_normaltidy);
+
+	perf_ts_mark_print("shutdown");
+
+	return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * c-tarcreate.c - test tar creator
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <dpkg/dpkg.h>
+#include <dpkg/ehandle.h>
+#include <dpkg/varbuf.h>
+#include <dpkg/tarfn.h>
+
+/*
+ * Usage: c-tarcreate <dir> <timestamp> [<owner> [<mode>]] <filelist
+ *
+ * The filelist contains NUL-separated pathnames relative to dir, and the
+ * tar archive gets written to stdout. An owner of "root" archives all
+ * entries as owned by root.
+ */
+int
+main(int argc, char **argv)
+{
+	struct tar_pack_options options;
+	struct tar_writer *tw;
+	struct varbuf name = VARBUF_INIT;
+	struct varbuf pathname = VARBUF_INIT;
+	const char *dir;
+	int c;
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	push_error_context();
+
+	if (argc < 3)
+		ohshit("missing arguments");
+
+	dir = argv[1];
+	options.timestamp = strtoimax(argv[2], NULL, 10);
+	options.root_owner_group = argc > 3 && strcmp(argv[3], "root") == 0;
+	options.mode = argc > 4 ? argv[4] : NULL;
+	options.index = NULL;
+
+	tw = tar_writer_new(STDOUT_FILENO, "stdout", &options);
+
+	do {
+		struct stat st;
+
+		c = getchar();
+		if (c != EOF && c != '\0') {
+			varbuf_add_char(&name, c);
+			continue;
+		}
+		if (name.used == 0)
+			continue;
+
+		varbuf_set_fmt(&pathname, "%s/%s", dir, varbuf_str(&name));
+		if (lstat(varbuf_str(&pathname), &st) < 0)
+			ohshite("cannot stat '%s'", varbuf_str(&pathname));
+
+		tar_writer_add(tw, varbuf_str(&name), varbuf_str(&pathname), &st);
+		varbuf_reset(&name);
+	} while (c != EOF);
+
+	tar_writer_close(tw);
+
+	varbuf_destroy(&name);
+	varbuf_destroy(&pathname);
+
+	pop_error_context(ehflag_normaltidy);
+
+	return 0;
+}
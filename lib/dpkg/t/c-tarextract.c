@@ -55,14 +55,13 @@ tar_read(struct tar_archive *tar, char *buffer, int size)
 static int
 tar_object_skip(struct tar_archive *tar, struct tar_entry *te)
 {
-	struct tar_context *tc = tar->ctx;
 	off_t size;
 
 	size = (te->size + TARBLKSZ - 1) / TARBLKSZ * TARBLKSZ;
 	if (size == 0)
 		return 0;
 
-	return fd_skip(tc->tar_fd, size, NULL);
+	return tar_skip(tar, size, NULL);
 }
 
 static int
@@ -124,6 +123,9 @@ main(int argc, char **argv)
 	struct tar_context tar_ctx;
 	const char *tar_name = argv[1];
 
+	if (tar_name && argc > 2)
+		tar_ops.read_bufsize = atoi(argv[2]);
+
 	setvbuf(stdout, NULL, _IOLBF, 0);
 
 	push_error_context();
@@ -52,10 +52,32 @@ test_ar_member_is_invalid(void)
 	test_fail(dpkg_ar_member_is_invalid(&arh));
 }
 
+static void
+test_ar_member_get_size(void)
+{
+	struct dpkg_ar_hdr arh;
+
+	memcpy(arh.ar_size, "1234      ", sizeof(arh.ar_size));
+	test_pass(dpkg_ar_member_get_size(&arh) == 1234);
+
+	memcpy(arh.ar_size, "  42      ", sizeof(arh.ar_size));
+	test_pass(dpkg_ar_member_get_size(&arh) == 42);
+
+	memcpy(arh.ar_size, "9999999999", sizeof(arh.ar_size));
+	test_pass(dpkg_ar_member_get_size(&arh) == 9999999999);
+
+	memcpy(arh.ar_size, "12x4      ", sizeof(arh.ar_size));
+	test_pass(dpkg_ar_member_get_size(&arh) == -1);
+
+	memcpy(arh.ar_size, "-1        ", sizeof(arh.ar_size));
+	test_pass(dpkg_ar_member_get_size(&arh) == -1);
+}
+
 TEST_ENTRY(test)
 {
-	test_plan(4);
+	test_plan(9);
 
 	test_ar_normalize_name();
 	test_ar_member_is_invalid();
+	test_ar_member_get_size();
 }
@@ -0,0 +1,142 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * t-arena.c - test memory arena support
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <dpkg/test.h>
+#include <dpkg/dpkg-db.h>
+#include <dpkg/arena.h>
+
+static void
+test_arena_alloc(void)
+{
+	struct dpkg_arena *arena;
+	struct dpkg_arena_stats stats;
+	char *a, *b, *str;
+	size_t size;
+
+	arena = dpkg_arena_new();
+	dpkg_arena_get_stats(arena, &stats);
+	test_pass(stats.chunks == 1);
+	test_pass(stats.size > 0);
+	test_pass(stats.peak == stats.size);
+	test_pass(stats.allocs == 0);
+	test_pass(stats.used == 0);
+	size = stats.size;
+
+	a = dpkg_arena_alloc(arena, 3);
+	b = dpkg_arena_alloc(arena, sizeof(uint64_t));
+	test_pass(a != NULL);
+	test_pass(b != NULL);
+	test_pass(a != b);
+	test_pass(((uintptr_t)b % sizeof(uint64_t)) == 0);
+	memset(a, 'a', 3);
+	memset(b, 'b', sizeof(uint64_t));
+	test_mem(a, ==, "aaa", 3);
+
+	str = dpkg_arena_strdup(arena, "string");
+	test_str(str, ==, "string");
+	str = dpkg_arena_strndup(arena, "string", 3);
+	test_str(str, ==, "str");
+
+	dpkg_arena_get_stats(arena, &stats);
+	test_pass(stats.chunks == 1);
+	test_pass(stats.allocs == 4);
+	test_pass(stats.used == 3 + sizeof(uint64_t) + 7 + 4);
+
+	/* Larger than a chunk. */
+	a = dpkg_arena_alloc(arena, 64 * 1024);
+	memset(a, 0, 64 * 1024);
+	dpkg_arena_get_stats(arena, &stats);
+	test_pass(stats.chunks == 2);
+	test_pass(stats.size > 64 * 1024);
+	test_pass(stats.peak == stats.size);
+
+	/* Resetting keeps the first chunk around. */
+	dpkg_arena_reset(arena);
+	dpkg_arena_get_stats(arena, &stats);
+	test_pass(stats.chunks == 1);
+	test_pass(stats.size == size);
+	test_pass(stats.peak > 64 * 1024);
+	test_pass(stats.allocs == 0);
+	test_pass(stats.used == 0);
+
+	str = dpkg_arena_strdup(arena, "reused");
+	test_str(str, ==, "reused");
+	dpkg_arena_get_stats(arena, &stats);
+	test_pass(stats.chunks == 1);
+	test_pass(stats.allocs == 1);
+
+	dpkg_arena_free(arena);
+	dpkg_arena_free(NULL);
+}
+
+static void
+test_arena_nfmalloc(void)
+{
+	struct dpkg_arena *arena;
+	struct dpkg_arena_stats stats;
+	struct pkgset *set;
+
+	arena = dpkg_arena_new();
+
+	test_pass(nfmalloc_get_arena() != NULL);
+	test_pass(nfmalloc_get_arena() != arena);
+
+	nfmalloc_set_arena(arena);
+	test_pass(nfmalloc_get_arena() == arena);
+
+	nfmalloc(16);
+	nfstrsave("string");
+	dpkg_arena_get_stats(arena, &stats);
+	test_pass(stats.allocs == 2);
+
+	/* The package database gets allocated from the arena. */
+	set = pkg_hash_find_set("pkg-arena");
+	test_str(set->name, ==, "pkg-arena");
+	dpkg_arena_get_stats(arena, &stats);
+	test_pass(stats.allocs > 2);
+
+	/* And it gets reset instead of freed on database reset. */
+	pkg_hash_reset();
+	dpkg_arena_get_stats(arena, &stats);
+	test_pass(stats.chunks == 1);
+	test_pass(stats.allocs == 0);
+
+	set = pkg_hash_find_set("pkg-arena");
+	test_str(set->name, ==, "pkg-arena");
+	pkg_hash_reset();
+
+	nfmalloc_set_arena(NULL);
+	test_pass(nfmalloc_get_arena() != arena);
+	dpkg_arena_free(arena);
+}
+
+TEST_ENTRY(test)
+{
+	test_plan(36);
+
+	test_arena_alloc();
+	test_arena_nfmalloc();
+}
@@ -27,6 +27,7 @@
 
 #include <sys/types.h>
 
+#include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -35,23 +36,59 @@ static const char str_empty[] = "";
 static const char ref_hash_empty[] = "d41d8cd98f00b204e9800998ecf8427e";
 static const char str_test[] = "this is a test string\n";
 static const char ref_hash_test[] = "475aae3b885d70a9130eec23ab33f2b9";
+#ifdef HAVE_SHA1_H
+static const char ref_sha1_test[] =
+	"552059c2fff2559a4048d7222ee25c0335f7dc2d";
+#endif
+#ifdef HAVE_SHA256
+static const char ref_sha256_empty[] =
+	"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+static const char ref_sha256_test[] =
+	"6102e76cb0b1c6f0e8ac9a1f38a093db285ae3b35c086b39eefb9a5b506c693d";
+#endif
 
 static void
 test_buffer_hash(void)
 {
 	char hash[MD5HASHLEN + 1];
+#ifdef HAVE_SHA256
+	char sha256[SHA256HASHLEN + 1];
+#endif
 
 	buffer_md5(str_empty, hash, strlen(str_empty));
 	test_str(hash, ==, ref_hash_empty);
 
 	buffer_md5(str_test, hash, strlen(str_test));
 	test_str(hash, ==, ref_hash_test);
+
+#ifdef HAVE_SHA256
+	buffer_sha256(str_empty, sha256, strlen(str_empty));
+	test_str(sha256, ==, ref_sha256_empty);
+
+	buffer_sha256(str_test, sha256, strlen(str_test));
+	test_str(sha256, ==, ref_sha256_test);
+#else
+	test_skip("no SHA-256 support");
+	test_skip("no SHA-256 support");
+#endif
 }
 
 static void
 test_fdio_hash(void)
 {
 	char hash[MD5HASHLEN + 1];
+	char sha1[SHA1HASHLEN + 1];
+	char sha256[SHA256HASHLEN + 1];
+	struct buffer_digest_entry digests[] = {
+		{ BUFFER_DIGEST_MD5, hash },
+#ifdef HAVE_SHA1_H
+		{ BUFFER_DIGEST_SHA1, sha1 },
+#endif
+#ifdef HAVE_SHA256
+		{ BUFFER_DIGEST_SHA256, sha256 },
+#endif
+		{ BUFFER_DIGEST_NULL, NULL },
+	};
 	char *test_file;
 	int fd;
 
@@ -68,6 +105,34 @@ test_fdio_hash(void)
 	test_pass(fd_md5(fd, hash, -1, NULL) >= 0);
 	test_str(hash, ==, ref_hash_test);
 
+#ifdef HAVE_SHA256
+	test_pass(lseek(fd, 0, SEEK_SET) == 0);
+	test_pass(fd_sha256(fd, sha256, -1, NULL) >= 0);
+	test_str(sha256, ==, ref_sha256_test);
+#else
+	test_skip("no SHA-256 support");
+	test_skip("no SHA-256 support");
+	test_skip("no SHA-256 support");
+#endif
+
+	/* Compute all digests in one pass. */
+	memset(hash, 0, sizeof(hash));
+	memset(sha1, 0, sizeof(sha1));
+	memset(sha256, 0, sizeof(sha256));
+	test_pass(lseek(fd, 0, SEEK_SET) == 0);
+	test_pass(fd_digests(fd, digests, -1, NULL) == (off_t)strlen(str_test));
+	test_str(hash, ==, ref_hash_test);
+#ifdef HAVE_SHA1_H
+	test_str(sha1, ==, ref_sha1_test);
+#else
+	test_skip("no SHA-1 support");
+#endif
+#ifdef HAVE_SHA256
+	test_str(sha256, ==, ref_sha256_test);
+#else
+	test_skip("no SHA-256 support");
+#endif
+
 	test_pass(unlink(test_file) == 0);
 
 	free(test_file);
@@ -75,7 +140,7 @@ test_fdio_hash(void)
 
 TEST_ENTRY(test)
 {
-	test_plan(10);
+	test_plan(20);
 
 	test_buffer_hash();
 	test_fdio_hash();
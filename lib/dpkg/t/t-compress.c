@@ -0,0 +1,579 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * t-compress.c - test compression support
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifdef WITH_LIBBZ2
+#include <bzlib.h>
+#endif
+
+#include <dpkg/test.h>
+#include <dpkg/fdio.h>
+#include <dpkg/compress.h>
+
+#define PLAIN_FILE	"t-compress.plain"
+#define PACKED_FILE	"t-compress.packed"
+
+/* Larger than the stream buffers, to exercise refilling them. */
+#define DATA_SIZE	(300 * 1024)
+
+static const char trailer[] = "trailing data that must not get decoded";
+
+static char *
+make_data(void)
+{
+	char *data;
+	size_t i;
+
+	data = test_alloc(malloc(DATA_SIZE));
+	for (i = 0; i < DATA_SIZE; i++)
+		data[i] = "abcdefghijklmnop\n"[(i * 7 + i / 1024) % 17];
+
+	return data;
+}
+
+static off_t
+pack_data(struct compress_params *params, const char *data, size_t len,
+          int flags)
+{
+	struct dpkg_error err;
+	struct stat st;
+	int fd_in, fd_out;
+
+	fd_in = open(PLAIN_FILE, O_CREAT | O_TRUNC | O_RDWR, 0644);
+	if (fd_in < 0 ||
+	    fd_write(fd_in, data, len) != (ssize_t)len ||
+	    lseek(fd_in, 0, SEEK_SET) != 0)
+		test_bail("cannot write plain file");
+
+	fd_out = open(PACKED_FILE, O_CREAT | O_WRONLY | flags, 0644);
+	if (fd_out < 0)
+		test_bail("cannot create packed file");
+
+	if (!compressor_check_params(params, &err))
+		test_bail(err.str);
+	compress_filter(params, fd_in, fd_out, "compressing %s",
+	                compressor_get_name(params->type));
+	close(fd_in);
+	close(fd_out);
+
+	if (stat(PACKED_FILE, &st) < 0)
+		test_bail("cannot stat packed file");
+
+	return st.st_size;
+}
+
+static void
+append_trailer(void)
+{
+	int fd;
+
+	/* The stream must stop at the member boundary. */
+	fd = open(PACKED_FILE, O_WRONLY | O_APPEND);
+	if (fd < 0 ||
+	    fd_write(fd, trailer, strlen(trailer)) < 0)
+		test_bail("cannot append trailer");
+	close(fd);
+}
+
+static off_t
+pack_file(struct compress_params *params, const char *data)
+{
+	off_t size;
+
+	size = pack_data(params, data, DATA_SIZE, O_TRUNC);
+	append_trailer();
+
+	return size;
+}
+
+static char *
+read_packed(off_t size)
+{
+	char *buf;
+	int fd;
+
+	buf = test_alloc(malloc(size));
+	fd = open(PACKED_FILE, O_RDONLY);
+	if (fd < 0 || fd_read(fd, buf, size) != size)
+		test_bail("cannot read packed file");
+	close(fd);
+
+	return buf;
+}
+
+static bool
+stream_is_truncated(struct compress_params *params, off_t size)
+{
+	struct decompress_stream *ds;
+	jmp_buf truncated_jump;
+	volatile bool truncated = false;
+	char buf[4096];
+	int fd;
+
+	fd = open(PACKED_FILE, O_RDONLY);
+	if (fd < 0)
+		test_bail("cannot open packed file");
+
+	ds = decompress_stream_open(params, fd, size, "truncated %s",
+	                            compressor_get_name(params->type));
+	test_try(truncated_jump) {
+		while (decompress_stream_read(ds, buf, sizeof(buf)) > 0)
+			;
+	} test_catch {
+		truncated = true;
+	} test_finally;
+
+	decompress_stream_close(ds);
+	close(fd);
+
+	return truncated;
+}
+
+static void
+test_decompress_stream_type(enum compressor_type type, const char *data)
+{
+	struct compress_params params = {
+		.type = type,
+		.strategy = COMPRESSOR_STRATEGY_NONE,
+		.level = -1,
+		.threads_max = 1,
+	};
+	struct decompress_stream *ds;
+	char *buf;
+	size_t chunks[] = { 1, 511, 512, 7, 65536, 100000 };
+	size_t used = 0, i;
+	ssize_t n;
+	off_t size;
+	int fd;
+
+	size = pack_file(&params, data);
+
+	fd = open(PACKED_FILE, O_RDONLY);
+	if (fd < 0)
+		test_bail("cannot open packed file");
+
+	ds = decompress_stream_open(&params, fd, size, "decompressing %s",
+	                            compressor_get_name(type));
+	test_pass(ds != NULL);
+
+	/* Mix small and large reads, which take different paths. */
+	buf = test_alloc(malloc(DATA_SIZE + 1));
+	for (i = 0; used <= DATA_SIZE; i++) {
+		size_t len = min(chunks[i % countof(chunks)], DATA_SIZE + 1 - used);
+
+		n = decompress_stream_read(ds, buf + used, len);
+		if (n <= 0)
+			break;
+		used += n;
+	}
+	test_pass(used == DATA_SIZE);
+	test_mem(buf, ==, data, DATA_SIZE);
+	test_pass(decompress_stream_read(ds, buf, 1) == 0);
+
+	decompress_stream_close(ds);
+	close(fd);
+	free(buf);
+
+	if (type != COMPRESSOR_TYPE_NONE)
+		test_pass(stream_is_truncated(&params, size - 8));
+
+	test_pass(unlink(PLAIN_FILE) == 0);
+	test_pass(unlink(PACKED_FILE) == 0);
+}
+
+static const struct {
+	enum compressor_type type;
+	const char *skip;
+} decompress_stream_types[] = {
+	{ COMPRESSOR_TYPE_NONE, NULL },
+#if USE_LIBZ_IMPL != USE_LIBZ_IMPL_NONE
+	{ COMPRESSOR_TYPE_GZIP, NULL },
+#else
+	{ COMPRESSOR_TYPE_GZIP, "no zlib support" },
+#endif
+#ifdef WITH_LIBBZ2
+	{ COMPRESSOR_TYPE_BZIP2, NULL },
+#else
+	{ COMPRESSOR_TYPE_BZIP2, "no libbz2 support" },
+#endif
+#ifdef WITH_LIBLZMA
+	{ COMPRESSOR_TYPE_XZ, NULL },
+	{ COMPRESSOR_TYPE_LZMA, NULL },
+#else
+	{ COMPRESSOR_TYPE_XZ, "no liblzma support" },
+	{ COMPRESSOR_TYPE_LZMA, "no liblzma support" },
+#endif
+#ifdef WITH_LIBZSTD
+	{ COMPRESSOR_TYPE_ZSTD, NULL },
+#else
+	{ COMPRESSOR_TYPE_ZSTD, "no libzstd support" },
+#endif
+};
+
+static void
+test_decompress_stream(void)
+{
+	char *data = make_data();
+	size_t i;
+	int j;
+
+	for (i = 0; i < countof(decompress_stream_types); i++) {
+		if (decompress_stream_types[i].skip == NULL) {
+			test_decompress_stream_type(decompress_stream_types[i].type,
+			                            data);
+			continue;
+		}
+
+		for (j = 0; j < 7; j++)
+			test_skip(decompress_stream_types[i].skip);
+	}
+
+	free(data);
+}
+
+static void
+test_decompress_stream_concat_type(enum compressor_type type,
+                                   const char *data)
+{
+	struct compress_params params = {
+		.type = type,
+		.strategy = COMPRESSOR_STRATEGY_NONE,
+		.level = -1,
+		.threads_max = 1,
+	};
+	struct decompress_stream *ds;
+	char *buf;
+	size_t used = 0;
+	ssize_t n;
+	off_t size;
+	int fd;
+
+	/* Concatenated streams get decoded up to the end of the last one. */
+	pack_data(&params, data, DATA_SIZE / 2, O_TRUNC);
+	size = pack_data(&params, data + DATA_SIZE / 2,
+	                 DATA_SIZE - DATA_SIZE / 2, O_APPEND);
+	append_trailer();
+
+	fd = open(PACKED_FILE, O_RDONLY);
+	if (fd < 0)
+		test_bail("cannot open packed file");
+
+	ds = decompress_stream_open(&params, fd, size, "decompressing %s frames",
+	                            compressor_get_name(type));
+	test_pass(ds != NULL);
+
+	buf = test_alloc(malloc(DATA_SIZE + 1));
+	while (used <= DATA_SIZE) {
+		n = decompress_stream_read(ds, buf + used, DATA_SIZE + 1 - used);
+		if (n <= 0)
+			break;
+		used += n;
+	}
+	test_pass(used == DATA_SIZE);
+	test_mem(buf, ==, data, DATA_SIZE);
+	test_pass(decompress_stream_read(ds, buf, 1) == 0);
+
+	decompress_stream_close(ds);
+	close(fd);
+	free(buf);
+
+	test_pass(unlink(PLAIN_FILE) == 0);
+	test_pass(unlink(PACKED_FILE) == 0);
+}
+
+static const struct {
+	enum compressor_type type;
+	const char *skip;
+} decompress_stream_concat_types[] = {
+#if USE_LIBZ_IMPL != USE_LIBZ_IMPL_NONE
+	{ COMPRESSOR_TYPE_GZIP, NULL },
+#else
+	{ COMPRESSOR_TYPE_GZIP, "no zlib support" },
+#endif
+#ifdef WITH_LIBZSTD
+	{ COMPRESSOR_TYPE_ZSTD, NULL },
+#else
+	{ COMPRESSOR_TYPE_ZSTD, "no libzstd support" },
+#endif
+};
+
+static void
+test_decompress_stream_concat(void)
+{
+	char *data = make_data();
+	size_t i;
+	int j;
+
+	for (i = 0; i < countof(decompress_stream_concat_types); i++) {
+		if (decompress_stream_concat_types[i].skip == NULL) {
+			test_decompress_stream_concat_type(decompress_stream_concat_types[i].type,
+			                                   data);
+			continue;
+		}
+
+		for (j = 0; j < 6; j++)
+			test_skip(decompress_stream_concat_types[i].skip);
+	}
+
+	free(data);
+}
+
+static void
+test_compress_blocks_type(enum compressor_type type, int level,
+                          const char *data)
+{
+	struct compress_params params = {
+		.type = type,
+		.strategy = COMPRESSOR_STRATEGY_NONE,
+		.level = level,
+		.threads_max = -1,
+	};
+	struct decompress_stream *ds;
+	const int threads[] = { 1, 2, 8 };
+	char *buf, *packed;
+	size_t used = 0, i;
+	ssize_t n;
+	off_t size;
+	int fd;
+
+	size = pack_file(&params, data);
+
+	fd = open(PACKED_FILE, O_RDONLY);
+	if (fd < 0)
+		test_bail("cannot open packed file");
+
+	/* The decoders stop at the first stream end, so the blocks must
+	 * have been joined into a single stream. */
+	ds = decompress_stream_open(&params, fd, size, "decompressing %s blocks",
+	                            compressor_get_name(type));
+	test_pass(ds != NULL);
+
+	buf = test_alloc(malloc(DATA_SIZE + 1));
+	while (used <= DATA_SIZE) {
+		n = decompress_stream_read(ds, buf + used, DATA_SIZE + 1 - used);
+		if (n <= 0)
+			break;
+		used += n;
+	}
+	test_pass(used == DATA_SIZE);
+	test_mem(buf, ==, data, DATA_SIZE);
+	test_pass(decompress_stream_read(ds, buf, 1) == 0);
+
+	decompress_stream_close(ds);
+	close(fd);
+	free(buf);
+
+	/* The output must not depend on the number of threads. */
+	packed = read_packed(size);
+	for (i = 0; i < countof(threads); i++) {
+		params.threads_max = threads[i];
+		test_pass(pack_file(&params, data) == size);
+		buf = read_packed(size);
+		test_mem(buf, ==, packed, size);
+		free(buf);
+	}
+	free(packed);
+
+	test_pass(unlink(PLAIN_FILE) == 0);
+	test_pass(unlink(PACKED_FILE) == 0);
+}
+
+/* Use levels that split the data into several blocks. */
+static const struct {
+	enum compressor_type type;
+	int level;
+	const char *skip;
+} compress_blocks_types[] = {
+#if USE_LIBZ_IMPL != USE_LIBZ_IMPL_NONE
+	{ COMPRESSOR_TYPE_GZIP, 9, NULL },
+#else
+	{ COMPRESSOR_TYPE_GZIP, 9, "no zlib support" },
+#endif
+#ifdef WITH_LIBBZ2
+	{ COMPRESSOR_TYPE_BZIP2, 1, NULL },
+#else
+	{ COMPRESSOR_TYPE_BZIP2, 1, "no libbz2 support" },
+#endif
+};
+
+static void
+test_compress_blocks(void)
+{
+	char *data = make_data();
+	size_t i;
+	int j;
+
+	for (i = 0; i < countof(compress_blocks_types); i++) {
+		if (compress_blocks_types[i].skip == NULL) {
+			test_compress_blocks_type(compress_blocks_types[i].type,
+			                          compress_blocks_types[i].level,
+			                          data);
+			continue;
+		}
+
+		for (j = 0; j < 12; j++)
+			test_skip(compress_blocks_types[i].skip);
+	}
+
+	free(data);
+}
+
+static void
+test_compress_blocks_bzip2_stream(void)
+{
+#ifdef WITH_LIBBZ2
+	struct compress_params params = {
+		.type = COMPRESSOR_TYPE_BZIP2,
+		.strategy = COMPRESSOR_STRATEGY_NONE,
+		.level = 1,
+		.threads_max = 2,
+	};
+	char *data, *stream, *packed;
+	unsigned int stream_len = DATA_SIZE + DATA_SIZE / 100 + 600;
+	size_t i, run, k;
+	off_t size;
+
+	/* Runs of many lengths, so that the run-length encoding done by libbz2
+	 * makes its blocks hold a varying amount of data. */
+	data = test_alloc(malloc(DATA_SIZE));
+	for (i = 0, k = 0; i < DATA_SIZE; k++)
+		for (run = k * 7 % 12 + 1; run && i < DATA_SIZE; run--)
+			data[i++] = "abcdefgh"[k % 8];
+
+	/* The blocks must be split where libbz2 does, so that the output is
+	 * the same as a single stream. */
+	stream = test_alloc(malloc(stream_len));
+	test_pass(BZ2_bzBuffToBuffCompress(stream, &stream_len, data, DATA_SIZE,
+	                                   params.level, 0, 0) == BZ_OK);
+
+	size = pack_data(&params, data, DATA_SIZE, O_TRUNC);
+	test_pass(size == stream_len);
+	packed = read_packed(size);
+	test_mem(packed, ==, stream, size);
+
+	free(packed);
+	free(stream);
+	free(data);
+
+	test_pass(unlink(PLAIN_FILE) == 0);
+	test_pass(unlink(PACKED_FILE) == 0);
+#else
+	int i;
+
+	for (i = 0; i < 5; i++)
+		test_skip("no libbz2 support");
+#endif
+}
+
+static void
+test_decompress_stream_seek_type(enum compressor_type type, const char *data)
+{
+	struct compress_params params = {
+		.type = type,
+		.strategy = COMPRESSOR_STRATEGY_NONE,
+		.level = -1,
+		.threads_max = 1,
+		.block_size = 64 * 1024,
+	};
+	/* Forward within a block, across blocks and backwards. */
+	off_t offsets[] = { 1000, 1500, 70000, 300, 200000, DATA_SIZE - 10 };
+	struct decompress_stream *ds;
+	char buf[10];
+	off_t size;
+	size_t i;
+	int fd;
+
+	size = pack_file(&params, data);
+
+	fd = open(PACKED_FILE, O_RDONLY);
+	if (fd < 0)
+		test_bail("cannot open packed file");
+
+	ds = decompress_stream_open(&params, fd, size, "seeking %s",
+	                            compressor_get_name(type));
+	test_pass(ds != NULL);
+
+	for (i = 0; i < countof(offsets); i++) {
+		decompress_stream_seek(ds, offsets[i]);
+		test_pass(decompress_stream_read(ds, buf, sizeof(buf)) == sizeof(buf));
+		test_mem(buf, ==, data + offsets[i], sizeof(buf));
+	}
+	test_pass(decompress_stream_read(ds, buf, 1) == 0);
+
+	decompress_stream_close(ds);
+	close(fd);
+
+	test_pass(unlink(PLAIN_FILE) == 0);
+	test_pass(unlink(PACKED_FILE) == 0);
+}
+
+static const struct {
+	enum compressor_type type;
+	const char *skip;
+} decompress_stream_seek_types[] = {
+	{ COMPRESSOR_TYPE_NONE, NULL },
+#if defined(WITH_LIBLZMA) && defined(HAVE_LZMA_MT_ENCODER)
+	{ COMPRESSOR_TYPE_XZ, NULL },
+#else
+	{ COMPRESSOR_TYPE_XZ, "no liblzma multi-threaded encoder support" },
+#endif
+};
+
+static void
+test_decompress_stream_seek(void)
+{
+	char *data = make_data();
+	size_t i;
+	int j;
+
+	for (i = 0; i < countof(decompress_stream_seek_types); i++) {
+		if (decompress_stream_seek_types[i].skip == NULL) {
+			test_decompress_stream_seek_type(decompress_stream_seek_types[i].type,
+			                                 data);
+			continue;
+		}
+
+		for (j = 0; j < 16; j++)
+			test_skip(decompress_stream_seek_types[i].skip);
+	}
+
+	free(data);
+}
+
+TEST_ENTRY(test)
+{
+	test_plan(114);
+
+	test_decompress_stream();
+	test_decompress_stream_concat();
+	test_compress_blocks();
+	test_compress_blocks_bzip2_stream();
+	test_decompress_stream_seek();
+}
@@ -0,0 +1,377 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * t-db-fsys-files.c - test files list cache
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dpkg/test.h>
+#include <dpkg/dpkg.h>
+#include <dpkg/varbuf.h>
+#include <dpkg/fdio.h>
+#include <dpkg/dir.h>
+#include <dpkg/file.h>
+#include <dpkg/debug.h>
+#include <dpkg/subproc.h>
+#include <dpkg/dpkg-db.h>
+#include <dpkg/pkg-array.h>
+#include <dpkg/pkg-show.h>
+#include <dpkg/pkg-files.h>
+#include <dpkg/db-fsys.h>
+
+#define ADMIN_DIR	"t.tmp/t-db-fsys-files"
+#define INFO_DIR	ADMIN_DIR "/info"
+#define STATUS_FILE	ADMIN_DIR "/status"
+#define CACHE_FILE	ADMIN_DIR "/files-cache"
+#define LIST_A		INFO_DIR "/pkg-a.list"
+#define LIST_B		INFO_DIR "/pkg-b.list"
+#define DEBUG_LOG	ADMIN_DIR "/debug.log"
+#define FILES_DUMP	ADMIN_DIR "/files.dump"
+
+static const char status[] =
+	"Package: pkg-a\n"
+	"Status: install ok installed\n"
+	"Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+	"Architecture: all\n"
+	"Version: 1.0-1\n"
+	"Description: test package A\n"
+	"\n"
+	"Package: pkg-b\n"
+	"Status: install ok installed\n"
+	"Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+	"Architecture: all\n"
+	"Version: 2.0-1\n"
+	"Description: test package B\n"
+	"\n";
+
+static const char list_a[] =
+	"/.\n"
+	"/usr\n"
+	"/usr/bin\n"
+	"/usr/bin/pkg-a\n";
+
+static const char list_b[] =
+	"/.\n"
+	"/usr\n"
+	"/usr/share\n"
+	"/usr/share/pkg-b\n";
+
+/* The same size as list_b, so that only the timestamps can tell. */
+static const char list_b_new[] =
+	"/.\n"
+	"/usr\n"
+	"/usr/share\n"
+	"/usr/share/pkg-x\n";
+
+static void
+write_file(const char *filename, const char *data)
+{
+	int fd;
+
+	fd = open(filename, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	test_pass(fd >= 0);
+	test_pass(fd_write(fd, data, strlen(data)) == (ssize_t)strlen(data));
+	test_pass(close(fd) == 0);
+}
+
+/*
+ * Rewrite a file in place, making sure its timestamp changes, which might
+ * need waiting on filesystems with a coarse timestamp granularity.
+ */
+static void
+rewrite_file(const char *filename, const char *data)
+{
+	struct stat st;
+	int64_t mtime;
+	int fd;
+
+	test_pass(stat(filename, &st) == 0);
+	mtime = file_stat_mtime_nsec(&st);
+
+	do {
+		usleep(1000);
+		fd = open(filename, O_TRUNC | O_WRONLY);
+		if (fd < 0)
+			break;
+		if (fd_write(fd, data, strlen(data)) < 0 ||
+		    fstat(fd, &st) < 0 || close(fd) < 0) {
+			fd = -1;
+			break;
+		}
+	} while (file_stat_mtime_nsec(&st) == mtime);
+	test_pass(fd >= 0 && file_stat_mtime_nsec(&st) != mtime);
+}
+
+static char *
+read_file(const char *filename)
+{
+	struct varbuf vb = VARBUF_INIT;
+	struct dpkg_error err;
+
+	if (file_slurp(filename, &vb, &err) < 0) {
+		dpkg_error_destroy(&err);
+		return NULL;
+	}
+
+	return varbuf_detach(&vb);
+}
+
+static off_t
+file_size(const char *filename)
+{
+	struct stat st;
+
+	if (stat(filename, &st) < 0)
+		return -1;
+
+	return st.st_size;
+}
+
+static void
+dump_files(FILE *fp)
+{
+	struct pkg_array array;
+	int i;
+
+	pkg_array_init_from_hash(&array);
+	pkg_array_sort(&array, pkg_sorter_by_nonambig_name_arch);
+
+	for (i = 0; i < array.n_pkgs; i++) {
+		struct pkginfo *pkg = array.pkgs[i];
+		struct fsys_namenode_list *file;
+
+		if (pkg->status == PKG_STAT_NOTINSTALLED)
+			continue;
+
+		fprintf(fp, "%s:\n", pkg_name(pkg, pnaw_nonambig));
+		for (file = pkg->files; file; file = file->next)
+			fprintf(fp, "%s\n", file->namenode->name);
+	}
+
+	pkg_array_destroy(&array);
+}
+
+/*
+ * Load the files database from a new process, as the loaded state cannot
+ * be reset, and record its debug output and the loaded files lists.
+ */
+static void
+load_files(const char *pkgname, const char *newlist)
+{
+	pid_t pid;
+
+	unlink(DEBUG_LOG);
+	unlink(FILES_DUMP);
+
+	pid = subproc_fork();
+	if (pid == 0) {
+		FILE *fp;
+
+		fp = fopen(DEBUG_LOG, "w");
+		debug_set_output(fp, DEBUG_LOG);
+		debug_set_mask(dbg_general);
+
+		modstatdb_open(msdbrw_readonly);
+		fsys_hash_init();
+		ensure_allinstfiles_available_quiet();
+
+		if (pkgname) {
+			struct pkginfo *pkg = pkg_hash_find_singleton(pkgname);
+			struct fsys_namenode_list *list = NULL;
+			struct fsys_namenode_list **tail = &list;
+			char *names = m_strdup(newlist);
+			char *name;
+
+			/* Rewrite the files list, as done on unpack. */
+			for (name = strtok(names, "\n"); name;
+			     name = strtok(NULL, "\n")) {
+				struct fsys_namenode *namenode;
+
+				namenode = fsys_hash_find_node(name, FHFF_NONE);
+				tail = pkg_files_add_file(pkg, namenode, tail);
+			}
+			write_filelist_except(pkg, &pkg->installed, list, 0);
+			ensure_packagefiles_available(pkg);
+			free(names);
+		}
+
+		fp = fopen(FILES_DUMP, "w");
+		dump_files(fp);
+		fclose(fp);
+
+		modstatdb_shutdown();
+		_exit(0);
+	}
+	test_pass(subproc_reap(pid, "files database loader", 0) == 0);
+}
+
+static void
+test_log(const char *expected)
+{
+	char *log = read_file(DEBUG_LOG);
+
+	test_pass(log != NULL && strstr(log, expected) != NULL);
+	free(log);
+}
+
+static void
+test_files(const char *a, const char *b)
+{
+	struct varbuf vb = VARBUF_INIT;
+	char *dump = read_file(FILES_DUMP);
+
+	varbuf_add_str(&vb, "pkg-a:\n");
+	varbuf_add_str(&vb, a);
+	varbuf_add_str(&vb, "pkg-b:\n");
+	varbuf_add_str(&vb, b);
+	test_str(dump, ==, varbuf_str(&vb));
+
+	varbuf_destroy(&vb);
+	free(dump);
+}
+
+static void
+test_cache_rebuild(void)
+{
+	unlink(CACHE_FILE);
+
+	/* Without a cache, the files lists get read and the cache created. */
+	load_files(NULL, NULL);
+	test_log("files-cache: 0 records, 0 live, rebuild yes");
+	test_files(list_a, list_b);
+	test_pass(file_size(CACHE_FILE) > 0);
+
+	/* Then the files lists get loaded from the cache. */
+	load_files(NULL, NULL);
+	test_log("files-cache: 2 records, 2 live, rebuild no");
+	test_files(list_a, list_b);
+}
+
+static void
+test_cache_append(void)
+{
+	off_t size;
+
+	/* Writing a files list appends a record superseding the old one. */
+	size = file_size(CACHE_FILE);
+	load_files("pkg-a", list_b_new);
+	test_log("files-cache: 2 records, 2 live, rebuild no");
+	test_files(list_b_new, list_b);
+	test_pass(file_size(CACHE_FILE) > size);
+
+	/* Which gets used, and the superseded one dropped on rebuild. */
+	load_files(NULL, NULL);
+	test_log("files-cache: 3 records, 2 live, rebuild yes");
+	test_files(list_b_new, list_b);
+	test_pass(file_size(CACHE_FILE) ==
+	          size + (off_t)(strlen(list_b_new) - strlen(list_a)));
+
+	load_files(NULL, NULL);
+	test_log("files-cache: 2 records, 2 live, rebuild no");
+	test_files(list_b_new, list_b);
+}
+
+static void
+test_cache_stale(void)
+{
+	/* Rewrite the files lists in place, keeping their inode. */
+	write_file(LIST_A, list_a);
+	load_files(NULL, NULL);
+	test_log("files-cache: 2 records, 1 live, rebuild yes");
+	test_files(list_a, list_b);
+
+	write_file(LIST_B, list_b_new);
+	load_files(NULL, NULL);
+	test_log("files-cache: 2 records, 1 live, rebuild yes");
+	test_files(list_a, list_b_new);
+
+	/* With the same size too, and usually within the same second as the
+	 * record just written, which only the sub-second timestamps can tell. */
+	rewrite_file(LIST_B, list_b);
+	load_files(NULL, NULL);
+	test_log("files-cache: 2 records, 1 live, rebuild yes");
+	test_files(list_a, list_b);
+}
+
+static void
+test_cache_corrupt(void)
+{
+	char *cache;
+	off_t size;
+	int fd;
+
+	/* A truncated record stops the load, and the cache gets rebuilt. */
+	size = file_size(CACHE_FILE);
+	test_pass(truncate(CACHE_FILE, size - 4) == 0);
+	load_files(NULL, NULL);
+	test_log("files-cache: corrupt record 1");
+	test_log("files-cache: 1 records, 1 live, rebuild yes");
+	test_files(list_a, list_b);
+	test_pass(file_size(CACHE_FILE) == size);
+
+	/* A corrupted record data does not match its checksum. */
+	cache = read_file(CACHE_FILE);
+	cache[size - 2] ^= 0x20;
+	fd = open(CACHE_FILE, O_WRONLY);
+	test_pass(fd_write(fd, cache, size) == size);
+	test_pass(close(fd) == 0);
+	free(cache);
+	load_files(NULL, NULL);
+	test_log("files-cache: corrupt record 1");
+	test_files(list_a, list_b);
+	test_pass(file_size(CACHE_FILE) == size);
+
+	/* An unknown format gets ignored and replaced. */
+	write_file(CACHE_FILE, "garbage\n");
+	load_files(NULL, NULL);
+	test_log("files-cache: unknown format");
+	test_log("files-cache: 0 records, 0 live, rebuild yes");
+	test_files(list_a, list_b);
+	test_pass(file_size(CACHE_FILE) == size);
+
+	load_files(NULL, NULL);
+	test_log("files-cache: 2 records, 2 live, rebuild no");
+	test_files(list_a, list_b);
+}
+
+TEST_ENTRY(test)
+{
+	test_plan(68);
+
+	test_pass(dir_make_path(INFO_DIR, 0755) == 0);
+	dpkg_db_set_dir(ADMIN_DIR);
+
+	write_file(STATUS_FILE, status);
+	write_file(LIST_A, list_a);
+	write_file(LIST_B, list_b);
+
+	test_cache_rebuild();
+	test_cache_append();
+	test_cache_stale();
+	test_cache_corrupt();
+}
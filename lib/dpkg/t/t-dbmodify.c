@@ -0,0 +1,224 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * t-dbmodify.c - test status database update files
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include <dpkg/test.h>
+#include <dpkg/fdio.h>
+#include <dpkg/dir.h>
+#include <dpkg/file.h>
+#include <dpkg/subproc.h>
+#include <dpkg/dpkg-db.h>
+#include <dpkg/pkg.h>
+
+#define ADMIN_DIR	"t.tmp/t-dbmodify"
+#define STATUS_FILE	ADMIN_DIR "/status"
+#define STATUS_NEW	ADMIN_DIR "/status-new"
+#define UPDATES_DIR	ADMIN_DIR "/updates"
+
+static const char status[] =
+	"Package: pkg-a\n"
+	"Status: install ok installed\n"
+	"Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+	"Architecture: all\n"
+	"Version: 1.0-1\n"
+	"Description: test package A\n"
+	"\n"
+	"Package: pkg-b\n"
+	"Status: install ok installed\n"
+	"Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+	"Architecture: all\n"
+	"Version: 2.0-1\n"
+	"Description: test package B\n"
+	"\n";
+
+static const char status_triggers[] =
+	"Package: pkg-a\n"
+	"Status: install ok triggers-awaited\n"
+	"Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+	"Architecture: all\n"
+	"Version: 1.0-1\n"
+	"Description: test package A\n"
+	"Triggers-Awaited: pkg-b\n"
+	"\n"
+	"Package: pkg-b\n"
+	"Status: install ok triggers-pending\n"
+	"Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+	"Architecture: all\n"
+	"Version: 2.0-1\n"
+	"Description: test package B\n"
+	"Triggers-Pending: test-trigger\n"
+	"\n";
+
+static void
+write_status(const char *data)
+{
+	int fd;
+
+	fd = open(STATUS_NEW, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	test_pass(fd >= 0);
+	test_pass(fd_write(fd, data, strlen(data)) == (ssize_t)strlen(data));
+	test_pass(close(fd) == 0);
+	test_pass(rename(STATUS_NEW, STATUS_FILE) == 0);
+}
+
+static char *
+read_file(const char *filename)
+{
+	struct varbuf vb = VARBUF_INIT;
+	struct dpkg_error err;
+
+	if (file_slurp(filename, &vb, &err) < 0) {
+		dpkg_error_destroy(&err);
+		return NULL;
+	}
+
+	return varbuf_detach(&vb);
+}
+
+static struct pkginfo *
+find_pkg(const char *name)
+{
+	return pkg_hash_find_singleton(name);
+}
+
+static void
+test_update_file(const char *name, const char *pkgname)
+{
+	char *data;
+
+	data = read_file(name);
+	test_pass(data != NULL && strncmp(data, pkgname, strlen(pkgname)) == 0);
+	free(data);
+}
+
+static void
+note_and_crash(enum pkgwant want, enum pkgstatus status_b)
+{
+	pid_t pid;
+
+	pid = subproc_fork();
+	if (pid == 0) {
+		struct pkginfo *pkg;
+
+		modstatdb_open(msdbrw_write);
+
+		pkg = find_pkg("pkg-a");
+		pkg_set_want(pkg, want);
+		modstatdb_note(pkg);
+
+		pkg = find_pkg("pkg-b");
+		pkg_set_status(pkg, status_b);
+		modstatdb_note(pkg);
+
+		/* Do not checkpoint, to leave the update files behind. */
+		_exit(0);
+	}
+	test_pass(subproc_reap(pid, "crashing writer", 0) == 0);
+}
+
+static void
+test_updates_replay(void)
+{
+	char *data;
+
+	write_status(status);
+
+	note_and_crash(PKG_WANT_HOLD, PKG_STAT_HALFCONFIGURED);
+
+	/* The status file is untouched, and the changes are in numbered
+	 * update files, one per stanza, as expected by other tools. */
+	data = read_file(STATUS_FILE);
+	test_str(data, ==, status);
+	free(data);
+	test_update_file(UPDATES_DIR "/0000", "Package: pkg-a\n");
+	test_update_file(UPDATES_DIR "/0001", "Package: pkg-b\n");
+
+	modstatdb_open(msdbrw_readonly);
+	test_pass(find_pkg("pkg-a")->want == PKG_WANT_HOLD);
+	test_pass(find_pkg("pkg-b")->status == PKG_STAT_HALFCONFIGURED);
+	modstatdb_shutdown();
+
+	/* Opening for writing incorporates the updates into the status. */
+	modstatdb_open(msdbrw_write);
+	modstatdb_shutdown();
+
+	data = read_file(STATUS_FILE);
+	test_pass(strstr(data, "Status: hold ok installed\n") != NULL);
+	test_pass(strstr(data, "Status: install ok half-configured\n") != NULL);
+	free(data);
+
+	test_pass(access(UPDATES_DIR "/0000", F_OK) < 0);
+	test_pass(access(UPDATES_DIR "/0001", F_OK) < 0);
+}
+
+static void
+test_updates_awaiters(void)
+{
+	pid_t pid;
+
+	write_status(status_triggers);
+
+	pid = subproc_fork();
+	if (pid == 0) {
+		struct pkginfo *pkg;
+
+		modstatdb_open(msdbrw_write);
+
+		/* Clearing the pending triggers notes the awaiter too. */
+		pkg = find_pkg("pkg-b");
+		pkg_set_status(pkg, PKG_STAT_INSTALLED);
+		modstatdb_note(pkg);
+
+		_exit(0);
+	}
+	test_pass(subproc_reap(pid, "crashing writer", 0) == 0);
+
+	/* The noted package gets recorded before its awaiters. */
+	test_update_file(UPDATES_DIR "/0000", "Package: pkg-b\n");
+	test_update_file(UPDATES_DIR "/0001", "Package: pkg-a\n");
+
+	modstatdb_open(msdbrw_readonly);
+	test_pass(find_pkg("pkg-a")->status == PKG_STAT_INSTALLED);
+	test_pass(find_pkg("pkg-a")->trigaw.head == NULL);
+	test_pass(find_pkg("pkg-b")->status == PKG_STAT_INSTALLED);
+	test_pass(find_pkg("pkg-b")->trigpend_head == NULL);
+	modstatdb_shutdown();
+
+	modstatdb_open(msdbrw_write);
+	modstatdb_shutdown();
+}
+
+TEST_ENTRY(test)
+{
+	test_plan(26);
+
+	test_pass(dir_make_path(ADMIN_DIR, 0755) == 0);
+	dpkg_db_set_dir(ADMIN_DIR);
+
+	test_updates_replay();
+	test_updates_awaiters();
+}
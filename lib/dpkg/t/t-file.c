@@ -112,6 +112,7 @@ test_file_slurp(void)
 {
 	struct varbuf vb = VARBUF_INIT;
 	struct dpkg_error err = DPKG_ERROR_INIT;
+	struct stat st;
 	char *test_file;
 	char *test_dir;
 	int fd;
@@ -154,6 +155,12 @@ test_file_slurp(void)
 	test_pass(err.type == DPKG_MSG_NONE);
 	varbuf_destroy(&vb);
 
+	test_pass(file_slurp_stat(test_file, &vb, &st, &err) == 0);
+	test_pass(vb.used == strlen(ref_data));
+	test_pass(st.st_size == (off_t)strlen(ref_data));
+	test_pass(S_ISREG(st.st_mode));
+	varbuf_destroy(&vb);
+
 	test_fail(file_is_exec(test_dir));
 	test_fail(file_is_exec(test_file));
 	test_pass(chmod(test_file, 0755) == 0);
@@ -168,7 +175,7 @@ test_file_slurp(void)
 
 TEST_ENTRY(test)
 {
-	test_plan(43);
+	test_plan(47);
 
 	test_file_getcwd();
 	test_file_realpath();
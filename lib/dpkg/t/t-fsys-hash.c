@@ -28,9 +28,18 @@
 static void
 test_fsys_nodes(void)
 {
+	/* The order of the hash bins, of FNV-1a modulo 262139. */
+	static const char *const sorted[] = {
+		"/test/path/dd",
+		"/test/path/bb",
+		"/test/path/ff",
+		"/test/path/aa",
+		"/test/path/cc",
+	};
 	struct fsys_namenode *fnn;
 	struct fsys_hash_iter *iter;
 	const char *name;
+	int i;
 
 	test_pass(fsys_hash_entries() == 0);
 
@@ -66,28 +75,56 @@ test_fsys_nodes(void)
 	test_pass(fnn->oldhash == NULL);
 	test_pass(fnn->newhash == NULL);
 
+	/* The nodes get returned in insertion order. */
 	iter = fsys_hash_iter_new();
-	while ((fnn = fsys_hash_iter_next(iter))) {
-		if (strcmp(fnn->name, "/test/path/aa") == 0)
-			test_str(fnn->name, ==, "/test/path/aa");
-		else if (strcmp(fnn->name, "/test/path/bb") == 0)
-			test_str(fnn->name, ==, "/test/path/bb");
-		else if (strcmp(fnn->name, "/test/path/cc") == 0)
-			test_str(fnn->name, ==, "/test/path/cc");
-		else
-			test_fail("unknown fsys_namenode");
+	fnn = fsys_hash_iter_next(iter);
+	test_str(fnn->name, ==, "/test/path/aa");
+	fnn = fsys_hash_iter_next(iter);
+	test_str(fnn->name, ==, "/test/path/bb");
+
+	/* Including the nodes added while iterating. */
+	fsys_hash_find_node("/test/path/dd", FHFF_NONE);
+	test_pass(fsys_hash_entries() == 4);
+
+	fnn = fsys_hash_iter_next(iter);
+	test_str(fnn->name, ==, "/test/path/cc");
+	fnn = fsys_hash_iter_next(iter);
+	test_str(fnn->name, ==, "/test/path/dd");
+	fnn = fsys_hash_iter_next(iter);
+	test_pass(fnn == NULL);
+
+	/* Even after having reached the end. */
+	fsys_hash_find_node("/test/path/ff", FHFF_NONE);
+	test_pass(fsys_hash_entries() == 5);
+
+	fnn = fsys_hash_iter_next(iter);
+	test_str(fnn->name, ==, "/test/path/ff");
+	fnn = fsys_hash_iter_next(iter);
+	test_pass(fnn == NULL);
+	fsys_hash_iter_free(iter);
+
+	/* The sorted iterator returns the nodes in the previous hash bin
+	 * order, without the nodes added while iterating. */
+	iter = fsys_hash_iter_new_sorted();
+	fsys_hash_find_node("/test/path/gg", FHFF_NONE);
+	test_pass(fsys_hash_entries() == 6);
+	for (i = 0; i < 5; i++) {
+		fnn = fsys_hash_iter_next(iter);
+		test_str(fnn->name, ==, sorted[i]);
 	}
+	fnn = fsys_hash_iter_next(iter);
+	test_pass(fnn == NULL);
 	fsys_hash_iter_free(iter);
 
 	fsys_hash_init();
-	test_pass(fsys_hash_entries() == 3);
+	test_pass(fsys_hash_entries() == 6);
 	fnn = fsys_hash_find_node("/test/path/aa", FHFF_NO_NEW);
 	test_pass(fnn != NULL);
 	fnn = fsys_hash_find_node("/test/path/bb", FHFF_NO_NEW);
 	test_pass(fnn != NULL);
 	fnn = fsys_hash_find_node("/test/path/cc", FHFF_NO_NEW);
 	test_pass(fnn != NULL);
-	test_pass(fsys_hash_entries() == 3);
+	test_pass(fsys_hash_entries() == 6);
 
 	fsys_hash_reset();
 	test_pass(fsys_hash_entries() == 0);
@@ -98,11 +135,22 @@ test_fsys_nodes(void)
 	fnn = fsys_hash_find_node("/test/path/cc", FHFF_NO_NEW);
 	test_pass(fnn == NULL);
 	test_pass(fsys_hash_entries() == 0);
+
+	/* The iteration restarts from scratch after a reset. */
+	iter = fsys_hash_iter_new();
+	test_pass(fsys_hash_iter_next(iter) == NULL);
+	fsys_hash_iter_free(iter);
+	fnn = fsys_hash_find_node("/test/path/ee", FHFF_NONE);
+	iter = fsys_hash_iter_new();
+	test_pass(fsys_hash_iter_next(iter) == fnn);
+	test_pass(fsys_hash_iter_next(iter) == NULL);
+	fsys_hash_iter_free(iter);
+	fsys_hash_reset();
 }
 
 TEST_ENTRY(test)
 {
-	test_plan(35);
+	test_plan(51);
 
 	test_fsys_nodes();
 }
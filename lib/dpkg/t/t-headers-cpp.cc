@@ -23,6 +23,7 @@
 
 #include <dpkg/ar.h>
 #include <dpkg/arch.h>
+#include <dpkg/arena.h>
 #include <dpkg/atomic-file.h>
 #include <dpkg/buffer.h>
 #include <dpkg/c-ctype.h>
@@ -66,6 +67,7 @@
 #include <dpkg/subproc.h>
 #include <dpkg/tarfn.h>
 #include <dpkg/test.h>
+#include <dpkg/thread-pool.h>
 #include <dpkg/treewalk.h>
 #include <dpkg/trigdeferred.h>
 #include <dpkg/triglib.h>
@@ -0,0 +1,322 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * t-parse-cache.c - test binary database file cache, zero-copy and lazy parsing
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include <dpkg/test.h>
+#include <dpkg/varbuf.h>
+#include <dpkg/fdio.h>
+#include <dpkg/file.h>
+#include <dpkg/dpkg-db.h>
+#include <dpkg/pkg-array.h>
+#include <dpkg/pkg-show.h>
+
+#define STATUS_FILE	"t-parse-cache.status"
+#define STATUS_NEW	"t-parse-cache.status-new"
+#define CACHE_FILE	"t-parse-cache.cache"
+
+static const char status_a[] =
+	"Package: pkg-a\n"
+	"Status: install ok installed\n"
+	"Priority: optional\n"
+	"Section: misc\n"
+	"Installed-Size: 10\n"
+	"Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+	"Architecture: all\n"
+	"Version: 1.0-1\n"
+	"Depends: pkg-b (>= 2.0), pkg-c | pkg-d\n"
+	"Conffiles:\n"
+	" /etc/pkg-a.conf 0123456789abcdef0123456789abcdef\n"
+	"Description: test package A\n"
+	" Long description\n"
+	" .\n"
+	" with multiple lines.\n"
+	"X-Custom-Field: custom value\n"
+	"\n"
+	"Package: pkg-b\n"
+	"Status: install ok installed\n"
+	"Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+	"Architecture: all\n"
+	"Multi-Arch: foreign\n"
+	"Version: 2.0-1\n"
+	"Description: test package B\n"
+	"\n";
+
+static const char status_b[] =
+	"Package: pkg-b\n"
+	"Status: install ok installed\n"
+	"Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+	"Architecture: all\n"
+	"Multi-Arch: foreign\n"
+	"Version: 3.0-1\n"
+	"Description: test package B\n"
+	"\n";
+
+static void
+write_file(const char *filename, const char *data)
+{
+	int fd;
+
+	fd = open(STATUS_NEW, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	test_pass(fd >= 0);
+	test_pass(fd_write(fd, data, strlen(data)) == (ssize_t)strlen(data));
+	test_pass(close(fd) == 0);
+	test_pass(rename(STATUS_NEW, filename) == 0);
+}
+
+/* The same size as status_b, so that only the timestamps can tell. */
+static const char status_c[] =
+	"Package: pkg-b\n"
+	"Status: install ok installed\n"
+	"Maintainer: Dpkg Developers <debian-dpkg@lists.debian.org>\n"
+	"Architecture: all\n"
+	"Multi-Arch: foreign\n"
+	"Version: 3.0-2\n"
+	"Description: test package B\n"
+	"\n";
+
+/*
+ * Rewrite a file in place, making sure its timestamp changes, which might
+ * need waiting on filesystems with a coarse timestamp granularity.
+ */
+static void
+rewrite_file(const char *filename, const char *data)
+{
+	struct stat st;
+	int64_t mtime;
+	int fd;
+
+	test_pass(stat(filename, &st) == 0);
+	mtime = file_stat_mtime_nsec(&st);
+
+	do {
+		usleep(1000);
+		fd = open(filename, O_TRUNC | O_WRONLY);
+		if (fd < 0)
+			break;
+		if (fd_write(fd, data, strlen(data)) < 0 ||
+		    fstat(fd, &st) < 0 || close(fd) < 0) {
+			fd = -1;
+			break;
+		}
+	} while (file_stat_mtime_nsec(&st) == mtime);
+	test_pass(fd >= 0 && file_stat_mtime_nsec(&st) != mtime);
+}
+
+static void
+dump_db(struct varbuf *vb)
+{
+	struct pkg_array array;
+	int i;
+
+	varbuf_reset(vb);
+
+	pkg_array_init_from_hash(&array);
+	pkg_array_sort(&array, pkg_sorter_by_nonambig_name_arch);
+
+	for (i = 0; i < array.n_pkgs; i++) {
+		struct pkginfo *pkg = array.pkgs[i];
+
+		if (!pkg_is_informative(pkg, &pkg->installed))
+			continue;
+
+		varbuf_stanza(vb, pkg, &pkg->installed);
+		varbuf_add_char(vb, '\n');
+	}
+
+	pkg_array_destroy(&array);
+}
+
+static off_t
+file_size(const char *filename)
+{
+	struct stat st;
+
+	if (stat(filename, &st) < 0)
+		return -1;
+
+	return st.st_size;
+}
+
+static void
+test_parse_cache(void)
+{
+	struct varbuf ref = VARBUF_INIT;
+	struct varbuf vb = VARBUF_INIT;
+	off_t size;
+	int count;
+
+	unlink(CACHE_FILE);
+	write_file(STATUS_FILE, status_a);
+
+	/* Parse from text, which generates the cache. */
+	count = parsedb_cached(STATUS_FILE, CACHE_FILE, pdb_parse_status, NULL);
+	test_pass(count == 2);
+	test_pass(file_size(CACHE_FILE) > 0);
+	dump_db(&ref);
+	test_str(varbuf_str(&ref), ==, status_a);
+	pkg_hash_reset();
+
+	/* Parse from the cache. */
+	count = parsedb_cached(STATUS_FILE, CACHE_FILE, pdb_parse_status, NULL);
+	test_pass(count == 2);
+	dump_db(&vb);
+	test_str(varbuf_str(&vb), ==, varbuf_str(&ref));
+	pkg_hash_reset();
+
+	/* Replace the database, which makes the cache stale. */
+	write_file(STATUS_FILE, status_b);
+	count = parsedb_cached(STATUS_FILE, CACHE_FILE, pdb_parse_status, NULL);
+	test_pass(count == 1);
+	dump_db(&vb);
+	test_str(varbuf_str(&vb), ==, status_b);
+	pkg_hash_reset();
+
+	/* Rewrite the database in place with the same size, and usually within
+	 * the same second, which only the sub-second timestamps can tell. */
+	rewrite_file(STATUS_FILE, status_c);
+	count = parsedb_cached(STATUS_FILE, CACHE_FILE, pdb_parse_status, NULL);
+	test_pass(count == 1);
+	dump_db(&vb);
+	test_str(varbuf_str(&vb), ==, status_c);
+	pkg_hash_reset();
+
+	/* Truncate the cache, which gets detected and regenerated. */
+	size = file_size(CACHE_FILE);
+	test_pass(truncate(CACHE_FILE, size - 4) == 0);
+	count = parsedb_cached(STATUS_FILE, CACHE_FILE, pdb_parse_status, NULL);
+	test_pass(count == 1);
+	dump_db(&vb);
+	test_str(varbuf_str(&vb), ==, status_c);
+	test_pass(file_size(CACHE_FILE) == size);
+	pkg_hash_reset();
+
+	test_pass(unlink(STATUS_FILE) == 0);
+	test_pass(unlink(CACHE_FILE) == 0);
+
+	varbuf_destroy(&ref);
+	varbuf_destroy(&vb);
+}
+
+static void
+test_parse_zero_copy(void)
+{
+	struct varbuf ref = VARBUF_INIT;
+	struct varbuf vb = VARBUF_INIT;
+	int count;
+
+	write_file(STATUS_FILE, status_a);
+
+	count = parsedb(STATUS_FILE, pdb_parse_status & ~pdb_zero_copy, NULL);
+	test_pass(count == 2);
+	dump_db(&ref);
+	test_str(varbuf_str(&ref), ==, status_a);
+	pkg_hash_reset();
+
+	/* The values get referenced in place, and must survive the file. */
+	count = parsedb(STATUS_FILE, pdb_parse_status | pdb_zero_copy, NULL);
+	test_pass(count == 2);
+	test_pass(unlink(STATUS_FILE) == 0);
+	dump_db(&vb);
+	test_str(varbuf_str(&vb), ==, varbuf_str(&ref));
+	pkg_hash_reset();
+
+	varbuf_destroy(&ref);
+	varbuf_destroy(&vb);
+}
+
+static void
+test_parse_lazy_pkg(void)
+{
+	struct pkginfo *pkg;
+	struct pkgset *set;
+	struct varbuf vb = VARBUF_INIT;
+
+	pkg = pkg_hash_find_singleton("pkg-a");
+	set = pkg_hash_find_set("pkg-b");
+
+	test_pass(pkg->installed.lazy != NULL);
+	test_pass(pkg->installed.depends == NULL);
+	test_pass(pkg->installed.conffiles == NULL);
+	test_pass(set->depended.installed == NULL);
+	test_pass(pkg_is_informative(pkg, &pkg->installed));
+
+	pkgbin_parse_lazy(pkg, &pkg->installed);
+	test_pass(pkg->installed.lazy == NULL);
+	test_pass(pkg->installed.depends != NULL);
+	test_pass(pkg->installed.conffiles != NULL);
+	test_pass(set->depended.installed != NULL);
+	test_pass(set->depended.installed->up->up == pkg);
+
+	dump_db(&vb);
+	test_str(varbuf_str(&vb), ==, status_a);
+	pkg_hash_reset();
+
+	varbuf_destroy(&vb);
+}
+
+static void
+test_parse_lazy(void)
+{
+	struct pkginfo *pkg;
+	int count;
+
+	unlink(CACHE_FILE);
+	write_file(STATUS_FILE, status_a);
+
+	/* The values have not been checked yet, so these get parsed. */
+	count = parsedb(STATUS_FILE, pdb_parse_status | pdb_lazy_fields, NULL);
+	test_pass(count == 2);
+	pkg = pkg_hash_find_singleton("pkg-a");
+	test_pass(pkg->installed.lazy == NULL);
+	test_pass(pkg->installed.depends != NULL);
+	test_pass(pkg_hash_find_set("pkg-b")->depended.installed != NULL);
+	pkg_hash_reset();
+
+	/* The values need to be copied when replayed from the cache. */
+	count = parsedb_cached(STATUS_FILE, CACHE_FILE, pdb_parse_status, NULL);
+	test_pass(count == 2);
+	pkg_hash_reset();
+	count = parsedb_cached(STATUS_FILE, CACHE_FILE,
+	                       pdb_parse_status | pdb_lazy_fields, NULL);
+	test_pass(count == 2);
+	test_parse_lazy_pkg();
+
+	test_pass(unlink(STATUS_FILE) == 0);
+	test_pass(unlink(CACHE_FILE) == 0);
+}
+
+TEST_ENTRY(test)
+{
+	test_plan(57);
+
+	test_parse_cache();
+	test_parse_zero_copy();
+	test_parse_lazy();
+}
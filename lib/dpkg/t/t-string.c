@@ -57,6 +57,8 @@ test_str_match_end(void)
 static void
 test_str_fnv_hash(void)
 {
+	size_t len;
+
 	test_pass(str_fnv_hash("") == 0x811c9dc5U);
 	test_pass(str_fnv_hash("a") == 0xe40c292cUL);
 	test_pass(str_fnv_hash("b") == 0xe70c2de5UL);
@@ -74,6 +76,20 @@ test_str_fnv_hash(void)
 	test_pass(str_fnv_hash("Test-string") == 0x00a54b81UL);
 	test_pass(str_fnv_hash("rest-string") == 0x1cdeebffUL);
 	test_pass(str_fnv_hash("Rest-string") == 0x20464b9fUL);
+
+	test_pass(str_fnv_hash_len("", 0) == 0x811c9dc5U);
+	test_pass(str_fnv_hash_len("foobar", 6) == 0xbf9cf968UL);
+	test_pass(str_fnv_hash_len("foobar", 3) == 0xa9f37ed7UL);
+	test_pass(str_fnv_hash_len("test-string", 11) == 0xd28f6e61UL);
+
+	test_pass(str_fnv_hash_lower("", &len) == 0x811c9dc5U);
+	test_pass(len == 0);
+	test_pass(str_fnv_hash_lower("foobar", &len) == 0xbf9cf968UL);
+	test_pass(len == 6);
+	test_pass(str_fnv_hash_lower("FooBAR", &len) == 0xbf9cf968UL);
+	test_pass(len == 6);
+	test_pass(str_fnv_hash_lower("Test-string", &len) == 0xd28f6e61UL);
+	test_pass(len == 11);
 }
 
 static void
@@ -267,7 +283,7 @@ test_str_strip_quotes(void)
 
 TEST_ENTRY(test)
 {
-	test_plan(74);
+	test_plan(86);
 
 	test_str_is_set();
 	test_str_match_end();
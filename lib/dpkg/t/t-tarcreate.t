@@ -0,0 +1,154 @@
+#!/usr/bin/perl
+#
+# Copyright © 2026 Dpkg Developers
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+use v5.36;
+use version;
+
+use Test::More;
+use Cwd;
+use File::Path qw(make_path);
+use File::Compare;
+use File::Find;
+use POSIX qw(mkfifo);
+
+use Dpkg ();
+use Dpkg::File;
+use Dpkg::IPC;
+
+my $builddir = $ENV{builddir} || '.';
+my $tmpdir = 't.tmp/t-tarcreate';
+
+# We require GNU tar >= 1.29 for --clamp-mtime.
+delete $ENV{TAR_OPTIONS};
+my $tar_version = qx($Dpkg::PROGTAR --version 2>/dev/null);
+if (not $tar_version or $tar_version !~ m/^tar \(GNU tar\) (\d+\.\d+)/ or
+    qv("v$1") < qv('v1.29'))
+{
+    plan skip_all => 'needs GNU tar >= 1.29';
+}
+
+my @options = (
+    [ 'root' ],
+    [ 'user' ],
+    [ 'root', 'u+rw,go=rX' ],
+    [ 'user', 'a+x,o-r' ],
+    [ 'root', '0640' ],
+);
+
+plan tests => scalar @options * 2;
+
+# Set a known umask.
+umask 0022;
+
+sub tar_create_tree {
+    my $long_a = 'a' x 60;
+    my $long_b = 'b' x 60;
+
+    file_dump('file', "data\n");
+    link 'file', 'hardlink';
+    # Enough hard links to grow the table tracking them.
+    make_path('links');
+    foreach my $i (1 .. 100) {
+        file_dump("links/file-$i", "data $i\n");
+        link "links/file-$i", "links/link-$i";
+    }
+    file_dump('executable', "#!/bin/sh\n");
+    chmod 0755, 'executable';
+
+    make_path("$long_a/$long_b");
+    file_dump("$long_a/$long_b/long", 'x' x 1000);
+    # Names filling the name field, with and without room for the NUL.
+    file_touch('n' x 98);
+    file_touch('m' x 99);
+
+    symlink "$long_a/$long_b/long", 'symlink-long';
+    symlink 'l' x 100, 'symlink-100';
+    symlink 'file', 'symlink';
+
+    mkdir 'directory';
+    mkfifo('fifo', 0770);
+
+    # A modification time in the future, which must get clamped.
+    file_touch('future');
+    utime 4000000000, 4000000000, 'future';
+}
+
+sub test_tar_creator {
+    my @paths;
+
+    make_path("$tmpdir/tree");
+
+    my $cwd = getcwd();
+    chdir "$tmpdir/tree";
+    tar_create_tree();
+    find({
+        wanted => sub { push @paths, $_ },
+        preprocess => sub { my @files = sort @_; @files },
+        no_chdir => 1,
+    }, '.');
+    chdir $cwd;
+
+    my $paths_list = join "\0", @paths;
+
+    foreach my $opt (@options) {
+        my ($owner, $mode) = @{$opt};
+        my $name = join ' ', @{$opt};
+        my @tar_opts;
+
+        push @tar_opts, '--mode', $mode if defined $mode;
+        push @tar_opts, '--owner', 'root:0', '--group', 'root:0'
+            if $owner eq 'root';
+
+        spawn(
+            exec => [
+                $Dpkg::PROGTAR,
+                '-cf', '-',
+                '--format=gnu',
+                '-C', "$tmpdir/tree",
+                '--mtime=@1700000000',
+                '--clamp-mtime',
+                @tar_opts,
+                '--null',
+                '--no-unquote',
+                '--no-recursion',
+                '-T-',
+            ],
+            delete_env => [
+                'TAR_OPTIONS',
+            ],
+            wait_child => 1,
+            from_string => \$paths_list,
+            to_file => "$tmpdir/gnu.tar",
+        );
+
+        spawn(
+            exec => [
+                "$builddir/t/c-tarcreate", "$tmpdir/tree", '1700000000',
+                $owner, $mode // (),
+            ],
+            wait_child => 1,
+            no_check => 1,
+            from_string => \$paths_list,
+            to_file => "$tmpdir/dpkg.tar",
+        );
+        ok($? == 0, "tar creator $name should succeed");
+        ok(compare("$tmpdir/gnu.tar", "$tmpdir/dpkg.tar") == 0,
+           "tar creator $name matches GNU tar");
+    }
+}
+
+test_tar_creator();
@@ -41,7 +41,7 @@ if ($tar_version and $tar_version =~ m/^tar \(GNU tar\) (\d+\.\d+)/ and
 {
     plan skip_all => 'needs GNU tar >= 1.27';
 }
-plan tests => 12;
+plan tests => 24;
 
 # Set a known umask.
 umask 0022;
@@ -164,15 +164,21 @@ TAR
         $expected =~ s/\n^.*dddd.*$//mg if $type eq 'v7';
         $expected =~ s/\n^.*symlink-long.*$//mg if $type eq 'ustar';
 
-        spawn(
-            exec => [ "$builddir/t/c-tarextract", "$dirtree.tar" ],
-            no_check => 1,
-            to_string => \$stdout,
-            to_error => \$stderr,
-        );
-        ok($? == 0, "tar extractor $type should succeed");
-        is($stderr, undef, "tar extractor $type stderr is empty");
-        is($stdout, $expected, "tar extractor $type is ok");
+        # Use an odd read-ahead buffer size, so that headers straddle it.
+        foreach my $bufsize (qw(0 1000)) {
+            my $name = "$type bufsize=$bufsize";
+
+            spawn(
+                exec => [ "$builddir/t/c-tarextract", "$dirtree.tar",
+                          $bufsize ],
+                no_check => 1,
+                to_string => \$stdout,
+                to_error => \$stderr,
+            );
+            ok($? == 0, "tar extractor $name should succeed");
+            is($stderr, undef, "tar extractor $name stderr is empty");
+            is($stdout, $expected, "tar extractor $name is ok");
+        }
     }
 }
 
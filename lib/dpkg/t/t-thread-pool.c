@@ -0,0 +1,125 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * t-thread-pool.c - test worker thread pool support
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <dpkg/test.h>
+#include <dpkg/thread-pool.h>
+
+#define TEST_TASKS	256
+
+struct test_work {
+	struct thread_task task;
+	unsigned long input;
+	unsigned long output;
+};
+
+static void
+test_work_run(void *data)
+{
+	struct test_work *work = data;
+	unsigned long i;
+
+	work->output = 0;
+	for (i = 0; i <= work->input; i++)
+		work->output += i;
+}
+
+static void
+test_thread_pool_jobs(int jobs)
+{
+	struct thread_pool *pool;
+	struct test_work work[TEST_TASKS];
+	bool pass = true;
+	int i;
+
+	pool = thread_pool_new(jobs);
+	if (jobs < 2)
+		test_pass(thread_pool_get_jobs(pool) == 0);
+	else
+		test_pass(thread_pool_get_jobs(pool) <= jobs);
+
+	for (i = 0; i < TEST_TASKS; i++) {
+		work[i].task.func = test_work_run;
+		work[i].task.data = &work[i];
+		work[i].input = i * 1000;
+		work[i].output = 0;
+
+		thread_pool_submit(pool, &work[i].task);
+	}
+
+	/* Wait in reverse order, to check out of order completion. */
+	for (i = TEST_TASKS - 1; i >= 0; i--) {
+		unsigned long n = work[i].input;
+
+		thread_pool_wait(pool, &work[i].task);
+		if (work[i].output != n * (n + 1) / 2)
+			pass = false;
+	}
+	test_pass(pass);
+
+	thread_pool_free(pool);
+}
+
+static void
+test_thread_pool_free_pending(void)
+{
+	struct thread_pool *pool;
+	struct test_work work[TEST_TASKS];
+	bool pass = true;
+	int i;
+
+	pool = thread_pool_new(4);
+
+	for (i = 0; i < TEST_TASKS; i++) {
+		work[i].task.func = test_work_run;
+		work[i].task.data = &work[i];
+		work[i].input = i;
+		work[i].output = 0;
+
+		thread_pool_submit(pool, &work[i].task);
+	}
+
+	/* Pending tasks must be completed when freeing the pool. */
+	thread_pool_free(pool);
+
+	for (i = 0; i < TEST_TASKS; i++) {
+		unsigned long n = work[i].input;
+
+		if (work[i].output != n * (n + 1) / 2)
+			pass = false;
+	}
+	test_pass(pass);
+}
+
+TEST_ENTRY(test)
+{
+	test_plan(10);
+
+	test_pass(thread_pool_get_cputhreads() >= 1);
+
+	test_thread_pool_jobs(0);
+	test_thread_pool_jobs(1);
+	test_thread_pool_jobs(2);
+	test_thread_pool_jobs(thread_pool_get_cputhreads());
+
+	test_thread_pool_free_pending();
+}
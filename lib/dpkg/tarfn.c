@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <string.h>
 #include <pwd.h>
@@ -40,7 +41,11 @@
 #include <dpkg/macros.h>
 #include <dpkg/dpkg.h>
 #include <dpkg/i18n.h>
+#include <dpkg/c-ctype.h>
 #include <dpkg/error.h>
+#include <dpkg/fdio.h>
+#include <dpkg/varbuf.h>
+#include <dpkg/string.h>
 #include <dpkg/sysuser.h>
 #include <dpkg/tarfn.h>
 
@@ -381,7 +386,7 @@ tar_gnu_long(struct tar_archive *tar, struct tar_entry *te, char **longp)
 	for (long_read = te->size; long_read > 0; long_read -= TARBLKSZ) {
 		int copysize;
 
-		status = tar->ops->read(tar, buf, TARBLKSZ);
+		status = tar_archive_read(tar, buf, TARBLKSZ);
 		if (status == TARBLKSZ) {
 			status = 0;
 		} else {
@@ -435,6 +440,106 @@ struct tar_symlink_entry {
 	struct tar_entry h;
 };
 
+static ssize_t
+tar_archive_fill(struct tar_archive *tar)
+{
+	int n;
+
+	n = tar->ops->read(tar, tar->buf, tar->ops->read_bufsize);
+	if (n < 0)
+		return n;
+
+	tar->buf_pos = 0;
+	tar->buf_len = n;
+
+	return n;
+}
+
+/**
+ * Get a pointer to the next archive data in the read-ahead buffer.
+ *
+ * This avoids copying the entry data out of the buffer, and can only be
+ * used when the archive is being read with a read-ahead buffer.
+ *
+ * @return The amount of data available at ptr, which is at most len, 0 on
+ *         end of archive, or a negative value on error.
+ */
+ssize_t
+tar_archive_read_ptr(struct tar_archive *tar, const char **ptr, size_t len)
+{
+	size_t avail;
+
+	if (tar->buf == NULL)
+		internerr("tar archive read without a read-ahead buffer");
+
+	if (tar->buf_pos == tar->buf_len) {
+		ssize_t n = tar_archive_fill(tar);
+
+		if (n <= 0)
+			return n;
+	}
+
+	avail = min(tar->buf_len - tar->buf_pos, len);
+	*ptr = tar->buf + tar->buf_pos;
+	tar->buf_pos += avail;
+
+	return avail;
+}
+
+/**
+ * Read archive data.
+ *
+ * @return The amount of data read, which is less than len only at the end
+ *         of the archive, or a negative value on error.
+ */
+ssize_t
+tar_archive_read(struct tar_archive *tar, void *buf, size_t len)
+{
+	char *bufp = buf;
+	size_t total = 0;
+
+	if (tar->buf == NULL)
+		return tar->ops->read(tar, buf, len);
+
+	while (total < len) {
+		const char *ptr;
+		ssize_t n;
+
+		n = tar_archive_read_ptr(tar, &ptr, len - total);
+		if (n < 0)
+			return n;
+		if (n == 0)
+			break;
+
+		memcpy(bufp + total, ptr, n);
+		total += n;
+	}
+
+	return total;
+}
+
+static int
+tar_archive_read_header(struct tar_archive *tar, char *buf, const char **hdr)
+{
+	/* Hand out the header in place, unless it straddles a refill. */
+	if (tar->buf && tar->buf_pos == tar->buf_len) {
+		ssize_t n = tar_archive_fill(tar);
+
+		if (n <= 0)
+			return n;
+	}
+	if (tar->buf && tar->buf_len - tar->buf_pos >= TARBLKSZ) {
+		*hdr = tar->buf + tar->buf_pos;
+		tar->buf_pos += TARBLKSZ;
+
+		return TARBLKSZ;
+	}
+
+	*hdr = buf;
+
+	return tar_archive_read(tar, buf, TARBLKSZ);
+}
+
 /**
  * Update the tar entry from system information.
  *
@@ -463,6 +568,7 @@ tar_extractor(struct tar_archive *tar)
 {
 	int status;
 	char buffer[TARBLKSZ];
+	const char *header;
 	struct tar_entry h;
 
 	char *next_long_name, *next_long_link;
@@ -477,10 +583,16 @@ tar_extractor(struct tar_archive *tar)
 	h.stat.uname = NULL;
 	h.stat.gname = NULL;
 
-	while ((status = tar->ops->read(tar, buffer, TARBLKSZ)) == TARBLKSZ) {
+	tar->buf = NULL;
+	tar->buf_pos = 0;
+	tar->buf_len = 0;
+	if (tar->ops->read_bufsize > 0)
+		tar->buf = m_malloc(tar->ops->read_bufsize);
+
+	while ((status = tar_archive_read_header(tar, buffer, &header)) == TARBLKSZ) {
 		int name_len;
 
-		if (tar_header_decode((struct tar_header *)buffer, &h, &tar->err) < 0) {
+		if (tar_header_decode((struct tar_header *)header, &h, &tar->err) < 0) {
 			if (h.name[0] == '\0') {
 				/* The checksum failed on the terminating
 				 * End Of Tape block entry of zeros. */
@@ -608,6 +720,9 @@ tar_extractor(struct tar_archive *tar)
 	free(next_long_name);
 	free(next_long_link);
 
+	free(tar->buf);
+	tar->buf = NULL;
+
 	if (status > 0) {
 		status = dpkg_put_error(&tar->err,
 		                        _("partially read tar header"));
@@ -617,3 +732,559 @@ tar_extractor(struct tar_archive *tar)
 	/* Return whatever I/O function returned. */
 	return status;
 }
+
+/*
+ * Tar archive creation.
+ */
+
+/* The GNU tar default blocking factor. */
+#define TAR_RECORDSZ		(20 * TARBLKSZ)
+#define TAR_WRITER_BUFSZ	(64 * 1024)
+
+/*
+ * The entries with more than one hard link already archived are kept in a
+ * hash table keyed by their device and inode, using open addressing with
+ * linear probing, which grows by doubling its size when reaching the
+ * maximum load factor.
+ */
+
+/* This must always be a power of two. */
+#define TAR_WRITER_LINKS_SIZE_MIN	64
+/* Maximum load factor, in percent. */
+#define TAR_WRITER_LINKS_LOAD_MAX	70
+
+struct tar_writer_link {
+	uint32_t hash;
+	dev_t dev;
+	ino_t ino;
+	char *name;
+	off_t offset;
+};
+
+struct tar_writer {
+	int fd;
+	const char *name;
+	struct tar_pack_options options;
+
+	/* Entries with more than one hard link already archived. */
+	struct tar_writer_link **links;
+	size_t links_size;
+	size_t links_used;
+
+	/* Last looked up user and group names. */
+	uid_t uid;
+	gid_t gid;
+	char *uname;
+	char *gname;
+
+	char *buf;
+	size_t buf_used;
+	off_t size;
+};
+
+/**
+ * Encode a number into a tar header field.
+ *
+ * Values that fit are encoded in zero-padded ASCII octal terminated by a
+ * NUL character, otherwise they are encoded in GNU base-256.
+ */
+static void
+tar_header_put_num(char *s, size_t size, intmax_t value)
+{
+	uintmax_t n = value;
+	size_t i;
+
+	if (value >= 0 && n < ((uintmax_t)1 << (3 * (size - 1)))) {
+		s[size - 1] = '\0';
+		for (i = size - 1; i > 0; i--) {
+			s[i - 1] = '0' + (n & 07);
+			n >>= 3;
+		}
+	} else {
+		for (i = size - 1; i > 0; i--) {
+			s[i] = n & 0xff;
+			n >>= 8;
+		}
+		s[0] = value < 0 ? 0xff : 0x80;
+	}
+}
+
+/**
+ * Apply a chmod(1) style mode specification to a mode.
+ *
+ * Supports an octal mode, or a comma separated list of symbolic clauses,
+ * with the “ugoa” who, the “+-=” operators and the “rwxXst” permissions.
+ */
+static mode_t
+tar_mode_apply(const char *spec, mode_t mode)
+{
+	const char *s = spec;
+
+	if (c_isdigit(*s)) {
+		mode_t value = 0;
+
+		while (*s >= '0' && *s <= '7')
+			value = (value << 3) | (*s++ - '0');
+		if (*s != '\0')
+			internerr("invalid tar mode '%s'", spec);
+
+		return (mode & ~07777) | (value & 07777);
+	}
+
+	for (;;) {
+		mode_t who = 0;
+
+		for (; *s; s++) {
+			if (*s == 'u')
+				who |= S_ISUID | S_IRWXU;
+			else if (*s == 'g')
+				who |= S_ISGID | S_IRWXG;
+			else if (*s == 'o')
+				who |= S_ISVTX | S_IRWXO;
+			else if (*s == 'a')
+				who |= 07777;
+			else
+				break;
+		}
+		if (who == 0)
+			who = 07777;
+
+		if (*s != '+' && *s != '-' && *s != '=')
+			internerr("invalid tar mode '%s'", spec);
+
+		while (*s == '+' || *s == '-' || *s == '=') {
+			char op = *s++;
+			mode_t perm = 0;
+
+			for (; *s; s++) {
+				if (*s == 'r')
+					perm |= S_IRUSR | S_IRGRP | S_IROTH;
+				else if (*s == 'w')
+					perm |= S_IWUSR | S_IWGRP | S_IWOTH;
+				else if (*s == 'x')
+					perm |= S_IXUSR | S_IXGRP | S_IXOTH;
+				else if (*s == 'X' &&
+				         (S_ISDIR(mode) ||
+				          (mode & (S_IXUSR | S_IXGRP | S_IXOTH))))
+					perm |= S_IXUSR | S_IXGRP | S_IXOTH;
+				else if (*s == 's')
+					perm |= S_ISUID | S_ISGID;
+				else if (*s == 't')
+					perm |= S_ISVTX;
+				else if (*s != 'X')
+					break;
+			}
+			perm &= who;
+
+			if (op == '+')
+				mode |= perm;
+			else if (op == '-')
+				mode &= ~perm;
+			else
+				mode = (mode & ~who) | perm;
+		}
+
+		if (*s == '\0')
+			break;
+		if (*s++ != ',')
+			internerr("invalid tar mode '%s'", spec);
+	}
+
+	return mode;
+}
+
+static void
+tar_writer_flush(struct tar_writer *tw)
+{
+	if (tw->buf_used == 0)
+		return;
+
+	if (fd_write(tw->fd, tw->buf, tw->buf_used) < 0)
+		ohshite(_("cannot write tar archive (%s)"), tw->name);
+	tw->buf_used = 0;
+}
+
+static void
+tar_writer_put(struct tar_writer *tw, const void *data, size_t len)
+{
+	const char *ptr = data;
+
+	while (len > 0) {
+		size_t n = min(len, TAR_WRITER_BUFSZ - tw->buf_used);
+
+		if (ptr)
+			memcpy(tw->buf + tw->buf_used, ptr, n);
+		else
+			memset(tw->buf + tw->buf_used, 0, n);
+		tw->buf_used += n;
+		tw->size += n;
+		len -= n;
+		if (ptr)
+			ptr += n;
+
+		if (tw->buf_used == TAR_WRITER_BUFSZ)
+			tar_writer_flush(tw);
+	}
+}
+
+static void
+tar_writer_pad(struct tar_writer *tw, size_t blksz)
+{
+	size_t pad = (blksz - tw->size % blksz) % blksz;
+
+	tar_writer_put(tw, NULL, pad);
+}
+
+static void
+tar_writer_put_header(struct tar_writer *tw, struct tar_header *h)
+{
+	char *block = (char *)h;
+
+	memcpy(h->checksum, "        ", sizeof(h->checksum));
+	tar_header_put_num(h->checksum, sizeof(h->checksum) - 1,
+	                   tar_header_checksum(h));
+
+	tar_writer_put(tw, block, TARBLKSZ);
+}
+
+/**
+ * Encode a GNU longlink or longname entry.
+ *
+ * These are laid out as GNU tar does, see tar_gnu_long() for details.
+ */
+static void
+tar_writer_put_long(struct tar_writer *tw, enum tar_filetype type,
+                    const char *name)
+{
+	char block[TARBLKSZ] = { 0 };
+	struct tar_header *h = (struct tar_header *)block;
+	size_t len = strlen(name) + 1;
+
+	strcpy(h->name, "././@LongLink");
+	tar_header_put_num(h->mode, sizeof(h->mode), 0644);
+	tar_header_put_num(h->uid, sizeof(h->uid), 0);
+	tar_header_put_num(h->gid, sizeof(h->gid), 0);
+	tar_header_put_num(h->size, sizeof(h->size), len);
+	tar_header_put_num(h->mtime, sizeof(h->mtime), 0);
+	h->linkflag = type;
+	memcpy(h->magic, TAR_MAGIC_GNU, sizeof(h->magic));
+	strcpy(h->user, "root");
+	strcpy(h->group, "root");
+
+	tar_writer_put_header(tw, h);
+	tar_writer_put(tw, name, len);
+	tar_writer_pad(tw, TARBLKSZ);
+}
+
+static void
+tar_writer_set_owner(struct tar_writer *tw, struct tar_header *h,
+                     const struct stat *st)
+{
+	uid_t uid = st->st_uid;
+	gid_t gid = st->st_gid;
+
+	if (tw->options.root_owner_group) {
+		uid = 0;
+		gid = 0;
+		strcpy(h->user, "root");
+		strcpy(h->group, "root");
+	} else {
+		if (tw->uname == NULL || tw->uid != uid) {
+			struct passwd *pw = dpkg_sysuser_from_uid(uid);
+
+			free(tw->uname);
+			tw->uname = m_strdup(pw ? pw->pw_name : "");
+			tw->uid = uid;
+		}
+		if (tw->gname == NULL || tw->gid != gid) {
+			struct group *gr = dpkg_sysgroup_from_gid(gid);
+
+			free(tw->gname);
+			tw->gname = m_strdup(gr ? gr->gr_name : "");
+			tw->gid = gid;
+		}
+		strncpy(h->user, tw->uname, sizeof(h->user));
+		strncpy(h->group, tw->gname, sizeof(h->group));
+	}
+
+	tar_header_put_num(h->uid, sizeof(h->uid), uid);
+	tar_header_put_num(h->gid, sizeof(h->gid), gid);
+}
+
+static inline size_t
+tar_writer_links_index(struct tar_writer *tw, uint32_t hash)
+{
+	/* Mix the upper bits in, as we only use the lower ones. */
+	return (hash ^ (hash >> 16)) & (tw->links_size - 1);
+}
+
+static void
+tar_writer_links_resize(struct tar_writer *tw, size_t size)
+{
+	struct tar_writer_link **old_links = tw->links;
+	size_t old_size = tw->links_size;
+	size_t i;
+
+	tw->links = m_calloc(size, sizeof(*tw->links));
+	tw->links_size = size;
+
+	for (i = 0; i < old_size; i++) {
+		size_t n;
+
+		if (old_links[i] == NULL)
+			continue;
+
+		n = tar_writer_links_index(tw, old_links[i]->hash);
+		while (tw->links[n])
+			n = (n + 1) & (tw->links_size - 1);
+		tw->links[n] = old_links[i];
+	}
+
+	free(old_links);
+}
+
+static const struct tar_writer_link *
+tar_writer_find_link(struct tar_writer *tw, const char *name,
+                     const struct stat *st, off_t offset)
+{
+	struct tar_writer_link *link;
+	uint64_t key[2] = { st->st_dev, st->st_ino };
+	uint32_t hash;
+	size_t n;
+
+	hash = str_fnv_hash_len((const char *)key, sizeof(key));
+
+	if (tw->links_size == 0)
+		tar_writer_links_resize(tw, TAR_WRITER_LINKS_SIZE_MIN);
+
+	for (n = tar_writer_links_index(tw, hash); tw->links[n];
+	     n = (n + 1) & (tw->links_size - 1)) {
+		link = tw->links[n];
+		if (link->dev == st->st_dev && link->ino == st->st_ino)
+			return link;
+	}
+
+	link = m_malloc(sizeof(*link));
+	link->hash = hash;
+	link->dev = st->st_dev;
+	link->ino = st->st_ino;
+	link->name = m_strdup(name);
+	link->offset = offset;
+	tw->links[n] = link;
+	tw->links_used++;
+
+	if (tw->links_used * 100 >= tw->links_size * TAR_WRITER_LINKS_LOAD_MAX)
+		tar_writer_links_resize(tw, tw->links_size * 2);
+
+	return NULL;
+}
+
+static void
+tar_writer_put_file(struct tar_writer *tw, const char *name,
+                    const char *pathname, off_t size)
+{
+	int fd;
+
+	fd = open(pathname, O_RDONLY);
+	if (fd < 0)
+		ohshite(_("cannot open '%s'"), pathname);
+
+	while (size > 0) {
+		size_t n = TAR_WRITER_BUFSZ - tw->buf_used;
+		ssize_t r;
+
+		if ((off_t)n > size)
+			n = size;
+
+		r = fd_read(fd, tw->buf + tw->buf_used, n);
+		if (r < 0)
+			ohshite(_("cannot read '%s'"), pathname);
+		if (r == 0)
+			ohshit(_("file '%s' shrank while archiving it"), name);
+
+		tw->buf_used += r;
+		tw->size += r;
+		size -= r;
+
+		if (tw->buf_used == TAR_WRITER_BUFSZ)
+			tar_writer_flush(tw);
+	}
+
+	close(fd);
+
+	tar_writer_pad(tw, TARBLKSZ);
+}
+
+/**
+ * Create a new tar archive writer.
+ *
+ * The archive gets written in GNU format, to the file descriptor fd, and
+ * name is used to describe it in error messages.
+ */
+struct tar_writer *
+tar_writer_new(int fd, const char *name,
+               const struct tar_pack_options *options)
+{
+	struct tar_writer *tw;
+
+	tw = m_malloc(sizeof(*tw));
+	tw->fd = fd;
+	tw->name = name;
+	tw->options = *options;
+	tw->links = NULL;
+	tw->links_size = 0;
+	tw->links_used = 0;
+	tw->uname = NULL;
+	tw->gname = NULL;
+	tw->buf = m_malloc(TAR_WRITER_BUFSZ);
+	tw->buf_used = 0;
+	tw->size = 0;
+
+	return tw;
+}
+
+/**
+ * Add an entry to a tar archive.
+ *
+ * The entry is described by the stat information of pathname, which is
+ * expected to come from lstat(), and it gets archived with name.
+ * Subsequent entries for an already archived inode are archived as hard
+ * links to it. Sockets cannot be archived and get skipped with a warning.
+ */
+void
+tar_writer_add(struct tar_writer *tw, const char *name, const char *pathname,
+               const struct stat *st)
+{
+	char block[TARBLKSZ] = { 0 };
+	struct tar_header *h = (struct tar_header *)block;
+	struct varbuf dirname = VARBUF_INIT;
+	struct varbuf linkbuf = VARBUF_INIT;
+	const struct tar_writer_link *link = NULL;
+	const char *linkname = NULL;
+	intmax_t mtime;
+	off_t offset = tw->size;
+	off_t size = 0;
+	mode_t mode;
+
+	if (S_ISSOCK(st->st_mode)) {
+		warning(_("skipping socket '%s' in tar archive (%s)"),
+		        name, tw->name);
+		return;
+	}
+
+	if (!S_ISDIR(st->st_mode) && st->st_nlink > 1)
+		link = tar_writer_find_link(tw, name, st, offset);
+
+	if (link) {
+		linkname = link->name;
+		h->linkflag = TAR_FILETYPE_HARDLINK;
+	} else if (S_ISREG(st->st_mode)) {
+		h->linkflag = TAR_FILETYPE_FILE;
+		size = st->st_size;
+	} else if (S_ISLNK(st->st_mode)) {
+		ssize_t len;
+
+		len = file_readlink(pathname, &linkbuf, st->st_size);
+		if (len < 0)
+			ohshite(_("cannot read link '%s'"), pathname);
+		if (len > st->st_size)
+			ohshit(_("symbolic link '%s' size has changed from %jd to %zd"),
+			       pathname, (intmax_t)st->st_size, len);
+		linkname = varbuf_str(&linkbuf);
+
+		h->linkflag = TAR_FILETYPE_SYMLINK;
+	} else if (S_ISDIR(st->st_mode)) {
+		size_t len = strlen(name);
+
+		if (len == 0 || name[len - 1] != '/') {
+			varbuf_set_str(&dirname, name);
+			varbuf_add_char(&dirname, '/');
+			name = varbuf_str(&dirname);
+		}
+
+		h->linkflag = TAR_FILETYPE_DIR;
+	} else if (S_ISCHR(st->st_mode) || S_ISBLK(st->st_mode)) {
+		h->linkflag = S_ISCHR(st->st_mode) ? TAR_FILETYPE_CHARDEV :
+		                                     TAR_FILETYPE_BLOCKDEV;
+		tar_header_put_num(h->devmajor, sizeof(h->devmajor),
+		                   major(st->st_rdev));
+		tar_header_put_num(h->devminor, sizeof(h->devminor),
+		                   minor(st->st_rdev));
+	} else if (S_ISFIFO(st->st_mode)) {
+		h->linkflag = TAR_FILETYPE_FIFO;
+	} else {
+		ohshit(_("unknown file type for '%s'"), pathname);
+	}
+
+	if (linkname && strlen(linkname) > sizeof(h->linkname))
+		tar_writer_put_long(tw, TAR_FILETYPE_GNU_LONGLINK, linkname);
+	if (strlen(name) > sizeof(h->name))
+		tar_writer_put_long(tw, TAR_FILETYPE_GNU_LONGNAME, name);
+
+	mode = st->st_mode;
+	if (tw->options.mode)
+		mode = tar_mode_apply(tw->options.mode, mode);
+
+	mtime = st->st_mtime;
+	if (mtime > tw->options.timestamp)
+		mtime = tw->options.timestamp;
+
+	strncpy(h->name, name, sizeof(h->name));
+	tar_header_put_num(h->mode, sizeof(h->mode), mode & 07777);
+	tar_writer_set_owner(tw, h, st);
+	tar_header_put_num(h->size, sizeof(h->size), size);
+	tar_header_put_num(h->mtime, sizeof(h->mtime), mtime);
+	if (linkname)
+		strncpy(h->linkname, linkname, sizeof(h->linkname));
+	memcpy(h->magic, TAR_MAGIC_GNU, sizeof(h->magic));
+
+	tar_writer_put_header(tw, h);
+
+	if (size > 0)
+		tar_writer_put_file(tw, name, pathname, size);
+
+	if (tw->options.index) {
+		varbuf_add_fmt(tw->options.index, "%jd %jd ",
+		               (intmax_t)offset, (intmax_t)(tw->size - offset));
+		if (link)
+			varbuf_add_fmt(tw->options.index, "%jd ",
+			               (intmax_t)link->offset);
+		else
+			varbuf_add_str(tw->options.index, "- ");
+		varbuf_add_str(tw->options.index, name);
+		varbuf_add_char(tw->options.index, '\n');
+	}
+
+	varbuf_destroy(&dirname);
+	varbuf_destroy(&linkbuf);
+}
+
+/**
+ * Finish a tar archive, and release the writer.
+ *
+ * The end of archive marker gets written, and the archive gets padded to
+ * the record size, as GNU tar does.
+ */
+void
+tar_writer_close(struct tar_writer *tw)
+{
+	size_t i;
+
+	tar_writer_put(tw, NULL, TARBLKSZ * 2);
+	tar_writer_pad(tw, TAR_RECORDSZ);
+	tar_writer_flush(tw);
+
+	for (i = 0; i < tw->links_size; i++) {
+		struct tar_writer_link *link = tw->links[i];
+
+		if (link == NULL)
+			continue;
+		free(link->name);
+		free(link);
+	}
+	free(tw->links);
+	free(tw->uname);
+	free(tw->gname);
+	free(tw->buf);
+	free(tw);
+}
@@ -23,7 +23,9 @@
 #define LIBDPKG_TARFN_H
 
 #include <sys/types.h>
+#include <sys/stat.h>
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <dpkg/error.h>
@@ -96,6 +98,14 @@ typedef int tar_make_func(struct tar_archive *tar, struct tar_entry *h);
 
 struct tar_operations {
 	tar_read_func *read;
+	/**
+	 * Size of the read-ahead buffer, or 0 to read each block directly.
+	 *
+	 * When set, the archive gets read in chunks of this size, and the
+	 * entry data must then be consumed with tar_archive_read() or
+	 * tar_archive_read_ptr() instead of directly from the source.
+	 */
+	int read_bufsize;
 
 	tar_make_func *extract_file;
 	tar_make_func *link;
@@ -114,6 +124,11 @@ struct tar_archive {
 	/* Operation functions and context. */
 	const struct tar_operations *ops;
 	void *ctx;
+
+	/* Read-ahead buffer, managed by tar_extractor(). */
+	char *buf;
+	size_t buf_pos;
+	size_t buf_len;
 };
 
 uintmax_t
@@ -124,9 +139,40 @@ tar_atosl(const char *s, size_t size, intmax_t min, intmax_t max);
 void
 tar_entry_update_from_system(struct tar_entry *te);
 
+ssize_t
+tar_archive_read(struct tar_archive *tar, void *buf, size_t len);
+ssize_t
+tar_archive_read_ptr(struct tar_archive *tar, const char **ptr, size_t len);
+
 int
 tar_extractor(struct tar_archive *tar);
 
+struct tar_pack_options {
+	/** Clamp the entries modification time to this timestamp. */
+	intmax_t timestamp;
+	/** A chmod(1) style mode to apply to the entries, or NULL. */
+	const char *mode;
+	/** Whether to archive the entries as owned by root. */
+	bool root_owner_group;
+	/**
+	 * If not NULL, append an index line for each entry, with its offset
+	 * and size in the archive, the offset of its hard link target entry
+	 * or "-", and its name, separated by spaces.
+	 */
+	struct varbuf *index;
+};
+
+struct tar_writer;
+
+struct tar_writer *
+tar_writer_new(int fd, const char *name,
+               const struct tar_pack_options *options);
+void
+tar_writer_add(struct tar_writer *tw, const char *name, const char *pathname,
+               const struct stat *st);
+void
+tar_writer_close(struct tar_writer *tw);
+
 /** @} */
 
 DPKG_END_DECLS
@@ -0,0 +1,262 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * thread-pool.c - worker thread pool support
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <signal.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include <dpkg/dpkg.h>
+#include <dpkg/debug.h>
+#include <dpkg/thread-pool.h>
+
+struct thread_pool {
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t lock;
+	pthread_cond_t todo_cond;
+	pthread_cond_t done_cond;
+	pthread_t *threads;
+
+	struct thread_task *head;
+	struct thread_task *tail;
+	bool shutdown;
+#endif
+	int n_threads;
+};
+
+/**
+ * Get the number of threads that can run in parallel.
+ *
+ * @return The number of online CPUs, or 1 if there is no threads support.
+ */
+int
+thread_pool_get_cputhreads(void)
+{
+	long threads_max = 1;
+
+#if defined(HAVE_PTHREAD) && defined(_SC_NPROCESSORS_ONLN)
+	threads_max = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads_max < 1)
+		return 1;
+#endif
+
+	return threads_max;
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+thread_pool_worker(void *arg)
+{
+	struct thread_pool *pool = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		struct thread_task *task;
+
+		while (pool->head == NULL && !pool->shutdown)
+			pthread_cond_wait(&pool->todo_cond, &pool->lock);
+
+		task = pool->head;
+		if (task == NULL)
+			break;
+		pool->head = task->next;
+		if (pool->head == NULL)
+			pool->tail = NULL;
+
+		pthread_mutex_unlock(&pool->lock);
+
+		task->func(task->data);
+
+		pthread_mutex_lock(&pool->lock);
+		task->done = true;
+		pthread_cond_broadcast(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void
+thread_pool_start(struct thread_pool *pool, int jobs)
+{
+	sigset_t sigmask, sigmask_old;
+	int i;
+
+	if (pthread_mutex_init(&pool->lock, NULL) != 0)
+		return;
+	if (pthread_cond_init(&pool->todo_cond, NULL) != 0) {
+		pthread_mutex_destroy(&pool->lock);
+		return;
+	}
+	if (pthread_cond_init(&pool->done_cond, NULL) != 0) {
+		pthread_cond_destroy(&pool->todo_cond);
+		pthread_mutex_destroy(&pool->lock);
+		return;
+	}
+
+	pool->head = NULL;
+	pool->tail = NULL;
+	pool->shutdown = false;
+	pool->threads = m_malloc(jobs * sizeof(*pool->threads));
+
+	/* The signals must be handled by the main thread. */
+	sigfillset(&sigmask);
+	pthread_sigmask(SIG_SETMASK, &sigmask, &sigmask_old);
+
+	for (i = 0; i < jobs; i++) {
+		if (pthread_create(&pool->threads[i], NULL,
+		                   thread_pool_worker, pool) != 0)
+			break;
+		pool->n_threads++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &sigmask_old, NULL);
+
+	if (pool->n_threads == 0) {
+		free(pool->threads);
+		pthread_cond_destroy(&pool->done_cond);
+		pthread_cond_destroy(&pool->todo_cond);
+		pthread_mutex_destroy(&pool->lock);
+	}
+
+	debug(dbg_general, "thread-pool: started %d threads", pool->n_threads);
+}
+
+static void
+thread_pool_stop(struct thread_pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->todo_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->n_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	free(pool->threads);
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->todo_cond);
+	pthread_mutex_destroy(&pool->lock);
+}
+#endif
+
+/**
+ * Create a new thread pool.
+ *
+ * If jobs is less than 2, or there is no threads support, or the threads
+ * cannot be created, the tasks get run synchronously when submitted.
+ *
+ * @param jobs The number of worker threads to start.
+ */
+struct thread_pool *
+thread_pool_new(int jobs)
+{
+	struct thread_pool *pool;
+
+	pool = m_malloc(sizeof(*pool));
+	pool->n_threads = 0;
+
+#ifdef HAVE_PTHREAD
+	if (jobs > 1)
+		thread_pool_start(pool, jobs);
+#endif
+
+	return pool;
+}
+
+/**
+ * Get the number of worker threads in the pool.
+ *
+ * @return The number of threads, or 0 if the tasks are run synchronously.
+ */
+int
+thread_pool_get_jobs(struct thread_pool *pool)
+{
+	return pool->n_threads;
+}
+
+/**
+ * Submit a task to be run by the thread pool.
+ *
+ * The task must stay valid until it has been waited for.
+ */
+void
+thread_pool_submit(struct thread_pool *pool, struct thread_task *task)
+{
+	task->next = NULL;
+	task->done = false;
+
+	if (pool->n_threads == 0) {
+		task->func(task->data);
+		task->done = true;
+		return;
+	}
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&pool->lock);
+	if (pool->tail)
+		pool->tail->next = task;
+	else
+		pool->head = task;
+	pool->tail = task;
+	pthread_cond_signal(&pool->todo_cond);
+	pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+/**
+ * Wait for a submitted task to finish.
+ */
+void
+thread_pool_wait(struct thread_pool *pool, struct thread_task *task)
+{
+	if (pool->n_threads == 0)
+		return;
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&pool->lock);
+	while (!task->done)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+/**
+ * Free the thread pool.
+ *
+ * Any pending task is run to completion before the threads are stopped.
+ */
+void
+thread_pool_free(struct thread_pool *pool)
+{
+#ifdef HAVE_PTHREAD
+	if (pool->n_threads > 0)
+		thread_pool_stop(pool);
+#endif
+
+	free(pool);
+}
@@ -0,0 +1,72 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * thread-pool.h - worker thread pool support
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBDPKG_THREAD_POOL_H
+#define LIBDPKG_THREAD_POOL_H
+
+#include <stdbool.h>
+
+#include <dpkg/macros.h>
+
+DPKG_BEGIN_DECLS
+
+/**
+ * @defgroup thread_pool Worker thread pool support
+ * @ingroup dpkg-internal
+ * @{
+ *
+ * The task functions are run on the worker threads, so they must not use
+ * the error handling functions, such as ohshit(), nor any other non-thread
+ * safe code. Any error must be stored in the task data, and handled by the
+ * caller after waiting for the task.
+ */
+
+typedef void thread_task_func(void *data);
+
+struct thread_task {
+	thread_task_func *func;
+	void *data;
+
+	/* Private members. */
+	struct thread_task *next;
+	bool done;
+};
+
+struct thread_pool;
+
+int
+thread_pool_get_cputhreads(void);
+
+struct thread_pool *
+thread_pool_new(int jobs);
+int
+thread_pool_get_jobs(struct thread_pool *pool);
+void
+thread_pool_submit(struct thread_pool *pool, struct thread_task *task);
+void
+thread_pool_wait(struct thread_pool *pool, struct thread_task *task);
+void
+thread_pool_free(struct thread_pool *pool);
+
+/** @} */
+
+DPKG_END_DECLS
+
+#endif /* LIBDPKG_THREAD_POOL_H */
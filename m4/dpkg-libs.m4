@@ -23,6 +23,39 @@ AC_DEFUN([DPKG_LIB_MD], [
   AS_IF([test "$have_libmd" = "no"], [
     AC_MSG_FAILURE([md5 digest functions not found])
   ])
+
+  dpkg_save_libmd_LIBS=$LIBS
+  LIBS="$MD_LIBS $LIBS"
+  AC_CHECK_HEADER([sha1.h], [
+    AC_CHECK_FUNC([SHA1Init], [
+      AC_DEFINE([HAVE_SHA1_H], [1],
+        [Define to 1 if you have <sha1.h> and the SHA1Init function])
+    ])
+  ])
+  have_sha256="no"
+  dnl The libmd, NetBSD and OpenBSD interface.
+  AC_CHECK_HEADER([sha2.h], [
+    AC_CHECK_FUNC([SHA256Init], [
+      have_sha256="yes"
+      AC_DEFINE([HAVE_SHA2_H], [1],
+        [Define to 1 if you have <sha2.h> and the SHA256Init function])
+    ])
+  ])
+  dnl The FreeBSD interface.
+  AS_IF([test "$have_sha256" = "no"], [
+    AC_CHECK_HEADER([sha256.h], [
+      AC_CHECK_FUNC([SHA256_Init], [
+        have_sha256="yes"
+        AC_DEFINE([HAVE_SHA256_H], [1],
+          [Define to 1 if you have <sha256.h> and the SHA256_Init function])
+      ])
+    ])
+  ])
+  AS_IF([test "$have_sha256" = "yes"], [
+    AC_DEFINE([HAVE_SHA256], [1],
+      [Define to 1 if SHA-256 digest functions are available])
+  ])
+  LIBS=$dpkg_save_libmd_LIBS
 ])# DPKG_LIB_MD
 
 # DPKG_WITH_COMPRESS_LIB(NAME, HEADER, FUNC)
@@ -225,6 +258,29 @@ AC_DEFUN([DPKG_LIB_RT], [
   ])
 ])# DPKG_LIB_RT
 
+# DPKG_LIB_PTHREAD
+# ----------------
+# Check for POSIX threads library
+AC_DEFUN([DPKG_LIB_PTHREAD], [
+  AC_ARG_VAR([PTHREAD_LIBS], [linker flags for pthread library])dnl
+  have_libpthread="no"
+  AC_CHECK_HEADERS([pthread.h], [
+    dpkg_save_libpthread_LIBS=$LIBS
+    AC_SEARCH_LIBS([pthread_create], [pthread])
+    LIBS=$dpkg_save_libpthread_LIBS
+    AS_IF([test "$ac_cv_search_pthread_create" = "none required"], [
+      have_libpthread="builtin"
+    ], [test "$ac_cv_search_pthread_create" != "no"], [
+      have_libpthread="yes"
+      PTHREAD_LIBS="$ac_cv_search_pthread_create"
+    ])
+  ])
+  AS_IF([test "$have_libpthread" != "no"], [
+    AC_DEFINE([HAVE_PTHREAD], [1],
+      [Define to 1 if you have POSIX threads support])
+  ])
+])# DPKG_LIB_PTHREAD
+
 # DPKG_LIB_SOCKET
 # ---------------
 # Check for Solaris socket library
@@ -20,8 +20,9 @@
 use v5.36;
 
 use Getopt::Long qw(:config posix_default bundling_values no_ignorecase);
-use List::Util qw(none);
+use List::Util qw(any none);
 use File::Find;
+use File::Temp;
 
 use Dpkg ();
 use Dpkg::Gettext;
@@ -31,6 +32,7 @@ use Dpkg::Control;
 use Dpkg::Version;
 use Dpkg::Checksums;
 use Dpkg::Compression::FileHandle;
+use Dpkg::IPC;
 
 textdomain('dpkg-dev');
 
@@ -60,6 +62,7 @@ my %options = (
     multiversion    => 0,
     'extra-override' => undef,
     medium          => undef,
+    jobs            => 1,
 );
 
 my @options_spec = (
@@ -72,6 +75,7 @@ my @options_spec = (
     'multiversion|m!',
     'extra-override|e=s',
     'medium|M=s',
+    'jobs|j=i',
 );
 
 sub usage {
@@ -112,6 +116,10 @@ sub usage {
 "          Add X-Medium field for dselect media access method.\n" .
     ''));
     print_option(g_(
+"  -j, --jobs <jobs>\n" .
+"          Scan <jobs> packages in parallel (0 means all CPUs).\n" .
+    ''));
+    print_option(g_(
 "  -?, --help\n" .
 "          Show this help message.\n" .
     ''));
@@ -193,8 +201,8 @@ sub load_override_extra
     close($comp_file);
 }
 
-sub process_deb {
-    my ($pathprefix, $fn) = @_;
+sub read_deb_fields {
+    my $fn = shift;
 
     my $fields = Dpkg::Control->new(type => CTRL_REPO_PKG);
 
@@ -209,6 +217,22 @@ sub process_deb {
         return;
     }
 
+    warning(g_('package %s (filename %s) has Filename field!'),
+            $fields->{'Package'} // '', $fn)
+        if defined($fields->{'Filename'});
+
+    return $fields;
+}
+
+sub checksum_field {
+    my $alg = shift;
+
+    return $alg eq 'md5' ? 'MD5sum' : $alg;
+}
+
+sub process_deb {
+    my ($pathprefix, $fn, $fields) = @_;
+
     my $p = $fields->{'Package'};
     error(g_('no Package field in control file of %s'), $fn)
         if not defined $p;
@@ -234,25 +258,79 @@ sub process_deb {
         }
     }
 
-    warning(g_('package %s (filename %s) has Filename field!'), $p, $fn)
-        if defined($fields->{'Filename'});
     $fields->{'Filename'} = "$pathprefix$fn";
 
-    my $sums = Dpkg::Checksums->new();
-    $sums->add_from_file($fn, checksums => \@checksums);
-    foreach my $alg (@checksums) {
-        if ($alg eq 'md5') {
-            $fields->{'MD5sum'} = $sums->get_checksum($fn, $alg);
-        } else {
-            $fields->{$alg} = $sums->get_checksum($fn, $alg);
+    # The scanner emits the checksums it supports, only keep the requested
+    # ones, and compute any missing ones, as when not using the scanner.
+    foreach my $alg (checksums_get_list()) {
+        next if any { $alg eq $_ } @checksums;
+        delete $fields->{checksum_field($alg)};
+    }
+    my @missing = grep { not defined $fields->{checksum_field($_)} } @checksums;
+    if (@missing or not defined $fields->{'Size'}) {
+        my $sums = Dpkg::Checksums->new();
+        $sums->add_from_file($fn, checksums => \@missing);
+        foreach my $alg (@missing) {
+            $fields->{checksum_field($alg)} = $sums->get_checksum($fn, $alg);
         }
+        $fields->{'Size'} //= $sums->get_size($fn);
     }
-    $fields->{'Size'} = $sums->get_size($fn);
     $fields->{'X-Medium'} = $options{medium} if defined $options{medium};
 
     push @{$packages{$p}}, $fields;
 }
 
+sub scan_is_supported {
+    # Older dpkg-deb versions do not support --scan, otherwise with no
+    # archives to scan it outputs nothing and succeeds.
+    spawn(
+        exec => [ 'dpkg-deb', '--scan' ],
+        from_file => '/dev/null',
+        to_file => '/dev/null',
+        error_to_file => '/dev/null',
+        wait_child => 1,
+        no_check => 1,
+    );
+
+    return $? == 0;
+}
+
+sub scan_debs {
+    my ($pathprefix, @archives) = @_;
+
+    # The archive names are passed one per line to the scanner.
+    my $archives_fh = File::Temp->new();
+    foreach my $fn (@archives) {
+        if ($fn =~ m/\n/) {
+            warning(g_('filename %s contains a newline, skipping package'),
+                    $fn);
+            next;
+        }
+        print { $archives_fh } "$fn\n";
+    }
+    close $archives_fh;
+
+    my $scan_fh;
+    my $scan_pid = spawn(
+        exec => [ 'dpkg-deb', "--jobs=$options{jobs}", '--scan' ],
+        from_file => $archives_fh->filename,
+        to_pipe => \$scan_fh,
+    );
+    while (1) {
+        my $fields = Dpkg::Control->new(type => CTRL_REPO_PKG);
+
+        $fields->parse($scan_fh, g_('dpkg-deb --scan output'))
+            or last;
+        process_deb($pathprefix, $fields->{'Filename'}, $fields);
+    }
+    close $scan_fh;
+    wait_child($scan_pid, no_check => 1, cmdline => 'dpkg-deb --scan');
+    if ($?) {
+        warning(g_("'dpkg-deb --scan' exited with %d, some packages were skipped"),
+                $?);
+    }
+}
+
 {
     local $SIG{__WARN__} = sub { usageerr($_[0]) };
     GetOptions(\%options, @options_spec);
@@ -262,6 +340,10 @@ if (not 1 <= @ARGV <= 3) {
     usageerr(g_('one to three arguments expected'));
 }
 
+if ($options{jobs} < 0) {
+    usageerr(g_('invalid number of jobs %d'), $options{jobs});
+}
+
 my $type = $options{type} // 'deb';
 my $arch = $options{arch};
 my %hash = map { $_ => 1 } split /,/, $options{hash} // '';
@@ -303,8 +385,15 @@ my $scan_archives = {
     follow_skip => 2,
 };
 find($scan_archives, $binarypath);
-foreach my $fn (@archives) {
-    process_deb($pathprefix, $fn);
+
+if (scan_is_supported()) {
+    scan_debs($pathprefix, @archives);
+} else {
+    foreach my $fn (@archives) {
+        my $fields = read_deb_fields($fn);
+
+        process_deb($pathprefix, $fn, $fields) if defined $fields;
+    }
 }
 
 load_override($override) if defined $override;
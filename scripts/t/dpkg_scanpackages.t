@@ -0,0 +1,155 @@
+#!/usr/bin/perl
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+use v5.36;
+
+use Test::More;
+use Test::Dpkg qw(:needs :paths);
+
+use File::Spec::Functions qw(rel2abs catfile path);
+use File::Path qw(make_path);
+
+use Dpkg::File;
+use Dpkg::IPC;
+use Dpkg::Checksums;
+use Dpkg::Control;
+
+test_needs_command('dpkg-deb');
+
+plan tests => 10;
+
+my $srcdir = rel2abs($ENV{srcdir} || '.');
+my $tmpdir = test_get_temp_path();
+
+$ENV{$_} = rel2abs($ENV{$_}) foreach qw(DPKG_DATADIR);
+
+chdir $tmpdir;
+
+my %pkgs = (
+    'pkg-scan-a' => '1.0-1',
+    'pkg-scan-b' => '2:0.5',
+    'pkg-scan-c' => '0.1',
+);
+
+make_path('pool');
+foreach my $pkg (sort keys %pkgs) {
+    make_path("$pkg/DEBIAN", "$pkg/usr/share/$pkg");
+    file_dump("$pkg/DEBIAN/control", <<"CONTROL");
+Package: $pkg
+Version: $pkgs{$pkg}
+Architecture: all
+Maintainer: Dpkg Developers <debian-dpkg\@lists.debian.org>
+Description: test package for dpkg-scanpackages
+CONTROL
+    file_dump("$pkg/usr/share/$pkg/data", "data for $pkg\n" x 1000);
+
+    spawn(
+        exec => [ 'dpkg-deb', '--root-owner-group', '-b', $pkg,
+                  "pool/${pkg}_all.deb" ],
+        to_file => '/dev/null',
+        wait_child => 1,
+    );
+}
+
+sub scanpackages {
+    my @args = @_;
+    my $output;
+
+    spawn(
+        exec => [ $ENV{PERL}, "$srcdir/dpkg-scanpackages.pl", @args ],
+        to_string => \$output,
+        error_to_file => '/dev/null',
+        wait_child => 1,
+    );
+
+    return $output;
+}
+
+sub parse_stanzas {
+    my $output = shift;
+    my @stanzas;
+
+    open my $fh, '<', \$output or die "cannot open output: $!\n";
+    while (1) {
+        my $fields = Dpkg::Control->new(type => CTRL_REPO_PKG);
+
+        $fields->parse($fh, 'dpkg-scanpackages output')
+            or last;
+        push @stanzas, $fields;
+    }
+    close $fh;
+
+    return @stanzas;
+}
+
+# Scan with the default single job.
+my $output = scanpackages('pool');
+my @stanzas = parse_stanzas($output);
+is_deeply([ map { $_->{Package} } @stanzas ], [ sort keys %pkgs ],
+          'scanned packages in order');
+
+foreach my $fields (@stanzas) {
+    my $fn = $fields->{Filename};
+    my $sums = Dpkg::Checksums->new();
+
+    $sums->add_from_file($fn);
+    my %expected = (
+        Size => -s $fn,
+        MD5sum => $sums->get_checksum($fn, 'md5'),
+        SHA1 => $sums->get_checksum($fn, 'sha1'),
+        SHA256 => $sums->get_checksum($fn, 'sha256'),
+    );
+    my %got = map { $_ => $fields->{$_} } keys %expected;
+
+    is_deeply(\%got, \%expected, "size and checksums for $fn");
+}
+
+# The output does not depend on the number of jobs.
+is(scanpackages('--jobs=4', 'pool'), $output, 'scan with 4 jobs');
+is(scanpackages('--jobs=0', 'pool'), $output, 'scan with all CPUs');
+is(scanpackages('-j2', 'pool', '/dev/null', 'prefix/'),
+   $output =~ s{^Filename: }{Filename: prefix/}mgr,
+   'scan with a path prefix');
+
+# Only the requested checksums get output.
+@stanzas = parse_stanzas(scanpackages('--jobs=2', '--hash=md5', 'pool'));
+is_deeply([ map { [ sort grep { m/^(?:MD5sum|SHA1|SHA256)$/ } keys %{$_} ] }
+            @stanzas ],
+          [ ([ 'MD5sum' ]) x 3 ],
+          'scan with only the md5 checksum');
+
+# Use a dpkg-deb that does not support --scan.
+my $dpkg_deb = (grep { -x } map { catfile($_, 'dpkg-deb') } path())[0];
+make_path('bin');
+file_dump('bin/dpkg-deb', <<"SCRIPT");
+#!/bin/sh
+for arg; do
+  case "\$arg" in
+  --scan|--jobs=*)
+    echo "dpkg-deb: error: unknown option \$arg" >&2
+    exit 2
+    ;;
+  esac
+done
+exec '$dpkg_deb' "\$@"
+SCRIPT
+chmod 0755, 'bin/dpkg-deb';
+
+{
+    local $ENV{PATH} = rel2abs('bin') . ":$ENV{PATH}";
+
+    is(scanpackages('pool'), $output, 'scan with fallback');
+    is(scanpackages('--jobs=2', 'pool'), $output, 'scan with fallback and jobs');
+}
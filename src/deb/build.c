@@ -50,15 +50,15 @@
 #include <dpkg/fdio.h>
 #include <dpkg/buffer.h>
 #include <dpkg/subproc.h>
-#include <dpkg/command.h>
 #include <dpkg/compress.h>
+#include <dpkg/tarfn.h>
 #include <dpkg/ar.h>
 #include <dpkg/options.h>
 
 #include "dpkg-deb.h"
 
 static void
-control_treewalk_feed(const char *dir, int fd_out)
+control_treewalk_feed(const char *dir, struct tar_writer *tw)
 {
 	struct treeroot *tree;
 	struct treenode *node;
@@ -68,9 +68,8 @@ control_treewalk_feed(const char *dir, int fd_out)
 		char *nodename;
 
 		nodename = str_fmt("./%s", treenode_get_virtname(node));
-		if (fd_write(fd_out, nodename, strlen(nodename) + 1) < 0)
-			ohshite(_("cannot write filename to tar pipe (%s)"),
-			        _("control member"));
+		tar_writer_add(tw, nodename, treenode_get_pathname(node),
+		               treenode_get_stat(node));
 		free(nodename);
 	}
 	treewalk_close(tree);
@@ -82,6 +81,8 @@ control_treewalk_feed(const char *dir, int fd_out)
 struct file_info {
 	struct file_info *next;
 	char *fn;
+	char *pathname;
+	struct stat st;
 };
 
 static struct file_info *
@@ -91,6 +92,7 @@ file_info_new(const char *filename)
 
 	fi = m_malloc(sizeof(*fi));
 	fi->fn = m_strdup(filename);
+	fi->pathname = NULL;
 	fi->next = NULL;
 
 	return fi;
@@ -100,6 +102,7 @@ static void
 file_info_free(struct file_info *fi)
 {
 	free(fi->fn);
+	free(fi->pathname);
 	free(fi);
 }
 
@@ -152,7 +155,7 @@ file_info_list_free(struct file_info *fi)
 }
 
 static void
-file_treewalk_feed(const char *dir, int fd_out)
+file_treewalk_feed(const char *dir, struct tar_writer *tw)
 {
 	struct treeroot *tree;
 	struct treenode *node;
@@ -178,10 +181,12 @@ file_treewalk_feed(const char *dir, int fd_out)
 		 * symlinks will not appear before their target. */
 		if (S_ISLNK(treenode_get_mode(node))) {
 			fi = file_info_new(nodename);
+			fi->pathname = m_strdup(treenode_get_pathname(node));
+			fi->st = *treenode_get_stat(node);
 			file_info_list_append(&symlist, &symlist_end, fi);
-		} else if (fd_write(fd_out, nodename, strlen(nodename) + 1) < 0) {
-			ohshite(_("cannot write filename to tar pipe (%s)"),
-			        _("data member"));
+		} else {
+			tar_writer_add(tw, nodename, treenode_get_pathname(node),
+			               treenode_get_stat(node));
 		}
 
 		free(nodename);
@@ -189,9 +194,7 @@ file_treewalk_feed(const char *dir, int fd_out)
 	treewalk_close(tree);
 
 	for (fi = symlist; fi; fi = fi->next)
-		if (fd_write(fd_out, fi->fn, strlen(fi->fn) + 1) < 0)
-			ohshite(_("cannot write filename to tar pipe (%s)"),
-			        _("data member"));
+		tar_writer_add(tw, fi->fn, fi->pathname, &fi->st);
 
 	file_info_list_free(symlist);
 }
@@ -509,91 +512,50 @@ gen_dest_pathname_from_pkg(const char *dir, struct pkginfo *pkg)
 	               pkg->available.arch->name, DEBEXT);
 }
 
-typedef void filenames_feed_func(const char *dir, int fd_out);
-
-struct tar_pack_options {
-	intmax_t timestamp;
-	const char *mode;
-	bool root_owner_group;
-};
+typedef void tarball_feed_func(const char *dir, struct tar_writer *tw);
 
 /**
  * Pack the contents of a directory into a tarball.
+ *
+ * The tar archive is generated in-process from the treewalk results, and
+ * fed to a compressor child, unless no compression has been requested.
  */
 static void
-tarball_pack(const char *dir, filenames_feed_func *tar_filenames_feeder,
-             struct tar_pack_options *options,
+tarball_pack(const char *dir, tarball_feed_func *tarball_feeder,
+             struct tar_pack_options *options, const char *member,
              struct compress_params *tar_compress_params, int fd_out)
 {
-	int pipe_filenames[2], pipe_tarball[2];
-	pid_t pid_tar, pid_comp;
+	struct tar_writer *tw;
+	int pipe_tarball[2];
+	pid_t pid_comp;
+
+	if (tar_compress_params->type == COMPRESSOR_TYPE_NONE) {
+		tw = tar_writer_new(fd_out, member, options);
+		tarball_feeder(dir, tw);
+		tar_writer_close(tw);
+		return;
+	}
 
-	/* Fork off a tar. We will feed it a list of filenames on stdin
-	 * later. */
-	m_pipe(pipe_filenames);
 	m_pipe(pipe_tarball);
-	pid_tar = subproc_fork();
-	if (pid_tar == 0) {
-		struct command cmd;
-		char mtime[50];
-
-		m_dup2(pipe_filenames[0], 0);
-		close(pipe_filenames[0]);
-		close(pipe_filenames[1]);
-		m_dup2(pipe_tarball[1], 1);
-		close(pipe_tarball[0]);
-		close(pipe_tarball[1]);
-
-		if (chdir(dir))
-			ohshite(_("cannot change directory to '%s'"), dir);
-
-		snprintf(mtime, sizeof(mtime), "@%jd", options->timestamp);
-
-		command_init(&cmd, TAR, "tar -cf");
-		command_add_args(&cmd, "tar",
-		                 "-cf", "-",
-		                 "--format=gnu",
-		                 "--mtime", mtime,
-		                 "--clamp-mtime",
-		                 NULL);
-		/* Mode might become a positional argument, pass it
-		 * before -T. */
-		if (options->mode)
-			command_add_args(&cmd, "--mode", options->mode, NULL);
-		if (options->root_owner_group)
-			command_add_args(&cmd,
-			                 "--owner", "root:0",
-			                 "--group", "root:0",
-			                 NULL);
-		command_add_args(&cmd,
-		                 "--null",
-		                 "--no-unquote",
-		                 "--no-recursion",
-		                 "-T", "-",
-		                 NULL);
-		command_exec(&cmd);
-	}
-	close(pipe_filenames[0]);
-	close(pipe_tarball[1]);
 
-	/* We should not forget to compress the archive as well. */
+	/* Fork off the compressor, we will feed it the tarball. */
 	pid_comp = subproc_fork();
 	if (pid_comp == 0) {
-		close(pipe_filenames[1]);
+		close(pipe_tarball[1]);
 		compress_filter(tar_compress_params, pipe_tarball[0], fd_out,
 		                _("compressing tar member"));
 		exit(0);
 	}
 	close(pipe_tarball[0]);
 
-	/* All the pipes are set, now lets start feeding filenames to tar. */
-	tar_filenames_feeder(dir, pipe_filenames[1]);
+	/* Now lets start feeding the filesystem objects to the tarball. */
+	tw = tar_writer_new(pipe_tarball[1], member, options);
+	tarball_feeder(dir, tw);
+	tar_writer_close(tw);
 
-	/* All done, clean up wait for tar and <compress> to finish their
-	 * job. */
-	close(pipe_filenames[1]);
+	/* All done, clean up and wait for <compress> to finish its job. */
+	close(pipe_tarball[1]);
 	subproc_reap(pid_comp, _("<compress> from tar -cf"), 0);
-	subproc_reap(pid_tar, "tar -cf", 0);
 }
 
 static intmax_t
@@ -619,7 +581,9 @@ int
 do_build(const char *const *argv)
 {
 	struct compress_params control_compress_params;
+	struct compress_params data_compress_params;
 	struct tar_pack_options tar_options;
+	struct varbuf data_index = VARBUF_INIT;
 	struct dpkg_error err;
 	struct dpkg_ar *ar;
 	intmax_t timestamp;
@@ -673,8 +637,6 @@ do_build(const char *const *argv)
 
 	dpkg_ar_set_mtime(ar, timestamp);
 
-	unsetenv("TAR_OPTIONS");
-
 	/* Create a temporary file to store the control data in. Immediately
 	 * unlink our temporary file so others can't mess with it. */
 	tfbuf = path_make_temp_template("dpkg-deb");
@@ -699,12 +661,13 @@ do_build(const char *const *argv)
 			          err.str);
 	}
 
-	/* Fork a tar to package the control-section of the package. */
+	/* Pack the control-section of the package. */
 	tar_options.mode = "u+rw,go=rX";
 	tar_options.timestamp = timestamp;
 	tar_options.root_owner_group = true;
+	tar_options.index = NULL;
 	tarball_pack(ctrldir, control_treewalk_feed, &tar_options,
-	             &control_compress_params, gzfd);
+	             _("control member"), &control_compress_params, gzfd);
 
 	free(ctrldir);
 
@@ -772,13 +735,22 @@ do_build(const char *const *argv)
 		          deb_format.major, deb_format.minor);
 	}
 
+	/* For a seekable data member, compress it in independent blocks, and
+	 * record where each entry is in the tar archive. */
+	data_compress_params = compress_params;
+	if (opt_seekable) {
+		data_compress_params.block_size = SEEKABLE_BLOCK_SIZE;
+		varbuf_set_str(&data_index, DATAINDEXVERSION "\n");
+	}
+
 	/* Pack the directory into a tarball, feeding files from the
 	 * callback. */
 	tar_options.mode = NULL;
 	tar_options.timestamp = timestamp;
 	tar_options.root_owner_group = opt_root_owner_group;
+	tar_options.index = opt_seekable ? &data_index : NULL;
 	tarball_pack(dir, file_treewalk_feed, &tar_options,
-	             &compress_params, gzfd);
+	             _("data member"), &data_compress_params, gzfd);
 
 	/* Okay, we have data.tar as well now, add it to the ar wrapper. */
 	if (deb_format.major == 2) {
@@ -791,6 +763,11 @@ do_build(const char *const *argv)
 			ohshite(_("cannot rewind temporary file (%s)"),
 			        _("data member"));
 
+		/* The index goes before the data member, so that readers
+		 * do not need to seek back, while older ones skip it. */
+		if (opt_seekable)
+			dpkg_ar_member_put_mem(ar, DATAINDEXMEMBER,
+			                       data_index.buf, data_index.used);
 		dpkg_ar_member_put_file(ar, datamember, gzfd, -1);
 
 		close(gzfd);
@@ -800,6 +777,7 @@ do_build(const char *const *argv)
 
 	dpkg_ar_close(ar);
 
+	varbuf_destroy(&data_index);
 	free(debar);
 
 	return 0;
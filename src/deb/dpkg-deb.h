@@ -33,11 +33,15 @@ action_func do_field;
 action_func do_extract;
 action_func do_vextract;
 action_func do_raw_extract;
+action_func do_extract_path;
+action_func do_scan;
 action_func do_ctrltarfile;
 action_func do_fsystarfile;
 
 extern int opt_verbose;
 extern int opt_root_owner_group;
+extern int opt_seekable;
+extern int opt_jobs;
 extern int opt_uniform_compression;
 extern int opt_debug;
 extern int opt_check;
@@ -77,6 +81,12 @@ extern struct compress_params compress_params;
 #define DEBMAGIC		"debian-binary"
 #define ADMINMEMBER		"control.tar"
 #define DATAMEMBER		"data.tar"
+#define DATAINDEXMEMBER		"_data.index"
+
+#define DATAINDEXVERSION	"1.0"
+
+/* The uncompressed size of the independent blocks in seekable members. */
+#define SEEKABLE_BLOCK_SIZE	(1024 * 1024)
 
 #ifdef PATH_MAX
 # define INTERPRETER_MAX	PATH_MAX
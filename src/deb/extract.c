@@ -31,6 +31,7 @@
 #include <string.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -40,6 +41,8 @@
 #include <dpkg/i18n.h>
 #include <dpkg/dpkg.h>
 #include <dpkg/fdio.h>
+#include <dpkg/path.h>
+#include <dpkg/varbuf.h>
 #include <dpkg/buffer.h>
 #include <dpkg/subproc.h>
 #include <dpkg/command.h>
@@ -89,10 +92,64 @@ read_line(int fd, char *buf, size_t min_size, size_t max_size)
 	return line_size;
 }
 
+static void DPKG_ATTR_NORET
+tar_exec(int fd_in, const char *dir, enum dpkg_tar_options taroption,
+         const char *const *members)
+{
+	struct command cmd;
+
+	command_init(&cmd, TAR, "tar");
+	command_add_arg(&cmd, "tar");
+
+	if ((taroption & DPKG_TAR_LIST) &&
+	    (taroption & DPKG_TAR_EXTRACT))
+		command_add_arg(&cmd, "-xv");
+	else if (taroption & DPKG_TAR_EXTRACT)
+		command_add_arg(&cmd, "-x");
+	else if (taroption & DPKG_TAR_LIST)
+		command_add_arg(&cmd, "-tv");
+	else
+		internerr("unknown or missing tar action '%d'",
+		          taroption);
+
+	if (taroption & DPKG_TAR_PERMS)
+		command_add_arg(&cmd, "-p");
+	if (taroption & DPKG_TAR_NOMTIME)
+		command_add_arg(&cmd, "-m");
+
+	command_add_arg(&cmd, "-f");
+	command_add_arg(&cmd, "-");
+	command_add_arg(&cmd, "--warning=no-timestamp");
+
+	while (members && *members)
+		command_add_arg(&cmd, *members++);
+
+	m_dup2(fd_in, 0);
+	close(fd_in);
+
+	unsetenv("TAR_OPTIONS");
+
+	if (dir) {
+		if (mkdir(dir, 0777) != 0) {
+			if (errno != EEXIST)
+				ohshite(_("cannot create directory '%s'"), dir);
+
+			if (taroption & DPKG_TAR_CREATE_DIR)
+				ohshite(_("unexpected pre-existing pathname %s"),
+				        dir);
+		}
+		if (chdir(dir) != 0)
+			ohshite(_("cannot change directory to '%s'"), dir);
+	}
+
+	command_exec(&cmd);
+}
+
 /* TODO: Refactor to reduce nesting levels. */
-void
-extracthalf(const char *debar, const char *dir,
-            enum dpkg_tar_options taroption, int admininfo)
+static void
+extract_member(const char *debar, const char *dir,
+               enum dpkg_tar_options taroption, int admininfo,
+               const char *const *members)
 {
 	struct dpkg_error err;
 	const char *errstr;
@@ -348,52 +405,8 @@ extracthalf(const char *debar, const char *dir,
 		close(p2[1]);
 
 		c3 = subproc_fork();
-		if (!c3) {
-			struct command cmd;
-
-			command_init(&cmd, TAR, "tar");
-			command_add_arg(&cmd, "tar");
-
-			if ((taroption & DPKG_TAR_LIST) &&
-			    (taroption & DPKG_TAR_EXTRACT))
-				command_add_arg(&cmd, "-xv");
-			else if (taroption & DPKG_TAR_EXTRACT)
-				command_add_arg(&cmd, "-x");
-			else if (taroption & DPKG_TAR_LIST)
-				command_add_arg(&cmd, "-tv");
-			else
-				internerr("unknown or missing tar action '%d'",
-				          taroption);
-
-			if (taroption & DPKG_TAR_PERMS)
-				command_add_arg(&cmd, "-p");
-			if (taroption & DPKG_TAR_NOMTIME)
-				command_add_arg(&cmd, "-m");
-
-			command_add_arg(&cmd, "-f");
-			command_add_arg(&cmd, "-");
-			command_add_arg(&cmd, "--warning=no-timestamp");
-
-			m_dup2(p2[0], 0);
-			close(p2[0]);
-
-			unsetenv("TAR_OPTIONS");
-
-			if (dir) {
-				if (mkdir(dir, 0777) != 0) {
-					if (errno != EEXIST)
-						ohshite(_("cannot create directory '%s'"), dir);
-
-					if (taroption & DPKG_TAR_CREATE_DIR)
-						ohshite(_("unexpected pre-existing pathname %s"),
-						        dir);
-				}
-				if (chdir(dir) != 0)
-					ohshite(_("cannot change directory to '%s'"), dir);
-			}
-
-			command_exec(&cmd);
-		}
+		if (!c3)
+			tar_exec(p2[0], dir, taroption, members);
 		close(p2[0]);
 		subproc_reap(c3, "tar", 0);
 	}
@@ -403,6 +416,13 @@ extracthalf(const char *debar, const char *dir,
 		subproc_reap(c1, _("paste"), 0);
 }
 
+void
+extracthalf(const char *debar, const char *dir,
+            enum dpkg_tar_options taroption, int admininfo)
+{
+	extract_member(debar, dir, taroption, admininfo, NULL);
+}
+
 int
 do_ctrltarfile(const char *const *argv)
 {
@@ -535,3 +555,397 @@ do_raw_extract(const char *const *argv)
 
 	return 0;
 }
+
+struct data_index_entry {
+	off_t offset;
+	off_t size;
+	off_t link_offset;
+	char *name;
+	bool selected;
+};
+
+struct data_index {
+	struct data_index_entry *entries;
+	size_t nentries;
+	size_t size;
+};
+
+/*
+ * Locate the data member of a seekable archive, and load its index.
+ *
+ * Returns false if the archive cannot be accessed randomly, in which case
+ * the caller needs to fall back to extracting from the whole stream.
+ */
+static bool
+data_index_open(struct dpkg_ar *ar, struct varbuf *index,
+                struct compress_params *params, off_t *data_offset,
+                off_t *data_size)
+{
+	struct dpkg_error err;
+	char versionbuf[40];
+	off_t ar_pos;
+	ssize_t rc;
+	bool header_done = false;
+
+	if (!ar->is_seekable)
+		return false;
+
+	rc = read_line(ar->fd, versionbuf, strlen(DPKG_AR_MAGIC),
+	               sizeof(versionbuf) - 1);
+	if (rc <= 0)
+		read_fail(rc, ar->name, _("archive magic version number"));
+	if (strcmp(versionbuf, DPKG_AR_MAGIC) != 0)
+		return false;
+
+	ar_pos = strlen(DPKG_AR_MAGIC);
+
+	dpkg_ar_check_size(ar);
+
+	for (;;) {
+		struct dpkg_ar_hdr arh;
+		off_t memberlen, ar_member_size;
+
+		rc = fd_read(ar->fd, &arh, sizeof(arh));
+		if (rc != sizeof(arh))
+			read_fail(rc, ar->name, _("archive member header"));
+
+		ar_pos += sizeof(arh);
+
+		if (dpkg_ar_member_is_invalid(&arh))
+			ohshit(_("file '%s' is corrupt - bad archive header magic"),
+			       ar->name);
+
+		dpkg_ar_normalize_name(&arh);
+
+		memberlen = dpkg_ar_member_parse_size(ar, &arh);
+		ar_member_size = memberlen + (memberlen & 1);
+
+		if (!header_done) {
+			if (strncmp(arh.ar_name, DEBMAGIC, sizeof(arh.ar_name)) != 0)
+				ohshit(_("file '%s' is not a Debian binary archive (try dpkg-split?)"),
+				       ar->name);
+			header_done = true;
+		} else if (strcmp(arh.ar_name, DATAINDEXMEMBER) == 0) {
+			if (memberlen > ar->size)
+				ohshit(_("archive '%s' is truncated or corrupt, "
+				         "expected more data than available (%jd > %jd)"),
+				       ar->name, (intmax_t)memberlen,
+				       (intmax_t)ar->size);
+
+			varbuf_reset(index);
+			varbuf_grow(index, memberlen + 1);
+			rc = fd_read(ar->fd, index->buf, memberlen);
+			if (rc != memberlen)
+				read_fail(rc, ar->name, _("archive data index member"));
+			varbuf_trunc(index, memberlen);
+
+			ar_member_size -= memberlen;
+			ar_pos += memberlen;
+		} else if (strncmp(arh.ar_name, DATAMEMBER, strlen(DATAMEMBER)) == 0) {
+			const char *extension = arh.ar_name + strlen(DATAMEMBER);
+
+			if (index->used == 0)
+				return false;
+
+			params->type = compressor_find_by_extension(extension);
+			if (params->type == COMPRESSOR_TYPE_UNKNOWN)
+				ohshit(_("archive '%s' uses unknown compression for member '%.*s', "
+				         "giving up"),
+				       ar->name, (int)sizeof(arh.ar_name), arh.ar_name);
+
+			*data_offset = ar_pos;
+			*data_size = memberlen;
+
+			return true;
+		}
+
+		/* The version has been checked by the caller, and any other
+		 * member is not needed. */
+		if (fd_skip(ar->fd, ar_member_size, &err) < 0)
+			ohshit(_("cannot skip archive member from '%s': %s"),
+			       ar->name, err.str);
+		ar_pos += ar_member_size;
+	}
+}
+
+static void
+data_index_parse(struct data_index *di, struct varbuf *index,
+                 const char *debar)
+{
+	struct deb_version version;
+	const char *errstr;
+	char *line, *next;
+	off_t offset = 0;
+
+	line = index->buf;
+	next = strchr(line, '\n');
+	if (next == NULL)
+		ohshit(_("archive '%s' has a corrupt data index: %s"),
+		       debar, _("missing version"));
+	*next++ = '\0';
+
+	errstr = deb_version_parse(&version, line);
+	if (errstr)
+		ohshit(_("archive '%s' has a corrupt data index: %s"),
+		       debar, errstr);
+	if (version.major != 1)
+		ohshit(_("archive '%s' has an unsupported data index version %d.%d"),
+		       debar, version.major, version.minor);
+
+	di->entries = NULL;
+	di->nentries = 0;
+	di->size = 0;
+
+	for (line = next; *line; line = next) {
+		struct data_index_entry *entry;
+		char *endp;
+
+		next = strchr(line, '\n');
+		if (next == NULL)
+			ohshit(_("archive '%s' has a corrupt data index: %s"),
+			       debar, _("missing end of line"));
+		*next++ = '\0';
+
+		if (di->nentries == di->size) {
+			di->size = di->size ? di->size * 2 : 256;
+			di->entries = m_realloc(di->entries,
+			                        di->size * sizeof(*di->entries));
+		}
+		entry = &di->entries[di->nentries];
+
+		errno = 0;
+		entry->offset = strtoimax(line, &endp, 10);
+		if (errno || endp == line || *endp != ' ' ||
+		    entry->offset < offset)
+			ohshit(_("archive '%s' has a corrupt data index: %s"),
+			       debar, _("invalid entry offset"));
+		line = endp + 1;
+
+		entry->size = strtoimax(line, &endp, 10);
+		if (errno || endp == line || *endp != ' ' || entry->size <= 0)
+			ohshit(_("archive '%s' has a corrupt data index: %s"),
+			       debar, _("invalid entry size"));
+		line = endp + 1;
+
+		if (line[0] == '-' && line[1] == ' ') {
+			entry->link_offset = -1;
+			line += 2;
+		} else {
+			entry->link_offset = strtoimax(line, &endp, 10);
+			if (errno || endp == line || *endp != ' ' ||
+			    entry->link_offset < 0 ||
+			    entry->link_offset >= entry->offset)
+				ohshit(_("archive '%s' has a corrupt data index: %s"),
+				       debar, _("invalid link offset"));
+			line = endp + 1;
+		}
+
+		entry->name = line;
+		path_trim_slash_slashdot(entry->name);
+		entry->name = (char *)path_skip_slash_dotslash(entry->name);
+		entry->selected = false;
+
+		offset = entry->offset + entry->size;
+		di->nentries++;
+	}
+}
+
+static void
+data_index_select(struct data_index *di, const char *debar,
+                  const char *const *pathnames)
+{
+	size_t i;
+
+	for (; *pathnames; pathnames++) {
+		const char *pathname = *pathnames;
+		size_t len = strlen(pathname);
+		bool found = false;
+
+		for (i = 0; i < di->nentries; i++) {
+			struct data_index_entry *entry = &di->entries[i];
+
+			if (len == 0 ||
+			    (strncmp(entry->name, pathname, len) == 0 &&
+			     (entry->name[len] == '\0' || entry->name[len] == '/'))) {
+				entry->selected = true;
+				found = true;
+			}
+		}
+
+		if (!found)
+			ohshit(_("pathname '%s' not found in archive '%s'"),
+			       pathname, debar);
+	}
+
+	/* The hard link targets need to be extracted before the links. */
+	for (i = 0; i < di->nentries; i++) {
+		struct data_index_entry *entry = &di->entries[i];
+		size_t lo = 0, hi = i;
+
+		if (!entry->selected || entry->link_offset < 0)
+			continue;
+
+		/* The entries are sorted by offset. */
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (di->entries[mid].offset < entry->link_offset)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == i || di->entries[lo].offset != entry->link_offset)
+			ohshit(_("archive '%s' has a corrupt data index: %s"),
+			       debar, _("missing hard link target"));
+		di->entries[lo].selected = true;
+	}
+}
+
+static bool
+extract_seekable(struct dpkg_ar *ar, struct data_index *di,
+                 struct compress_params *params, off_t data_offset,
+                 off_t data_size, const char *dir,
+                 enum dpkg_tar_options taroption)
+{
+	struct decompress_stream *ds;
+	char buf[DPKG_BUFFER_SIZE];
+	int p1[2];
+	pid_t pid;
+	size_t i;
+
+	if (lseek(ar->fd, data_offset, SEEK_SET) < 0)
+		ohshite(_("cannot seek to data member in archive '%s'"), ar->name);
+
+	ds = decompress_stream_open(params, ar->fd, data_size,
+	                            _("decompressing archive '%s' (size=%jd) member '%s'"),
+	                            ar->name, (intmax_t)ar->size, DATAMEMBER);
+	if (ds == NULL)
+		return false;
+
+	m_pipe(p1);
+	pid = subproc_fork();
+	if (pid == 0) {
+		close(p1[1]);
+		tar_exec(p1[0], dir, taroption, NULL);
+	}
+	close(p1[0]);
+
+	for (i = 0; i < di->nentries; i++) {
+		struct data_index_entry *entry = &di->entries[i];
+		off_t size;
+
+		if (!entry->selected)
+			continue;
+
+		decompress_stream_seek(ds, entry->offset);
+
+		for (size = entry->size; size > 0; ) {
+			ssize_t n;
+
+			n = decompress_stream_read(ds, buf, min(size, (off_t)sizeof(buf)));
+			if (n == 0)
+				ohshit(_("archive '%s' has a corrupt data index: %s"),
+				       ar->name, _("entry past end of data member"));
+			if (fd_write(p1[1], buf, n) < 0)
+				ohshite(_("cannot write to tar pipe"));
+			size -= n;
+		}
+	}
+
+	/* Terminate the tar archive with two zero blocks. */
+	memset(buf, 0, 1024);
+	if (fd_write(p1[1], buf, 1024) < 0)
+		ohshite(_("cannot write to tar pipe"));
+	if (close(p1[1]))
+		ohshite(_("cannot close tar pipe"));
+
+	decompress_stream_close(ds);
+
+	subproc_reap(pid, "tar", 0);
+
+	return true;
+}
+
+int
+do_extract_path(const char *const *argv)
+{
+	struct compress_params params = {
+		.type = COMPRESSOR_TYPE_NONE,
+		.threads_max = compress_params.threads_max,
+	};
+	enum dpkg_tar_options options = DPKG_TAR_EXTRACT | DPKG_TAR_PERMS;
+	struct varbuf index = VARBUF_INIT;
+	struct dpkg_ar *ar;
+	const char *debar, *dir;
+	char **pathnames;
+	off_t data_offset, data_size;
+	bool done = false;
+	int i, n;
+
+	if (opt_verbose)
+		options |= DPKG_TAR_LIST;
+
+	debar = *argv++;
+	if (debar == NULL)
+		badusage(_("--%s needs .deb filename, directory and pathname arguments"),
+		         cipaction->olong);
+	dir = *argv++;
+	if (dir == NULL || *argv == NULL)
+		badusage(_("--%s needs .deb filename, directory and pathname arguments"),
+		         cipaction->olong);
+
+	for (n = 0; argv[n]; n++)
+		;
+	pathnames = m_malloc((n + 1) * sizeof(*pathnames));
+	for (i = 0; i < n; i++) {
+		pathnames[i] = m_strdup(path_skip_slash_dotslash(argv[i]));
+		path_trim_slash_slashdot(pathnames[i]);
+	}
+	pathnames[n] = NULL;
+
+	ar = dpkg_ar_open(debar);
+
+	if (data_index_open(ar, &index, &params, &data_offset, &data_size)) {
+		struct data_index di;
+
+		data_index_parse(&di, &index, debar);
+		data_index_select(&di, debar, (const char *const *)pathnames);
+		done = extract_seekable(ar, &di, &params, data_offset,
+		                        data_size, dir, options);
+
+		free(di.entries);
+	}
+	dpkg_ar_close(ar);
+
+	if (!done) {
+		char **members;
+
+		/* Extract from the whole stream, letting tar select the
+		 * members, unless one of them covers the entire tree. */
+		members = m_malloc((n + 1) * sizeof(*members));
+		for (i = 0; i < n; i++) {
+			if (pathnames[i][0] == '\0')
+				break;
+			members[i] = str_fmt("./%s", pathnames[i]);
+		}
+		members[i] = NULL;
+
+		if (i < n) {
+			extract_member(debar, dir, options, 0, NULL);
+		} else {
+			extract_member(debar, dir, options, 0,
+			               (const char *const *)members);
+		}
+
+		for (i = 0; members[i]; i++)
+			free(members[i]);
+		free(members);
+	}
+
+	for (i = 0; i < n; i++)
+		free(pathnames[i]);
+	free(pathnames);
+	varbuf_destroy(&index);
+
+	return 0;
+}
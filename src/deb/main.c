@@ -109,6 +109,14 @@ usage(const char *const *argv)
 "          Extract metadata and filesystem files.\n"
 	));
 	print_option(_(
+"      --extract-path <deb> <directory> <pathname>...\n"
+"          Extract the named filesystem files.\n"
+	));
+	print_option(_(
+"      --scan\n"
+"          Output index stanzas for the archives named on stdin.\n"
+	));
+	print_option(_(
 "      --ctrl-tarfile <deb>\n"
 "          Output control tarfile.\n"
 	));
@@ -162,10 +170,18 @@ usage(const char *const *argv)
 "          Alias for --no-check.\n"
 	));
 	print_option(_(
+"  -j, --jobs=<jobs>\n"
+"          Use <jobs> threads with --scan (0 means all CPUs).\n"
+	));
+	print_option(_(
 "      --root-owner-group\n"
 "          Forces the owner and groups to root.\n"
 	));
 	print_option(_(
+"      --seekable\n"
+"          Build a data.tar member with random access.\n"
+	));
+	print_option(_(
 "      --threads-max=<threads>\n"
 "          Use at most <threads> with compressor.\n"
 	));
@@ -221,6 +237,8 @@ int opt_debug = 0;
 int opt_check = 1;
 int opt_verbose = 0;
 int opt_root_owner_group = 0;
+int opt_seekable = 0;
+int opt_jobs = 1;
 int opt_uniform_compression = 1;
 
 struct deb_version deb_format = DEB_VERSION(2, 0);
@@ -327,6 +345,12 @@ set_threads_max(const struct cmdinfo *cip, const char *value)
 	compress_params.threads_max = dpkg_options_parse_arg_int(cip, value);
 }
 
+static void
+set_jobs(const struct cmdinfo *cip, const char *value)
+{
+	opt_jobs = dpkg_options_parse_arg_int(cip, value);
+}
+
 static const struct cmdinfo cmdinfos[] = {
 	ACTION("build",         'b', 0, do_build),
 	ACTION("contents",      'c', 0, do_contents),
@@ -336,6 +360,8 @@ static const struct cmdinfo cmdinfos[] = {
 	ACTION("extract",       'x', 0, do_extract),
 	ACTION("vextract",      'X', 0, do_vextract),
 	ACTION("raw-extract",   'R', 0, do_raw_extract),
+	ACTION("extract-path",  0,   0, do_extract_path),
+	ACTION("scan",          0,   0, do_scan),
 	ACTION("ctrl-tarfile",  0,   0, do_ctrltarfile),
 	ACTION("fsys-tarfile",  0,   0, do_fsystarfile),
 	ACTION("show",          'W', 0, do_showinfo),
@@ -347,7 +373,9 @@ static const struct cmdinfo cmdinfos[] = {
 	{ "verbose",       'v', 0, &opt_verbose,   NULL,         NULL,          1 },
 	{ "nocheck",       0,   0, &opt_check,     NULL,         NULL,          0 },
 	{ "no-check",      0,   0, &opt_check,     NULL,         NULL,          0 },
+	{ "jobs",          'j', 1, NULL,           NULL,         set_jobs         },
 	{ "root-owner-group",    0, 0, &opt_root_owner_group,    NULL, NULL,    1 },
+	{ "seekable",      0,   0, &opt_seekable,  NULL,         NULL,          1 },
 	{ "threads-max",   0,   1, NULL,           NULL,         set_threads_max  },
 	{ "uniform-compression", 0, 0, &opt_uniform_compression, NULL, NULL,    1 },
 	{ "no-uniform-compression", 0, 0, &opt_uniform_compression, NULL, NULL, 0 },
@@ -386,6 +414,10 @@ main(int argc, const char *const *argv)
 		badusage(_("unsupported deb format '%d.%d' with non-uniform compression"),
 		         deb_format.major, deb_format.minor);
 
+	if (opt_seekable && deb_format.major == 0)
+		badusage(_("unsupported deb format '%d.%d' with seekable data member"),
+		         deb_format.major, deb_format.minor);
+
 	if (deb_format.major == 0)
 		compress_params = compress_params_deb0;
 
@@ -400,6 +432,12 @@ main(int argc, const char *const *argv)
 		badusage(_("unsupported compression type '%s' with uniform compression"),
 		         compressor_get_name(compress_params.type));
 
+	if (opt_seekable &&
+	    (compress_params.type != COMPRESSOR_TYPE_NONE &&
+	     compress_params.type != COMPRESSOR_TYPE_XZ))
+		badusage(_("unsupported compression type '%s' with seekable data member"),
+		         compressor_get_name(compress_params.type));
+
 	ret = cipaction->action(argv);
 
 	dpkg_program_done();
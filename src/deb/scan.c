@@ -0,0 +1,598 @@
+/*
+ * dpkg-deb - construction and deconstruction of *.deb archives
+ * scan.c - scanning archives for repository indices
+ *
+ * Copyright © 2026 Dpkg Developers
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dpkg/i18n.h>
+#include <dpkg/c-ctype.h>
+#include <dpkg/dpkg.h>
+#include <dpkg/debug.h>
+#include <dpkg/varbuf.h>
+#include <dpkg/fdio.h>
+#include <dpkg/buffer.h>
+#include <dpkg/path.h>
+#include <dpkg/subproc.h>
+#include <dpkg/compress.h>
+#include <dpkg/ar.h>
+#include <dpkg/deb-version.h>
+#include <dpkg/tarfn.h>
+#include <dpkg/thread-pool.h>
+#include <dpkg/options.h>
+
+#include "dpkg-deb.h"
+
+/* How many archives to queue per job ahead of the one being output. */
+#define SCAN_ARCHIVES_AHEAD 4
+
+/*
+ * The control file gets extracted by the main thread, and then the whole
+ * archive gets digested by a pool of worker threads, while it is still
+ * in the page cache. The results are output in input order, so that the
+ * output does not depend on the number of jobs.
+ */
+
+struct scan_job {
+	struct thread_task task;
+	struct scan_job *next;
+
+	char *filename;
+	int fd;
+	struct varbuf control;
+
+	/* The worker cannot use struct dpkg_error, which is not thread-safe. */
+	int errnum;
+	off_t size;
+	char md5[MD5HASHLEN + 1];
+	char sha1[SHA1HASHLEN + 1];
+	char sha256[SHA256HASHLEN + 1];
+};
+
+struct scan_queue {
+	struct thread_pool *pool;
+	struct scan_job *head;
+	struct scan_job *tail;
+	int queued;
+	int ahead;
+	int errors;
+};
+
+struct scan_control {
+	struct decompress_stream *ds;
+	int fd;
+	struct varbuf *control;
+	bool found;
+};
+
+/* The fields we generate, which replace any in the control file. */
+static const char *const scan_fields[] = {
+	"Filename",
+	"Size",
+	"MD5sum",
+	"SHA1",
+	"SHA256",
+	NULL,
+};
+
+static void
+scan_print_error(const char *emsg, const void *data)
+{
+	const char *filename = data;
+
+	notice(_("error processing archive %s (--%s):\n %s"),
+	       filename, cipaction->olong, emsg);
+}
+
+/*
+ * Open the control member for in-process decoding.
+ *
+ * This only handles well-formed format 2.x archives with a control member
+ * compressed with a supported codec. For anything else we return NULL, and
+ * the caller will fallback to dpkg-deb --ctrl-tarfile, which will report
+ * any problem. We do not fork and extract in-process, as the child would
+ * then flush the shared stdio streams on exit.
+ */
+static struct decompress_stream *
+scan_control_open(struct dpkg_ar *ar, struct compress_params *params)
+{
+	struct dpkg_error err;
+	char magic[sizeof(DPKG_AR_MAGIC) - 1];
+	bool header_done = false;
+
+	if (fd_read(ar->fd, magic, sizeof(magic)) != sizeof(magic) ||
+	    memcmp(magic, DPKG_AR_MAGIC, sizeof(magic)) != 0)
+		return NULL;
+
+	for (;;) {
+		struct dpkg_ar_hdr arh;
+		off_t memberlen, ar_member_size;
+
+		if (fd_read(ar->fd, &arh, sizeof(arh)) != sizeof(arh))
+			return NULL;
+		if (dpkg_ar_member_is_invalid(&arh))
+			return NULL;
+		dpkg_ar_normalize_name(&arh);
+
+		memberlen = dpkg_ar_member_get_size(&arh);
+		if (memberlen < 0)
+			return NULL;
+		ar_member_size = memberlen + (memberlen & 1);
+
+		if (!header_done) {
+			struct deb_version version;
+			char infobuf[40];
+
+			if (strncmp(arh.ar_name, DEBMAGIC, sizeof(arh.ar_name)) != 0)
+				return NULL;
+			if (ar_member_size >= (off_t)sizeof(infobuf))
+				return NULL;
+			if (fd_read(ar->fd, infobuf, ar_member_size) != ar_member_size)
+				return NULL;
+			infobuf[memberlen] = '\0';
+
+			if (deb_version_parse(&version, infobuf) != NULL ||
+			    version.major != 2)
+				return NULL;
+
+			header_done = true;
+		} else if (arh.ar_name[0] == '_') {
+			if (fd_skip(ar->fd, ar_member_size, &err) < 0)
+				return NULL;
+		} else if (memberlen > 0 &&
+		           strncmp(arh.ar_name, ADMINMEMBER, strlen(ADMINMEMBER)) == 0) {
+			params->type = compressor_find_by_extension(arh.ar_name +
+			                                            strlen(ADMINMEMBER));
+			if (params->type == COMPRESSOR_TYPE_UNKNOWN)
+				return NULL;
+			if (lseek(ar->fd, 0, SEEK_CUR) + memberlen > ar->size)
+				return NULL;
+
+			return decompress_stream_open(params, ar->fd, memberlen,
+			                              _("decompressing archive '%s' (size=%jd) member '%s'"),
+			                              ar->name, (intmax_t)ar->size,
+			                              ADMINMEMBER);
+		} else {
+			return NULL;
+		}
+	}
+}
+
+static int
+scan_tar_read(struct tar_archive *tar, char *buffer, int length)
+{
+	struct scan_control *sc = tar->ctx;
+
+	if (sc->ds)
+		return decompress_stream_read(sc->ds, buffer, length);
+	else
+		return fd_read(sc->fd, buffer, length);
+}
+
+static int
+scan_tar_file(struct tar_archive *tar, struct tar_entry *te)
+{
+	struct scan_control *sc = tar->ctx;
+	struct varbuf *control = NULL;
+	char buffer[TARBLKSZ];
+	off_t size;
+
+	if (!sc->found &&
+	    strcmp(path_skip_slash_dotslash(te->name), CONTROLFILE) == 0) {
+		control = sc->control;
+		sc->found = true;
+	}
+
+	for (size = te->size; size > 0; size -= TARBLKSZ) {
+		ssize_t n;
+
+		n = tar_archive_read(tar, buffer, TARBLKSZ);
+		if (n < 0)
+			return dpkg_put_errno(&tar->err, _("cannot read"));
+		if (n != TARBLKSZ) {
+			errno = 0;
+			return dpkg_put_error(&tar->err,
+			                      _("partially read tar entry '%s'"),
+			                      te->name);
+		}
+
+		if (control)
+			varbuf_add_buf(control, buffer, min(size, TARBLKSZ));
+	}
+
+	return 0;
+}
+
+static int
+scan_tar_skip(struct tar_archive *tar, struct tar_entry *te)
+{
+	return 0;
+}
+
+/*
+ * Extract the control file from the archive, ar positioned at its start.
+ */
+static void
+scan_control_extract(struct dpkg_ar *ar, struct varbuf *control)
+{
+	static const struct tar_operations tf = {
+		.read = scan_tar_read,
+		.extract_file = scan_tar_file,
+		.link = scan_tar_skip,
+		.symlink = scan_tar_skip,
+		.mkdir = scan_tar_skip,
+		.mknod = scan_tar_skip,
+	};
+	struct compress_params params = {
+		.type = COMPRESSOR_TYPE_NONE,
+		.threads_max = 1,
+	};
+	struct scan_control sc = {
+		.fd = -1,
+		.control = control,
+		.found = false,
+	};
+	struct tar_archive tar;
+	struct dpkg_error err;
+	pid_t pid = -1;
+	int rc;
+
+	sc.ds = scan_control_open(ar, &params);
+	if (sc.ds == NULL) {
+		int p1[2];
+
+		debug(dbg_general, "using %s to extract control member of '%s'",
+		      BACKEND " --ctrl-tarfile", ar->name);
+
+		m_pipe(p1);
+		pid = subproc_fork();
+		if (pid == 0) {
+			m_dup2(p1[1], 1);
+			close(p1[0]);
+			close(p1[1]);
+			execlp(BACKEND, BACKEND, "--ctrl-tarfile", ar->name, NULL);
+			ohshite(_("cannot execute %s (%s)"),
+			        _("package control information extraction"), BACKEND);
+		}
+		close(p1[1]);
+		sc.fd = p1[0];
+	}
+
+	tar.err = DPKG_ERROR_OBJECT;
+	tar.ctx = &sc;
+	tar.ops = &tf;
+
+	rc = tar_extractor(&tar);
+	if (rc)
+		ohshit(_("corrupted control tarfile in archive '%s': %s"),
+		       ar->name, tar.err.str);
+
+	if (sc.ds) {
+		decompress_stream_close(sc.ds);
+	} else {
+		/* Consume any trailing padding, so that the child can exit. */
+		if (fd_skip(sc.fd, -1, &err) < 0)
+			ohshit(_("cannot skip control member padding from '%s': %s"),
+			       ar->name, err.str);
+		close(sc.fd);
+		subproc_reap(pid, BACKEND " --ctrl-tarfile", 0);
+	}
+
+	if (!sc.found)
+		ohshit(_("archive '%s' has no control file"), ar->name);
+}
+
+static bool
+scan_field_is_generated(const char *line)
+{
+	int i;
+
+	for (i = 0; scan_fields[i]; i++) {
+		size_t len = strlen(scan_fields[i]);
+
+		if (strncasecmp(line, scan_fields[i], len) == 0 &&
+		    line[len] == ':')
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Copy the control file stanza into the job, without the fields that we
+ * generate ourselves.
+ */
+static void
+scan_control_filter(struct scan_job *job, struct varbuf *control)
+{
+	const char *line, *end;
+	bool skip = false;
+
+	/* Trim any trailing empty lines. */
+	while (control->used > 0 &&
+	       c_isspace(control->buf[control->used - 1]))
+		control->used--;
+	varbuf_trunc(control, control->used);
+
+	if (control->used == 0)
+		ohshit(_("archive '%s' has an empty control file"), job->filename);
+
+	for (line = control->buf; line < control->buf + control->used; line = end + 1) {
+		const char *p;
+
+		end = strchr(line, '\n');
+		if (end == NULL)
+			end = control->buf + control->used;
+
+		for (p = line; p < end && c_isspace(*p); p++)
+			;
+		if (p == end)
+			ohshit(_("archive '%s' has empty lines in its control file"),
+			       job->filename);
+
+		if (line[0] != ' ' && line[0] != '\t') {
+			skip = scan_field_is_generated(line);
+			if (skip && strncasecmp(line, "Filename:", 9) == 0)
+				warning(_("archive '%s' has a Filename field in its control file, ignoring it"),
+				        job->filename);
+		}
+		if (skip)
+			continue;
+
+		varbuf_add_buf(&job->control, line, end - line);
+		varbuf_add_char(&job->control, '\n');
+	}
+}
+
+static void
+scan_job_run(void *data)
+{
+	struct scan_job *job = data;
+	struct buffer_digest_entry digests[] = {
+		{ BUFFER_DIGEST_MD5, job->md5 },
+#ifdef HAVE_SHA1_H
+		{ BUFFER_DIGEST_SHA1, job->sha1 },
+#endif
+#ifdef HAVE_SHA256
+		{ BUFFER_DIGEST_SHA256, job->sha256 },
+#endif
+		{ BUFFER_DIGEST_NULL, NULL },
+	};
+
+	if (lseek(job->fd, 0, SEEK_SET) < 0) {
+		job->errnum = errno;
+		job->size = -1;
+		return;
+	}
+
+	job->size = fd_digests(job->fd, digests, -1, NULL);
+	if (job->size < 0)
+		job->errnum = errno;
+}
+
+static void
+scan_job_free(struct scan_job *job)
+{
+	if (job->fd >= 0)
+		close(job->fd);
+	varbuf_destroy(&job->control);
+	free(job->filename);
+	free(job);
+}
+
+static void
+scan_queue_init(struct scan_queue *queue, int jobs)
+{
+	if (jobs == 0)
+		jobs = thread_pool_get_cputhreads();
+
+	queue->pool = thread_pool_new(jobs);
+	queue->head = NULL;
+	queue->tail = NULL;
+	queue->queued = 0;
+	queue->ahead = thread_pool_get_jobs(queue->pool) * SCAN_ARCHIVES_AHEAD;
+	queue->errors = 0;
+
+	debug(dbg_general, "scan: digesting archives with %d threads",
+	      thread_pool_get_jobs(queue->pool));
+}
+
+static void
+scan_queue_reap(struct scan_queue *queue)
+{
+	struct scan_job *job = queue->head;
+
+	thread_pool_wait(queue->pool, &job->task);
+
+	queue->head = job->next;
+	if (queue->head == NULL)
+		queue->tail = NULL;
+	queue->queued--;
+
+	if (job->size < 0) {
+		char *emsg;
+
+		emsg = str_fmt(_("cannot compute digests: %s"),
+		               strerror(job->errnum));
+		scan_print_error(emsg, job->filename);
+		free(emsg);
+		queue->errors++;
+	} else {
+		printf("%s", varbuf_str(&job->control));
+		printf("Filename: %s\n", job->filename);
+		printf("Size: %jd\n", (intmax_t)job->size);
+		printf("MD5sum: %s\n", job->md5);
+#ifdef HAVE_SHA1_H
+		printf("SHA1: %s\n", job->sha1);
+#endif
+#ifdef HAVE_SHA256
+		printf("SHA256: %s\n", job->sha256);
+#endif
+		printf("\n");
+	}
+
+	scan_job_free(job);
+}
+
+static void
+scan_queue_submit(struct scan_queue *queue, struct scan_job *job)
+{
+	job->next = NULL;
+	if (queue->tail)
+		queue->tail->next = job;
+	else
+		queue->head = job;
+	queue->tail = job;
+	queue->queued++;
+
+	job->task.func = scan_job_run;
+	job->task.data = job;
+	thread_pool_submit(queue->pool, &job->task);
+
+	while (queue->queued > queue->ahead)
+		scan_queue_reap(queue);
+}
+
+static void
+scan_queue_done(struct scan_queue *queue)
+{
+	while (queue->head)
+		scan_queue_reap(queue);
+
+	thread_pool_free(queue->pool);
+}
+
+static void
+cu_scan_job(int argc, void **argv)
+{
+	struct scan_job *job = argv[0];
+
+	scan_job_free(job);
+}
+
+static void
+cu_scan_ar(int argc, void **argv)
+{
+	struct dpkg_ar *ar = argv[0];
+
+	dpkg_ar_close(ar);
+}
+
+static struct scan_job *
+scan_archive(const char *filename)
+{
+	struct varbuf control = VARBUF_INIT;
+	struct scan_job *job;
+	struct dpkg_ar *ar;
+
+	job = m_malloc(sizeof(*job));
+	job->filename = m_strdup(filename);
+	job->fd = -1;
+	varbuf_init(&job->control, 0);
+	job->errnum = 0;
+	job->size = -1;
+	push_cleanup(cu_scan_job, ehflag_bombout, 1, job);
+
+	ar = dpkg_ar_open(filename);
+	push_cleanup(cu_scan_ar, ~0, 1, ar);
+	if (!ar->is_seekable)
+		ohshit(_("archive '%s' is not a regular file"), filename);
+
+	scan_control_extract(ar, &control);
+	scan_control_filter(job, &control);
+	varbuf_destroy(&control);
+
+	/* Keep the archive open for the digest worker. */
+	job->fd = dup(ar->fd);
+	if (job->fd < 0)
+		ohshite(_("cannot duplicate file descriptor for archive '%s'"),
+		        filename);
+
+	pop_cleanup(ehflag_normaltidy);
+	pop_cleanup(ehflag_normaltidy);
+
+	return job;
+}
+
+static bool
+scan_read_filename(FILE *fp, struct varbuf *filename)
+{
+	int c;
+
+	varbuf_reset(filename);
+	while ((c = getc(fp)) != EOF && c != '\n')
+		varbuf_add_char(filename, c);
+	if (ferror(fp))
+		ohshite(_("cannot read archive names from standard input"));
+
+	return c != EOF || filename->used > 0;
+}
+
+int
+do_scan(const char *const *argv)
+{
+	struct scan_queue queue;
+	struct varbuf filename = VARBUF_INIT;
+
+	if (*argv)
+		badusage(_("--%s takes no arguments"), cipaction->olong);
+
+	scan_queue_init(&queue, opt_jobs);
+
+	while (scan_read_filename(stdin, &filename)) {
+		struct scan_job *job;
+		jmp_buf ejbuf;
+
+		if (filename.used == 0)
+			continue;
+
+		if (setjmp(ejbuf)) {
+			pop_error_context(ehflag_bombout);
+			queue.errors++;
+			continue;
+		}
+		push_error_context_jump(&ejbuf, scan_print_error,
+		                        varbuf_str(&filename));
+
+		job = scan_archive(varbuf_str(&filename));
+
+		pop_error_context(ehflag_normaltidy);
+
+		scan_queue_submit(&queue, job);
+	}
+
+	scan_queue_done(&queue);
+
+	m_output(stdout, _("<standard output>"));
+
+	varbuf_destroy(&filename);
+
+	return queue.errors ? 1 : 0;
+}
@@ -438,7 +438,7 @@ divertdb_write(void)
 	file = atomic_file_new(dbname, ATOMIC_FILE_BACKUP);
 	atomic_file_open(file);
 
-	iter = fsys_hash_iter_new();
+	iter = fsys_hash_iter_new_sorted();
 	while ((namenode = fsys_hash_iter_next(iter))) {
 		struct fsys_diversion *d = namenode->divert;
 
@@ -774,7 +774,7 @@ diversion_list(const char *const *argv)
 	if (glob_list == NULL)
 		glob_list_prepend(&glob_list, m_strdup("*"));
 
-	iter = fsys_hash_iter_new();
+	iter = fsys_hash_iter_new_sorted();
 	while ((namenode = fsys_hash_iter_next(iter))) {
 		struct glob_node *g;
 		struct fsys_diversion *contest = namenode->divert;
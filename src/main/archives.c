@@ -48,11 +48,13 @@
 #include <dpkg/path.h>
 #include <dpkg/fdio.h>
 #include <dpkg/buffer.h>
+#include <dpkg/compress.h>
 #include <dpkg/subproc.h>
 #include <dpkg/command.h>
 #include <dpkg/file.h>
 #include <dpkg/treewalk.h>
 #include <dpkg/tarfn.h>
+#include <dpkg/thread-pool.h>
 #include <dpkg/options.h>
 #include <dpkg/triglib.h>
 #include <dpkg/db-ctrl.h>
@@ -289,6 +291,9 @@ tarfileread(struct tar_archive *tar, char *buf, int len)
 	struct tarcontext *tc = (struct tarcontext *)tar->ctx;
 	int n;
 
+	if (tc->backend_stream)
+		return decompress_stream_read(tc->backend_stream, buf, len);
+
 	n = fd_read(tc->backendpipe, buf, len);
 	if (n < 0)
 		ohshite(_("cannot read from dpkg-deb pipe"));
@@ -297,7 +302,7 @@ tarfileread(struct tar_archive *tar, char *buf, int len)
 }
 
 static void
-tarobject_skip_padding(struct tarcontext *tc, struct tar_entry *te)
+tarobject_skip_padding(struct tar_archive *tar, struct tar_entry *te)
 {
 	struct dpkg_error err;
 	size_t remainder;
@@ -306,23 +311,23 @@ tarobject_skip_padding(struct tarcontext *tc, struct tar_entry *te)
 	if (remainder == 0)
 		return;
 
-	if (fd_skip(tc->backendpipe, TARBLKSZ - remainder, &err) < 0)
+	if (tar_skip(tar, TARBLKSZ - remainder, &err) < 0)
 		ohshit(_("cannot skip padding for file '%s': %s"),
 		       te->name, err.str);
 }
 
 static void
-tarobject_skip_entry(struct tarcontext *tc, struct tar_entry *ti)
+tarobject_skip_entry(struct tar_archive *tar, struct tar_entry *ti)
 {
 	/* We need to advance the tar file to the next object, so read the
 	 * file data and set it to oblivion. */
 	if (ti->type == TAR_FILETYPE_FILE) {
 		struct dpkg_error err;
 
-		if (fd_skip(tc->backendpipe, ti->size, &err) < 0)
+		if (tar_skip(tar, ti->size, &err) < 0)
 			ohshit(_("cannot skip file '%s' (replaced or excluded?) from pipe: %s"),
 			       ti->name, err.str);
-		tarobject_skip_padding(tc, ti);
+		tarobject_skip_padding(tar, ti);
 	}
 }
 
@@ -369,21 +374,406 @@ does_replace(struct pkginfo *new_pkg, struct pkgbin *new_pkgbin,
 	return false;
 }
 
+static int
+tar_set_mtime(const char *path, enum tar_filetype type, time_t mtime)
+{
+	struct timeval tv[2];
+#ifdef HAVE_UTIMENSAT
+	struct timespec ts[2];
+	int rc, flags;
+
+	ts[0].tv_sec = currenttime;
+	ts[0].tv_nsec = 0;
+	ts[1].tv_sec = mtime;
+	ts[1].tv_nsec = 0;
+
+	if (type == TAR_FILETYPE_SYMLINK)
+		flags = AT_SYMLINK_NOFOLLOW;
+	else
+		flags = 0;
+
+	/* Try to use the POSIX.1-2008 interface, and fallback to the old code
+	 * in case it is not supported by the system at run-time. */
+	rc = utimensat(AT_FDCWD, path, ts, flags);
+	if (rc == 0)
+		return 0;
+	else if (rc < 0 && errno != ENOSYS)
+		return -1;
+#endif
+
+	tv[0].tv_sec = currenttime;
+	tv[0].tv_usec = 0;
+	tv[1].tv_sec = mtime;
+	tv[1].tv_usec = 0;
+
+	if (type == TAR_FILETYPE_SYMLINK) {
+#ifdef HAVE_LUTIMES
+		if (lutimes(path, tv) && errno != ENOSYS)
+			return -1;
+#endif
+	} else {
+		if (utimes(path, tv))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * The small regular files get written out by a pool of worker threads, so
+ * that unpacking many of them is not bound by the latency of creating each
+ * one in turn. The tar stream is still read and processed in archive order
+ * by the main thread, which hands over the buffered file contents and waits
+ * for a pending write before touching the same pathname again. All writes
+ * are waited for before the deferred extraction.
+ */
+
+#define TAR_WRITE_POOL_JOBS_MAX		8
+
+/* Files larger than this get written directly from the tar stream. */
+#define TAR_WRITE_POOL_FILE_MAX		(256 * 1024)
+/* Maximum amount of buffered file contents pending to be written. */
+#define TAR_WRITE_POOL_QUEUE_MAX	(32 * 1024 * 1024)
+/* Number of pending files per worker thread. */
+#define TAR_WRITE_POOL_AHEAD		16
+
+enum tar_write_error {
+	TAR_WRITE_OK,
+	TAR_WRITE_ERROR_CREATE,
+	TAR_WRITE_ERROR_WRITE,
+	TAR_WRITE_ERROR_CHOWN,
+	TAR_WRITE_ERROR_CHMOD,
+	TAR_WRITE_ERROR_CLOSE,
+	TAR_WRITE_ERROR_MTIME,
+};
+
+struct tar_write_file {
+	struct thread_task task;
+	struct tar_write_file *next;
+
+	struct fsys_namenode *usenode;
+	char *name;
+	char *path;
+	char *matchpath;
+	struct varbuf data;
+	uid_t uid;
+	gid_t gid;
+	mode_t mode;
+	time_t mtime;
+
+	/* The error is reported when reaping the file, which might happen
+	 * while processing a later tar entry, so we keep the pathname the
+	 * failing operation was done on together with it. */
+	enum tar_write_error error;
+	const char *errpath;
+	int errnum;
+};
+
+/* The number of jobs requested, or -1 to pick them from the CPUs. */
+static int write_pool_jobs = -1;
+
+static struct {
+	struct thread_pool *pool;
+	struct tar_write_file *head;
+	struct tar_write_file *tail;
+	struct tar_write_file *failed;
+	size_t queued_size;
+	int queued;
+	int ahead;
+} write_pool;
+
+static void
+tar_write_file_error(struct tar_write_file *file, enum tar_write_error error,
+                     const char *path)
+{
+	file->error = error;
+	file->errpath = path;
+	file->errnum = errno;
+}
+
+/* This runs on the worker threads, so it must not call ohshit() & co. */
+static void
+tar_write_file(void *data)
+{
+	struct tar_write_file *file = data;
+	int fd, rc;
+
+	/* We create the file with mode 0 to make sure nobody can do anything
+	 * with it until we apply the proper mode, as in tarobject_extract(). */
+	fd = open(file->path, O_CREAT | O_EXCL | O_WRONLY, 0);
+	if (fd < 0) {
+		tar_write_file_error(file, TAR_WRITE_ERROR_CREATE, file->path);
+		return;
+	}
+
+	fd_allocate_size(fd, 0, file->data.used);
+
+	if (fd_write(fd, file->data.buf, file->data.used) < 0) {
+		tar_write_file_error(file, TAR_WRITE_ERROR_WRITE, file->path);
+		close(fd);
+		return;
+	}
+
+	fd_writeback_init(fd);
+
+	rc = fchown(fd, file->uid, file->gid);
+	if (forcible_nonroot_error(rc)) {
+		tar_write_file_error(file, TAR_WRITE_ERROR_CHOWN, file->path);
+		close(fd);
+		return;
+	}
+	rc = fchmod(fd, file->mode & ~S_IFMT);
+	if (forcible_nonroot_error(rc)) {
+		tar_write_file_error(file, TAR_WRITE_ERROR_CHMOD, file->path);
+		close(fd);
+		return;
+	}
+
+	if (close(fd)) {
+		tar_write_file_error(file, TAR_WRITE_ERROR_CLOSE, file->path);
+		return;
+	}
+
+	if (tar_set_mtime(file->path, TAR_FILETYPE_FILE, file->mtime) < 0)
+		tar_write_file_error(file, TAR_WRITE_ERROR_MTIME, file->path);
+}
+
+static void
+tar_write_file_free(struct tar_write_file *file)
+{
+	varbuf_destroy(&file->data);
+	free(file->name);
+	free(file->path);
+	free(file->matchpath);
+	free(file);
+}
+
+static struct tar_write_file *
+tar_write_pool_dequeue(void)
+{
+	struct tar_write_file *file = write_pool.head;
+
+	thread_pool_wait(write_pool.pool, &file->task);
+
+	write_pool.head = file->next;
+	if (write_pool.head == NULL)
+		write_pool.tail = NULL;
+	write_pool.queued_size -= file->data.used;
+	write_pool.queued--;
+
+	file->usenode->flags &= ~FNNF_DEFERRED_WRITE;
+
+	return file;
+}
+
+static void
+tar_write_pool_reap(void)
+{
+	struct tar_write_file *file;
+
+	file = tar_write_pool_dequeue();
+
+	/* Keep the file around for the error message, until cancelled. */
+	write_pool.failed = file;
+	errno = file->errnum;
+
+	switch (file->error) {
+	case TAR_WRITE_OK:
+		break;
+	case TAR_WRITE_ERROR_CREATE:
+		ohshite(_("cannot create '%s' (while processing '%s')"),
+		        file->errpath, file->name);
+	case TAR_WRITE_ERROR_WRITE:
+		ohshit(_("cannot copy extracted data for '%s' to '%s': %s"),
+		       file->name, file->errpath, strerror(file->errnum));
+	case TAR_WRITE_ERROR_CHOWN:
+		ohshite(_("cannot set ownership of '%s'"), file->errpath);
+	case TAR_WRITE_ERROR_CHMOD:
+		ohshite(_("cannot set permissions of '%s'"), file->errpath);
+	case TAR_WRITE_ERROR_CLOSE:
+		ohshite(_("cannot close/write '%s'"), file->errpath);
+	case TAR_WRITE_ERROR_MTIME:
+		ohshite(_("cannot set timestamps of '%s'"), file->errpath);
+	default:
+		internerr("unknown tar write error %d", file->error);
+	}
+
+	write_pool.failed = NULL;
+
+	debug(dbg_eachfiledetail, "tarobject file created '%s'", file->name);
+
+	dpkg_selabel_set_context(file->matchpath, file->path, file->mode);
+
+	tar_write_file_free(file);
+}
+
+/**
+ * Set the number of jobs to write the unpacked files with.
+ *
+ * A value of 0 uses the number of online CPUs, and a value of 1 writes the
+ * files from the main thread.
+ */
+void
+tar_write_pool_set_jobs(int jobs)
+{
+	write_pool_jobs = jobs;
+}
+
+/**
+ * Wait for all pending file writes, and check their results.
+ */
+void
+tar_write_pool_flush(void)
+{
+	while (write_pool.head)
+		tar_write_pool_reap();
+}
+
+/**
+ * Wait for all pending file writes, and discard them.
+ *
+ * This is used on error unwinding, before the cleanup handlers remove the
+ * files being written.
+ */
+void
+tar_write_pool_cancel(void)
+{
+	while (write_pool.head)
+		tar_write_file_free(tar_write_pool_dequeue());
+
+	if (write_pool.failed) {
+		tar_write_file_free(write_pool.failed);
+		write_pool.failed = NULL;
+	}
+}
+
 static void
-tarobject_extract(struct tarcontext *tc, struct tar_entry *te,
+tar_write_pool_free(void)
+{
+	tar_write_pool_cancel();
+
+	if (write_pool.pool == NULL)
+		return;
+
+	thread_pool_free(write_pool.pool);
+	write_pool.pool = NULL;
+}
+
+static bool
+tar_write_pool_wanted(struct tar_entry *te, struct fsys_namenode *namenode)
+{
+	int jobs;
+
+	/* Conffiles get extracted next to the dereferenced pathname. */
+	if (namenode->flags & FNNF_NEW_CONFF)
+		return false;
+	if (te->size > TAR_WRITE_POOL_FILE_MAX)
+		return false;
+
+	if (write_pool.pool == NULL) {
+		/* The writes compete for the CPU with the decompression and
+		 * the tar stream processing, so there is no point in using
+		 * threads on a single CPU, unless explicitly requested. */
+		if (write_pool_jobs < 0)
+			jobs = min(thread_pool_get_cputhreads(),
+			           TAR_WRITE_POOL_JOBS_MAX);
+		else if (write_pool_jobs == 0)
+			jobs = thread_pool_get_cputhreads();
+		else
+			jobs = write_pool_jobs;
+
+		write_pool.pool = thread_pool_new(jobs);
+		write_pool.ahead = thread_pool_get_jobs(write_pool.pool) *
+		                   TAR_WRITE_POOL_AHEAD;
+
+		debug(dbg_general, "tarobject writing files with %d threads",
+		      thread_pool_get_jobs(write_pool.pool));
+	}
+
+	return thread_pool_get_jobs(write_pool.pool) > 0;
+}
+
+static void
+tar_write_pool_submit(struct tar_archive *tar, struct tar_entry *te,
+                      const char *path, struct file_stat *st,
+                      struct fsys_namenode *namenode, char *newhash)
+{
+	struct tarcontext *tc = tar->ctx;
+	struct tar_write_file *file;
+	struct dpkg_error err;
+
+	file = m_malloc(sizeof(*file));
+	varbuf_init(&file->data, te->size);
+
+	if (tar_vbuf_copy_and_md5(tar, &file->data, newhash, te->size, &err) < 0) {
+		varbuf_destroy(&file->data);
+		free(file);
+		ohshit(_("cannot copy extracted data for '%s' to '%s': %s"),
+		       te->name, path, err.str);
+	}
+
+	file->usenode = namenodetouse(namenode, tc->pkg, &tc->pkg->available);
+	file->usenode->flags |= FNNF_DEFERRED_WRITE;
+	file->name = m_strdup(te->name);
+	file->path = m_strdup(path);
+	file->matchpath = m_strdup(fnamevb.buf);
+	file->uid = st->uid;
+	file->gid = st->gid;
+	file->mode = st->mode;
+	file->mtime = te->mtime;
+	file->error = TAR_WRITE_OK;
+	file->errpath = NULL;
+	file->errnum = 0;
+	file->next = NULL;
+
+	if (write_pool.tail)
+		write_pool.tail->next = file;
+	else
+		write_pool.head = file;
+	write_pool.tail = file;
+	write_pool.queued_size += file->data.used;
+	write_pool.queued++;
+
+	file->task.func = tar_write_file;
+	file->task.data = file;
+	thread_pool_submit(write_pool.pool, &file->task);
+
+	while (write_pool.queued > write_pool.ahead ||
+	       write_pool.queued_size > TAR_WRITE_POOL_QUEUE_MAX)
+		tar_write_pool_reap();
+}
+
+static void
+tarobject_extract(struct tar_archive *tar, struct tar_entry *te,
                   const char *path, struct file_stat *st,
                   struct fsys_namenode *namenode)
 {
 	static struct varbuf hardlinkfn;
 	static int fd;
 
+	struct tarcontext *tc = tar->ctx;
 	struct dpkg_error err;
-	struct fsys_namenode *linknode;
+	struct fsys_namenode *linknode, *linkusenode;
 	char *newhash;
 	int rc;
 
 	switch (te->type) {
 	case TAR_FILETYPE_FILE:
+		if (tar_write_pool_wanted(te, namenode)) {
+			newhash = nfmalloc(MD5HASHLEN + 1);
+			tar_write_pool_submit(tar, te, path, st, namenode, newhash);
+			namenode->newhash = newhash;
+			debug(dbg_eachfiledetail,
+			      "tarobject file queued, size=%jd digest=%s",
+			      (intmax_t)te->size, namenode->newhash);
+
+			tarobject_skip_padding(tar, te);
+
+			if (!in_force(FORCE_UNSAFE_IO))
+				namenode->flags |= FNNF_DEFERRED_FSYNC;
+			break;
+		}
+
 		/* We create the file with mode 0 to make sure nobody can do
 		 * anything with it until we apply the proper mode, which
 		 * might be a statoverride. */
@@ -401,14 +791,14 @@ tarobject_extract(struct tarcontext *tc, struct tar_entry *te,
 		fd_allocate_size(fd, 0, te->size);
 
 		newhash = nfmalloc(MD5HASHLEN + 1);
-		if (fd_fd_copy_and_md5(tc->backendpipe, fd, newhash, te->size, &err) < 0)
+		if (tar_fd_copy_and_md5(tar, fd, newhash, te->size, &err) < 0)
 			ohshit(_("cannot copy extracted data for '%s' to '%s': %s"),
 			       te->name, fnamenewvb.buf, err.str);
 		namenode->newhash = newhash;
 		debug(dbg_eachfiledetail,
 		      "tarobject file digest=%s", namenode->newhash);
 
-		tarobject_skip_padding(tc, te);
+		tarobject_skip_padding(tar, te);
 
 		fd_writeback_init(fd);
 
@@ -455,8 +845,10 @@ tarobject_extract(struct tarcontext *tc, struct tar_entry *te,
 	case TAR_FILETYPE_HARDLINK:
 		varbuf_set_str(&hardlinkfn, dpkg_fsys_get_dir());
 		linknode = fsys_hash_find_node(te->linkname, FHFF_NONE);
-		varbuf_add_str(&hardlinkfn,
-		               namenodetouse(linknode, tc->pkg, &tc->pkg->available)->name);
+		linkusenode = namenodetouse(linknode, tc->pkg, &tc->pkg->available);
+		if (linkusenode->flags & FNNF_DEFERRED_WRITE)
+			tar_write_pool_flush();
+		varbuf_add_str(&hardlinkfn, linkusenode->name);
 		if (linknode->flags & (FNNF_DEFERRED_RENAME | FNNF_NEW_CONFF))
 			varbuf_add_str(&hardlinkfn, DPKGNEWEXT);
 		if (link(hardlinkfn.buf, path))
@@ -488,7 +880,7 @@ tarobject_extract(struct tarcontext *tc, struct tar_entry *te,
 }
 
 static void
-tarobject_hash(struct tarcontext *tc, struct tar_entry *te,
+tarobject_hash(struct tar_archive *tar, struct tar_entry *te,
                struct fsys_namenode *namenode)
 {
 	if (te->type == TAR_FILETYPE_FILE) {
@@ -496,10 +888,10 @@ tarobject_hash(struct tarcontext *tc, struct tar_entry *te,
 		char *newhash;
 
 		newhash = nfmalloc(MD5HASHLEN + 1);
-		if (fd_md5(tc->backendpipe, newhash, te->size, &err) < 0)
+		if (tar_md5(tar, newhash, te->size, &err) < 0)
 			ohshit(_("cannot compute MD5 digest for file '%s' in tar archive: %s"),
 			       te->name, err.str);
-		tarobject_skip_padding(tc, te);
+		tarobject_skip_padding(tar, te);
 
 		namenode->newhash = newhash;
 		debug(dbg_eachfiledetail, "tarobject file digest=%s",
@@ -517,46 +909,8 @@ tarobject_hash(struct tarcontext *tc, struct tar_entry *te,
 static void
 tarobject_set_mtime(struct tar_entry *te, const char *path)
 {
-	struct timeval tv[2];
-#ifdef HAVE_UTIMENSAT
-	struct timespec ts[2];
-	int rc, flags;
-
-	ts[0].tv_sec = currenttime;
-	ts[0].tv_nsec = 0;
-	ts[1].tv_sec = te->mtime;
-	ts[1].tv_nsec = 0;
-
-	if (te->type == TAR_FILETYPE_SYMLINK)
-		flags = AT_SYMLINK_NOFOLLOW;
-	else
-		flags = 0;
-
-	/* Try to use the POSIX.1-2008 interface, and fallback to the old code
-	 * in case it is not supported by the system at run-time. */
-	rc = utimensat(AT_FDCWD, path, ts, flags);
-	if (rc == 0)
-		return;
-	else if (rc < 0 && errno != ENOSYS)
-		ohshite(_("cannot set timestamps for '%s'"), path);
-#endif
-
-	tv[0].tv_sec = currenttime;
-	tv[0].tv_usec = 0;
-	tv[1].tv_sec = te->mtime;
-	tv[1].tv_usec = 0;
-
-	if (te->type == TAR_FILETYPE_SYMLINK) {
-#ifdef HAVE_LUTIMES
-		if (lutimes(path, tv) && errno != ENOSYS)
-			ohshite(_("cannot set timestamps of '%s'"),
-			        path);
-#endif
-	} else {
-		if (utimes(path, tv))
-			ohshite(_("cannot set timestamps of '%s'"),
-			        path);
-	}
+	if (tar_set_mtime(path, te->type, te->mtime) < 0)
+		ohshite(_("cannot set timestamps of '%s'"), path);
 }
 
 static void
@@ -819,6 +1173,10 @@ tarobject(struct tar_archive *tar, struct tar_entry *ti)
 
 	setupfnamevbs(usename);
 
+	/* The same pathname is being written, wait for it to be done. */
+	if (usenode->flags & FNNF_DEFERRED_WRITE)
+		tar_write_pool_flush();
+
 	statr = lstat(fnamevb.buf, &stab);
 	if (statr) {
 		/* The lstat failed. */
@@ -1047,7 +1405,7 @@ tarobject(struct tar_archive *tar, struct tar_entry *ti)
 		if (nifd->namenode->flags & FNNF_NEW_CONFF)
 			nifd->namenode->flags |= FNNF_OBS_CONFF;
 		tar_fsys_namenode_queue_pop(tc->newfiles_queue, oldnifd, nifd);
-		tarobject_skip_entry(tc, ti);
+		tarobject_skip_entry(tar, ti);
 
 		return 0;
 	}
@@ -1055,7 +1413,7 @@ tarobject(struct tar_archive *tar, struct tar_entry *ti)
 	if (filter_should_skip(ti)) {
 		nifd->namenode->flags &= ~FNNF_NEW_INARCHIVE;
 		nifd->namenode->flags |= FNNF_FILTERED;
-		tarobject_skip_entry(tc, ti);
+		tarobject_skip_entry(tar, ti);
 
 		return 0;
 	}
@@ -1083,7 +1441,7 @@ tarobject(struct tar_archive *tar, struct tar_entry *ti)
 		/* If we are not forced to overwrite the path and are
 		 * refcounting, just compute the hash w/o extracting
 		 * the object. */
-		tarobject_hash(tc, ti, nifd->namenode);
+		tarobject_hash(tar, ti, nifd->namenode);
 	} else {
 		/* Now, at this stage we want to make sure neither of
 		 * .dpkg-new and .dpkg-tmp are hanging around. */
@@ -1103,7 +1461,7 @@ tarobject(struct tar_archive *tar, struct tar_entry *ti)
 		 */
 
 		/* Extract whatever it is as .dpkg-new ... */
-		tarobject_extract(tc, ti, fnamenewvb.buf, &nodestat,
+		tarobject_extract(tar, ti, fnamenewvb.buf, &nodestat,
 		                  nifd->namenode);
 	}
 
@@ -1116,9 +1474,13 @@ tarobject(struct tar_archive *tar, struct tar_entry *ti)
 	if (refcounting && !in_force(FORCE_OVERWRITE))
 		return 0;
 
-	tarobject_set_perms(ti, fnamenewvb.buf, &nodestat);
-	tarobject_set_mtime(ti, fnamenewvb.buf);
-	tarobject_set_se_context(fnamevb.buf, fnamenewvb.buf, nodestat.mode);
+	/* The write pool takes care of these when the file has been written. */
+	if (!(usenode->flags & FNNF_DEFERRED_WRITE)) {
+		tarobject_set_perms(ti, fnamenewvb.buf, &nodestat);
+		tarobject_set_mtime(ti, fnamenewvb.buf);
+		tarobject_set_se_context(fnamevb.buf, fnamenewvb.buf,
+		                         nodestat.mode);
+	}
 
 	/*
 	 * CLEANUP: Now we have extracted the new object in .dpkg-new (or,
@@ -1784,6 +2146,7 @@ archivefiles(const char *const *argv)
 		pop_error_context(ehflag_normaltidy);
 	}
 
+	tar_write_pool_free();
 	dpkg_selabel_close();
 
 	if (arglist) {
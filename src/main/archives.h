@@ -28,6 +28,8 @@
 
 struct tarcontext {
 	int backendpipe;
+	/** The in-process data member decoder, or NULL to use backendpipe. */
+	struct decompress_stream *backend_stream;
 	struct pkginfo *pkg;
 	/** A queue of fsys_namenode that have been extracted anew. */
 	struct fsys_namenode_queue *newfiles_queue;
@@ -96,6 +98,10 @@ tarobject(struct tar_archive *tar, struct tar_entry *ti);
 int
 tarfileread(struct tar_archive *tar, char *buf, int len);
 void
+tar_write_pool_flush(void);
+void
+tar_write_pool_cancel(void);
+void
 tar_deferred_extract(struct fsys_namenode_list *files, struct pkginfo *pkg);
 
 struct fsys_namenode_list *
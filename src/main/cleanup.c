@@ -75,6 +75,9 @@ cu_installnew(int argc, void **argv)
 	cleanup_pkg_failed++;
 	cleanup_conflictor_failed++;
 
+	/* Make sure no new file is still being written behind our back. */
+	tar_write_pool_cancel();
+
 	debug_at(dbg_eachfile, "'%s' flags=%o",
 	         namenode->name, namenode->flags);
 
@@ -305,6 +305,18 @@ usage(const char *const *argv)
 "          Verify output format (supported: 'rpm').\n"
 	));
 	print_option(_(
+"      --jobs=<n>\n"
+"          Number of parallel jobs to verify or unpack (0 for all CPUs).\n"
+	));
+	print_option(_(
+"      --verify-cache\n"
+"          Reuse the digests of unchanged files for --verify.\n"
+	));
+	print_option(_(
+"      --verify-full\n"
+"          Recompute all digests for --verify, updating the cache.\n"
+	));
+	print_option(_(
 "      --no-pager\n"
 "          Disables the use of any pager.\n"
 	));
@@ -482,6 +494,27 @@ set_verify_format(const struct cmdinfo *cip, const char *value)
 		badusage(_("unknown verify output format '%s'"), value);
 }
 
+static void
+set_jobs(const struct cmdinfo *cip, const char *value)
+{
+	int jobs = dpkg_options_parse_arg_int(cip, value);
+
+	verify_set_jobs(jobs);
+	tar_write_pool_set_jobs(jobs);
+}
+
+static void
+set_verify_cache(const struct cmdinfo *cip, const char *value)
+{
+	verify_set_cache(true);
+}
+
+static void
+set_verify_full(const struct cmdinfo *cip, const char *value)
+{
+	verify_set_full(true);
+}
+
 static void
 set_ignore_depends(const struct cmdinfo *cip, const char *value)
 {
@@ -796,6 +829,9 @@ static const struct cmdinfo cmdinfos[] = {
 	{ "path-exclude",      0,   1, NULL,          NULL,      set_filter,     0 },
 	{ "path-include",      0,   1, NULL,          NULL,      set_filter,     1 },
 	{ "verify-format",     0,   1, NULL,          NULL,      set_verify_format },
+	{ "jobs",              0,   1, NULL,          NULL,      set_jobs },
+	{ "verify-cache",      0,   0, NULL,          NULL,      set_verify_cache },
+	{ "verify-full",       0,   0, NULL,          NULL,      set_verify_full },
 	{ "status-logger",     0,   1, NULL,          NULL,      set_invoke_hook, 0, &status_loggers },
 	{ "status-fd",         0,   1, NULL,          NULL,      set_pipe, 0 },
 	{ "log",               0,   1, NULL,          &log_file, NULL,    0 },
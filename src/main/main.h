@@ -107,6 +107,8 @@ void
 process_archive(const char *filename);
 bool
 wanttoinstall(struct pkginfo *pkg);
+void
+tar_write_pool_set_jobs(int jobs);
 
 /* from update.c */
 
@@ -148,6 +150,12 @@ cmpversions(const char *const *argv);
 
 bool
 verify_set_output(const char *name);
+void
+verify_set_jobs(int jobs);
+void
+verify_set_cache(bool enabled);
+void
+verify_set_full(bool full);
 int
 verify(const char *const *argv);
 
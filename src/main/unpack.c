@@ -46,7 +46,11 @@
 #include <dpkg/pkg.h>
 #include <dpkg/pkg-queue.h>
 #include <dpkg/path.h>
+#include <dpkg/fdio.h>
 #include <dpkg/command.h>
+#include <dpkg/ar.h>
+#include <dpkg/deb-version.h>
+#include <dpkg/compress.h>
 #include <dpkg/buffer.h>
 #include <dpkg/subproc.h>
 #include <dpkg/dir.h>
@@ -1266,12 +1270,134 @@ pkg_remove_backup_files(struct pkginfo *pkg,
 	}
 }
 
+/**
+ * Open the data member of a binary package for in-process decoding.
+ *
+ * This only handles well-formed format 2.x archives with a data member
+ * compressed with a supported codec. For anything else we return NULL, and
+ * the caller will fallback to dpkg-deb, which will report any problem.
+ */
+static struct decompress_stream *
+deb_data_open(const char *filename, struct dpkg_ar **arp)
+{
+	static struct compress_params params = {
+		.type = COMPRESSOR_TYPE_NONE,
+		.strategy = COMPRESSOR_STRATEGY_NONE,
+		.level = -1,
+		.threads_max = -1,
+	};
+	struct decompress_stream *ds = NULL;
+	struct dpkg_error err;
+	struct dpkg_ar *ar;
+	char magic[sizeof(DPKG_AR_MAGIC) - 1];
+	bool header_done = false;
+	bool control_done = false;
+
+	ar = dpkg_ar_open(filename);
+
+	if (fd_read(ar->fd, magic, sizeof(magic)) != sizeof(magic) ||
+	    memcmp(magic, DPKG_AR_MAGIC, sizeof(magic)) != 0)
+		goto fallback;
+
+	for (;;) {
+		struct dpkg_ar_hdr arh;
+		off_t memberlen, ar_member_size;
+
+		if (fd_read(ar->fd, &arh, sizeof(arh)) != sizeof(arh))
+			goto fallback;
+		if (dpkg_ar_member_is_invalid(&arh))
+			goto fallback;
+		dpkg_ar_normalize_name(&arh);
+
+		memberlen = dpkg_ar_member_get_size(&arh);
+		if (memberlen < 0)
+			goto fallback;
+		ar_member_size = memberlen + (memberlen & 1);
+
+		if (!header_done) {
+			struct deb_version version;
+			char infobuf[40];
+
+			if (strncmp(arh.ar_name, "debian-binary",
+			            sizeof(arh.ar_name)) != 0)
+				goto fallback;
+			if (ar_member_size >= (off_t)sizeof(infobuf))
+				goto fallback;
+			if (fd_read(ar->fd, infobuf, ar_member_size) != ar_member_size)
+				goto fallback;
+			infobuf[memberlen] = '\0';
+
+			if (deb_version_parse(&version, infobuf) != NULL ||
+			    version.major != 2)
+				goto fallback;
+
+			header_done = true;
+		} else if (arh.ar_name[0] == '_' ||
+		           (!control_done &&
+		            strncmp(arh.ar_name, "control.tar", 11) == 0)) {
+			if (fd_skip(ar->fd, ar_member_size, &err) < 0)
+				goto fallback;
+
+			if (arh.ar_name[0] != '_')
+				control_done = true;
+		} else if (control_done && memberlen > 0 &&
+		           strncmp(arh.ar_name, "data.tar", 8) == 0) {
+			params.type = compressor_find_by_extension(arh.ar_name + 8);
+			if (params.type == COMPRESSOR_TYPE_UNKNOWN)
+				goto fallback;
+			if (ar->is_seekable &&
+			    lseek(ar->fd, 0, SEEK_CUR) + memberlen > ar->size)
+				goto fallback;
+
+			ds = decompress_stream_open(&params, ar->fd, memberlen,
+			                            _("decompressing archive '%s' (size=%jd) member '%s'"),
+			                            ar->name, (intmax_t)memberlen,
+			                            "data.tar");
+			break;
+		} else {
+			goto fallback;
+		}
+	}
+
+	if (ds == NULL)
+		goto fallback;
+
+	debug(dbg_general, "decoding data member of '%s' in-process", filename);
+
+	*arp = ar;
+	return ds;
+
+fallback:
+	debug(dbg_general, "using %s to extract data member of '%s'",
+	      BACKEND, filename);
+	dpkg_ar_close(ar);
+	return NULL;
+}
+
+static void
+cu_closedebdata(int argc, void **argv)
+{
+	struct decompress_stream **ds = argv[0];
+	struct dpkg_ar **ar = argv[1];
+
+	if (*ds) {
+		decompress_stream_close(*ds);
+		*ds = NULL;
+	}
+	if (*ar) {
+		dpkg_ar_close(*ar);
+		*ar = NULL;
+	}
+}
+
 /* TODO: Refactor to reduce nesting levels. */
 void
 process_archive(const char *filename)
 {
 	static const struct tar_operations tf = {
 		.read = tarfileread,
+		/* Batch the reads of small entries and their headers. */
+		.read_bufsize = 1024 * 1024,
 		.extract_file = tarobject,
 		.link = tarobject,
 		.symlink = tarobject,
@@ -1284,6 +1410,7 @@ process_archive(const char *filename)
 	 * we unwind the stack before processing the cleanup list, and these
 	 * variables had better still exist ... */
 	static int p1[2];
+	static struct dpkg_ar *ar;
 	static enum pkgstatus oldversionstatus;
 	static struct tarcontext tc;
 
@@ -1622,19 +1749,30 @@ process_archive(const char *filename)
 	 * files get replaced ‘as we go’.
 	 */
 
-	m_pipe(p1);
-	push_cleanup(cu_closepipe, ehflag_bombout, 1, (void *)&p1[0]);
-	pid = subproc_fork();
-	if (pid == 0) {
-		m_dup2(p1[1], 1);
-		close(p1[0]);
+	/* We decode the data member ourselves when possible, to avoid piping
+	 * all the archive contents through a dpkg-deb process. */
+	pid = -1;
+	ar = NULL;
+	tc.backend_stream = deb_data_open(filename, &ar);
+	if (tc.backend_stream) {
+		push_cleanup(cu_closedebdata, ehflag_bombout,
+		             2, (void *)&tc.backend_stream, (void *)&ar);
+		p1[0] = p1[1] = -1;
+	} else {
+		m_pipe(p1);
+		push_cleanup(cu_closepipe, ehflag_bombout, 1, (void *)&p1[0]);
+		pid = subproc_fork();
+		if (pid == 0) {
+			m_dup2(p1[1], 1);
+			close(p1[0]);
+			close(p1[1]);
+			execlp(BACKEND, BACKEND, "--fsys-tarfile", filename, NULL);
+			ohshite(_("cannot execute %s (%s)"),
+			        _("package filesystem archive extraction"), BACKEND);
+		}
 		close(p1[1]);
-		execlp(BACKEND, BACKEND, "--fsys-tarfile", filename, NULL);
-		ohshite(_("cannot execute %s (%s)"),
-		        _("package filesystem archive extraction"), BACKEND);
+		p1[1] = -1;
 	}
-	close(p1[1]);
-	p1[1] = -1;
 
 	newfiles_queue.head = NULL;
 	newfiles_queue.tail = &newfiles_queue.head;
@@ -1653,13 +1791,24 @@ process_archive(const char *filename)
 	if (rc)
 		dpkg_error_print(&tar.err,
 		                 _("corrupted filesystem tarfile in package archive"));
-	if (fd_skip(p1[0], -1, &err) < 0)
-		ohshit(_("cannot zap possible trailing zeros from dpkg-deb: %s"),
-		       err.str);
-	close(p1[0]);
-	p1[0] = -1;
-	subproc_reap(pid, BACKEND " --fsys-tarfile", SUBPROC_NOPIPE);
+	if (tc.backend_stream) {
+		if (stream_skip(tc.backend_stream, -1, &err) < 0)
+			ohshit(_("cannot zap possible trailing zeros from package archive: %s"),
+			       err.str);
+		decompress_stream_close(tc.backend_stream);
+		tc.backend_stream = NULL;
+		dpkg_ar_close(ar);
+		ar = NULL;
+	} else {
+		if (fd_skip(p1[0], -1, &err) < 0)
+			ohshit(_("cannot zap possible trailing zeros from dpkg-deb: %s"),
+			       err.str);
+		close(p1[0]);
+		p1[0] = -1;
+		subproc_reap(pid, BACKEND " --fsys-tarfile", SUBPROC_NOPIPE);
+	}
 
+	tar_write_pool_flush();
 	tar_deferred_extract(newfiles_queue.head, pkg);
 
 	if (oldversionstatus == PKG_STAT_HALFINSTALLED ||
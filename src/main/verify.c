@@ -21,8 +21,13 @@
 #include <config.h>
 #include <compat.h>
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdbool.h>
@@ -36,7 +41,10 @@
 #include <dpkg/options.h>
 #include <dpkg/db-ctrl.h>
 #include <dpkg/db-fsys.h>
+#include <dpkg/file.h>
+#include <dpkg/fdio.h>
 #include <dpkg/buffer.h>
+#include <dpkg/thread-pool.h>
 
 #include "main.h"
 
@@ -112,72 +120,618 @@ verify_set_output(const char *name)
 	return true;
 }
 
+/* Number of pending files per job, so that the workers can read ahead. */
+#define VERIFY_FILES_AHEAD	64
+
+static int verify_jobs = 1;
+
+void
+verify_set_jobs(int jobs)
+{
+	verify_jobs = jobs;
+}
+
+/*** Verify cache. ***/
+
+/*
+ * The verify cache records the digest computed for each pathname, keyed on
+ * the identity and metadata of the file it was computed from, so that the
+ * files that have not changed since do not need to be read again. Any
+ * write to a file changes its ctime, which cannot be set from userland.
+ * Files changed in the same second the cache entry would be recorded in
+ * are not cached, as a later change in that same second could go unseen.
+ *
+ * The cache gets replaced atomically with a rename, from a uniquely named
+ * temporary file, so that concurrent runs, which do not hold the database
+ * lock, never see a partial cache, and the last writer wins. A stale or
+ * truncated cache can only cause digests to be computed again.
+ */
+
+#define VERIFY_CACHE_MAGIC	"dpkgvfc"
+#define VERIFY_CACHE_VERSION	1
+#define VERIFY_CACHE_BYTEORDER	0x01020304
+
+struct verify_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+};
+
+struct verify_cache_record {
+	uint32_t keylen;
+	uint32_t pad;
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime;
+	int64_t ctime;
+	char digest[MD5HASHLEN];
+};
+
+struct verify_cache_entry {
+	struct verify_cache_record rec;
+	const char *key;
+	int seq;
+	bool seen;
+	bool recorded;
+};
+
+static struct {
+	bool enabled;
+	bool full;
+	bool dirty;
+	time_t start;
+	struct varbuf data;
+	struct verify_cache_entry *entries;
+	int n_entries;
+	int n_cached;
+	int n_computed;
+	struct varbuf out;
+} verify_cache;
+
+void
+verify_set_cache(bool enabled)
+{
+	verify_cache.enabled = enabled;
+}
+
+void
+verify_set_full(bool full)
+{
+	verify_cache.full = full;
+}
+
+static void
+verify_cache_add_header(struct varbuf *vb)
+{
+	struct verify_cache_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, VERIFY_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = VERIFY_CACHE_VERSION;
+	hdr.byteorder = VERIFY_CACHE_BYTEORDER;
+
+	varbuf_add_buf(vb, &hdr, sizeof(hdr));
+}
+
+static void
+verify_cache_add_record(struct varbuf *vb, const struct verify_cache_record *rec,
+                        const char *key)
+{
+	varbuf_add_buf(vb, rec, sizeof(*rec));
+	varbuf_add_buf(vb, key, rec->keylen);
+	varbuf_add_char(vb, '\0');
+}
+
+static bool
+verify_cache_record_matches(const struct verify_cache_record *rec,
+                            const struct stat *st)
+{
+	return rec->dev == (uint64_t)st->st_dev &&
+	       rec->ino == (uint64_t)st->st_ino &&
+	       rec->size == (uint64_t)st->st_size &&
+	       rec->mtime == (int64_t)st->st_mtime &&
+	       rec->ctime == (int64_t)st->st_ctime;
+}
+
+static int
+verify_cache_entry_cmp(const void *a, const void *b)
+{
+	const struct verify_cache_entry *ea = a;
+	const struct verify_cache_entry *eb = b;
+	int rc;
+
+	rc = strcmp(ea->key, eb->key);
+	if (rc)
+		return rc;
+
+	/* Later records supersede earlier ones, so sort them first. */
+	return eb->seq - ea->seq;
+}
+
 static int
-verify_digest(const char *filename, struct fsys_namenode *fnn,
-              struct verify_checks *checks)
+verify_cache_key_cmp(const void *a, const void *b)
+{
+	const char *key = a;
+	const struct verify_cache_entry *entry = b;
+
+	return strcmp(key, entry->key);
+}
+
+/**
+ * Parse the cache records in a buffer.
+ *
+ * @return The pointer to the first byte not parsed, which is not the end
+ *         of the buffer if there is a corrupt or truncated record.
+ */
+static char *
+verify_cache_parse(char *ptr, char *end, struct verify_cache_entry **entries_r,
+                   int *n_entries_r)
+{
+	struct verify_cache_entry *entries = NULL;
+	int n_entries = 0, n_alloc = 0;
+
+	while (ptr < end) {
+		struct verify_cache_entry entry;
+		size_t avail;
+
+		avail = end - ptr;
+		if (avail < sizeof(entry.rec))
+			break;
+		memcpy(&entry.rec, ptr, sizeof(entry.rec));
+		avail -= sizeof(entry.rec);
+		if (entry.rec.keylen == 0 || entry.rec.keylen >= avail)
+			break;
+
+		entry.key = ptr + sizeof(entry.rec);
+		if (entry.key[entry.rec.keylen] != '\0' ||
+		    memchr(entry.key, '\0', entry.rec.keylen) != NULL)
+			break;
+		entry.seq = n_entries;
+		entry.seen = false;
+		entry.recorded = false;
+
+		if (n_entries == n_alloc) {
+			n_alloc = n_alloc ? n_alloc * 2 : 1024;
+			entries = m_realloc(entries, n_alloc * sizeof(*entries));
+		}
+		entries[n_entries++] = entry;
+
+		ptr += sizeof(entry.rec) + entry.rec.keylen + 1;
+	}
+
+	*entries_r = entries;
+	*n_entries_r = n_entries;
+
+	return ptr;
+}
+
+/**
+ * Sort the cache entries by key, keeping only the latest one for each key.
+ *
+ * @return The number of entries left.
+ */
+static int
+verify_cache_sort(struct verify_cache_entry *entries, int n_entries)
+{
+	int i, n_uniq;
+
+	if (n_entries == 0)
+		return 0;
+
+	qsort(entries, n_entries, sizeof(*entries), verify_cache_entry_cmp);
+	for (i = 1, n_uniq = 1; i < n_entries; i++) {
+		if (strcmp(entries[i].key, entries[n_uniq - 1].key) == 0)
+			continue;
+		entries[n_uniq++] = entries[i];
+	}
+
+	return n_uniq;
+}
+
+static void
+verify_cache_load(void)
+{
+	struct varbuf ref = VARBUF_INIT;
+	struct dpkg_error err = DPKG_ERROR_INIT;
+	struct verify_cache_entry *entries;
+	char *cachefile;
+	char *ptr, *end;
+	int n_entries, n_uniq;
+
+	verify_cache.start = time(NULL);
+	varbuf_init(&verify_cache.out, 0);
+	verify_cache_add_header(&verify_cache.out);
+
+	cachefile = dpkg_db_get_path(VERIFYCACHEFILE);
+	if (file_slurp(cachefile, &verify_cache.data, &err) < 0) {
+		debug(dbg_general, "verify-cache: cannot load: %s", err.str);
+		dpkg_error_destroy(&err);
+		free(cachefile);
+		verify_cache.dirty = true;
+		return;
+	}
+	free(cachefile);
+
+	verify_cache_add_header(&ref);
+	if (verify_cache.data.used < ref.used ||
+	    memcmp(verify_cache.data.buf, ref.buf, ref.used) != 0) {
+		debug(dbg_general, "verify-cache: unknown format");
+		varbuf_destroy(&ref);
+		verify_cache.dirty = true;
+		return;
+	}
+
+	ptr = verify_cache.data.buf + ref.used;
+	end = verify_cache.data.buf + verify_cache.data.used;
+	varbuf_destroy(&ref);
+
+	ptr = verify_cache_parse(ptr, end, &entries, &n_entries);
+	if (ptr < end) {
+		debug(dbg_general, "verify-cache: corrupt record %d", n_entries);
+		verify_cache.dirty = true;
+	}
+
+	n_uniq = verify_cache_sort(entries, n_entries);
+	if (n_uniq < n_entries)
+		verify_cache.dirty = true;
+
+	if (n_uniq == 0) {
+		free(entries);
+		return;
+	}
+
+	verify_cache.entries = entries;
+	verify_cache.n_entries = n_uniq;
+
+	debug(dbg_general, "verify-cache: loaded %d entries", n_uniq);
+}
+
+static struct verify_cache_entry *
+verify_cache_lookup(const char *key)
+{
+	struct verify_cache_entry *entry;
+
+	if (verify_cache.n_entries == 0)
+		return NULL;
+
+	entry = bsearch(key, verify_cache.entries, verify_cache.n_entries,
+	                sizeof(*entry), verify_cache_key_cmp);
+	if (entry == NULL)
+		return NULL;
+
+	entry->seen = true;
+
+	return entry;
+}
+
+static void
+verify_cache_record(const char *key, const struct stat *st, const char *digest,
+                    struct verify_cache_entry *cached)
 {
-	static int fd;
+	struct verify_cache_record rec;
+
+	/* The same pathname can be verified more than once per run, such as
+	 * when it is shared by several packages, or when a package is named
+	 * several times, but it only needs to be recorded once. */
+	if (cached && cached->recorded)
+		return;
+
+	/* Do not trust the metadata of files that might still be changing
+	 * within the granularity of the timestamps. */
+	if (st->st_mtime >= verify_cache.start ||
+	    st->st_ctime >= verify_cache.start) {
+		verify_cache.dirty = true;
+		return;
+	}
 
-	fd = open(filename, O_RDONLY);
+	memset(&rec, 0, sizeof(rec));
+	rec.keylen = strlen(key);
+	rec.dev = st->st_dev;
+	rec.ino = st->st_ino;
+	rec.size = st->st_size;
+	rec.mtime = st->st_mtime;
+	rec.ctime = st->st_ctime;
+	memcpy(rec.digest, digest, MD5HASHLEN);
+
+	if (cached == NULL || memcmp(&cached->rec, &rec, sizeof(rec)) != 0)
+		verify_cache.dirty = true;
+	if (cached)
+		cached->recorded = true;
+
+	verify_cache_add_record(&verify_cache.out, &rec, key);
+}
 
-	if (fd >= 0) {
-		struct dpkg_error err;
-		char hash[MD5HASHLEN + 1];
+static void
+verify_cache_write(struct varbuf *vb)
+{
+	char *cachefile, *cachefile_new;
+	int fd;
+
+	cachefile = dpkg_db_get_path(VERIFYCACHEFILE);
+	cachefile_new = str_fmt("%s-new.XXXXXX", cachefile);
 
-		push_cleanup(cu_closefd, ehflag_bombout, 1, &fd);
-		if (fd_md5(fd, hash, -1, &err) < 0)
-			ohshit(_("cannot compute MD5 digest for file '%s': %s"),
-			       filename, err.str);
-		pop_cleanup(ehflag_normaltidy); /* fd = open(cdr.buf) */
+	fd = mkstemp(cachefile_new);
+	if (fd < 0) {
+		debug(dbg_general, "verify-cache: cannot create %s: %s",
+		      cachefile_new, strerror(errno));
+		goto out;
+	}
+
+	if (fchmod(fd, 0600) < 0 ||
+	    fd_write(fd, vb->buf, vb->used) < 0 || fsync(fd) < 0) {
 		close(fd);
+		goto fail;
+	}
+	if (close(fd) < 0 || rename(cachefile_new, cachefile) < 0)
+		goto fail;
+
+	goto out;
+
+fail:
+	debug(dbg_general, "verify-cache: cannot write %s: %s",
+	      cachefile, strerror(errno));
+	unlink(cachefile_new);
+out:
+	free(cachefile_new);
+	free(cachefile);
+}
 
-		if (strcmp(hash, fnn->newhash) == 0) {
-			checks->md5sum = VERIFY_PASS;
-			return 0;
-		} else {
-			checks->md5sum = VERIFY_FAIL;
+/**
+ * Write the updated verify cache, if anything changed.
+ *
+ * @param all Whether all packages have been verified, so that the entries
+ *            for pathnames not seen can be dropped.
+ */
+static void
+verify_cache_done(bool all)
+{
+	struct verify_cache_entry *entries;
+	struct varbuf vb = VARBUF_INIT;
+	char *ptr, *end;
+	int n_entries;
+	int i;
+
+	debug(dbg_general, "verify-cache: %d cached, %d computed digests",
+	      verify_cache.n_cached, verify_cache.n_computed);
+
+	for (i = 0; i < verify_cache.n_entries; i++) {
+		struct verify_cache_entry *entry = &verify_cache.entries[i];
+
+		if (entry->seen)
+			continue;
+		if (all) {
+			verify_cache.dirty = true;
+			continue;
 		}
+		verify_cache_add_record(&verify_cache.out, &entry->rec,
+		                        entry->key);
+	}
+
+	if (!verify_cache.dirty)
+		goto out;
+
+	/* Pathnames not in the cache might have been recorded more than once,
+	 * so write only their latest record. */
+	ptr = verify_cache.out.buf + sizeof(struct verify_cache_header);
+	end = verify_cache.out.buf + verify_cache.out.used;
+	verify_cache_parse(ptr, end, &entries, &n_entries);
+	n_entries = verify_cache_sort(entries, n_entries);
+
+	verify_cache_add_header(&vb);
+	for (i = 0; i < n_entries; i++)
+		verify_cache_add_record(&vb, &entries[i].rec, entries[i].key);
+	free(entries);
+
+	debug(dbg_general, "verify-cache: writing %d entries", n_entries);
+	verify_cache_write(&vb);
+	varbuf_destroy(&vb);
+
+out:
+	free(verify_cache.entries);
+	verify_cache.entries = NULL;
+	verify_cache.n_entries = 0;
+	varbuf_destroy(&verify_cache.data);
+	varbuf_destroy(&verify_cache.out);
+}
+
+/*** File checks. ***/
+
+enum verify_digest_source {
+	VERIFY_DIGEST_NONE,
+	VERIFY_DIGEST_CACHED,
+	VERIFY_DIGEST_COMPUTED,
+};
+
+struct verify_job {
+	struct thread_task task;
+	struct verify_job *next;
+
+	struct fsys_namenode *fnn;
+	const char *hash;
+	char *filename;
+	struct verify_cache_entry *cached;
+
+	struct stat st;
+	char digest[MD5HASHLEN + 1];
+	enum verify_digest_source digest_source;
+
+	struct verify_checks checks;
+	/* The worker cannot use struct dpkg_error, which is not thread-safe. */
+	int digest_errno;
+	int failures;
+};
+
+/* These run on the worker threads, so they must not call ohshit() & co. */
+static int
+verify_digest(struct verify_job *job)
+{
+	struct verify_checks *checks = &job->checks;
+
+	if (job->cached && !verify_cache.full && S_ISREG(job->st.st_mode) &&
+	    verify_cache_record_matches(&job->cached->rec, &job->st)) {
+		memcpy(job->digest, job->cached->rec.digest, MD5HASHLEN);
+		job->digest[MD5HASHLEN] = '\0';
+		job->digest_source = VERIFY_DIGEST_CACHED;
 	} else {
-		checks->md5sum = VERIFY_NONE;
+		int fd;
+		off_t rc;
+
+		fd = open(job->filename, O_RDONLY);
+		if (fd < 0) {
+			checks->md5sum = VERIFY_NONE;
+			return -1;
+		}
+
+		rc = fd_md5(fd, job->digest, -1, NULL);
+		if (rc < 0)
+			job->digest_errno = errno;
+		close(fd);
+		if (rc < 0)
+			return -1;
+		job->digest_source = VERIFY_DIGEST_COMPUTED;
+	}
+
+	if (strcmp(job->digest, job->hash) == 0) {
+		checks->md5sum = VERIFY_PASS;
+		return 0;
+	} else {
+		checks->md5sum = VERIFY_FAIL;
 	}
 
 	return -1;
 }
 
 static int
-verify_file(const char *filename, struct fsys_namenode *fnn,
-            struct pkginfo *pkg, struct verify_checks *checks)
+verify_file(struct verify_job *job)
 {
-	struct stat st;
+	struct verify_checks *checks = &job->checks;
 	int failures = 0;
 
-	if (lstat(filename, &st) < 0) {
+	if (lstat(job->filename, &job->st) < 0) {
 		checks->exists_errno = errno;
 		checks->exists = VERIFY_FAIL;
 		return 1;
 	}
 	checks->exists = VERIFY_PASS;
 
-	if (fnn->newhash == NULL && fnn->oldhash != NULL)
-		fnn->newhash = fnn->oldhash;
-
-	if (fnn->newhash != NULL) {
+	if (job->hash != NULL) {
 		/* Mode check heuristic: If we know its digest, the pathname
 		 * must be a regular file. */
-		if (!S_ISREG(st.st_mode)) {
+		if (!S_ISREG(job->st.st_mode)) {
 			checks->mode = VERIFY_FAIL;
 			failures++;
 		}
 
-		if (verify_digest(filename, fnn, checks) < 0)
+		if (verify_digest(job) < 0)
 			failures++;
 	}
 
 	return failures;
 }
 
+/*
+ * The files get verified by a pool of worker threads, in archive order,
+ * and their results are reported in the same order they were queued, so
+ * that the output does not depend on the number of jobs.
+ */
+
+struct verify_queue {
+	struct thread_pool *pool;
+	struct verify_job *head;
+	struct verify_job *tail;
+	int queued;
+	int ahead;
+};
+
+static void
+verify_job_run(void *data)
+{
+	struct verify_job *job = data;
+
+	job->failures = verify_file(job);
+}
+
+static void
+verify_queue_init(struct verify_queue *queue)
+{
+	int jobs = verify_jobs;
+
+	if (jobs == 0)
+		jobs = thread_pool_get_cputhreads();
+
+	queue->pool = thread_pool_new(jobs);
+	queue->head = NULL;
+	queue->tail = NULL;
+	queue->queued = 0;
+	queue->ahead = thread_pool_get_jobs(queue->pool) * VERIFY_FILES_AHEAD;
+
+	debug(dbg_general, "verify: checking files with %d threads",
+	      thread_pool_get_jobs(queue->pool));
+}
+
 static void
-verify_package(struct pkginfo *pkg)
+verify_queue_reap(struct verify_queue *queue)
+{
+	struct verify_job *job = queue->head;
+
+	thread_pool_wait(queue->pool, &job->task);
+
+	queue->head = job->next;
+	if (queue->head == NULL)
+		queue->tail = NULL;
+	queue->queued--;
+
+	if (job->digest_errno)
+		ohshit(_("cannot compute MD5 digest for file '%s': %s"),
+		       job->filename, strerror(job->digest_errno));
+
+	if (job->digest_source == VERIFY_DIGEST_CACHED)
+		verify_cache.n_cached++;
+	else if (job->digest_source == VERIFY_DIGEST_COMPUTED)
+		verify_cache.n_computed++;
+
+	if (verify_cache.enabled && job->digest_source != VERIFY_DIGEST_NONE)
+		verify_cache_record(job->fnn->name, &job->st, job->digest,
+		                    job->cached);
+
+	if (job->failures > 0)
+		verify_output(job->fnn, &job->checks);
+
+	free(job->filename);
+	free(job);
+}
+
+static void
+verify_queue_submit(struct verify_queue *queue, struct verify_job *job)
+{
+	job->next = NULL;
+	if (queue->tail)
+		queue->tail->next = job;
+	else
+		queue->head = job;
+	queue->tail = job;
+	queue->queued++;
+
+	job->task.func = verify_job_run;
+	job->task.data = job;
+	thread_pool_submit(queue->pool, &job->task);
+
+	while (queue->queued > queue->ahead)
+		verify_queue_reap(queue);
+}
+
+static void
+verify_queue_done(struct verify_queue *queue)
+{
+	while (queue->head)
+		verify_queue_reap(queue);
+
+	thread_pool_free(queue->pool);
+}
+
+static void
+verify_package(struct verify_queue *queue, struct pkginfo *pkg)
 {
 	struct fsys_namenode_list *file;
 	struct varbuf filename = VARBUF_INIT;
@@ -187,18 +741,27 @@ verify_package(struct pkginfo *pkg)
 	pkg_conffiles_mark_old(pkg);
 
 	for (file = pkg->files; file; file = file->next) {
-		struct verify_checks checks;
+		struct verify_job *job;
 		struct fsys_namenode *fnn;
 
 		fnn = namenodetouse(file->namenode, pkg, &pkg->installed);
 
+		if (fnn->newhash == NULL && fnn->oldhash != NULL)
+			fnn->newhash = fnn->oldhash;
+
 		varbuf_set_str(&filename, dpkg_fsys_get_dir());
 		varbuf_add_str(&filename, fnn->name);
 
-		memset(&checks, 0, sizeof(checks));
+		job = m_calloc(1, sizeof(*job));
+		job->fnn = fnn;
+		/* Later packages might set a different digest for the same
+		 * pathname, before this job gets run. */
+		job->hash = fnn->newhash;
+		job->filename = m_strdup(varbuf_str(&filename));
+		if (verify_cache.enabled)
+			job->cached = verify_cache_lookup(fnn->name);
 
-		if (verify_file(varbuf_str(&filename), fnn, pkg, &checks) > 0)
-			verify_output(fnn, &checks);
+		verify_queue_submit(queue, job);
 	}
 
 	varbuf_destroy(&filename);
@@ -207,18 +770,25 @@ verify_package(struct pkginfo *pkg)
 int
 verify(const char *const *argv)
 {
+	struct verify_queue queue;
 	struct pkginfo *pkg;
+	bool all = !*argv;
 	int rc = 0;
 
 	modstatdb_open(msdbrw_readonly);
 	ensure_diversions();
 
-	if (!*argv) {
+	if (verify_cache.enabled)
+		verify_cache_load();
+
+	verify_queue_init(&queue);
+
+	if (all) {
 		struct pkg_hash_iter *iter;
 
 		iter = pkg_hash_iter_new();
 		while ((pkg = pkg_hash_iter_next_pkg(iter)))
-			verify_package(pkg);
+			verify_package(&queue, pkg);
 		pkg_hash_iter_free(iter);
 	} else {
 		const char *thisarg;
@@ -232,10 +802,15 @@ verify(const char *const *argv)
 				continue;
 			}
 
-			verify_package(pkg);
+			verify_package(&queue, pkg);
 		}
 	}
 
+	verify_queue_done(&queue);
+
+	if (verify_cache.enabled)
+		verify_cache_done(all);
+
 	modstatdb_shutdown();
 
 	m_output(stdout, _("<standard output>"));
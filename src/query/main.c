@@ -33,7 +33,9 @@
 #endif
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
 #include <string.h>
+#include <stdbool.h>
 #include <fcntl.h>
 #include <dirent.h>
 #include <fnmatch.h>
@@ -64,6 +66,50 @@ static const char *opt_showformat = "${binary:Package}\t${Version}\n";
 
 static int opt_loadavail = 0;
 
+/*
+ * Plain package names are resolved to their package set upfront, and
+ * sorted by it, so that matching them costs a binary search per package
+ * instead of a comparison per package and pattern. Only the actual glob
+ * patterns need to be tried against each package.
+ */
+struct pkg_pattern_set {
+	struct pkgset *set;
+	int ip;
+};
+
+static int
+pkg_pattern_set_cmp(const void *a, const void *b)
+{
+	const struct pkg_pattern_set *pa = a;
+	const struct pkg_pattern_set *pb = b;
+	uintptr_t sa = (uintptr_t)pa->set;
+	uintptr_t sb = (uintptr_t)pb->set;
+
+	if (sa != sb)
+		return sa < sb ? -1 : 1;
+
+	return pa->ip - pb->ip;
+}
+
+static int
+pkg_pattern_set_find(struct pkg_pattern_set *sets, int n_sets,
+                     struct pkgset *set)
+{
+	int lo = 0, hi = n_sets;
+
+	/* Find the first entry for the package set, if any. */
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if ((uintptr_t)sets[mid].set < (uintptr_t)set)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
 static int
 pkg_array_match_patterns(struct pkg_array *array,
                          pkg_array_visitor_func *pkg_visitor, void *pkg_data,
@@ -72,23 +118,48 @@ pkg_array_match_patterns(struct pkg_array *array,
 	int argc, i, ip, *found;
 	int misses = 0;
 	struct pkg_spec *ps;
+	struct pkg_pattern_set *sets;
+	int *globs;
+	int n_sets = 0, n_globs = 0;
 
 	for (argc = 0; argv[argc]; argc++)
 		;
 	found = m_calloc(argc, sizeof(int));
 
 	ps = m_malloc(sizeof(*ps) * argc);
+	sets = m_malloc(sizeof(*sets) * argc);
+	globs = m_malloc(sizeof(*globs) * argc);
 	for (ip = 0; ip < argc; ip++) {
 		pkg_spec_init(&ps[ip], PKG_SPEC_PATTERNS | PKG_SPEC_ARCH_WILDCARD);
 		pkg_spec_parse(&ps[ip], argv[ip]);
+
+		if (ps[ip].name_is_pattern) {
+			globs[n_globs++] = ip;
+		} else {
+			sets[n_sets].set = pkg_hash_find_set(ps[ip].name);
+			sets[n_sets].ip = ip;
+			n_sets++;
+		}
 	}
+	qsort(sets, n_sets, sizeof(*sets), pkg_pattern_set_cmp);
 
 	for (i = 0; i < array->n_pkgs; i++) {
 		struct pkginfo *pkg;
 		bool pkg_found = false;
+		int is, ig;
 
 		pkg = array->pkgs[i];
-		for (ip = 0; ip < argc; ip++) {
+
+		is = pkg_pattern_set_find(sets, n_sets, pkg->set);
+		for (; is < n_sets && sets[is].set == pkg->set; is++) {
+			ip = sets[is].ip;
+			if (pkg_spec_match_pkg(&ps[ip], pkg, &pkg->installed)) {
+				pkg_found = true;
+				found[ip]++;
+			}
+		}
+		for (ig = 0; ig < n_globs; ig++) {
+			ip = globs[ig];
 			if (pkg_spec_match_pkg(&ps[ip], pkg, &pkg->installed)) {
 				pkg_found = true;
 				found[ip]++;
@@ -108,6 +179,8 @@ pkg_array_match_patterns(struct pkg_array *array,
 		pkg_spec_destroy(&ps[ip]);
 	}
 
+	free(globs);
+	free(sets);
 	free(ps);
 	free(found);
 
@@ -304,9 +377,10 @@ listpackages(const char *const *argv)
 	struct pager *pager;
 
 	if (!opt_loadavail)
-		modstatdb_open(msdbrw_readonly);
+		modstatdb_open(msdbrw_readonly | msdbrw_lazy_fields);
 	else
-		modstatdb_open(msdbrw_readonly | msdbrw_available_readonly);
+		modstatdb_open(msdbrw_readonly | msdbrw_available_readonly |
+		               msdbrw_lazy_fields);
 
 	pkg_array_init_from_hash(&array);
 	pkg_array_sort(&array, pkg_sorter_by_nonambig_name_arch);
@@ -386,54 +460,252 @@ searchoutput(struct fsys_namenode *namenode)
 	return found + (namenode->divert ? 1 : 0);
 }
 
+/*
+ * The glob patterns get matched against all pathnames in a single pass
+ * over the files database. As fnmatch() is comparatively expensive, each
+ * pattern is prefiltered with the literal strings any match must contain,
+ * which rejects most pathnames with a few byte comparisons.
+ */
+
+struct search_pattern {
+	char *pattern;
+	char *pathname;
+	bool is_glob;
+
+	/* Literal strings any matching pathname must start with, end with
+	 * and contain, respectively. */
+	char *prefix;
+	size_t prefix_len;
+	char *suffix;
+	size_t suffix_len;
+	char *infix;
+
+	struct fsys_namenode **nodes;
+	int nodes_used;
+	int nodes_size;
+};
+
+static void
+search_pattern_parse(struct search_pattern *sp)
+{
+	struct varbuf run = VARBUF_INIT;
+	const char *p = sp->pattern;
+	bool at_start = true;
+
+	while (true) {
+		if (*p == '\0' || *p == '*' || *p == '?' || *p == '[') {
+			if (run.used && at_start) {
+				sp->prefix_len = run.used;
+				sp->prefix = m_strdup(varbuf_str(&run));
+			}
+			if (run.used && *p == '\0') {
+				sp->suffix_len = run.used;
+				sp->suffix = m_strdup(varbuf_str(&run));
+			}
+			if (run.used > 0 &&
+			    (sp->infix == NULL || run.used > strlen(sp->infix))) {
+				free(sp->infix);
+				sp->infix = m_strdup(varbuf_str(&run));
+			}
+			varbuf_reset(&run);
+		}
+
+		if (*p == '\0') {
+			break;
+		} else if (*p == '*' || *p == '?') {
+			at_start = false;
+			p++;
+		} else if (*p == '[') {
+			/* Skip the bracket expression, which matches a single
+			 * character. */
+			const char *q = p + 1;
+
+			if (*q == '!' || *q == '^')
+				q++;
+			if (*q == ']')
+				q++;
+			while (*q != ']') {
+				if (*q == '\0' || *q == '\\')
+					goto unknown;
+				if (q[0] == '[' && q[1] != '\0' &&
+				    strchr(":=.", q[1])) {
+					/* Skip the class, equivalence class
+					 * or collating symbol. */
+					char delim[] = { q[1], ']', '\0' };
+
+					q = strstr(q + 2, delim);
+					if (q == NULL)
+						goto unknown;
+					q += 2;
+				} else {
+					q++;
+				}
+			}
+			at_start = false;
+			p = q + 1;
+		} else if (*p == '\\') {
+			if (p[1] == '\0')
+				goto unknown;
+			varbuf_add_char(&run, p[1]);
+			p += 2;
+		} else {
+			varbuf_add_char(&run, *p);
+			p++;
+		}
+	}
+
+	varbuf_destroy(&run);
+
+	return;
+
+unknown:
+	/* Leave anything we do not fully understand to fnmatch(). */
+	free(sp->prefix);
+	free(sp->suffix);
+	free(sp->infix);
+	sp->prefix = sp->suffix = sp->infix = NULL;
+	sp->prefix_len = sp->suffix_len = 0;
+	varbuf_destroy(&run);
+}
+
+static void
+search_pattern_init(struct search_pattern *sp, const char *arg)
+{
+	memset(sp, 0, sizeof(*sp));
+
+	if (!strchr("*[?/", *arg))
+		sp->pattern = str_fmt("*%s*", arg);
+	else
+		sp->pattern = m_strdup(arg);
+
+	if (strpbrk(sp->pattern, "*[?\\")) {
+		sp->is_glob = true;
+		search_pattern_parse(sp);
+	} else {
+		/* Trim trailing ‘/’ and ‘/.’ from the argument if it is not
+		 * a pattern, just a pathname. */
+		sp->is_glob = false;
+		sp->pathname = m_strdup(sp->pattern);
+		sp->pathname[path_trim_slash_slashdot(sp->pathname)] = '\0';
+	}
+}
+
+static void
+search_pattern_destroy(struct search_pattern *sp)
+{
+	free(sp->pattern);
+	free(sp->pathname);
+	free(sp->prefix);
+	free(sp->suffix);
+	free(sp->infix);
+	free(sp->nodes);
+}
+
+static bool
+search_pattern_match(struct search_pattern *sp, const char *name,
+                     size_t name_len)
+{
+	if (sp->prefix && strncmp(name, sp->prefix, sp->prefix_len) != 0)
+		return false;
+	if (sp->suffix &&
+	    (name_len < sp->suffix_len ||
+	     memcmp(name + name_len - sp->suffix_len, sp->suffix,
+	            sp->suffix_len) != 0))
+		return false;
+	if (sp->infix && strstr(name, sp->infix) == NULL)
+		return false;
+
+	return fnmatch(sp->pattern, name, 0) == 0;
+}
+
+static void
+search_pattern_add_node(struct search_pattern *sp, struct fsys_namenode *node)
+{
+	if (sp->nodes_used == sp->nodes_size) {
+		sp->nodes_size = sp->nodes_size ? sp->nodes_size * 2 : 16;
+		sp->nodes = m_realloc(sp->nodes,
+		                      sp->nodes_size * sizeof(*sp->nodes));
+	}
+	sp->nodes[sp->nodes_used++] = node;
+}
+
+static void
+search_patterns_match(struct search_pattern *patterns, int n_patterns)
+{
+	struct fsys_hash_iter *iter;
+	struct fsys_namenode *namenode;
+	int n_globs = 0;
+	int i;
+
+	for (i = 0; i < n_patterns; i++)
+		if (patterns[i].is_glob)
+			n_globs++;
+	if (n_globs == 0)
+		return;
+
+	iter = fsys_hash_iter_new();
+	while ((namenode = fsys_hash_iter_next(iter)) != NULL) {
+		size_t name_len;
+
+		/* Nodes with no owners nor diversions do not produce any
+		 * output, so there is no point in matching them. */
+		if (namenode->packages == NULL && namenode->divert == NULL)
+			continue;
+
+		name_len = strlen(namenode->name);
+		for (i = 0; i < n_patterns; i++) {
+			struct search_pattern *sp = &patterns[i];
+
+			if (!sp->is_glob)
+				continue;
+			if (search_pattern_match(sp, namenode->name, name_len))
+				search_pattern_add_node(sp, namenode);
+		}
+	}
+	fsys_hash_iter_free(iter);
+}
+
 static int
 searchfiles(const char *const *argv)
 {
-	const char *thisarg;
+	struct search_pattern *patterns;
+	int n_patterns = 0;
 	int misses = 0;
-	struct varbuf path = VARBUF_INIT;
-	static struct varbuf vb;
+	int i;
 
 	if (!*argv)
 		badusage(_("--search needs at least one file name pattern argument"));
 
-	modstatdb_open(msdbrw_readonly);
+	while (argv[n_patterns])
+		n_patterns++;
+	patterns = m_malloc(n_patterns * sizeof(*patterns));
+	for (i = 0; i < n_patterns; i++)
+		search_pattern_init(&patterns[i], argv[i]);
+
+	modstatdb_open(msdbrw_readonly | msdbrw_lazy_fields);
 	ensure_allinstfiles_available_quiet();
 	ensure_diversions();
 
-	while ((thisarg = *argv++) != NULL) {
+	search_patterns_match(patterns, n_patterns);
+
+	for (i = 0; i < n_patterns; i++) {
+		struct search_pattern *sp = &patterns[i];
 		struct fsys_namenode *namenode;
 		int found = 0;
 
-		if (!strchr("*[?/", *thisarg)) {
-			varbuf_reset(&vb);
-			varbuf_add_char(&vb, '*');
-			varbuf_add_str(&vb, thisarg);
-			varbuf_add_char(&vb, '*');
-			thisarg = vb.buf;
-		}
-		if (!strpbrk(thisarg, "*[?\\")) {
-			/* Trim trailing ‘/’ and ‘/.’ from the argument if it
-			 * is not a pattern, just a pathname. */
-			varbuf_set_str(&path, thisarg);
-			varbuf_trunc(&path, path_trim_slash_slashdot(path.buf));
-
-			namenode = fsys_hash_find_node(varbuf_str(&path),
-			                               FHFF_NONE);
-			found += searchoutput(namenode);
-		} else {
-			struct fsys_hash_iter *iter;
+		if (sp->is_glob) {
+			int j;
 
-			iter = fsys_hash_iter_new();
-			while ((namenode = fsys_hash_iter_next(iter)) != NULL) {
-				if (fnmatch(thisarg, namenode->name, 0))
-					continue;
-				found += searchoutput(namenode);
-			}
-			fsys_hash_iter_free(iter);
+			fsys_hash_sort_nodes(sp->nodes, sp->nodes_used);
+			for (j = 0; j < sp->nodes_used; j++)
+				found += searchoutput(sp->nodes[j]);
+		} else {
+			namenode = fsys_hash_find_node(sp->pathname, FHFF_NONE);
+			found += searchoutput(namenode);
 		}
 		if (!found) {
-			notice(_("no path found matching pattern %s"), thisarg);
+			notice(_("no path found matching pattern %s"),
+			       sp->pattern);
 			misses++;
 			m_output(stderr, _("<standard error>"));
 		} else {
@@ -442,7 +714,9 @@ searchfiles(const char *const *argv)
 	}
 	modstatdb_shutdown();
 
-	varbuf_destroy(&path);
+	for (i = 0; i < n_patterns; i++)
+		search_pattern_destroy(&patterns[i]);
+	free(patterns);
 
 	return !!misses;
 }
@@ -644,9 +918,10 @@ showpackages(const char *const *argv)
 	fmt_needs_db_fsys = pkg_format_needs_db_fsys(fmt);
 
 	if (!opt_loadavail)
-		modstatdb_open(msdbrw_readonly);
+		modstatdb_open(msdbrw_readonly | msdbrw_lazy_fields);
 	else
-		modstatdb_open(msdbrw_readonly | msdbrw_available_readonly);
+		modstatdb_open(msdbrw_readonly | msdbrw_available_readonly |
+		               msdbrw_lazy_fields);
 
 	pkg_array_init_from_hash(&array);
 	pkg_array_sort(&array, pkg_sorter_by_nonambig_name_arch);
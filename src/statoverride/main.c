@@ -270,7 +270,7 @@ statdb_write(void)
 	dbfile = atomic_file_new(dbname, ATOMIC_FILE_BACKUP);
 	atomic_file_open(dbfile);
 
-	iter = fsys_hash_iter_new();
+	iter = fsys_hash_iter_new_sorted();
 	while ((file = fsys_hash_iter_next(iter)))
 		statdb_node_print(dbfile->fp, file);
 	fsys_hash_iter_free(iter);
@@ -394,7 +394,7 @@ statoverride_list(const char *const *argv)
 	if (glob_list == NULL)
 		glob_list_prepend(&glob_list, m_strdup("*"));
 
-	iter = fsys_hash_iter_new();
+	iter = fsys_hash_iter_new_sorted();
 	while ((file = fsys_hash_iter_next(iter))) {
 		struct glob_node *g;
 